@@ -7,6 +7,7 @@
 
 #include "hdf5Alignment.h"
 #include "halCLParser.h"
+#include "halCachedStats.h"
 #include "halCommon.h"
 #include "halSequenceIterator.h"
 #include "hdf5Common.h"
@@ -408,6 +409,7 @@ void Hdf5Alignment::removeGenome(const string &name) {
             botSegIt->bseg()->setTopParseIndex(bottomSegments[i].topParseIndex);
         }
         free(bottomSegments);
+        invalidateCachedStats(parentGenome);
     }
     map<string, Hdf5Genome *>::iterator mapIt = _openGenomes.find(name);
     if (mapIt != _openGenomes.end()) {
@@ -21,6 +21,7 @@
 #include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <limits>
 
 using namespace hal;
 using namespace std;
@@ -31,14 +32,33 @@ const string Hdf5Genome::topArrayName = "TOP_ARRAY";
 const string Hdf5Genome::bottomArrayName = "BOTTOM_ARRAY";
 const string Hdf5Genome::sequenceIdxArrayName = "SEQIDX_ARRAY";
 const string Hdf5Genome::sequenceNameArrayName = "SEQNAME_ARRAY";
+const string Hdf5Genome::sequenceHashFunctionArrayName = "SEQHASHFUNC_ARRAY";
+const string Hdf5Genome::sequenceHashArrayName = "SEQHASH_ARRAY";
+const string Hdf5Genome::sequenceSiteIndexArrayName = "SEQSITE_ARRAY";
 const string Hdf5Genome::metaGroupName = "Meta";
 const string Hdf5Genome::rupGroupName = "Rup";
 const double Hdf5Genome::dnaChunkScale = 10.;
 
+/* Parameters of the sequence name hash, as used for the mmap format's
+ * perfect hash table */
+static const size_t SEQUENCE_PHF_LAMBDA = 1;
+static const size_t SEQUENCE_PHF_ALPHA = 80;
+static const phf_seed_t SEQUENCE_PHF_SEED = 0;
+
+/* The hash function array holds these fields of struct phf, followed by
+ * the uint32 displacement map */
+enum { PHF_NODIV_FIELD, PHF_SEED_FIELD, PHF_G_OP_FIELD, PHF_D_MAX_FIELD, PHF_R_FIELD, PHF_M_FIELD, PHF_NUM_FIELDS };
+
+/* Empty slots of the sequence name hash table */
+static const uint32_t NO_SEQUENCE = numeric_limits<uint32_t>::max();
+
 Hdf5Genome::Hdf5Genome(const string &name, Hdf5Alignment *alignment, PortableH5Location *h5Parent,
                        const DSetCreatPropList &dcProps, bool inMemory)
     : Genome(alignment, name), _alignment(alignment), _h5Parent(h5Parent), _name(name), _numChildrenInBottomArray(0),
-      _totalSequenceLength(0), _numChunksInArrayBuffer(inMemory ? 0 : 1) {
+      _totalSequenceLength(0), _numChunksInArrayBuffer(inMemory ? 0 : 1), _hasSequenceNameIndex(false),
+      _hasSequenceSiteIndex(false), _sequenceNameIndexDirty(false), _lastSiteSequence(NULL), _lastSiteStart(0),
+      _lastSiteEnd(0) {
+    memset(&_sequenceHash, 0, sizeof(_sequenceHash));
     _dcprops.copy(dcProps);
     assert(!name.empty());
     assert(alignment != NULL && h5Parent != NULL);
@@ -111,6 +131,7 @@ void Hdf5Genome::setDimensions(const vector<Sequence::Info> &sequenceDimensions,
         _group.unlink(sequenceNameArrayName);
     } catch (H5::Exception &) {
     }
+    unlinkSequenceIndex();
 
     if (_totalSequenceLength > 0 && storeDNAArrays) {
         hal_size_t arrayLength = _totalSequenceLength / 2;
@@ -140,6 +161,8 @@ void Hdf5Genome::setDimensions(const vector<Sequence::Info> &sequenceDimensions,
                                   _numChunksInArrayBuffer);
 
         writeSequences(sequenceDimensions);
+        writeSequenceNameIndex();
+        writeSequenceSiteIndex(sequenceDimensions);
     }
 
     // Do the same as above for the segments.
@@ -326,6 +349,14 @@ hal_size_t Hdf5Genome::getNumSequences() const {
 }
 
 Sequence *Hdf5Genome::getSequence(const string &name) {
+    if (_hasSequenceNameIndex && !_sequenceNameIndexDirty) {
+        hal_index_t index = findSequenceIndexByName(name);
+        if (index != NULL_INDEX) {
+            return getSequenceByIndex(index);
+        }
+        // the name may still be present if the index was made stale by a
+        // version of HAL that doesn't maintain it, so search the names
+    }
     loadSequenceNameCache();
     Sequence *sequence = NULL;
     map<string, Hdf5Sequence *>::iterator mapIt = _sequenceNameCache.find(name);
@@ -340,16 +371,29 @@ const Sequence *Hdf5Genome::getSequence(const string &name) const {
 }
 
 Sequence *Hdf5Genome::getSequenceBySite(hal_size_t position) {
-    loadSequencePosCache();
-    map<hal_size_t, Hdf5Sequence *>::iterator i;
-    i = _sequencePosCache.upper_bound(position);
-    if (i != _sequencePosCache.end()) {
-        if (position >= (hal_size_t)i->second->getStartPosition()) {
+    // lookups tend to be for nearby positions
+    if (_lastSiteSequence != NULL && position >= _lastSiteStart && position < _lastSiteEnd) {
+        return _lastSiteSequence;
+    }
+    Hdf5Sequence *sequence = NULL;
+    hal_index_t index = _hasSequenceSiteIndex ? findSequenceIndexBySite(position) : NULL_INDEX;
+    if (index != NULL_INDEX) {
+        sequence = getSequenceByIndex(index);
+    } else {
+        loadSequencePosCache();
+        map<hal_size_t, Hdf5Sequence *>::iterator i;
+        i = _sequencePosCache.upper_bound(position);
+        if (i != _sequencePosCache.end() && position >= (hal_size_t)i->second->getStartPosition()) {
             assert(position < i->second->getStartPosition() + i->second->getSequenceLength());
-            return i->second;
+            sequence = i->second;
         }
     }
-    return NULL;
+    if (sequence != NULL) {
+        _lastSiteSequence = sequence;
+        _lastSiteStart = sequence->getStartPosition();
+        _lastSiteEnd = _lastSiteStart + sequence->getSequenceLength();
+    }
+    return sequence;
 }
 
 const Sequence *Hdf5Genome::getSequenceBySite(hal_size_t position) const {
@@ -445,7 +489,9 @@ BottomSegmentIteratorPtr Hdf5Genome::getBottomSegmentIterator(hal_index_t positi
 }
 
 DnaIteratorPtr Hdf5Genome::getDnaIterator(hal_index_t position) {
-    assert(position / 2 <= (hal_index_t)_dnaArray.getSize());
+    // without DNA, the iterator only tracks positions (as in column
+    // iterators over an alignment made without --keepSequences)
+    assert(!containsDNAArray() || position / 2 <= (hal_index_t)_dnaArray.getSize());
     DnaIterator *dnaIt = new DnaIterator(this, _dnaAccess, position);
     return DnaIteratorPtr(dnaIt);
 }
@@ -524,6 +570,9 @@ void Hdf5Genome::write() {
     _rup->write();
     _sequenceIdxArray.write();
     _sequenceNameArray.write();
+    if (_sequenceNameIndexDirty) {
+        writeSequenceNameIndex();
+    }
 }
 
 void Hdf5Genome::read() {
@@ -564,6 +613,7 @@ void Hdf5Genome::read() {
     } catch (H5::Exception &) {
     }
 
+    readSequenceIndex();
     readSequences();
     if (dnaLoaded) {
         _dnaAccess = DnaAccessPtr(new HDF5DnaAccess(this, &_dnaArray, 0));
@@ -575,57 +625,41 @@ void Hdf5Genome::readSequences() {
 }
 
 void Hdf5Genome::deleteSequenceCache() {
-    if (_sequencePosCache.size() > 0 || _zeroLenPosCache.size() > 0) {
-        map<hal_size_t, Hdf5Sequence *>::iterator i;
-        for (i = _sequencePosCache.begin(); i != _sequencePosCache.end(); ++i) {
-            delete i->second;
-        }
-        vector<Hdf5Sequence *>::iterator z;
-        for (z = _zeroLenPosCache.begin(); z != _zeroLenPosCache.end(); ++z) {
-            delete *z;
-        }
-    } else if (_sequenceNameCache.size() > 0) {
-        map<string, Hdf5Sequence *>::iterator i;
-        for (i = _sequenceNameCache.begin(); i != _sequenceNameCache.end(); ++i) {
-            delete i->second;
-        }
+    for (size_t i = 0; i < _sequences.size(); ++i) {
+        delete _sequences[i];
     }
-    _sequencePosCache.clear();
-    _zeroLenPosCache.clear();
-    _sequenceNameCache.clear(); // I share my pointers with above.
+    _sequences.clear();
+    _sequencePosCache.clear();   // I share my pointers with above.
+    _sequenceNameCache.clear();
+    _sequenceHashG.clear();
+    _sequenceSiteIndex.clear();
+    _lastSiteSequence = NULL;
+}
+
+Hdf5Sequence *Hdf5Genome::getSequenceByIndex(hal_index_t index) const {
+    assert(index >= 0 && index < (hal_index_t)getNumSequences());
+    if (_sequences.empty()) {
+        _sequences.resize(getNumSequences(), NULL);
+    }
+    if (_sequences[index] == NULL) {
+        _sequences[index] =
+            new Hdf5Sequence(const_cast<Hdf5Genome *>(this), const_cast<Hdf5ExternalArray *>(&_sequenceIdxArray),
+                             const_cast<Hdf5ExternalArray *>(&_sequenceNameArray), index);
+    }
+    return _sequences[index];
 }
 
 void Hdf5Genome::loadSequencePosCache() const {
-    if (_sequencePosCache.size() > 0 || _zeroLenPosCache.size() > 0) {
+    if (_sequencePosCache.size() > 0) {
         return;
     }
     hal_size_t totalReadLen = 0;
     hal_size_t numSequences = _sequenceNameArray.getSize();
-
-    if (_sequenceNameCache.size() > 0) {
-        assert(_sequenceNameCache.size() == numSequences);
-        map<std::string, Hdf5Sequence *>::const_iterator i;
-        for (i = _sequenceNameCache.begin(); i != _sequenceNameCache.end(); ++i) {
-            if (i->second->getSequenceLength() > 0) {
-                _sequencePosCache.insert(pair<hal_size_t, Hdf5Sequence *>(
-                    i->second->getStartPosition() + i->second->getSequenceLength(), i->second));
-                totalReadLen += i->second->getSequenceLength();
-            } else {
-                // FIXME: _zeroLenPosCache.push_back(i->second);
-            }
-        }
-    } else {
-        for (hal_size_t i = 0; i < numSequences; ++i) {
-            Hdf5Sequence *seq =
-                new Hdf5Sequence(const_cast<Hdf5Genome *>(this), const_cast<Hdf5ExternalArray *>(&_sequenceIdxArray),
-                                 const_cast<Hdf5ExternalArray *>(&_sequenceNameArray), i);
-            if (seq->getSequenceLength() > 0) {
-                _sequencePosCache.insert(
-                    pair<hal_size_t, Hdf5Sequence *>(seq->getStartPosition() + seq->getSequenceLength(), seq));
-                totalReadLen += seq->getSequenceLength();
-            } else {
-                // FIXME: _zeroLenPosCache.push_back(seq);
-            }
+    for (hal_size_t i = 0; i < numSequences; ++i) {
+        Hdf5Sequence *seq = getSequenceByIndex(i);
+        if (seq->getSequenceLength() > 0) {
+            _sequencePosCache.insert(pair<hal_size_t, Hdf5Sequence *>(seq->getStartPosition() + seq->getSequenceLength(), seq));
+            totalReadLen += seq->getSequenceLength();
         }
     }
     if (_totalSequenceLength > 0 && totalReadLen != _totalSequenceLength) {
@@ -640,26 +674,238 @@ void Hdf5Genome::loadSequenceNameCache() const {
         return;
     }
     hal_size_t numSequences = _sequenceNameArray.getSize();
+    for (hal_size_t i = 0; i < numSequences; ++i) {
+        Hdf5Sequence *seq = getSequenceByIndex(i);
+        _sequenceNameCache.insert(pair<string, Hdf5Sequence *>(seq->getName(), seq));
+    }
+}
 
-    if (_sequencePosCache.size() > 0 || _zeroLenPosCache.size() > 0) {
-        assert(_sequencePosCache.size() + _zeroLenPosCache.size() == numSequences);
-        map<hal_size_t, Hdf5Sequence *>::iterator i;
-        for (i = _sequencePosCache.begin(); i != _sequencePosCache.end(); ++i) {
-            _sequenceNameCache.insert(pair<string, Hdf5Sequence *>(i->second->getName(), i->second));
+/* Load the persistent sequence indexes if the file has them.  Only their
+ * datasets are opened here, their contents are read on first use. */
+void Hdf5Genome::readSequenceIndex() {
+    _hasSequenceNameIndex = false;
+    _hasSequenceSiteIndex = false;
+    _sequenceNameIndexDirty = false;
+    try {
+        HDF5DisableExceptionPrinting prDisable;
+        _group.openDataSet(sequenceHashFunctionArrayName);
+        _group.openDataSet(sequenceHashArrayName);
+        _sequenceHashFunctionArray.load(&_group, sequenceHashFunctionArrayName, _numChunksInArrayBuffer);
+        _sequenceHashArray.load(&_group, sequenceHashArrayName, _numChunksInArrayBuffer);
+        _hasSequenceNameIndex = true;
+    } catch (H5::Exception &) {
+    }
+    try {
+        HDF5DisableExceptionPrinting prDisable;
+        _group.openDataSet(sequenceSiteIndexArrayName);
+        _sequenceSiteIndexArray.load(&_group, sequenceSiteIndexArrayName, _numChunksInArrayBuffer);
+        _hasSequenceSiteIndex = true;
+    } catch (H5::Exception &) {
+    }
+}
+
+void Hdf5Genome::unlinkSequenceIndex() {
+    const string *arrayNames[] = {&sequenceHashFunctionArrayName, &sequenceHashArrayName, &sequenceSiteIndexArrayName};
+    for (const string *arrayName : arrayNames) {
+        try {
+            HDF5DisableExceptionPrinting prDisable;
+            DataSet d = _group.openDataSet(*arrayName);
+            _group.unlink(*arrayName);
+        } catch (H5::Exception &) {
         }
-        vector<Hdf5Sequence *>::iterator z;
-        for (z = _zeroLenPosCache.begin(); z != _zeroLenPosCache.end(); ++z) {
-            _sequenceNameCache.insert(pair<string, Hdf5Sequence *>((*z)->getName(), (*z)));
+    }
+    _hasSequenceNameIndex = false;
+    _hasSequenceSiteIndex = false;
+    _sequenceNameIndexDirty = false;
+    _sequenceHashG.clear();
+    _sequenceSiteIndex.clear();
+}
+
+/* Build a perfect hash of the sequence names and store it, with the table
+ * of sequence indexes it hashes into.  No index is written if the names
+ * aren't unique, as the hash can't be built, and lookups then search the
+ * names. */
+void Hdf5Genome::writeSequenceNameIndex() {
+    const string *arrayNames[] = {&sequenceHashFunctionArrayName, &sequenceHashArrayName};
+    for (const string *arrayName : arrayNames) {
+        try {
+            HDF5DisableExceptionPrinting prDisable;
+            DataSet d = _group.openDataSet(*arrayName);
+            _group.unlink(*arrayName);
+        } catch (H5::Exception &) {
         }
-    } else {
-        for (hal_size_t i = 0; i < numSequences; ++i) {
-            Hdf5Sequence *seq =
-                new Hdf5Sequence(const_cast<Hdf5Genome *>(this), const_cast<Hdf5ExternalArray *>(&_sequenceIdxArray),
-                                 const_cast<Hdf5ExternalArray *>(&_sequenceNameArray), i);
+    }
+    _hasSequenceNameIndex = false;
+    _sequenceNameIndexDirty = false;
+    _sequenceHashG.clear();
+
+    hal_size_t numSequences = getNumSequences();
+    if (numSequences == 0 || numSequences >= NO_SEQUENCE) {
+        return;
+    }
+    vector<string> names(numSequences);
+    for (hal_size_t i = 0; i < numSequences; ++i) {
+        names[i] = _sequenceNameArray.get(i);
+    }
+    vector<string> sortedNames(names);
+    sort(sortedNames.begin(), sortedNames.end());
+    if (adjacent_find(sortedNames.begin(), sortedNames.end()) != sortedNames.end()) {
+        return;
+    }
+    sortedNames.clear();
+
+    struct phf hash;
+    memset(&hash, 0, sizeof(hash));
+    phf_error_t err =
+        PHF::init<string, true>(&hash, names.data(), numSequences, SEQUENCE_PHF_LAMBDA, SEQUENCE_PHF_ALPHA, SEQUENCE_PHF_SEED);
+    if (err != 0) {
+        throw hal_exception("can't create perfect hash function: " + string(strerror(err)));
+    }
+
+    _sequenceHashFunctionArray.create(&_group, sequenceHashFunctionArrayName, PredType::NATIVE_UINT32,
+                                      PHF_NUM_FIELDS + hash.r, &_dcprops, _numChunksInArrayBuffer);
+    uint32_t fields[PHF_NUM_FIELDS];
+    fields[PHF_NODIV_FIELD] = hash.nodiv;
+    fields[PHF_SEED_FIELD] = hash.seed;
+    fields[PHF_G_OP_FIELD] = hash.g_op;
+    fields[PHF_D_MAX_FIELD] = hash.d_max;
+    fields[PHF_R_FIELD] = hash.r;
+    fields[PHF_M_FIELD] = hash.m;
+    for (size_t i = 0; i < PHF_NUM_FIELDS; ++i) {
+        _sequenceHashFunctionArray.setValue<uint32_t>(i, 0, fields[i]);
+    }
+    for (size_t i = 0; i < hash.r; ++i) {
+        _sequenceHashFunctionArray.setValue<uint32_t>(PHF_NUM_FIELDS + i, 0, hash.g[i]);
+    }
+    _sequenceHashFunctionArray.write();
+
+    _sequenceHashArray.create(&_group, sequenceHashArrayName, PredType::NATIVE_UINT32, hash.m, &_dcprops,
+                              _numChunksInArrayBuffer);
+    vector<uint32_t> table(hash.m, NO_SEQUENCE);
+    for (hal_size_t i = 0; i < numSequences; ++i) {
+        table[PHF::hash(&hash, names[i])] = i;
+    }
+    for (size_t i = 0; i < hash.m; ++i) {
+        _sequenceHashArray.setValue<uint32_t>(i, 0, table[i]);
+    }
+    _sequenceHashArray.write();
+    PHF::destroy(&hash);
+    _hasSequenceNameIndex = true;
+}
+
+/* Store the index of the sequence containing each multiple of a bucket
+ * width, which is chosen to give about one bucket per sequence.  The
+ * array starts with the width, and ends with the last sequence. */
+void Hdf5Genome::writeSequenceSiteIndex(const vector<Sequence::Info> &sequenceDimensions) {
+    try {
+        HDF5DisableExceptionPrinting prDisable;
+        DataSet d = _group.openDataSet(sequenceSiteIndexArrayName);
+        _group.unlink(sequenceSiteIndexArrayName);
+    } catch (H5::Exception &) {
+    }
+    _hasSequenceSiteIndex = false;
+    _sequenceSiteIndex.clear();
 
-            _sequenceNameCache.insert(pair<string, Hdf5Sequence *>(seq->getName(), seq));
+    hal_size_t numNonEmpty = 0;
+    for (const Sequence::Info &info : sequenceDimensions) {
+        numNonEmpty += info._length > 0 ? 1 : 0;
+    }
+    if (numNonEmpty == 0) {
+        return;
+    }
+    hal_size_t bucketWidth = (_totalSequenceLength + numNonEmpty - 1) / numNonEmpty;
+    hal_size_t numBuckets = (_totalSequenceLength + bucketWidth - 1) / bucketWidth;
+
+    _sequenceSiteIndexArray.create(&_group, sequenceSiteIndexArrayName, PredType::NATIVE_HSIZE, numBuckets + 2, &_dcprops,
+                                   _numChunksInArrayBuffer);
+    _sequenceSiteIndexArray.setValue<hal_size_t>(0, 0, bucketWidth);
+    hal_size_t sequenceIndex = 0;
+    hal_size_t sequenceEnd = sequenceDimensions[0]._length;
+    for (hal_size_t bucket = 0; bucket <= numBuckets; ++bucket) {
+        hal_size_t position = std::min(bucket * bucketWidth, _totalSequenceLength - 1);
+        while (sequenceEnd <= position) {
+            ++sequenceIndex;
+            sequenceEnd += sequenceDimensions[sequenceIndex]._length;
+        }
+        _sequenceSiteIndexArray.setValue<hal_size_t>(bucket + 1, 0, sequenceIndex);
+    }
+    _sequenceSiteIndexArray.write();
+    _hasSequenceSiteIndex = true;
+}
+
+/* Look a name up in the persistent name index, returning NULL_INDEX if it
+ * isn't there.  The hash table is read an entry at a time, but the hash
+ * function is loaded in full on first use. */
+hal_index_t Hdf5Genome::findSequenceIndexByName(const string &name) const {
+    if (_sequenceHashG.empty()) {
+        Hdf5ExternalArray &functionArray = const_cast<Hdf5ExternalArray &>(_sequenceHashFunctionArray);
+        uint32_t fields[PHF_NUM_FIELDS];
+        for (size_t i = 0; i < PHF_NUM_FIELDS; ++i) {
+            fields[i] = functionArray.getValue<uint32_t>(i, 0);
+        }
+        if (functionArray.getSize() != PHF_NUM_FIELDS + fields[PHF_R_FIELD] ||
+            _sequenceHashArray.getSize() != fields[PHF_M_FIELD]) {
+            throw hal_exception("Sequence name index of genome " + getName() + " is corrupt");
         }
+        _sequenceHashG.resize(fields[PHF_R_FIELD]);
+        for (size_t i = 0; i < _sequenceHashG.size(); ++i) {
+            _sequenceHashG[i] = functionArray.getValue<uint32_t>(PHF_NUM_FIELDS + i, 0);
+        }
+        _sequenceHash.nodiv = fields[PHF_NODIV_FIELD];
+        _sequenceHash.seed = fields[PHF_SEED_FIELD];
+        _sequenceHash.g_op = static_cast<enum phf::g_op_t>(fields[PHF_G_OP_FIELD]);
+        _sequenceHash.d_max = fields[PHF_D_MAX_FIELD];
+        _sequenceHash.r = fields[PHF_R_FIELD];
+        _sequenceHash.m = fields[PHF_M_FIELD];
+        _sequenceHash.g = _sequenceHashG.data();
+    }
+    uint32_t index = _sequenceHashArray.getValue<uint32_t>(PHF::hash(&_sequenceHash, name), 0);
+    if (index == NO_SEQUENCE || index >= getNumSequences() ||
+        name != const_cast<Hdf5ExternalArray &>(_sequenceNameArray).get(index)) {
+        return NULL_INDEX;
+    }
+    return index;
+}
+
+/* Find the sequence containing a position with the persistent site index,
+ * returning NULL_INDEX if it isn't found.  The position's bucket bounds
+ * the range of sequences to search, which are then bisected by their
+ * start positions.  Zero length sequences share their start with the
+ * next sequence, so the last sequence starting at or before the position
+ * is the one containing it. */
+hal_index_t Hdf5Genome::findSequenceIndexBySite(hal_size_t position) const {
+    if (position >= _totalSequenceLength) {
+        return NULL_INDEX;
+    }
+    if (_sequenceSiteIndex.empty()) {
+        _sequenceSiteIndex.resize(_sequenceSiteIndexArray.getSize());
+        for (size_t i = 0; i < _sequenceSiteIndex.size(); ++i) {
+            _sequenceSiteIndex[i] = _sequenceSiteIndexArray.getValue<hal_size_t>(i, 0);
+        }
+    }
+    hal_size_t bucket = position / _sequenceSiteIndex[0];
+    if (bucket + 2 >= _sequenceSiteIndex.size()) {
+        return NULL_INDEX;
     }
+    hal_size_t lo = _sequenceSiteIndex[bucket + 1];
+    hal_size_t hi = _sequenceSiteIndex[bucket + 2];
+    if (lo > hi || hi >= getNumSequences()) {
+        return NULL_INDEX;
+    }
+    while (lo < hi) {
+        hal_size_t mid = lo + (hi - lo + 1) / 2;
+        if (_sequenceIdxArray.getValue<hal_size_t>(mid, 0) <= position) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    // check the result, in case the index is out of date
+    if (_sequenceIdxArray.getValue<hal_size_t>(lo, 0) > position ||
+        _sequenceIdxArray.getValue<hal_size_t>(lo + 1, 0) <= position) {
+        return NULL_INDEX;
+    }
+    return lo;
 }
 
 void Hdf5Genome::writeSequences(const vector<Sequence::Info> &sequenceDimensions) {
@@ -670,16 +916,9 @@ void Hdf5Genome::writeSequences(const vector<Sequence::Info> &sequenceDimensions
     hal_size_t bottomArrayIndex = 0;
     for (i = sequenceDimensions.begin(); i != sequenceDimensions.end(); ++i) {
         // Copy segment into HDF5 array
-        Hdf5Sequence *seq = new Hdf5Sequence(this, &_sequenceIdxArray, &_sequenceNameArray, i - sequenceDimensions.begin());
+        Hdf5Sequence *seq = getSequenceByIndex(i - sequenceDimensions.begin());
         // write all the Sequence::Info into the hdf5 sequence record
         seq->set(startPosition, *i, topArrayIndex, bottomArrayIndex);
-        // Keep the object pointer in our caches
-        if (seq->getSequenceLength() > 0) {
-            _sequencePosCache.insert(pair<hal_size_t, Hdf5Sequence *>(startPosition + i->_length, seq));
-        } else {
-            // FIXME: _zeroLenPosCache.push_back(seq);
-        }
-        _sequenceNameCache.insert(pair<string, Hdf5Sequence *>(i->_name, seq));
         startPosition += i->_length;
         topArrayIndex += i->_numTopSegments;
         bottomArrayIndex += i->_numBottomSegments;
@@ -709,6 +948,8 @@ void Hdf5Genome::renameSequence(const string &oldName, size_t index, const strin
     strcpy(arrayBuffer, newName.c_str());
     _sequenceNameArray.write();
     readSequences();
+    // the name index is rebuilt once on write() rather than on every rename
+    _sequenceNameIndexDirty = _hasSequenceNameIndex;
 }
 
 void Hdf5Genome::resizeNameArray(size_t newMaxSize) {
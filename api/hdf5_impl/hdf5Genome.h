@@ -14,6 +14,7 @@
 #include "hdf5Alignment.h"
 #include "hdf5ExternalArray.h"
 #include "hdf5MetaData.h"
+#include "mmapPhf.h"
 #include <H5Cpp.h>
 
 namespace hal {
@@ -127,8 +128,15 @@ namespace hal {
         void readSequences();
         void writeSequences(const std::vector<hal::Sequence::Info> &sequenceDimensions);
         void deleteSequenceCache();
+        Hdf5Sequence *getSequenceByIndex(hal_index_t index) const;
         void loadSequencePosCache() const;
         void loadSequenceNameCache() const;
+        void readSequenceIndex();
+        void unlinkSequenceIndex();
+        void writeSequenceNameIndex();
+        void writeSequenceSiteIndex(const std::vector<hal::Sequence::Info> &sequenceDimensions);
+        hal_index_t findSequenceIndexByName(const std::string &name) const;
+        hal_index_t findSequenceIndexBySite(hal_size_t position) const;
         void setGenomeTopDimensions(const std::vector<hal::Sequence::UpdateInfo> &sequenceDimensions);
 
         void setGenomeBottomDimensions(const std::vector<hal::Sequence::UpdateInfo> &sequenceDimensions);
@@ -147,6 +155,14 @@ namespace hal {
         Hdf5ExternalArray _sequenceIdxArray;
         Hdf5ExternalArray _sequenceNameArray;
 
+        // Persistent sequence indexes, which are optional as older files
+        // don't have them: a perfect hash of sequence names to indexes
+        // (the function, then its table), and the index of the sequence
+        // at regularly spaced positions of the genome.
+        Hdf5ExternalArray _sequenceHashFunctionArray;
+        Hdf5ExternalArray _sequenceHashArray;
+        Hdf5ExternalArray _sequenceSiteIndexArray;
+
         // FIXME: every DNAIteratorPtr uses the same DNAAccess. This causes
         // thrashing when multiple DNAIterators are used concurrently
         // accessing different stretches of DNA.
@@ -156,16 +172,32 @@ namespace hal {
         hal_size_t _numChildrenInBottomArray;
         hal_size_t _totalSequenceLength;
         hal_size_t _numChunksInArrayBuffer;
+        bool _hasSequenceNameIndex;
+        bool _hasSequenceSiteIndex;
+        bool _sequenceNameIndexDirty;
 
+        // sequence objects by index, created on demand and shared by the
+        // caches below
+        mutable std::vector<Hdf5Sequence *> _sequences;
         mutable std::map<hal_size_t, Hdf5Sequence *> _sequencePosCache;
-        mutable std::vector<Hdf5Sequence *> _zeroLenPosCache;
         mutable std::map<std::string, Hdf5Sequence *> _sequenceNameCache;
 
+        // parts of the persistent indexes loaded on first use
+        mutable struct phf _sequenceHash;
+        mutable std::vector<uint32_t> _sequenceHashG;
+        mutable std::vector<hal_size_t> _sequenceSiteIndex;
+        mutable Hdf5Sequence *_lastSiteSequence;
+        mutable hal_size_t _lastSiteStart;
+        mutable hal_size_t _lastSiteEnd;
+
         static const std::string dnaArrayName;
         static const std::string topArrayName;
         static const std::string bottomArrayName;
         static const std::string sequenceIdxArrayName;
         static const std::string sequenceNameArrayName;
+        static const std::string sequenceHashFunctionArrayName;
+        static const std::string sequenceHashArrayName;
+        static const std::string sequenceSiteIndexArrayName;
         static const std::string metaGroupName;
         static const std::string rupGroupName;
 
@@ -41,7 +41,7 @@ Sequence *Hdf5SequenceIterator::getSequence() {
     assert(_sequence._index >= 0 && _sequence._index < (hal_index_t)_sequence._genome->_sequenceNameArray.getSize());
     // don't return local sequence pointer.  give cached pointer from
     // genome instead (so it will not expire when iterator moves!)
-    return _sequence._genome->getSequence(_sequence.getName());
+    return _sequence._genome->getSequenceByIndex(_sequence._index);
 }
 
 bool Hdf5SequenceIterator::equals(SequenceIteratorPtr other) const {
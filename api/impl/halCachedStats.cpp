@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+#include "halCachedStats.h"
+#include "halAlignment.h"
+#include "halGenome.h"
+#include "halMetaData.h"
+#include <cstdio>
+
+using namespace std;
+using namespace hal;
+
+/* metadata keys used for cached statistics all start with this prefix */
+static const string CACHED_STAT_PREFIX = "halStats.";
+
+/* number of times a genome with cached statistics has been modified */
+static const string GENERATION_KEY = CACHED_STAT_PREFIX + "generation";
+
+/* FNV-1a hash of a string followed by a separator */
+static void hashString(uint64_t &hash, const string &str) {
+    for (size_t i = 0; i < str.size(); ++i) {
+        hash = (hash ^ (unsigned char)str[i]) * 1099511628211ULL;
+    }
+    hash = (hash ^ 0xff) * 1099511628211ULL;
+}
+
+static void hashGenome(uint64_t &hash, const Genome *genome) {
+    const MetaData *metaData = genome->getMetaData();
+    hashString(hash, genome->getName());
+    hashString(hash, to_string(genome->getSequenceLength()));
+    hashString(hash, to_string(genome->getNumSequences()));
+    hashString(hash, to_string(genome->getNumTopSegments()));
+    hashString(hash, to_string(genome->getNumBottomSegments()));
+    hashString(hash, to_string(genome->getNumChildren()));
+    hashString(hash, metaData->has(GENERATION_KEY) ? metaData->get(GENERATION_KEY) : "0");
+}
+
+static void hashSubtree(uint64_t &hash, const Genome *genome) {
+    hashGenome(hash, genome);
+    for (hal_size_t i = 0; i < genome->getNumChildren(); ++i) {
+        hashSubtree(hash, genome->getChild(i));
+    }
+}
+
+/* fingerprint of the data a statistic of the genome is computed from */
+static string getFingerprint(const Genome *genome, bool alignmentWide) {
+    uint64_t hash = 14695981039346656037ULL;
+    if (alignmentWide) {
+        const Alignment *alignment = genome->getAlignment();
+        hashSubtree(hash, alignment->openGenome(alignment->getRootName()));
+    } else {
+        hashGenome(hash, genome);
+    }
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)hash);
+    return buffer;
+}
+
+void hal::setCachedStat(Genome *genome, const string &name, const string &value, bool alignmentWide) {
+    MetaData *metaData = genome->getMetaData();
+    if (not metaData->has(GENERATION_KEY)) {
+        // doesn't change the fingerprint, but lets invalidateCachedStats()
+        // know that there is something to invalidate.
+        metaData->set(GENERATION_KEY, "0");
+    }
+    metaData->set(CACHED_STAT_PREFIX + name, getFingerprint(genome, alignmentWide) + "\n" + value);
+}
+
+bool hal::getCachedStat(const Genome *genome, const string &name, bool alignmentWide, string &value) {
+    const MetaData *metaData = genome->getMetaData();
+    string key = CACHED_STAT_PREFIX + name;
+    if (not metaData->has(key)) {
+        return false;
+    }
+    const string &stored = metaData->get(key);
+    size_t split = stored.find('\n');
+    if ((split == string::npos) or (stored.compare(0, split, getFingerprint(genome, alignmentWide)) != 0)) {
+        return false;
+    }
+    value = stored.substr(split + 1);
+    return true;
+}
+
+void hal::invalidateCachedStats(Genome *genome) {
+    MetaData *metaData = genome->getMetaData();
+    if (metaData->has(GENERATION_KEY)) {
+        metaData->set(GENERATION_KEY, to_string(stoull(metaData->get(GENERATION_KEY)) + 1));
+    }
+}
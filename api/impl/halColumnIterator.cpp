@@ -19,7 +19,7 @@ ColumnIterator::ColumnIterator(const Genome *reference, const set<const Genome *
                                hal_index_t lastColumnIndex, hal_size_t maxInsertLength, bool noDupes, bool noAncestors,
                                bool reverseStrand, bool unique, bool onlyOrthologs)
     : _maxInsertionLength(maxInsertLength), _noDupes(noDupes), _noAncestors(noAncestors),
-      _treeCache(NULL), _unique(unique), _onlyOrthologs(onlyOrthologs) {
+      _treeCache(NULL), _columnTreeValid(false), _unique(unique), _onlyOrthologs(onlyOrthologs) {
     assert(columnIndex >= 0 && lastColumnIndex >= columnIndex && lastColumnIndex < (hal_index_t)reference->getSequenceLength());
     // allocate temp iterators
     if (reference->getNumTopSegments() > 0) {
@@ -400,117 +400,27 @@ bool ColumnIterator::handleInsertion(const TopSegmentIteratorPtr &inputTopSegIt)
     return false;
 }
 
-// Builds a "gene"-tree node and labels it properly.
-static stTree *getTreeNode(SegmentIteratorPtr segIt) {
-    // Make sure the segment is sliced to only 1 base.
-    assert(segIt->getStartPosition() == segIt->getEndPosition());
-    stTree *ret = stTree_construct();
-    const Genome *genome = segIt->getGenome();
-    const Sequence *seq = genome->getSequenceBySite(segIt->getStartPosition());
-
-    std::string label(segIt->getGenome()->getName() + "." + seq->getName() + "|" +
-                      std::to_string(segIt->getStartPosition() - seq->getStartPosition()));
-    stTree_setLabel(ret, label.c_str());
-
-    DnaIteratorPtr *dnaIt = new DnaIteratorPtr(genome->getDnaIterator(segIt->getStartPosition()));
-    if (segIt->getReversed()) {
-        (*dnaIt)->toReverse();
-    }
-    stTree_setClientData(ret, (void *)dnaIt);
-
-    return ret;
-}
-
-// Recursive part of buildTree
-// tree parameter represents node corresponding to the genome with
-// bottom segment botIt
-static void buildTreeR(BottomSegmentIteratorPtr botSegIt, stTree *tree) {
-    const Genome *genome = botSegIt->getGenome();
-
-    // attach a node and recurse for each of this segment's children
-    // (and paralogous segments)
-    for (hal_size_t i = 0; i < botSegIt->bseg()->getNumChildren(); i++) {
-        if (botSegIt->bseg()->hasChild(i)) {
-            const Genome *child = genome->getChild(i);
-            TopSegmentIteratorPtr topSegIt = child->getTopSegmentIterator();
-            topSegIt->toChild(botSegIt, i);
-            stTree *canonicalParalog = getTreeNode(topSegIt);
-            stTree_setParent(canonicalParalog, tree);
-            if (topSegIt->tseg()->hasParseDown()) {
-                BottomSegmentIteratorPtr childBotSegIt = child->getBottomSegmentIterator();
-                childBotSegIt->toParseDown(topSegIt);
-                buildTreeR(childBotSegIt, canonicalParalog);
-            }
-            // Traverse the paralogous segments cycle and add those segments as well
-            if (topSegIt->tseg()->hasNextParalogy()) {
-                topSegIt->toNextParalogy();
-                while (!topSegIt->tseg()->isCanonicalParalog()) {
-                    stTree *paralog = getTreeNode(topSegIt);
-                    stTree_setParent(paralog, tree);
-                    if (topSegIt->tseg()->hasParseDown()) {
-                        BottomSegmentIteratorPtr childBotSegIt = child->getBottomSegmentIterator();
-                        childBotSegIt->toParseDown(topSegIt);
-                        buildTreeR(childBotSegIt, paralog);
-                    }
-                    topSegIt->toNextParalogy();
-                }
-            }
-        }
-    }
-}
-
-// Build cached gene-tree from a column iterator.
+// Build a "gene"-tree from the column tree, labelling the nodes
+// properly.
 stTree *ColumnIterator::buildTree() const {
-    // Get any base from the column to begin building the tree
-    const ColumnIterator::ColumnMap *colMap = getColumnMap();
-    ColumnIterator::ColumnMap::const_iterator colMapIt = colMap->begin();
-    const Sequence *sequence = NULL;
-    hal_index_t index = NULL_INDEX;
-    while (colMapIt != colMap->end()) {
-        if (!colMapIt->second->empty()) {
-            // Found a non-empty column map entry, just take the index and
-            // sequence of the first base found
-            sequence = colMapIt->first;
-            index = colMapIt->second->at(0)->getArrayIndex();
-            break;
-        }
-        colMapIt++;
-    }
-    assert(sequence != NULL && index != NULL_INDEX);
-    const Genome *genome = sequence->getGenome();
-
-    // Get the bottom segment that is the common ancestor of all entries
-    TopSegmentIteratorPtr topSegIt = genome->getTopSegmentIterator();
-    BottomSegmentIteratorPtr botSegIt;
-    if (genome->getNumTopSegments() == 0) {
-        // The reference is the root genome.
-        botSegIt = genome->getBottomSegmentIterator();
-        botSegIt->toSite(index);
-    } else {
-        // Keep heading up the tree until we hit the root segment.
-        topSegIt->toSite(index);
-        while (topSegIt->tseg()->hasParent()) {
-            const Genome *parent = topSegIt->getGenome()->getParent();
-            botSegIt = parent->getBottomSegmentIterator();
-            botSegIt->toParent(topSegIt);
-            if (parent->getParent() == NULL || !botSegIt->bseg()->hasParseUp()) {
-                // Reached root genome
-                break;
-            }
-            topSegIt = parent->getTopSegmentIterator();
-            topSegIt->toParseUp(botSegIt);
-        }
-    }
+    const ColumnTree *columnTree = getColumnTree();
+    vector<stTree *> nodes(columnTree->getNumNodes());
+    for (hal_size_t i = 0; i < columnTree->getNumNodes(); i++) {
+        const Genome *genome = columnTree->getGenome(i);
+        hal_index_t position = columnTree->getArrayIndex(i);
+        const Sequence *seq = genome->getSequenceBySite(position);
+        nodes[i] = stTree_construct();
+        std::string label(genome->getName() + "." + seq->getName() + "|" + std::to_string(position - seq->getStartPosition()));
+        stTree_setLabel(nodes[i], label.c_str());
 
-    stTree *tree = NULL;
-    if ((genome->getNumTopSegments() != 0) && (not topSegIt->tseg()->hasParent()) && (topSegIt->getGenome() == genome) &&
-        (genome->getNumBottomSegments() == 0)) {
-        // Handle insertions in leaves. botSegIt doesn't point anywhere since
-        // there are no bottom segments.
-        tree = getTreeNode(topSegIt);
-    } else {
-        tree = getTreeNode(botSegIt);
-        buildTreeR(botSegIt, tree);
+        DnaIteratorPtr *dnaIt = new DnaIteratorPtr(genome->getDnaIterator(position));
+        if (columnTree->getReversed(i)) {
+            (*dnaIt)->toReverse();
+        }
+        stTree_setClientData(nodes[i], (void *)dnaIt);
+        if (columnTree->getParent(i) != NULL_INDEX) {
+            stTree_setParent(nodes[i], nodes[columnTree->getParent(i)]);
+        }
     }
 
     if (_onlyOrthologs || _noDupes || !_targets.empty()) {
@@ -521,8 +431,8 @@ stTree *ColumnIterator::buildTree() const {
         // getInducedTree(tree);
     }
 
-    assert(tree != NULL);
-    return tree;
+    assert(!nodes.empty());
+    return nodes[0];
 }
 
 // Build a gene-tree from a column iterator.
@@ -539,6 +449,22 @@ stTree *ColumnIterator::getTree() const {
     return _treeCache;
 }
 
+// Update the column tree from any base in the column.  Usually this just
+// shifts the previous column's tree.
+const ColumnTree *ColumnIterator::getColumnTree() const {
+    if (!_columnTreeValid) {
+        const ColumnIterator::ColumnMap *colMap = getColumnMap();
+        ColumnIterator::ColumnMap::const_iterator colMapIt = colMap->begin();
+        while (colMapIt != colMap->end() && colMapIt->second->empty()) {
+            colMapIt++;
+        }
+        assert(colMapIt != colMap->end());
+        _columnTree.update(colMapIt->first->getGenome(), colMapIt->second->at(0)->getArrayIndex());
+        _columnTreeValid = true;
+    }
+    return &_columnTree;
+}
+
 static void clearTree_R(stTree *tree) {
     for (int64_t i = 0; i < stTree_getChildNumber(tree); i++) {
         clearTree_R(stTree_getChild(tree, i));
@@ -547,6 +473,7 @@ static void clearTree_R(stTree *tree) {
 }
 
 void ColumnIterator::clearTree() {
+    _columnTreeValid = false;
     if (_treeCache != NULL) {
         clearTree_R(_treeCache);
         stTree_destruct(_treeCache);
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+#include "halColumnTree.h"
+#include "halBottomSegmentIterator.h"
+#include "halDnaIterator.h"
+#include "halGenome.h"
+#include "halTopSegmentIterator.h"
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+using namespace hal;
+
+ColumnTree::ColumnTree() : _numBuilds(0) {
+}
+
+void ColumnTree::update(const Genome *genome, hal_index_t arrayIndex) {
+    hal_size_t ordinal = getOrdinal(genome);
+    if (_parents.empty() || !shift(ordinal, arrayIndex)) {
+        build(ordinal, arrayIndex);
+    }
+}
+
+void ColumnTree::clear() {
+    _parents.clear();
+    _subtreeEnds.clear();
+    _ordinals.clear();
+    _positions.clear();
+    _reversed.clear();
+    _dnaIts.clear();
+    _firstPositions.clear();
+    _lastPositions.clear();
+    for (size_t i = 0; i < _genomes.size(); i++) {
+        _genomes[i]._numDnaIts = 0;
+    }
+}
+
+hal_size_t ColumnTree::getOrdinal(const Genome *genome) {
+    map<const Genome *, hal_size_t>::const_iterator i = _genomeOrdinals.find(genome);
+    if (i != _genomeOrdinals.end()) {
+        return i->second;
+    }
+    GenomeEntry entry;
+    entry._genome = genome;
+    entry._numDnaIts = 0;
+    _genomes.push_back(entry);
+    _genomeOrdinals[genome] = _genomes.size() - 1;
+    return _genomes.size() - 1;
+}
+
+// Iterators are created the first time a genome needs them.  Callers copy
+// the pointer, since adding a genome can move the entries.
+const TopSegmentIteratorPtr &ColumnTree::getTop(hal_size_t ordinal) {
+    GenomeEntry &entry = _genomes[ordinal];
+    if (entry._top == NULL) {
+        entry._top = entry._genome->getTopSegmentIterator();
+    }
+    return entry._top;
+}
+
+const BottomSegmentIteratorPtr &ColumnTree::getBottom(hal_size_t ordinal) {
+    GenomeEntry &entry = _genomes[ordinal];
+    if (entry._bottom == NULL) {
+        entry._bottom = entry._genome->getBottomSegmentIterator();
+    }
+    return entry._bottom;
+}
+
+// Try to get the tree of the column containing the given base by
+// shifting the current tree.  Moving a node's base by d moves the bases
+// of the nodes with the same orientation by d and the others by -d, and
+// the topology stays the same as long as every node stays within its
+// segments.
+bool ColumnTree::shift(hal_size_t ordinal, hal_index_t arrayIndex) {
+    for (size_t node = 0; node < _parents.size(); node++) {
+        if (_ordinals[node] != ordinal) {
+            continue;
+        }
+        hal_index_t delta = arrayIndex - _positions[node];
+        if (_reversed[node] != _reversed[0]) {
+            delta = -delta;
+        }
+        bool fits = true;
+        for (size_t i = 0; i < _parents.size() && fits; i++) {
+            hal_index_t position = _positions[i] + (_reversed[i] != _reversed[0] ? -delta : delta);
+            fits = position >= _firstPositions[i] && position <= _lastPositions[i];
+        }
+        if (fits) {
+            // a built tree has the given base on the forward strand
+            char flip = _reversed[node];
+            for (size_t i = 0; i < _parents.size(); i++) {
+                _positions[i] += _reversed[i] != _reversed[0] ? -delta : delta;
+                _reversed[i] ^= flip;
+                _dnaIts[i]->jumpTo(_positions[i]);
+                _dnaIts[i]->setReversed(_reversed[i] != 0);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// Build the tree from the segments, going up from the base to the root
+// of its column and then down through all the children and paralogs.
+void ColumnTree::build(hal_size_t ordinal, hal_index_t arrayIndex) {
+    clear();
+    ++_numBuilds;
+    const Genome *genome = _genomes[ordinal]._genome;
+    if (genome->getNumTopSegments() == 0) {
+        // The base is in the root genome.
+        BottomSegmentIteratorPtr botSegIt = getBottom(ordinal);
+        if (botSegIt->getReversed()) {
+            botSegIt->toReverse();
+        }
+        botSegIt->toSite(arrayIndex);
+        buildR(ordinal, addNode(ordinal, NULL_INDEX, botSegIt.get()));
+    } else {
+        // Keep heading up the tree until we hit the root segment.
+        TopSegmentIteratorPtr topSegIt = getTop(ordinal);
+        if (topSegIt->getReversed()) {
+            topSegIt->toReverse();
+        }
+        topSegIt->toSite(arrayIndex);
+        hal_size_t rootOrdinal = ordinal;
+        bool atRootGenome = false;
+        while (!atRootGenome && topSegIt->tseg()->hasParent()) {
+            const Genome *parent = topSegIt->getGenome()->getParent();
+            rootOrdinal = getOrdinal(parent);
+            BottomSegmentIteratorPtr botSegIt = getBottom(rootOrdinal);
+            botSegIt->toParent(topSegIt);
+            if (parent->getParent() == NULL || !botSegIt->bseg()->hasParseUp()) {
+                atRootGenome = true;
+            } else {
+                topSegIt = getTop(rootOrdinal);
+                topSegIt->toParseUp(botSegIt);
+            }
+        }
+        if (atRootGenome) {
+            buildR(rootOrdinal, addNode(rootOrdinal, NULL_INDEX, getBottom(rootOrdinal).get()));
+        } else if (topSegIt->tseg()->hasParseDown()) {
+            // The root is an insertion in an ancestor.  Its top segment
+            // (without parent) is part of what makes it the root.
+            BottomSegmentIteratorPtr botSegIt = getBottom(rootOrdinal);
+            if (rootOrdinal == ordinal) {
+                botSegIt->toParseDown(topSegIt);
+            }
+            hal_index_t root = addNode(rootOrdinal, NULL_INDEX, botSegIt.get());
+            clipNode(root, topSegIt.get());
+            buildR(rootOrdinal, root);
+        } else {
+            // Insertion in a leaf, which has no bottom segments.
+            addNode(rootOrdinal, NULL_INDEX, topSegIt.get());
+        }
+    }
+
+    // nodes are in preorder, so the subtrees can be closed from the end
+    for (size_t node = 0; node < _parents.size(); node++) {
+        _subtreeEnds[node] = node + 1;
+    }
+    for (size_t node = _parents.size() - 1; node > 0; node--) {
+        _subtreeEnds[_parents[node]] = max(_subtreeEnds[_parents[node]], _subtreeEnds[node]);
+    }
+}
+
+// Recursive part of build.  node is the node of the genome's bottom
+// segment iterator, which gets a child node for each of the segment's
+// children (and their paralogous segments).
+void ColumnTree::buildR(hal_size_t ordinal, hal_index_t node) {
+    BottomSegmentIteratorPtr botSegIt = getBottom(ordinal);
+    const Genome *genome = botSegIt->getGenome();
+    for (hal_size_t i = 0; i < botSegIt->bseg()->getNumChildren(); i++) {
+        if (botSegIt->bseg()->hasChild(i)) {
+            hal_size_t childOrdinal = getOrdinal(genome->getChild(i));
+            TopSegmentIteratorPtr topSegIt = getTop(childOrdinal);
+            topSegIt->toChild(botSegIt, i);
+            bool first = true;
+            while (first || !topSegIt->tseg()->isCanonicalParalog()) {
+                hal_index_t childNode = addNode(childOrdinal, node, topSegIt.get());
+                if (topSegIt->tseg()->hasParseDown()) {
+                    BottomSegmentIteratorPtr childBotSegIt = getBottom(childOrdinal);
+                    childBotSegIt->toParseDown(topSegIt);
+                    clipNode(childNode, childBotSegIt.get());
+                    buildR(childOrdinal, childNode);
+                }
+                if (!topSegIt->tseg()->hasNextParalogy()) {
+                    break;
+                }
+                // Traverse the paralogous segments cycle and add those
+                // segments as well
+                topSegIt->toNextParalogy();
+                first = false;
+            }
+        }
+    }
+}
+
+// Add a node for the (single-base) segment iterator's base.  The node
+// can move within the segment without changing the tree.
+hal_index_t ColumnTree::addNode(hal_size_t ordinal, hal_index_t parent, const SegmentIterator *segIt) {
+    assert(segIt->getStartPosition() == segIt->getEndPosition());
+    hal_index_t position = segIt->getStartPosition();
+    GenomeEntry &entry = _genomes[ordinal];
+    if (entry._numDnaIts == entry._dnaIts.size()) {
+        entry._dnaIts.push_back(entry._genome->getDnaIterator(position));
+    }
+    DnaIterator *dnaIt = entry._dnaIts[entry._numDnaIts++].get();
+    dnaIt->jumpTo(position);
+    dnaIt->setReversed(segIt->getReversed());
+
+    _parents.push_back(parent);
+    _subtreeEnds.push_back(0);
+    _ordinals.push_back(ordinal);
+    _positions.push_back(position);
+    _reversed.push_back(segIt->getReversed() ? 1 : 0);
+    _dnaIts.push_back(dnaIt);
+    _firstPositions.push_back(segIt->getSegment()->getStartPosition());
+    _lastPositions.push_back(segIt->getSegment()->getEndPosition());
+    return _parents.size() - 1;
+}
+
+// Restrict the range over which a node can move to another segment that
+// contains its base.
+void ColumnTree::clipNode(hal_index_t node, const SegmentIterator *segIt) {
+    _firstPositions[node] = max(_firstPositions[node], segIt->getSegment()->getStartPosition());
+    _lastPositions[node] = min(_lastPositions[node], segIt->getSegment()->getEndPosition());
+}
@@ -1,6 +1,7 @@
 #include "halGenome.h"
 #include "halAlignment.h"
 #include "halBottomSegmentIterator.h"
+#include "halCachedStats.h"
 #include "halDnaIterator.h"
 #include "halMetaData.h"
 #include "halSegmentIterator.h"
@@ -12,6 +13,22 @@
 using namespace std;
 using namespace hal;
 
+void hal::Genome::getSequencesBySite(const vector<hal_size_t> &positions, vector<const Sequence *> &sequences) const {
+    sequences.resize(positions.size());
+    const Sequence *sequence = NULL;
+    hal_size_t start = 0, end = 0;
+    for (size_t i = 0; i < positions.size(); i++) {
+        if (sequence == NULL || positions[i] < start || positions[i] >= end) {
+            sequence = getSequenceBySite(positions[i]);
+            if (sequence != NULL) {
+                start = sequence->getStartPosition();
+                end = start + sequence->getSequenceLength();
+            }
+        }
+        sequences[i] = sequence;
+    }
+}
+
 void hal::Genome::copy(Genome *dest) const {
     copyDimensions(dest);
     copySequence(dest);
@@ -34,6 +51,7 @@ void hal::Genome::copyDimensions(Genome *dest) const {
         dimensions.push_back(info);
     }
     dest->setDimensions(dimensions);
+    invalidateCachedStats(dest);
 }
 
 void hal::Genome::copyTopDimensions(Genome *dest) const {
@@ -50,6 +68,7 @@ void hal::Genome::copyTopDimensions(Genome *dest) const {
         dimensions.push_back(info);
     }
     dest->updateTopDimensions(dimensions);
+    invalidateCachedStats(dest);
 }
 
 void hal::Genome::copyBottomDimensions(Genome *dest) const {
@@ -66,6 +85,7 @@ void hal::Genome::copyBottomDimensions(Genome *dest) const {
         dimensions.push_back(info);
     }
     dest->updateBottomDimensions(dimensions);
+    invalidateCachedStats(dest);
 }
 
 void hal::Genome::copyTopSegments(Genome *dest) const {
@@ -147,6 +167,7 @@ void hal::Genome::copyTopSegments(Genome *dest) const {
             }
         }
     }
+    invalidateCachedStats(dest);
 }
 
 void hal::Genome::copyBottomSegments(Genome *dest) const {
@@ -239,6 +260,7 @@ void hal::Genome::copyBottomSegments(Genome *dest) const {
             outBotSegIt->bseg()->setTopParseIndex(inBotSegIt->bseg()->getTopParseIndex());
         }
     }
+    invalidateCachedStats(dest);
 }
 
 void hal::Genome::copySequence(Genome *dest) const {
@@ -250,6 +272,7 @@ void hal::Genome::copySequence(Genome *dest) const {
         outDna->setBase(inDna->getBase());
     }
     outDna->flush();
+    invalidateCachedStats(dest);
 }
 
 void hal::Genome::copyMetadata(Genome *dest) const {
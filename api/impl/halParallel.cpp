@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+#include "halParallel.h"
+#include "halAlignmentInstance.h"
+#include "halCLParser.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+using namespace hal;
+
+unsigned hal::hardwareThreadCount() {
+    unsigned numThreads = thread::hardware_concurrency();
+    return (numThreads == 0) ? 1 : numThreads;
+}
+
+bool hal::supportsParallelRead(const string &alignmentPath, const CLParser *options) {
+    return detectHalAlignmentFormat(alignmentPath, options) == STORAGE_FORMAT_MMAP;
+}
+
+unsigned hal::getReadThreadCount(const string &alignmentPath, const CLParser *options, unsigned numThreads) {
+    if (numThreads == 0) {
+        numThreads = hardwareThreadCount();
+    }
+    if ((numThreads > 1) and not supportsParallelRead(alignmentPath, options)) {
+        cerr << "Warning: " << alignmentPath << " is not in " << STORAGE_FORMAT_MMAP
+             << " format and can only be read by one thread, ignoring --numThreads" << endl;
+        numThreads = 1;
+    }
+    return numThreads;
+}
+
+unsigned hal::getWriteThreadCount(const Alignment *alignment, unsigned numThreads) {
+    if (numThreads == 0) {
+        numThreads = hardwareThreadCount();
+    }
+    if ((numThreads > 1) and (alignment->getStorageFormat() != STORAGE_FORMAT_MMAP)) {
+        cerr << "Warning: alignment is not in " << STORAGE_FORMAT_MMAP
+             << " format and can only be written by one thread, ignoring --numThreads" << endl;
+        numThreads = 1;
+    }
+    return numThreads;
+}
+
+void hal::parallelFor(size_t numTasks, unsigned numThreads, const function<void(size_t, unsigned)> &task) {
+    if (numThreads > numTasks) {
+        numThreads = numTasks;
+    }
+    if (numThreads <= 1) {
+        for (size_t taskIdx = 0; taskIdx < numTasks; ++taskIdx) {
+            task(taskIdx, 0);
+        }
+        return;
+    }
+
+    atomic<size_t> nextTask(0);
+    atomic<bool> failed(false);
+    exception_ptr firstError;
+    mutex errorMutex;
+
+    auto worker = [&](unsigned threadIdx) {
+        size_t taskIdx;
+        while (not failed and ((taskIdx = nextTask++) < numTasks)) {
+            try {
+                task(taskIdx, threadIdx);
+            } catch (...) {
+                lock_guard<mutex> lock(errorMutex);
+                if (not failed) {
+                    firstError = current_exception();
+                    failed = true;
+                }
+            }
+        }
+    };
+
+    vector<thread> threads;
+    for (unsigned threadIdx = 1; threadIdx < numThreads; ++threadIdx) {
+        threads.push_back(thread(worker, threadIdx));
+    }
+    worker(0);
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+    if (firstError) {
+        rethrow_exception(firstError);
+    }
+}
+
+vector<pair<hal_index_t, hal_index_t>> hal::makeTiles(hal_size_t length, hal_size_t tileSize) {
+    if (tileSize == 0) {
+        tileSize = max(length, (hal_size_t)1);
+    }
+    vector<pair<hal_index_t, hal_index_t>> tiles;
+    for (hal_size_t start = 0; start < length; start += tileSize) {
+        tiles.push_back(make_pair((hal_index_t)start, (hal_index_t)min(start + tileSize, length)));
+    }
+    return tiles;
+}
+
+ThreadAlignments::ThreadAlignments(AlignmentConstPtr alignment, const string &alignmentPath, const CLParser *options,
+                                   unsigned numThreads) {
+    _alignments.push_back(alignment);
+    for (unsigned threadIdx = 1; threadIdx < numThreads; ++threadIdx) {
+        _alignments.push_back(openHalAlignment(alignmentPath, options));
+    }
+}
+
+OrderedOutput::OrderedOutput(ostream &outStream, size_t numChunks)
+    : _outStream(outStream), _pending(numChunks), _ready(numChunks, false), _next(0) {
+}
+
+void OrderedOutput::commit(size_t chunkIdx, string &buffer) {
+    lock_guard<mutex> lock(_mutex);
+    assert(chunkIdx < _ready.size() && !_ready[chunkIdx]);
+    _pending[chunkIdx].swap(buffer);
+    buffer.clear();
+    _ready[chunkIdx] = true;
+    while ((_next < _ready.size()) and _ready[_next]) {
+        _outStream.write(_pending[_next].data(), _pending[_next].size());
+        string().swap(_pending[_next]);
+        ++_next;
+    }
+}
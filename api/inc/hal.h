@@ -63,8 +63,10 @@
 #include "halAlignmentInstance.h"
 #include "halBottomSegment.h"
 #include "halBottomSegmentIterator.h"
+#include "halCachedStats.h"
 #include "halCLParser.h"
 #include "halColumnIterator.h"
+#include "halColumnTree.h"
 #include "halCommon.h"
 #include "halDefs.h"
 #include "halDnaIterator.h"
@@ -73,6 +75,7 @@
 #include "halGenome.h"
 #include "halMappedSegment.h"
 #include "halMetaData.h"
+#include "halParallel.h"
 #include "halPositionCache.h"
 #include "halRearrangement.h"
 #include "halSegment.h"
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef _HALCACHEDSTATS_H
+#define _HALCACHEDSTATS_H
+
+#include "halDefs.h"
+#include <string>
+
+namespace hal {
+    class Genome;
+
+    /*
+     * Summary statistics that are expensive to compute, such as base
+     * composition or coverage, can be stored in the metadata of their
+     * genome (see halStats --materialize).  Each value is stored along
+     * with a fingerprint of the data it was computed from and is ignored
+     * once the fingerprint no longer matches.  A statistic either depends
+     * only on its genome, or is alignment-wide and depends on every
+     * genome in the alignment.
+     */
+
+    /** Store the value of a statistic in the metadata of a genome. */
+    void setCachedStat(Genome *genome, const std::string &name, const std::string &value, bool alignmentWide);
+
+    /** Get the value of a statistic stored with setCachedStat().  Returns
+     * false if it was never stored or if it is out of date. */
+    bool getCachedStat(const Genome *genome, const std::string &name, bool alignmentWide, std::string &value);
+
+    /** Invalidate the cached statistics that depend on a genome.  The API
+     * calls this when it rewrites a genome; tools that modify a genome
+     * in place without changing its dimensions (ie by writing its DNA)
+     * must call it themselves. */
+    void invalidateCachedStats(Genome *genome);
+}
+
+#endif
+// Local Variables:
+// mode: c++
+// End:
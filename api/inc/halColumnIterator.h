@@ -9,6 +9,7 @@
 #define _HALCOLUMNITERATOR_H
 
 #include "halColumnIteratorStack.h"
+#include "halColumnTree.h"
 #include "halDefs.h"
 #include "halDnaIterator.h"
 #include "halPositionCache.h"
@@ -113,9 +114,17 @@ namespace hal {
 
         /** Get a new tree that represents the phylogenetic relationship
          * between the entries in this column. Do not attempt to free this
-         * tree. */
+         * tree.  The tree is made from getColumnTree(), which is much
+         * cheaper to use when iterating over many columns. */
         virtual stTree *getTree() const;
 
+        /** Get the gene tree of this column as flat arrays.  This is always
+         * the full tree found in the HAL graph, whatever the targets or
+         * the noDupes and onlyOrthologs options.  The tree is updated in
+         * place as the iterator moves, so the pointer stays the same but
+         * the contents are only valid for the current column. */
+        virtual const ColumnTree *getColumnTree() const;
+
         // temp -- probably want to have a "global column iterator" object
         // instead
         typedef std::map<const Genome *, PositionCache *> VisitCache;
@@ -173,6 +182,8 @@ namespace hal {
         hal_index_t _prevRefIndex;
         hal_index_t _leftmostRefPos;
         mutable stTree *_treeCache;
+        mutable ColumnTree _columnTree;
+        mutable bool _columnTreeValid;
         bool _unique;
         bool _onlyOrthologs;
     };
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef _HALCOLUMNTREE_H
+#define _HALCOLUMNTREE_H
+
+#include "halDefs.h"
+#include <map>
+#include <vector>
+
+namespace hal {
+
+    /**
+     * Gene tree of an alignment column, stored as flat arrays instead of
+     * an stTree.  Nodes are numbered in preorder starting with the root
+     * (node 0), so the subtree of node i is [i, getSubtreeEnd(i)).  Each
+     * genome is given an ordinal the first time it appears in a tree, and
+     * keeps it for the lifetime of the ColumnTree.
+     *
+     * The arrays, and the segment and dna iterators used to fill them,
+     * are reused from column to column.  When every base of the tree is
+     * still inside the same segments in the next column, the topology is
+     * unchanged and the tree is updated by only shifting the positions of
+     * its nodes, without any traversal or allocation.
+     */
+    class ColumnTree {
+      public:
+        ColumnTree();
+
+        /** Make this the tree of the column containing the given base
+         * @param genome genome of the base
+         * @param arrayIndex position of the base in the genome */
+        void update(const Genome *genome, hal_index_t arrayIndex);
+
+        /** Forget the current tree (the buffers are kept) */
+        void clear();
+
+        /** Number of nodes in the tree (0 if it was cleared) */
+        hal_size_t getNumNodes() const {
+            return _parents.size();
+        }
+
+        /** Parent of a node, or NULL_INDEX for the root */
+        hal_index_t getParent(hal_size_t node) const {
+            return _parents[node];
+        }
+
+        /** One past the last node of the subtree rooted at a node */
+        hal_size_t getSubtreeEnd(hal_size_t node) const {
+            return _subtreeEnds[node];
+        }
+
+        /** Ordinal of the genome of a node */
+        hal_size_t getGenomeOrdinal(hal_size_t node) const {
+            return _ordinals[node];
+        }
+
+        /** Genome of a node */
+        const Genome *getGenome(hal_size_t node) const {
+            return _genomes[_ordinals[node]]._genome;
+        }
+
+        /** Position of a node's base in its genome */
+        hal_index_t getArrayIndex(hal_size_t node) const {
+            return _positions[node];
+        }
+
+        /** Is a node's base on the reverse strand with respect to its
+         * genome's forward strand? */
+        bool getReversed(hal_size_t node) const {
+            return _reversed[node] != 0;
+        }
+
+        /** Dna iterator on a node's base (reverse complemented if the
+         * node is reversed).  It is only valid until the next update. */
+        const DnaIterator *getDnaIterator(hal_size_t node) const {
+            return _dnaIts[node];
+        }
+
+        /** Number of genomes that have been given an ordinal */
+        hal_size_t getNumGenomes() const {
+            return _genomes.size();
+        }
+
+        /** Genome with a given ordinal */
+        const Genome *getGenomeByOrdinal(hal_size_t ordinal) const {
+            return _genomes[ordinal]._genome;
+        }
+
+        /** Number of times the tree has been built from the segments, as
+         * opposed to shifted from the previous column. */
+        hal_size_t getNumBuilds() const {
+            return _numBuilds;
+        }
+
+      private:
+        struct GenomeEntry {
+            const Genome *_genome;
+            TopSegmentIteratorPtr _top;
+            BottomSegmentIteratorPtr _bottom;
+            std::vector<DnaIteratorPtr> _dnaIts;
+            hal_size_t _numDnaIts;
+        };
+
+        hal_size_t getOrdinal(const Genome *genome);
+        const TopSegmentIteratorPtr &getTop(hal_size_t ordinal);
+        const BottomSegmentIteratorPtr &getBottom(hal_size_t ordinal);
+
+        bool shift(hal_size_t ordinal, hal_index_t arrayIndex);
+        void build(hal_size_t ordinal, hal_index_t arrayIndex);
+        void buildR(hal_size_t ordinal, hal_index_t node);
+        hal_index_t addNode(hal_size_t ordinal, hal_index_t parent, const SegmentIterator *segIt);
+        void clipNode(hal_index_t node, const SegmentIterator *segIt);
+
+        std::vector<GenomeEntry> _genomes;
+        std::map<const Genome *, hal_size_t> _genomeOrdinals;
+
+        std::vector<hal_index_t> _parents;
+        std::vector<hal_size_t> _subtreeEnds;
+        std::vector<hal_size_t> _ordinals;
+        std::vector<hal_index_t> _positions;
+        std::vector<char> _reversed;
+        std::vector<DnaIterator *> _dnaIts;
+        // range of positions [first, last] over which the node's
+        // segments, and so the topology of the tree, stay the same
+        std::vector<hal_index_t> _firstPositions;
+        std::vector<hal_index_t> _lastPositions;
+        hal_size_t _numBuilds;
+    };
+}
+
+#endif
+// Local Variables:
+// mode: c++
+// End:
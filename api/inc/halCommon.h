@@ -155,6 +155,24 @@ namespace hal {
         return dist;
     }
 
+    /** Append the decimal form of an integer to a string.  Much faster
+     * than formatting through an ostream when writing large outputs */
+    inline void appendInt(std::string &buffer, int64_t value) {
+        char digits[20];
+        uint64_t absValue = (value < 0) ? -uint64_t(value) : uint64_t(value);
+        int numDigits = 0;
+        do {
+            digits[numDigits++] = '0' + (absValue % 10);
+            absValue /= 10;
+        } while (absValue != 0);
+        if (value < 0) {
+            buffer.push_back('-');
+        }
+        while (numDigits > 0) {
+            buffer.push_back(digits[--numDigits]);
+        }
+    }
+
     const Genome *getLowestCommonAncestor(const std::set<const Genome *> &inputSet);
 
     /* Given a set of genomes (input set) find all genomes in the spanning
@@ -189,6 +207,11 @@ namespace hal {
         return dnaUnpackMap[code];
     }
 
+    /** Complement a 4-bit DNA code, preserving case.  N is its own complement */
+    inline uint8_t dnaCodeComplement(uint8_t code) {
+        return ((code & 0x07) < 4) ? ((code & 0x08) | (3 - (code & 0x07))) : code;
+    }
+
     /** Pack a DNA character */
     inline unsigned char dnaPack(char unpackedChar, hal_index_t index, unsigned char packedChar) {
         uint8_t code = dnaPackMap[uint8_t(unpackedChar)];
@@ -8,6 +8,7 @@
 #ifndef _HALDNADRIVER_H
 #define _HALDNADRIVER_H
 #include "halCommon.h"
+#include <algorithm>
 
 namespace hal {
     /**
@@ -34,6 +35,32 @@ namespace hal {
             return dnaUnpack(relIndex, _buffer[relIndex / 2]);
         }
 
+        /* get the 4-bit codes of length bases starting at index, one code per byte.
+         * This is done a buffer at a time rather than a base at a time, so is much
+         * faster than getBase() for long runs of bases. */
+        inline void getCodes(hal_index_t index, hal_size_t length, uint8_t *codes) const {
+            hal_index_t endIndex = index + length;
+            while (index < endIndex) {
+                hal_index_t relIndex = access(index);
+                hal_index_t relEnd = std::min(endIndex, _endIndex) - _startIndex;
+                const uint8_t *packed = reinterpret_cast<const uint8_t *>(_buffer);
+                if (relIndex & 1) {
+                    *codes++ = packed[relIndex / 2] & 0x0F;
+                    ++relIndex;
+                }
+                for (; relIndex + 1 < relEnd; relIndex += 2) {
+                    uint8_t packedChar = packed[relIndex / 2];
+                    *codes++ = packedChar >> 4;
+                    *codes++ = packedChar & 0x0F;
+                }
+                if (relIndex < relEnd) {
+                    *codes++ = packed[relIndex / 2] >> 4;
+                    ++relIndex;
+                }
+                index = _startIndex + relIndex;
+            }
+        }
+
         /* set a base at the specified index. */
         inline void setBase(hal_index_t index, char base) {
             hal_index_t relIndex = access(index);
@@ -108,6 +108,10 @@ namespace hal {
         /* read a DNA string */
         void readString(std::string &outString, hal_size_t length);
 
+        /* read the 4-bit codes (see dnaUnpack()) of length bases, one code per
+         * byte.  Much faster than readString() for bulk comparisons. */
+        void readCodes(std::vector<uint8_t> &outCodes, hal_size_t length);
+
         /* write a DNA string */
         void writeString(const std::string &inString, hal_size_t length);
 
@@ -172,6 +176,25 @@ namespace hal {
         }
     }
 
+    inline void DnaIterator::readCodes(std::vector<uint8_t> &outCodes, hal_size_t length) {
+        assert(length == 0 || inRange() == true);
+        outCodes.resize(length);
+        if (length == 0) {
+            return;
+        }
+        if (not _reversed) {
+            _dnaAccess->getCodes(_index, length, outCodes.data());
+            _index += length;
+        } else {
+            _dnaAccess->getCodes(_index - length + 1, length, outCodes.data());
+            std::reverse(outCodes.begin(), outCodes.end());
+            for (hal_size_t i = 0; i < length; ++i) {
+                outCodes[i] = dnaCodeComplement(outCodes[i]);
+            }
+            _index -= length;
+        }
+    }
+
     inline void DnaIterator::writeString(const std::string &inString, hal_size_t length) {
         assert(length == 0 || inRange());
         for (hal_size_t i = 0; i < length; ++i) {
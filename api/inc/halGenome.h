@@ -103,6 +103,12 @@ namespace hal {
         /** Get a sequence by base's position (in genome coordinates) */
         virtual const Sequence *getSequenceBySite(hal_size_t position) const = 0;
 
+        /** Get the sequences containing a list of positions (in genome
+         * coordinates), or NULL for positions past the end of the genome.
+         * Each sequence is only looked up once for a run of positions
+         * in it, so this is fastest when the positions are sorted. */
+        void getSequencesBySite(const std::vector<hal_size_t> &positions, std::vector<const Sequence *> &sequences) const;
+
         /** Get a sequence iterator
          * @param position Number of the sequence to start iterator at */
         virtual SequenceIteratorPtr getSequenceIterator(hal_index_t position = 0) = 0;
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef _HALPARALLEL_H
+#define _HALPARALLEL_H
+
+#include "halAlignment.h"
+#include "halDefs.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace hal {
+    class CLParser;
+
+    /** Number of threads supported by the hardware, never less than one. */
+    unsigned hardwareThreadCount();
+
+    /** Check if the HAL file can be read from multiple threads, each
+     * thread using its own Alignment object.  This is true for mmap
+     * files.  The HDF5 library is not built thread-safe, so HDF5 files
+     * must be read from a single thread. */
+    bool supportsParallelRead(const std::string &alignmentPath, const CLParser *options = NULL);
+
+    /** Get the number of threads to use to read a HAL file given the
+     * value of a --numThreads option.  Zero means use all hardware
+     * threads.  If the file can't be read in parallel, a warning is
+     * printed and one is returned. */
+    unsigned getReadThreadCount(const std::string &alignmentPath, const CLParser *options, unsigned numThreads);
+
+    /** Get the number of threads to use to write different genomes of an
+     * open alignment at the same time, like getReadThreadCount.  Only mmap
+     * alignments can be written by more than one thread. */
+    unsigned getWriteThreadCount(const Alignment *alignment, unsigned numThreads);
+
+    /** Call task(taskIdx, threadIdx) for each taskIdx in [0, numTasks)
+     * using up to numThreads threads.  Tasks are handed out in increasing
+     * order.  With a single thread, tasks are run on the calling thread.
+     * If a task throws, no further tasks are started and the first
+     * exception is rethrown once all threads have finished. */
+    void parallelFor(size_t numTasks, unsigned numThreads, const std::function<void(size_t, unsigned)> &task);
+
+    /** Split the range [0, length) into consecutive tiles of at most
+     * tileSize positions so that a genome can be scanned by parallel
+     * tasks.  Tiles are returned as (start, end) pairs, with end
+     * exclusive.  A tileSize of zero gives a single tile. */
+    std::vector<std::pair<hal_index_t, hal_index_t>> makeTiles(hal_size_t length, hal_size_t tileSize);
+
+    /**
+     * One Alignment object per thread for parallel readers.  Slot zero
+     * is the alignment passed to the constructor, the others are opened
+     * up front from the calling thread so that no opening is done
+     * concurrently.
+     */
+    class ThreadAlignments {
+      public:
+        ThreadAlignments(AlignmentConstPtr alignment, const std::string &alignmentPath, const CLParser *options,
+                         unsigned numThreads);
+
+        /** Get the alignment to use in a thread */
+        AlignmentConstPtr get(unsigned threadIdx) const {
+            return _alignments[threadIdx];
+        }
+
+        unsigned size() const {
+            return _alignments.size();
+        }
+
+      private:
+        std::vector<AlignmentConstPtr> _alignments;
+    };
+
+    /**
+     * Write output that is produced in chunks by parallel tasks to a
+     * stream in chunk order.  A chunk is written as soon as all
+     * preceding chunks have been written, so that completed output
+     * doesn't accumulate behind running tasks more than needed.
+     */
+    class OrderedOutput {
+      public:
+        OrderedOutput(std::ostream &outStream, size_t numChunks);
+
+        /** Hand over the output of a chunk.  The buffer is swapped out
+         * and left empty so it can be reused.  Thread-safe. */
+        void commit(size_t chunkIdx, std::string &buffer);
+
+      private:
+        std::ostream &_outStream;
+        std::mutex _mutex;
+        std::vector<std::string> _pending;
+        std::vector<bool> _ready;
+        size_t _next;
+    };
+
+    /**
+     * Queue of at most capacity items passed between threads, such as
+     * records parsed by a reading thread ahead of the thread using them.
+     * push waits while the queue is full and pop while it is empty.
+     * After close, push fails and pop fails once the queue is empty, so a
+     * producer closes the queue when it is done and a consumer closes it
+     * to make a producer stop.
+     */
+    template <typename T> class BoundedQueue {
+      public:
+        BoundedQueue(size_t capacity) : _capacity(capacity), _closed(false) {
+        }
+
+        /** Add an item, returning false if the queue was closed. */
+        bool push(T item) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _notFull.wait(lock, [this]() { return _closed || _items.size() < _capacity; });
+            if (_closed) {
+                return false;
+            }
+            _items.push_back(std::move(item));
+            _notEmpty.notify_one();
+            return true;
+        }
+
+        /** Remove the first item, returning false if the queue is empty
+         * and closed. */
+        bool pop(T &item) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _notEmpty.wait(lock, [this]() { return _closed || !_items.empty(); });
+            if (_items.empty()) {
+                return false;
+            }
+            item = std::move(_items.front());
+            _items.pop_front();
+            _notFull.notify_one();
+            return true;
+        }
+
+        void close() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+            _notFull.notify_all();
+            _notEmpty.notify_all();
+        }
+
+      private:
+        size_t _capacity;
+        bool _closed;
+        std::deque<T> _items;
+        std::mutex _mutex;
+        std::condition_variable _notFull;
+        std::condition_variable _notEmpty;
+    };
+}
+
+#endif
+// Local Variables:
+// mode: c++
+// End:
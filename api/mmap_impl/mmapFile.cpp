@@ -114,6 +114,7 @@ void hal::MMapFile::createHeader() {
     _header->nextOffset = alignRound(sizeof(MMapHeader));
     _header->dirty = true;
     _header->nextOffset = _header->nextOffset;
+    parseCheckVersion();
 }
 
 namespace hal {
@@ -10,7 +10,7 @@
 namespace hal {
     /* Current API major and minor versions */
     static const unsigned MMAP_API_MAJOR_VERSION = 1;
-    static const unsigned MMAP_API_MINOR_VERSION = 1;
+    static const unsigned MMAP_API_MINOR_VERSION = 2;
 
     /* get current mmap version as a string */
     const std::string& getMmapCurentVersion();
@@ -65,6 +65,7 @@ namespace hal {
         virtual bool isUdcProtocol() const = 0;
 
         inline size_t getRootOffset() const;
+        inline size_t getUsedSize() const;
         inline void *toPtr(size_t offset, size_t accessSize);
         inline const void *toPtr(size_t offset, size_t accessSize) const;
         inline size_t allocMem(size_t size, bool isRoot = false);
@@ -124,6 +125,12 @@ size_t hal::MMapFile::getRootOffset() const {
     return _header->rootOffset;
 }
 
+/** Get the number of bytes allocated in the file, which is the offset of
+ * the next allocation */
+size_t hal::MMapFile::getUsedSize() const {
+    return _header->nextOffset;
+}
+
 /* fetch the range if required, else inline no-op */
 void hal::MMapFile::fetchIfNeeded(size_t offset, size_t accessSize) const {
     if (_mustFetch) {
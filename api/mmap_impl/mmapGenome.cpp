@@ -66,16 +66,14 @@ void MMapGenome::setDimensions(const vector<Sequence::Info> &sequenceDimensions,
 /* must be called after sequences are created */
 void MMapGenome::createSequenceNameHash(size_t numSequences) {
     // build perfect hash
-    vector<string> sequenceNames;
+    vector<string> sequenceNames(numSequences);
     for (size_t i = 0; i < numSequences; i++) {
-        sequenceNames.push_back(getSequenceByIndex(i)->getName());
+        sequenceNames[i] = getSequenceByIndex(i)->getName();
     }
     _data->_sequenceHashOffset = _sequenceNameHash.addKeys(sequenceNames);
 
     // add all sequence indexes
-    for (size_t i = 0; i < numSequences; i++) {
-        _sequenceNameHash.setIndex(getSequenceByIndex(i)->getName(), i);
-    }
+    _sequenceNameHash.setIndexes(sequenceNames);
 }
 
 /* must be called after sequences are created */
@@ -200,7 +198,11 @@ const Sequence *MMapGenome::getSequence(const string &name) const {
 }
 
 Sequence *MMapGenome::getSequenceBySite(hal_size_t position) {
-    return getSequenceByIndex(_genomeSiteMap.getSequenceIndexBySite(position));
+    hal_index_t index = _genomeSiteMap.getSequenceIndexBySite(position);
+    if (index == NULL_INDEX) {
+        return NULL; // past end of genome
+    }
+    return getSequenceByIndex(index);
 }
 
 const Sequence *MMapGenome::getSequenceBySite(hal_size_t position) const {
@@ -1,6 +1,7 @@
 #include "mmapGenomeSiteMap.h"
 #include "mmapRbTree.h"
 #include "mmapSequence.h"
+#include <limits>
 using namespace std;
 using namespace hal;
 
@@ -30,6 +31,15 @@ namespace hal {
     }
 }
 
+/* identifies a packed search tree following the binary tree */
+static const size_t GSM_INDEX_MAGIC = 0x7865646e4d53472eULL;
+
+/* the packed tree nodes are aligned to cache lines */
+static const size_t GSM_INDEX_NODE_ALIGN = 64;
+
+/* first mmap minor version with the packed search tree */
+static const unsigned GSM_INDEX_MINOR_VERSION = 2;
+
 /* calculate space required for the map in bytes */
 size_t hal::MMapGenomeSiteMap::calcRequiredSpace(size_t numSequences) {
     // root is in header
@@ -37,18 +47,65 @@ size_t hal::MMapGenomeSiteMap::calcRequiredSpace(size_t numSequences) {
            ((numSequences - 1) * MMapFile::alignRound(sizeof(MMapGenomeSiteMapNode)));
 }
 
+/* calculate space required for the packed search tree in bytes, including
+ * room to align the nodes */
+size_t hal::MMapGenomeSiteMap::calcIndexRequiredSpace(size_t numNodes) {
+    return MMapFile::alignRound(sizeof(MMapGenomeSiteMapIndex)) + GSM_INDEX_NODE_ALIGN +
+           numNodes * (sizeof(MMapGenomeSiteMapIndexNode) + GSM_INDEX_NODE_KEYS * sizeof(hal_index_t));
+}
+
 /* read header information */
 void hal::MMapGenomeSiteMap::readGsm(size_t gsmOffset) {
     _gsmOffset = gsmOffset;
     _data = static_cast<MMapGenomeSiteMapData *>(_file->toPtr(gsmOffset, sizeof(MMapGenomeSiteMapData)));
-    // prefetch full table
-    _file->toPtr(gsmOffset, calcRequiredSpace(_data->_numSequences));
+    if (_file->getMinorVersion() >= GSM_INDEX_MINOR_VERSION) {
+        readIndex();
+    }
+    if (_index == NULL) {
+        // prefetch full table
+        _file->toPtr(gsmOffset, calcRequiredSpace(_data->_numSequences));
+    }
 }
 
-void hal::MMapGenomeSiteMap::createGsm(size_t numSequences) {
-    _gsmOffset = _file->allocMem(calcRequiredSpace(numSequences));
-    _data = static_cast<MMapGenomeSiteMapData *>(_file->toPtr(_gsmOffset, calcRequiredSpace(numSequences)));
+/* use the packed search tree if it is there; its nodes are fetched as they
+ * are visited.  The index is only trusted if it lies within the allocated
+ * part of the file. */
+void hal::MMapGenomeSiteMap::readIndex() {
+    size_t usedSize = _file->getUsedSize();
+    if ((_data->_numSequences == 0) ||
+        (_data->_numSequences > usedSize / MMapFile::alignRound(sizeof(MMapGenomeSiteMapNode)))) {
+        return;
+    }
+    size_t indexOffset = _gsmOffset + calcRequiredSpace(_data->_numSequences);
+    if ((indexOffset > usedSize) || (usedSize - indexOffset < sizeof(MMapGenomeSiteMapIndex))) {
+        return;
+    }
+    MMapGenomeSiteMapIndex *index =
+        static_cast<MMapGenomeSiteMapIndex *>(_file->toPtr(indexOffset, sizeof(MMapGenomeSiteMapIndex)));
+    if ((index->_magic != GSM_INDEX_MAGIC) || (index->_numKeys > _data->_numSequences) ||
+        (index->_numNodes != (index->_numKeys + GSM_INDEX_NODE_KEYS - 1) / GSM_INDEX_NODE_KEYS)) {
+        return;
+    }
+    size_t nodesSpace =
+        index->_numNodes * (sizeof(MMapGenomeSiteMapIndexNode) + GSM_INDEX_NODE_KEYS * sizeof(hal_index_t));
+    if ((index->_nodesOffset < indexOffset + MMapFile::alignRound(sizeof(MMapGenomeSiteMapIndex))) ||
+        (index->_nodesOffset % GSM_INDEX_NODE_ALIGN != 0) || (index->_nodesOffset > usedSize) ||
+        (usedSize - index->_nodesOffset < nodesSpace)) {
+        throw hal_exception("corrupt mmap HAL file: genome site map index extends past the allocated space");
+    }
+    _index = index;
+}
+
+void hal::MMapGenomeSiteMap::createGsm(size_t numSequences, size_t numIndexNodes) {
+    size_t treeSpace = calcRequiredSpace(numSequences);
+    size_t space = treeSpace + calcIndexRequiredSpace(numIndexNodes);
+    _gsmOffset = _file->allocMem(space);
+    _data = static_cast<MMapGenomeSiteMapData *>(_file->toPtr(_gsmOffset, space));
     _data->_numSequences = numSequences;
+    _index = static_cast<MMapGenomeSiteMapIndex *>(_file->toPtr(_gsmOffset + treeSpace, sizeof(MMapGenomeSiteMapIndex)));
+    _index->_numNodes = numIndexNodes;
+    size_t nodesOffset = _gsmOffset + treeSpace + MMapFile::alignRound(sizeof(MMapGenomeSiteMapIndex));
+    _index->_nodesOffset = ((nodesOffset + GSM_INDEX_NODE_ALIGN - 1) / GSM_INDEX_NODE_ALIGN) * GSM_INDEX_NODE_ALIGN;
 }
 
 /* load into temporary site tree, which is balanced */
@@ -84,19 +141,96 @@ hal_index_t hal::MMapGenomeSiteMap::copyTree(struct rb_tree_node *tmpNode, int &
     return nodeIdx;
 }
 
+/* recursively store the keys in order, each node's keys interleaved with
+ * its subtrees.  Slots past the last key are padded with the maximum value,
+ * which are the last ones in order, so they are never less than a position. */
+void hal::MMapGenomeSiteMap::fillIndexNodes(size_t nodeIdx, const vector<MMapSequence *> &keySequences, size_t &nextKey) {
+    if (nodeIdx >= _index->_numNodes) {
+        return;
+    }
+    MMapGenomeSiteMapIndexNode *node = const_cast<MMapGenomeSiteMapIndexNode *>(getIndexNodePtr(nodeIdx));
+    hal_index_t *seqIndexes = static_cast<hal_index_t *>(_file->toPtr(
+        _index->_nodesOffset + _index->_numNodes * sizeof(MMapGenomeSiteMapIndexNode) +
+            nodeIdx * GSM_INDEX_NODE_KEYS * sizeof(hal_index_t),
+        GSM_INDEX_NODE_KEYS * sizeof(hal_index_t)));
+    for (size_t i = 0; i < GSM_INDEX_NODE_KEYS; i++) {
+        fillIndexNodes(nodeIdx * (GSM_INDEX_NODE_KEYS + 1) + i + 1, keySequences, nextKey);
+        if (nextKey < keySequences.size()) {
+            node->_keys[i] = keySequences[nextKey]->getStartPosition();
+            seqIndexes[i] = keySequences[nextKey]->getArrayIndex();
+            nextKey++;
+        } else {
+            node->_keys[i] = numeric_limits<size_t>::max();
+            seqIndexes[i] = NULL_INDEX;
+        }
+    }
+    fillIndexNodes(nodeIdx * (GSM_INDEX_NODE_KEYS + 1) + GSM_INDEX_NODE_KEYS + 1, keySequences, nextKey);
+}
+
+/* build the packed search tree from the non-empty sequences, which are
+ * contiguous in the genome */
+void hal::MMapGenomeSiteMap::buildIndex(const vector<MMapSequence *> &sequences) {
+    vector<MMapSequence *> keySequences;
+    size_t endPosition = 0;
+    for (auto seq : sequences) {
+        if (seq->getSequenceLength() > 0) {
+            assert(seq->getStartPosition() == (hal_index_t)endPosition);
+            keySequences.push_back(seq);
+            endPosition = seq->getStartPosition() + seq->getSequenceLength();
+        }
+    }
+    assert(_index->_numNodes == (keySequences.size() + GSM_INDEX_NODE_KEYS - 1) / GSM_INDEX_NODE_KEYS);
+    size_t nextKey = 0;
+    fillIndexNodes(0, keySequences, nextKey);
+    assert(nextKey == keySequences.size());
+    _index->_numKeys = keySequences.size();
+    _index->_endPosition = endPosition;
+    _index->_magic = GSM_INDEX_MAGIC;
+}
+
 size_t hal::MMapGenomeSiteMap::build(const vector<MMapSequence *> &sequences) {
     struct rb_tree tmpTree;
     TmpTreeNodes tmpTreeNodes; // manages memory for tmp tree
 
     rb_tree_new(&tmpTree, mmapGenomeSiteMapNodeCmp);
     loadTmpTree(sequences, &tmpTree, tmpTreeNodes);
-    createGsm(sequences.size());
+    size_t numKeys = 0;
+    for (auto seq : sequences) {
+        numKeys += (seq->getSequenceLength() > 0) ? 1 : 0;
+    }
+    createGsm(sequences.size(), (numKeys + GSM_INDEX_NODE_KEYS - 1) / GSM_INDEX_NODE_KEYS);
     int nextNodeIdx = 0;
     copyTree(tmpTree.root, nextNodeIdx);
+    buildIndex(sequences);
     return _gsmOffset;
 }
 
-hal_index_t MMapGenomeSiteMap::getSequenceIndexBySite(size_t position) {
+/* Find the last key that is not past the position.  Each node is searched by
+ * counting its keys that are not past the position, which has no branches,
+ * and that count is also the child to descend into. */
+hal_index_t MMapGenomeSiteMap::searchIndex(size_t position) {
+    if (position >= _index->_endPosition) {
+        return NULL_INDEX;
+    }
+    size_t slot = numeric_limits<size_t>::max();
+    for (size_t nodeIdx = 0; nodeIdx < _index->_numNodes;) {
+        const size_t *keys = getIndexNodePtr(nodeIdx)->_keys;
+        size_t numLess = 0;
+        for (size_t i = 0; i < GSM_INDEX_NODE_KEYS; i++) {
+            numLess += (keys[i] <= position);
+        }
+        slot = (numLess > 0) ? nodeIdx * GSM_INDEX_NODE_KEYS + numLess - 1 : slot;
+        nodeIdx = nodeIdx * (GSM_INDEX_NODE_KEYS + 1) + numLess + 1;
+    }
+    if (slot == numeric_limits<size_t>::max()) {
+        return NULL_INDEX;
+    }
+    return *static_cast<const hal_index_t *>(
+        _file->toPtr(_index->_nodesOffset + _index->_numNodes * sizeof(MMapGenomeSiteMapIndexNode) + slot * sizeof(hal_index_t),
+                     sizeof(hal_index_t)));
+}
+
+hal_index_t MMapGenomeSiteMap::searchTree(size_t position) {
     assert(_gsmOffset != MMAP_NULL_OFFSET);
     const MMapGenomeSiteMapNode *node = getNodePtr(0);
     while (node != NULL) {
@@ -47,17 +47,48 @@ namespace hal {
         MMapGenomeSiteMapNode _root;
     };
 
+    /* Number of start positions in a node of the packed search tree, which
+     * fills a cache line. */
+    static const size_t GSM_INDEX_NODE_KEYS = 8;
+
+    /* node of the packed search tree, unused keys are the maximum size_t */
+    class MMapGenomeSiteMapIndexNode {
+      public:
+        size_t _keys[GSM_INDEX_NODE_KEYS];
+    };
+
+    /* Header of the packed search tree that follows the binary tree nodes in
+     * files of mmap version 1.2 or later.  The tree holds the start positions
+     * of the non-empty sequences in an implicit B-tree: the children of node k
+     * are the nodes k * (GSM_INDEX_NODE_KEYS + 1) + i + 1, and the nodes are
+     * stored in breadth-first order, so the top levels of the tree share a few
+     * cache lines or UDC blocks.  The sequence indexes of the keys follow the
+     * nodes, with the same layout as the keys. */
+    class MMapGenomeSiteMapIndex {
+      public:
+        size_t _magic;
+        size_t _numKeys;
+        size_t _numNodes;
+        size_t _endPosition;
+        size_t _nodesOffset;
+    };
+
     /**
      * MMap file structure used to map position in genome to specific
      * sequence.  This builds a balance binary tree and stores it in the
-     * mmapped file for direct access.
+     * mmapped file for direct access.  Files of mmap version 1.2 or later
+     * also store a packed search tree of the sequence start positions after
+     * the binary tree, which is used instead of it when present.  The binary
+     * tree is still written so older versions of the library can read the
+     * file.
      */
     class MMapGenomeSiteMap {
       public:
         /** Construct new object for accessing site map in HAL file.
          * If the hash table is being created, then gsmOffset
          * should be MMAP_NULL_OFFSET.  */
-        MMapGenomeSiteMap(MMapFile *mmapFile, size_t gsmOffset) : _file(mmapFile), _gsmOffset(gsmOffset), _data(NULL) {
+        MMapGenomeSiteMap(MMapFile *mmapFile, size_t gsmOffset)
+            : _file(mmapFile), _gsmOffset(gsmOffset), _data(NULL), _index(NULL) {
             if (gsmOffset != MMAP_NULL_OFFSET) {
                 readGsm(gsmOffset);
             }
@@ -68,7 +99,9 @@ namespace hal {
         size_t build(const std::vector<MMapSequence *> &sequences);
 
         /** find the sequence index containing a position */
-        hal_index_t getSequenceIndexBySite(size_t position);
+        hal_index_t getSequenceIndexBySite(size_t position) {
+            return (_index != NULL) ? searchIndex(position) : searchTree(position);
+        }
 
         /** find the sequence containing a position */
         const Sequence *getSequenceBySite(hal_size_t position) const {
@@ -77,8 +110,14 @@ namespace hal {
 
       private:
         static size_t calcRequiredSpace(size_t numSequences);
+        static size_t calcIndexRequiredSpace(size_t numNodes);
         void readGsm(size_t gsmOffset);
-        void createGsm(size_t numSequences);
+        void createGsm(size_t numSequences, size_t numIndexNodes);
+        void readIndex();
+        void buildIndex(const std::vector<MMapSequence *> &sequences);
+        void fillIndexNodes(size_t nodeIdx, const std::vector<MMapSequence *> &keySequences, size_t &nextKey);
+        hal_index_t searchTree(size_t position);
+        hal_index_t searchIndex(size_t position);
         void loadTmpTree(const std::vector<MMapSequence *> &sequences, struct rb_tree *tmpTree, TmpTreeNodes &tmpTreeNodes);
         hal_index_t copyTree(struct rb_tree_node *tmpNode, int &nextNodeIdx);
 
@@ -96,9 +135,17 @@ namespace hal {
             return const_cast<MMapGenomeSiteMap *>(this)->getNodePtr(nodeIndex);
         }
 
+        /* node of the packed search tree, fetching it if needed */
+        const MMapGenomeSiteMapIndexNode *getIndexNodePtr(size_t nodeIndex) const {
+            return static_cast<const MMapGenomeSiteMapIndexNode *>(
+                _file->toPtr(_index->_nodesOffset + nodeIndex * sizeof(MMapGenomeSiteMapIndexNode),
+                             sizeof(MMapGenomeSiteMapIndexNode)));
+        }
+
         MMapFile *_file;
         size_t _gsmOffset;
         MMapGenomeSiteMapData *_data;
+        MMapGenomeSiteMapIndex *_index; // NULL if file only has binary tree
     };
 }
 #endif
@@ -36,7 +36,7 @@ namespace hal {
         };
 
         void set(const std::string &key, const std::string &value) {
-            _map.insert(make_pair(key, value));
+            _map[key] = value;
             _dirty = true;
         };
         const std::string &get(const std::string &key) const {
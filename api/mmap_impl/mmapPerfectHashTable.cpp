@@ -1,4 +1,5 @@
 #include "mmapPerfectHashTable.h"
+#include "halParallel.h"
 #include <algorithm>
 #include <cerrno>
 #include <memory>
@@ -13,6 +14,19 @@ static const size_t DEFAULT_PHF_ALPHA = 80; // load factor
 static const phf_seed_t DEFAULT_PHF_SEED = 0;
 static const bool DEFAULT_PHF_NODIV = true;
 
+/* Tables with at least this many keys are built and filled by the threads
+ * given to the table.  Smaller ones aren't worth starting threads for. */
+static const size_t PARALLEL_MIN_KEYS = 100000;
+static const size_t KEYS_PER_TASK = 16384;
+
+/* number of threads to use for a table of numKeys keys */
+unsigned hal::MMapPerfectHashTable::getNumThreads(size_t numKeys) const {
+    if (numKeys < PARALLEL_MIN_KEYS) {
+        return 1;
+    }
+    return _numThreads;
+}
+
 /* get relative offset of displacement map */
 size_t hal::MMapPerfectHashTable::displacementMapRelOffset() const {
     return MMapFile::alignRound(sizeof(PerfectHashTableData));
@@ -83,6 +97,17 @@ vector<hal_index_t> hal::MMapPerfectHashTable::readExistingIndexes(const vector<
     return existingIndexes;
 }
 
+void hal::MMapPerfectHashTable::setIndexes(const vector<string> &keys) {
+    // keys hash to distinct slots, so threads never write the same one
+    parallelFor((keys.size() + KEYS_PER_TASK - 1) / KEYS_PER_TASK, getNumThreads(keys.size()),
+                [&](size_t taskIdx, unsigned threadIdx) {
+                    size_t end = min(keys.size(), (taskIdx + 1) * KEYS_PER_TASK);
+                    for (size_t i = taskIdx * KEYS_PER_TASK; i < end; i++) {
+                        setIndex(keys[i], i);
+                    }
+                });
+}
+
 void hal::MMapPerfectHashTable::writeExistingIndexes(const vector<string> &existingKeys,
                                                      const vector<hal_index_t> &existingIndexes) {
     for (int i = 0; i < existingKeys.size(); i++) {
@@ -121,15 +146,20 @@ void hal::MMapPerfectHashTable::setupSpace(const struct phf *newPhf) {
 }
 
 void hal::MMapPerfectHashTable::buildHash(const vector<string> &newKeys, const vector<string> &existingKeys) {
+    // only copy the keys if there are two sets of them
     vector<string> allKeys;
-    std::move(existingKeys.begin(), existingKeys.end(), std::back_inserter(allKeys));
-    std::move(newKeys.begin(), newKeys.end(), std::back_inserter(allKeys));
+    if (not existingKeys.empty()) {
+        allKeys.reserve(existingKeys.size() + newKeys.size());
+        allKeys.insert(allKeys.end(), existingKeys.begin(), existingKeys.end());
+        allKeys.insert(allKeys.end(), newKeys.begin(), newKeys.end());
+    }
+    const vector<string> &keys = existingKeys.empty() ? newKeys : allKeys;
 
     // build new function in heap
     struct phf newPhf;
     memset(&newPhf, 0, sizeof(newPhf));
-    phf_error_t err = PHF::init<string, DEFAULT_PHF_NODIV>(&newPhf, &allKeys[0], allKeys.size(), DEFAULT_PHF_LAMBDA,
-                                                           DEFAULT_PHF_ALPHA, DEFAULT_PHF_SEED);
+    phf_error_t err = PHF::init<string, DEFAULT_PHF_NODIV>(&newPhf, keys.data(), keys.size(), DEFAULT_PHF_LAMBDA,
+                                                           DEFAULT_PHF_ALPHA, DEFAULT_PHF_SEED, getNumThreads(keys.size()));
     if (err != 0) {
         throw hal_exception("can't create perfect hash function: " + string(strerror(err)));
     }
@@ -43,9 +43,11 @@ namespace hal {
          * when keys are first added.  The growthFactor specified the approximate
          * number of additional set of keys will be added to the file.  Specifies
          * 0 if all keys are added in one set of keys.  This allows for space to
-         * avoid moving the hash. */
-        MMapPerfectHashTable(MMapFile *mmapFile, size_t phtOffset, size_t growthFactor = 0)
-            : _file(mmapFile), _phtOffset(phtOffset), _data(NULL), _growthFactor(growthFactor), _hashTable(NULL) {
+         * avoid moving the hash.  Large sets of keys are hashed by up to
+         * numThreads threads. */
+        MMapPerfectHashTable(MMapFile *mmapFile, size_t phtOffset, size_t growthFactor = 0, unsigned numThreads = 1)
+            : _file(mmapFile), _phtOffset(phtOffset), _data(NULL), _growthFactor(growthFactor),
+              _numThreads(max(numThreads, 1u)), _hashTable(NULL) {
             memset(&_phf, 0, sizeof(_phf));
             if (phtOffset != MMAP_NULL_OFFSET) {
                 readPhf(phtOffset);
@@ -61,6 +63,10 @@ namespace hal {
             return _hashTable[PHF::hash(&_phf, key)];
         }
 
+        /** Save the mapping of each key to its index in keys, which must all
+         * be in the hash. */
+        void setIndexes(const vector<string> &keys);
+
         /** Save mapping of string o hal_index_t in the hash.  If the string
          * is not in the hash, bad things will happen without notice */
         void setIndex(const string &key, hal_index_t index) {
@@ -79,6 +85,12 @@ namespace hal {
             return addKeys(newKeys, existingKeys);
         }
 
+        /** Set the maximum number of threads used to build and fill the
+         * table.  The default of 1 never starts any threads. */
+        void setNumThreads(unsigned numThreads) {
+            _numThreads = max(numThreads, 1u);
+        }
+
       private:
         inline size_t displacementMapRelOffset() const;
         inline size_t hashTableRelOffset(const struct phf *phf) const;
@@ -89,11 +101,13 @@ namespace hal {
         void writeExistingIndexes(const vector<string> &existingKeys, const vector<hal_index_t> &existingIndexes);
         void setupSpace(const struct phf *newPhf);
         void buildHash(const vector<string> &newKeys, const vector<string> &existingKeys);
+        unsigned getNumThreads(size_t numKeys) const;
 
         MMapFile *_file;
         size_t _phtOffset; // pht is perfect hash table, to distinguish from phf
         PerfectHashTableData *_data;
         size_t _growthFactor;
+        unsigned _numThreads;
         struct phf _phf;
         hal_index_t *_hashTable;
     };
@@ -31,6 +31,7 @@
 #include <assert.h> /* assert(3) */
 #include <errno.h>  /* errno */
 #include <halDefs.h>
+#include <halParallel.h>
 #include <inttypes.h> /* PRIu32 PRIu64 PRIx64 */
 #include <limits.h>   /* CHAR_BIT SIZE_MAX */
 #include <stdint.h>   /* UINT32_C UINT64_C uint32_t uint64_t */
@@ -46,6 +47,15 @@
 
 #define PHF_NO_COMPUTED_GOTOS 1
 
+/* keys hashed by each parallel task */
+#define PHF_TASK_KEYS 16384
+
+/* keys whose displacements are searched between parallel hashing steps */
+#define PHF_BATCH_KEYS 262144
+
+/* displacements whose f(d, k) are computed in parallel for each key */
+#define PHF_PARALLEL_D 2
+
 #ifdef __clang__
 #pragma clang diagnostic ignored "-Wunused-function"
 #if __cplusplus < 201103L
@@ -347,12 +357,12 @@ static inline uint32_t phf_round32(const unsigned char *p, size_t n, uint32_t h1
     return h1;
 } /* phf_round32() */
 
-static inline uint32_t phf_round32(phf_string_t k, uint32_t h1) {
+static inline uint32_t phf_round32(const phf_string_t &k, uint32_t h1) {
     return phf_round32(reinterpret_cast<const unsigned char *>(k.p), k.n, h1);
 } /* phf_round32() */
 
 #if !PHF_NO_LIBCXX
-static inline uint32_t phf_round32(std::string k, uint32_t h1) {
+static inline uint32_t phf_round32(const std::string &k, uint32_t h1) {
     return phf_round32(reinterpret_cast<const unsigned char *>(k.c_str()), k.length(), h1);
 } /* phf_round32() */
 #endif
@@ -384,7 +394,7 @@ static inline uint32_t phf_mix32(uint32_t h1) {
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 /* 32-bit, phf_string_t, and std::string keys */
-template <typename T> static inline uint32_t phf_g(T k, uint32_t seed) {
+template <typename T> static inline uint32_t phf_g(const T &k, uint32_t seed) {
     uint32_t h1 = seed;
 
     h1 = phf_round32(k, h1);
@@ -392,7 +402,7 @@ template <typename T> static inline uint32_t phf_g(T k, uint32_t seed) {
     return phf_mix32(h1);
 } /* phf_g() */
 
-template <typename T> static inline uint32_t phf_f(uint32_t d, T k, uint32_t seed) {
+template <typename T> static inline uint32_t phf_f(uint32_t d, const T &k, uint32_t seed) {
     uint32_t h1 = seed;
 
     h1 = phf_round32(d, h1);
@@ -422,16 +432,16 @@ static inline uint32_t phf_f(uint32_t d, uint64_t k, uint32_t seed) {
 } /* phf_f() */
 
 /* g() and f() which parameterize modular reduction */
-template <bool nodiv, typename T> static inline uint32_t phf_g_mod_r(T k, uint32_t seed, size_t r) {
+template <bool nodiv, typename T> static inline uint32_t phf_g_mod_r(const T &k, uint32_t seed, size_t r) {
     return (nodiv) ? (phf_g(k, seed) & (r - 1)) : (phf_g(k, seed) % r);
 } /* phf_g_mod_r() */
 
-template <bool nodiv, typename T> static inline uint32_t phf_f_mod_m(uint32_t d, T k, uint32_t seed, size_t m) {
+template <bool nodiv, typename T> static inline uint32_t phf_f_mod_m(uint32_t d, const T &k, uint32_t seed, size_t m) {
     return (nodiv) ? (phf_f(d, k, seed) & (m - 1)) : (phf_f(d, k, seed) % m);
 } /* phf_f_mod_m() */
 
 /*
- * B U C K E T  S O R T I N G  I N T E R F A C E S
+ * B U C K E T  S O R T I N G
  *
  * For every key [0..n) we calculate g(k) % r, where 0 < r <= n, and
  * associate it with a bucket [0..r). We then sort the buckets in decreasing
@@ -439,11 +449,10 @@ template <bool nodiv, typename T> static inline uint32_t phf_f_mod_m(uint32_t d,
  * optimal time complexity when calculating f(d, k) (less contention) and
  * optimal space complexity (smaller d).
  *
- * The actual sorting is done in the core routine. The buckets are organized
- * and sorted as a 1-dimensional array to minimize run-time memory (less
- * data structure overhead) and improve data locality (less pointer
- * indirection). The following section merely implements a templated
- * bucket-key structure and the comparison routine passed to qsort(3).
+ * The keys themselves are not copied. Key indexes are grouped by bucket in
+ * one array, and the buckets are ordered by a counting sort on their size,
+ * with ties broken by bucket number, so the order doesn't depend on how the
+ * keys were hashed.
  *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
@@ -451,32 +460,54 @@ static bool operator==(const phf_string_t &a, const phf_string_t &b) {
     return a.n == b.n && 0 == memcmp(a.p, b.p, a.n);
 }
 
-template <typename T> class phf_key {
+/* keys of each bucket and buckets in the order displacements are searched */
+class phf_buckets {
   public:
-    T k;
-    phf_hash_t g; /* result of g(k) % r */
-    size_t *n;    /* number of keys in bucket g */
-    phf_key() : g(0), n(NULL) {
-    }
-
-}; /* struct phf_key */
-
-template <typename T> struct phf_keycmp {
+    std::vector<uint32_t> keys;   /* key indexes grouped by bucket */
+    std::vector<uint32_t> start;  /* first entry in keys of each bucket, r + 1 entries */
+    std::vector<uint32_t> order;  /* non-empty buckets, largest first */
+
+    phf_buckets(const std::vector<phf_hash_t> &K_g, size_t r) : keys(K_g.size()), start(r + 1, 0) {
+        size_t z_max = 0;
+        for (size_t i = 0; i < K_g.size(); i++) {
+            ++start[K_g[i] + 1];
+        }
+        std::vector<size_t> z_n; /* number of buckets of each size */
+        for (size_t b = 0; b < r; b++) {
+            size_t z = start[b + 1];
+            if (z > z_max) {
+                z_max = z;
+                z_n.resize(z_max + 1, 0);
+            }
+            if (z > 0) {
+                ++z_n[z];
+            }
+            start[b + 1] += start[b];
+        }
 
-    bool operator()(const phf_key<T> &a, const phf_key<T> &b) {
-        if (a.n < b.n) {
-            return true;
+        std::vector<uint32_t> next(start.begin(), start.end() - 1);
+        for (size_t i = 0; i < K_g.size(); i++) {
+            keys[next[K_g[i]]++] = i;
         }
-        if (a.g < b.g) {
-            return true;
+
+        /* z_first[z] is where the buckets of size z start in order */
+        std::vector<size_t> z_first(z_max + 2, 0);
+        for (size_t z = z_max; z > 0; z--) {
+            z_first[z - 1] = z_first[z] + z_n[z];
         }
-        /* duplicate key? */
-        if ((a.k == b.k) && (&a != &b)) {
-            throw hal_exception("duplicate key in perfect hash");
+        order.resize(z_first[0]);
+        for (size_t b = 0; b < r; b++) {
+            size_t z = size(b);
+            if (z > 0) {
+                order[z_first[z]++] = b;
+            }
         }
-        return false;
     }
-};
+
+    size_t size(size_t b) const {
+        return start[b + 1] - start[b];
+    }
+}; /* class phf_buckets */
 
 /*
  * C O R E  F U N C T I O N  G E N E R A T O R
@@ -492,29 +523,29 @@ template <typename T> struct phf_keycmp {
  *  - a - alpha, hash table load factor (1%% - 100%%).
  *  - seed - random seed
  *  - nodiv - if true rounds r and m to powers of 2
+ *  - numThreads - threads used to compute g(k) and f(d, k)
+ *
+ * The displacement search is sequential, as each bucket's displacement
+ * depends on the slots taken by the buckets before it. With several
+ * threads, f(d, k) for the first PHF_PARALLEL_D displacements is computed
+ * in parallel for a batch of buckets ahead of the search, which then mostly
+ * only tests bits. The function generated is the same for any number of
+ * threads.
  *
  * Returns a system error number on failure, or 0 on success. phf is
- * unmodified on failure.
+ * unmodified on failure.  Duplicate keys throw a hal_exception.
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 template <typename key_t, bool nodiv>
 PHF_PUBLIC int PHF::init(struct phf *phf, const key_t k[], const size_t n, const size_t l, const size_t a,
-                         const phf_seed_t seed) {
+                         const phf_seed_t seed, const unsigned numThreads) {
     size_t n1 = PHF_MAX(n, 1); /* for computations that require n > 0 */
     size_t l1 = PHF_MAX(l, 1);
     size_t a1 = PHF_MAX(PHF_MIN(a, 100), 1);
-    size_t r; /* number of buckets */
-    size_t m; /* size of output array */
-    // original code used C arrays, but we change to vector to get initialization.
-    std::vector<phf_key<key_t>> B_k; /* linear bucket-slot array */
-    std::vector<size_t> B_z;         /* number of slots per bucket */
-    phf_key<key_t> *B_p, *B_pe;
-    phf_bits_t *T = NULL; /* bitmap to track index occupancy */
-    phf_bits_t *T_b;      /* per-bucket working bitmap */
-    size_t T_n;
+    size_t r;           /* number of buckets */
+    size_t m;           /* size of output array */
     uint32_t *g = NULL; /* displacement map */
     uint32_t d_max = 0; /* maximum displacement value */
-    int error;
 
     if ((phf->nodiv = nodiv)) {
         /* round to power-of-2 so we can use bit masks instead of modulo division */
@@ -526,78 +557,98 @@ PHF_PUBLIC int PHF::init(struct phf *phf, const key_t k[], const size_t n, const
         m = phf_primeup((n1 * 100) / a1);
     }
 
-    if (r == 0 || m == 0)
+    if (r == 0 || m == 0 || m > UINT32_MAX)
         return ERANGE;
 
-    B_k.resize(n1);
-    B_z.resize(r);
-
-    for (size_t i = 0; i < n; i++) {
-        phf_hash_t g = phf_g_mod_r<nodiv>(k[i], seed, r);
-
-        B_k[i].k = k[i];
-        B_k[i].g = g;
-        B_k[i].n = &B_z[g];
-        ++*B_k[i].n;
-    }
-
-    sort(B_k.begin(), B_k.end(), phf_keycmp<key_t>());
-
-    T_n = PHF_HOWMANY(m, PHF_BITS(*T));
-    if (!(T = static_cast<phf_bits_t *>(calloc(T_n * 2, sizeof *T))))
-        goto syerr;
-    T_b = &T[T_n]; /* share single allocation */
+    /* g(k) % r of each key */
+    std::vector<phf_hash_t> K_g(n);
+    hal::parallelFor(PHF_HOWMANY(n, PHF_TASK_KEYS), numThreads, [&](size_t task, unsigned) {
+        for (size_t i = task * PHF_TASK_KEYS; i < PHF_MIN(n, (task + 1) * PHF_TASK_KEYS); i++) {
+            K_g[i] = phf_g_mod_r<nodiv>(k[i], seed, r);
+        }
+    });
+    phf_buckets B(K_g, r);
+    K_g = std::vector<phf_hash_t>();
+
+    /* duplicate keys would never be displaced to different slots */
+    hal::parallelFor(PHF_HOWMANY(B.order.size(), PHF_TASK_KEYS), numThreads, [&](size_t task, unsigned) {
+        for (size_t j = task * PHF_TASK_KEYS; j < PHF_MIN(B.order.size(), (task + 1) * PHF_TASK_KEYS); j++) {
+            const uint32_t *B_k = &B.keys[B.start[B.order[j]]];
+            size_t z = B.size(B.order[j]);
+            for (size_t i1 = 1; i1 < z; i1++) {
+                for (size_t i0 = 0; i0 < i1; i0++) {
+                    if (k[B_k[i0]] == k[B_k[i1]]) {
+                        throw hal_exception("duplicate key in perfect hash");
+                    }
+                }
+            }
+        }
+    });
 
-    /*
-     * FIXME: T_b[] is unnecessary. We could clear T[] the same way we
-     * clear T_b[]. In fact, at the end of generation T_b[] is identical
-     * to T[] because we don't clear T_b[] on success.
-     *
-     * We just need to tweak the current reset logic to stop before the
-     * key that failed, and then we can elide the commit to T[] at the
-     * end of the outer loop.
-     */
+    std::vector<phf_bits_t> T(PHF_HOWMANY(m, PHF_BITS(phf_bits_t)), 0); /* bitmap to track index occupancy */
+    std::vector<uint32_t> F;   /* precomputed f(d, k) of the keys of a batch, in bucket order */
+    std::vector<uint32_t> F_b; /* slots of a bucket's keys for the displacement being tried */
+    size_t D = (numThreads > 1) ? PHF_PARALLEL_D : 0;
 
     if (!(g = static_cast<uint32_t *>(calloc(r, sizeof *g))))
-        goto syerr;
-
-    B_p = &B_k[0];
-    B_pe = &B_k[n];
-
-    for (; B_p<B_pe && * B_p->n> 0; B_p += *B_p->n) {
-        phf_key<key_t> *Bi_p, *Bi_pe;
-        size_t d = 0;
-        uint32_t f;
-    retry:
-        d++;
-        Bi_p = B_p;
-        Bi_pe = B_p + *B_p->n;
-
-        for (; Bi_p < Bi_pe; Bi_p++) {
-            f = phf_f_mod_m<nodiv>(d, Bi_p->k, seed, m);
-
-            if (phf_isset(T, f) || phf_isset(T_b, f)) {
-                /* reset T_b[] */
-                for (Bi_p = B_p; Bi_p < Bi_pe; Bi_p++) {
-                    f = phf_f_mod_m<nodiv>(d, Bi_p->k, seed, m);
-                    phf_clrbit(T_b, f);
-                }
+        return errno;
 
-                goto retry;
-            } else {
-                phf_setbit(T_b, f);
+    for (size_t j0 = 0; j0 < B.order.size();) {
+        /* batch of buckets [j0, j1) */
+        size_t j1 = j0, batchKeys = 0;
+        while (j1 < B.order.size() && batchKeys < PHF_BATCH_KEYS) {
+            batchKeys += B.size(B.order[j1++]);
+        }
+        if (D > 0) {
+            /* the batch's keys, in bucket order, are contiguous when the
+             * buckets are visited in order, so index them through a prefix */
+            std::vector<size_t> batchStart(j1 - j0 + 1, 0);
+            for (size_t j = j0; j < j1; j++) {
+                batchStart[j - j0 + 1] = batchStart[j - j0] + B.size(B.order[j]);
             }
+            F.resize(batchKeys * D);
+            hal::parallelFor(PHF_HOWMANY(j1 - j0, PHF_TASK_KEYS), numThreads, [&](size_t task, unsigned) {
+                for (size_t j = j0 + task * PHF_TASK_KEYS; j < PHF_MIN(j1, j0 + (task + 1) * PHF_TASK_KEYS); j++) {
+                    const uint32_t *B_k = &B.keys[B.start[B.order[j]]];
+                    uint32_t *F_k = &F[batchStart[j - j0] * D];
+                    for (size_t i = 0; i < B.size(B.order[j]); i++) {
+                        for (size_t d = 1; d <= D; d++) {
+                            *F_k++ = phf_f_mod_m<nodiv>(d, k[B_k[i]], seed, m);
+                        }
+                    }
+                }
+            });
         }
 
-        /* commit to T[] */
-        for (Bi_p = B_p; Bi_p < Bi_pe; Bi_p++) {
-            f = phf_f_mod_m<nodiv>(d, Bi_p->k, seed, m);
-            phf_setbit(T, f);
-        }
+        const uint32_t *F_k = F.data();
+        for (size_t j = j0; j < j1; j++) {
+            const uint32_t *B_k = &B.keys[B.start[B.order[j]]];
+            size_t z = B.size(B.order[j]);
+            uint32_t d = 0;
+            bool placed = false;
+            while (!placed) {
+                d++;
+                placed = true;
+                F_b.clear();
+                for (size_t i = 0; i < z && placed; i++) {
+                    uint32_t f = (d <= D) ? F_k[i * D + d - 1] : phf_f_mod_m<nodiv>(d, k[B_k[i]], seed, m);
+                    if (phf_isset(T.data(), f) || std::find(F_b.begin(), F_b.end(), f) != F_b.end()) {
+                        placed = false;
+                    } else {
+                        F_b.push_back(f);
+                    }
+                }
+            }
 
-        /* commit to g[] */
-        g[B_p->g] = d;
-        d_max = PHF_MAX(d, d_max);
+            /* commit to T[] and g[] */
+            for (uint32_t f : F_b) {
+                phf_setbit(T.data(), f);
+            }
+            g[B.order[j]] = d;
+            d_max = PHF_MAX(d, d_max);
+            F_k += z * D;
+        }
+        j0 = j1;
     }
 
     phf->seed = seed;
@@ -605,7 +656,6 @@ PHF_PUBLIC int PHF::init(struct phf *phf, const key_t k[], const size_t n, const
     phf->m = m;
 
     phf->g = g;
-    g = NULL;
 
     phf->d_max = d_max;
     phf->g_op = (nodiv) ? phf::PHF_G_UINT32_BAND_R : phf::PHF_G_UINT32_MOD_R;
@@ -613,16 +663,7 @@ PHF_PUBLIC int PHF::init(struct phf *phf, const key_t k[], const size_t n, const
 	phf->g_jmp = NULL;
 #endif
 
-    error = 0;
-
-    goto clean;
-syerr:
-    error = errno;
-clean:
-    free(g);
-    free(T);
-
-    return error;
+    return 0;
 } /* PHF::init() */
 
 /*
@@ -676,29 +717,29 @@ PHF_PUBLIC void PHF::compact(struct phf *phf) {
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 template int PHF::init<uint32_t, true>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t,
-                                       const phf_seed_t);
+                                       const phf_seed_t, const unsigned);
 template int PHF::init<uint64_t, true>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t,
-                                       const phf_seed_t);
+                                       const phf_seed_t, const unsigned);
 template int PHF::init<phf_string_t, true>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t,
-                                           const phf_seed_t);
+                                           const phf_seed_t, const unsigned);
 #if !PHF_NO_LIBCXX
 template int PHF::init<std::string, true>(struct phf *, const std::string[], const size_t, const size_t, const size_t,
-                                          const phf_seed_t);
+                                          const phf_seed_t, const unsigned);
 #endif
 
 template int PHF::init<uint32_t, false>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t,
-                                        const phf_seed_t);
+                                        const phf_seed_t, const unsigned);
 template int PHF::init<uint64_t, false>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t,
-                                        const phf_seed_t);
+                                        const phf_seed_t, const unsigned);
 template int PHF::init<phf_string_t, false>(struct phf *, const phf_string_t[], const size_t, const size_t, const size_t,
-                                            const phf_seed_t);
+                                            const phf_seed_t, const unsigned);
 #if !PHF_NO_LIBCXX
 template int PHF::init<std::string, false>(struct phf *, const std::string[], const size_t, const size_t, const size_t,
-                                           const phf_seed_t);
+                                           const phf_seed_t, const unsigned);
 #endif
 
 template <bool nodiv, typename map_t, typename key_t>
-static inline phf_hash_t phf_hash_(map_t *g, key_t k, uint32_t seed, size_t r, size_t m) {
+static inline phf_hash_t phf_hash_(map_t *g, const key_t &k, uint32_t seed, size_t r, size_t m) {
     if (nodiv) {
         uint32_t d = g[phf_g(k, seed) & (r - 1)];
 
@@ -710,7 +751,7 @@ static inline phf_hash_t phf_hash_(map_t *g, key_t k, uint32_t seed, size_t r, s
     }
 } /* phf_hash_() */
 
-template <typename T> PHF_PUBLIC phf_hash_t PHF::hash(const struct phf *phf, T k) {
+template <typename T> PHF_PUBLIC phf_hash_t PHF::hash(const struct phf *phf, const T &k) {
 #if PHF_HAVE_COMPUTED_GOTOS && !PHF_NO_COMPUTED_GOTOS
     static const void *const jmp[] = {
         NULL, &&uint8_mod_r, &&uint8_band_r, &&uint16_mod_r, &&uint16_band_r, &&uint32_mod_r, &&uint32_band_r,
@@ -751,11 +792,11 @@ uint32_band_r:
 #endif
 } /* PHF::hash() */
 
-template phf_hash_t PHF::hash<uint32_t>(const struct phf *, uint32_t);
-template phf_hash_t PHF::hash<uint64_t>(const struct phf *, uint64_t);
-template phf_hash_t PHF::hash<phf_string_t>(const struct phf *, phf_string_t);
+template phf_hash_t PHF::hash<uint32_t>(const struct phf *, const uint32_t &);
+template phf_hash_t PHF::hash<uint64_t>(const struct phf *, const uint64_t &);
+template phf_hash_t PHF::hash<phf_string_t>(const struct phf *, const phf_string_t &);
 #if !PHF_NO_LIBCXX
-template phf_hash_t PHF::hash<std::string>(const struct phf *, std::string);
+template phf_hash_t PHF::hash<std::string>(const struct phf *, const std::string &);
 #endif
 
 /** Deallocates internal tables, but not the struct object itself. */
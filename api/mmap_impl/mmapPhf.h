@@ -162,12 +162,15 @@ struct phf {
 namespace PHF {
     template <typename key_t> PHF_PUBLIC size_t uniq(key_t[], const size_t);
 
+    /* numThreads threads are used to hash the keys and search for
+     * displacements; the function built doesn't depend on it. */
     template <typename key_t, bool nodiv>
-    PHF_PUBLIC phf_error_t init(struct phf *, const key_t[], const size_t, const size_t, const size_t, const phf_seed_t);
+    PHF_PUBLIC phf_error_t init(struct phf *, const key_t[], const size_t, const size_t, const size_t, const phf_seed_t,
+                                const unsigned numThreads = 1);
 
     PHF_PUBLIC void compact(struct phf *);
 
-    template <typename key_t> PHF_PUBLIC phf_hash_t hash(const struct phf *, key_t);
+    template <typename key_t> PHF_PUBLIC phf_hash_t hash(const struct phf *, const key_t &);
 
     PHF_PUBLIC void destroy(struct phf *);
 }
@@ -180,32 +183,32 @@ extern template size_t PHF::uniq<std::string>(std::string[], const size_t);
 #endif
 
 extern template phf_error_t PHF::init<uint32_t, true>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t,
-                                                      const phf_seed_t);
+                                                      const phf_seed_t, const unsigned);
 extern template phf_error_t PHF::init<uint64_t, true>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t,
-                                                      const phf_seed_t);
+                                                      const phf_seed_t, const unsigned);
 extern template phf_error_t PHF::init<phf_string_t, true>(struct phf *, const phf_string_t[], const size_t, const size_t,
-                                                          const size_t, const phf_seed_t);
+                                                          const size_t, const phf_seed_t, const unsigned);
 #if !PHF_NO_LIBCXX
 extern template phf_error_t PHF::init<std::string, true>(struct phf *, const std::string[], const size_t, const size_t,
-                                                         const size_t, const phf_seed_t);
+                                                         const size_t, const phf_seed_t, const unsigned);
 #endif
 
 extern template phf_error_t PHF::init<uint32_t, false>(struct phf *, const uint32_t[], const size_t, const size_t, const size_t,
-                                                       const phf_seed_t);
+                                                       const phf_seed_t, const unsigned);
 extern template phf_error_t PHF::init<uint64_t, false>(struct phf *, const uint64_t[], const size_t, const size_t, const size_t,
-                                                       const phf_seed_t);
+                                                       const phf_seed_t, const unsigned);
 extern template phf_error_t PHF::init<phf_string_t, false>(struct phf *, const phf_string_t[], const size_t, const size_t,
-                                                           const size_t, const phf_seed_t);
+                                                           const size_t, const phf_seed_t, const unsigned);
 #if !PHF_NO_LIBCXX
 extern template phf_error_t PHF::init<std::string, false>(struct phf *, const std::string[], const size_t, const size_t,
-                                                          const size_t, const phf_seed_t);
+                                                          const size_t, const phf_seed_t, const unsigned);
 #endif
 
-extern template phf_hash_t PHF::hash<uint32_t>(const struct phf *, uint32_t);
-extern template phf_hash_t PHF::hash<uint64_t>(const struct phf *, uint64_t);
-extern template phf_hash_t PHF::hash<phf_string_t>(const struct phf *, phf_string_t);
+extern template phf_hash_t PHF::hash<uint32_t>(const struct phf *, const uint32_t &);
+extern template phf_hash_t PHF::hash<uint64_t>(const struct phf *, const uint64_t &);
+extern template phf_hash_t PHF::hash<phf_string_t>(const struct phf *, const phf_string_t &);
 #if !PHF_NO_LIBCXX
-extern template phf_hash_t PHF::hash<std::string>(const struct phf *, std::string);
+extern template phf_hash_t PHF::hash<std::string>(const struct phf *, const std::string &);
 #endif
 
 #endif /* __cplusplus */
@@ -48,7 +48,7 @@ namespace hal {
         }
 
         hal_index_t getEndPosition() const {
-            return _data->_startPosition + _data->_length;
+            return _data->_startPosition + _data->_length - 1;
         }
 
         hal_index_t getArrayIndex() const {
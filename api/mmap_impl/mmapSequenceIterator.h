@@ -25,11 +25,14 @@ namespace hal {
             return (_sequence._data < _genome->getSequenceData(0)) or
                    (_sequence._data >= _genome->getSequenceData(_genome->getNumSequences()));
         }
+        // give the genome's cached sequence rather than the local one, so
+        // that it doesn't expire when the iterator moves and is the same
+        // object as returned by the genome's getSequence methods
         const Sequence *getSequence() const {
-            return &_sequence;
+            return _genome->getSequenceByIndex(_index);
         }
         Sequence *getSequence() {
-            return &_sequence;
+            return _genome->getSequenceByIndex(_index);
         }
         bool equals(SequenceIteratorPtr other) const {
             const MMapSequenceIterator *mmapOther = reinterpret_cast<const MMapSequenceIterator *>(other.get());
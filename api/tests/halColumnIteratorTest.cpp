@@ -456,6 +456,55 @@ struct ColumnIteratorInvTest : public AlignmentTest {
     }
 };
 
+struct ColumnIteratorTreeTest : public ColumnIteratorInvTest {
+    void checkCallBack(AlignmentConstPtr alignment) {
+        validateAlignment(alignment.get());
+        const Genome *son1 = alignment->openGenome("son1");
+        ColumnIteratorPtr colIterator = son1->getSequenceBySite(0)->getColumnIterator();
+        for (size_t colNumber = 0; colNumber < son1->getSequenceLength(); colIterator->toRight(), ++colNumber) {
+            // the column tree is grandpa -> dad -> son1, with the bases
+            // of the column map
+            const ColumnTree *tree = colIterator->getColumnTree();
+            CuAssertTrue(_testCase, tree->getNumNodes() == 3);
+            CuAssertTrue(_testCase, tree->getGenome(0)->getName() == "grandpa");
+            CuAssertTrue(_testCase, tree->getGenome(1)->getName() == "dad");
+            CuAssertTrue(_testCase, tree->getGenome(2)->getName() == "son1");
+            const ColumnIterator::ColumnMap *colMap = colIterator->getColumnMap();
+            for (hal_size_t node = 0; node < tree->getNumNodes(); ++node) {
+                CuAssertTrue(_testCase, tree->getParent(node) == (hal_index_t)node - 1);
+                CuAssertTrue(_testCase, tree->getSubtreeEnd(node) == 3);
+                CuAssertTrue(_testCase, tree->getGenomeByOrdinal(tree->getGenomeOrdinal(node)) == tree->getGenome(node));
+                DnaIteratorPtr dnaIt = *colMap->find(tree->getGenome(node)->getSequenceBySite(0))->second->begin();
+                CuAssertTrue(_testCase, tree->getArrayIndex(node) == dnaIt->getArrayIndex());
+                CuAssertTrue(_testCase, tree->getDnaIterator(node)->getArrayIndex() == dnaIt->getArrayIndex());
+            }
+            // strands relative to son1 (the tree's are relative to the
+            // first base in the column map)
+            CuAssertTrue(_testCase, (tree->getReversed(1) != tree->getReversed(2)) == (colNumber < 20));
+            CuAssertTrue(_testCase, (tree->getReversed(0) != tree->getReversed(2)) == (colNumber < 10));
+
+            // shifting the previous column's tree gives the same tree as
+            // building it from scratch
+            ColumnTree fresh;
+            fresh.update(colMap->begin()->first->getGenome(), (*colMap->begin()->second->begin())->getArrayIndex());
+            CuAssertTrue(_testCase, fresh.getNumNodes() == tree->getNumNodes());
+            for (hal_size_t node = 0; node < tree->getNumNodes(); ++node) {
+                CuAssertTrue(_testCase, fresh.getGenome(node) == tree->getGenome(node));
+                CuAssertTrue(_testCase, fresh.getArrayIndex(node) == tree->getArrayIndex(node));
+                CuAssertTrue(_testCase, fresh.getReversed(node) == tree->getReversed(node));
+                CuAssertTrue(_testCase, fresh.getDnaIterator(node)->getBase() == tree->getDnaIterator(node)->getBase());
+            }
+
+            stTree *stree = colIterator->getTree();
+            CuAssertTrue(_testCase, stTree_getChildNumber(stree) == 1);
+            CuAssertTrue(_testCase, string(stTree_getLabel(stree)) ==
+                                        "grandpa.seq|" + std::to_string(tree->getArrayIndex(0)));
+        }
+        // the tree is only rebuilt when a segment boundary is crossed
+        CuAssertTrue(_testCase, colIterator->getColumnTree()->getNumBuilds() <= 10);
+    }
+};
+
 struct ColumnIteratorGapTest : public AlignmentTest {
     void createCallBack(AlignmentPtr alignment) {
         double branchLength = 1e-10;
@@ -985,6 +1034,11 @@ static void halColumnIteratorInvTest(CuTest *testCase) {
     tester.check(testCase);
 }
 
+static void halColumnIteratorTreeTest(CuTest *testCase) {
+    ColumnIteratorTreeTest tester;
+    tester.check(testCase);
+}
+
 static void halColumnIteratorGapTest(CuTest *testCase) {
     ColumnIteratorGapTest tester;
     tester.check(testCase);
@@ -1011,6 +1065,7 @@ static CuSuite *halColumnIteratorTestSuite(void) {
     SUITE_ADD_TEST(suite, halColumnIteratorDepthTest);
     SUITE_ADD_TEST(suite, halColumnIteratorDupTest);
     SUITE_ADD_TEST(suite, halColumnIteratorInvTest);
+    SUITE_ADD_TEST(suite, halColumnIteratorTreeTest);
     SUITE_ADD_TEST(suite, halColumnIteratorGapTest);
     SUITE_ADD_TEST(suite, halColumnIteratorMultiGapTest);
     SUITE_ADD_TEST(suite, halColumnIteratorMultiGapInvTest);
@@ -7,6 +7,7 @@
 #include "halApiTestSupport.h"
 #include "halAlignment.h"
 #include "halBottomSegmentIterator.h"
+#include "halCachedStats.h"
 #include "halColumnIterator.h"
 #include "halDnaIterator.h"
 #include "halGenome.h"
@@ -45,6 +46,47 @@ struct GenomeMetaTest : public AlignmentTest {
     }
 };
 
+struct GenomeCachedStatsTest : public AlignmentTest {
+    void createCallBack(AlignmentPtr alignment) {
+        Genome *ancGenome = alignment->addRootGenome("AncGenome", 0);
+        Genome *leafGenome = alignment->addLeafGenome("Leaf", "AncGenome", 0.1);
+        vector<Sequence::Info> seqVec(1);
+        seqVec[0] = Sequence::Info("Sequence", 1000, 0, 10);
+        ancGenome->setDimensions(seqVec);
+        seqVec[0] = Sequence::Info("Sequence", 1000, 10, 0);
+        leafGenome->setDimensions(seqVec);
+
+        string value;
+        CuAssertTrue(_testCase, getCachedStat(leafGenome, "local", false, value) == false);
+        setCachedStat(leafGenome, "local", "leaf", false);
+        setCachedStat(ancGenome, "local", "anc", false);
+        setCachedStat(ancGenome, "wide", "all", true);
+        CuAssertTrue(_testCase, getCachedStat(leafGenome, "local", false, value) == true);
+        CuAssertTrue(_testCase, value == "leaf");
+        CuAssertTrue(_testCase, getCachedStat(ancGenome, "wide", true, value) == true);
+        CuAssertTrue(_testCase, value == "all");
+
+        // modifying the leaf invalidates its own statistics and the
+        // alignment-wide ones, but not those local to other genomes
+        invalidateCachedStats(leafGenome);
+        CuAssertTrue(_testCase, getCachedStat(leafGenome, "local", false, value) == false);
+        CuAssertTrue(_testCase, getCachedStat(ancGenome, "wide", true, value) == false);
+        CuAssertTrue(_testCase, getCachedStat(ancGenome, "local", false, value) == true);
+        setCachedStat(leafGenome, "local", "leaf2", false);
+    }
+
+    void checkCallBack(AlignmentConstPtr alignment) {
+        const Genome *ancGenome = alignment->openGenome("AncGenome");
+        const Genome *leafGenome = alignment->openGenome("Leaf");
+        string value;
+        CuAssertTrue(_testCase, getCachedStat(leafGenome, "local", false, value) == true);
+        CuAssertTrue(_testCase, value == "leaf2");
+        CuAssertTrue(_testCase, getCachedStat(ancGenome, "local", false, value) == true);
+        CuAssertTrue(_testCase, value == "anc");
+        CuAssertTrue(_testCase, getCachedStat(ancGenome, "wide", true, value) == false);
+    }
+};
+
 struct GenomeCreateTest : public AlignmentTest {
     std::string _string;
     void createCallBack(AlignmentPtr alignment) {
@@ -541,6 +583,11 @@ static void halGenomeMetaTest(CuTest *testCase) {
     tester.check(testCase);
 }
 
+static void halGenomeCachedStatsTest(CuTest *testCase) {
+    GenomeCachedStatsTest tester;
+    tester.check(testCase);
+}
+
 static void halGenomeCreateTest(CuTest *testCase) {
     GenomeCreateTest tester;
     tester.check(testCase);
@@ -575,6 +622,7 @@ static void halGenomeDNAPackUnpackTest(CuTest *testCase) {
 static CuSuite *halGenomeTestSuite(void) {
     CuSuite *suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, halGenomeMetaTest);
+    SUITE_ADD_TEST(suite, halGenomeCachedStatsTest);
     SUITE_ADD_TEST(suite, halGenomeCreateTest);
     SUITE_ADD_TEST(suite, halGenomeUpdateTest);
     SUITE_ADD_TEST(suite, halGenomeStringTest);
@@ -5,7 +5,10 @@
  * Released under the MIT license, see LICENSE.txt
  */
 #include "halApiTestSupport.h"
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
 #include <string>
 #include "halSequence.h"
 #include "halGenome.h"
@@ -59,6 +62,12 @@ struct SequenceCreateTest : public AlignmentTest {
             CuAssertTrue(_testCase, seq->getNumBottomSegments() == i * 2);
             const Genome *gen = seq->getGenome();
             CuAssertTrue(_testCase, gen->getName() == "AncGenome");
+            // the iterator gives the same object as the genome lookups
+            CuAssertTrue(_testCase, seq == ancGenome->getSequence(name));
+            CuAssertTrue(_testCase, seq == ancGenome->getSequenceBySite(seq->getStartPosition()));
+            // the end position is the last base of the sequence
+            CuAssertTrue(_testCase, seq->getEndPosition() == (hal_index_t)(seq->getStartPosition() + len - 1));
+            CuAssertTrue(_testCase, ancGenome->getSequenceBySite(seq->getEndPosition()) == seq);
 
             numTopSegments += seq->getNumTopSegments();
             numBottomSegments += seq->getNumBottomSegments();
@@ -263,6 +272,87 @@ struct SequenceRenameTest : public AlignmentTest {
     }
 };
 
+// lookups by name and by site, with empty sequences mixed in
+struct SequenceLookupTest : public AlignmentTest {
+    static hal_size_t seqLength(size_t i) {
+        return i % 3 == 1 ? 0 : (i * 7) % 23 + 1;
+    }
+
+    void createCallBack(AlignmentPtr alignment) {
+        Genome *ancGenome = alignment->addRootGenome("AncGenome", 0);
+        vector<Sequence::Info> seqVec;
+        for (size_t i = 0; i < 2000; ++i) {
+            seqVec.push_back(Sequence::Info("scaffold" + std::to_string(i), seqLength(i), 0, 0));
+        }
+        ancGenome->setDimensions(seqVec);
+    }
+
+    void checkCallBack(AlignmentConstPtr alignment) {
+        const Genome *ancGenome = alignment->openGenome("AncGenome");
+        CuAssertTrue(_testCase, ancGenome->getNumSequences() == 2000);
+
+        hal_size_t position = 0;
+        for (SequenceIteratorPtr seqIt = ancGenome->getSequenceIterator(); not seqIt->atEnd(); seqIt->toNext()) {
+            const Sequence *seq = seqIt->getSequence();
+            size_t i = seq->getArrayIndex();
+            CuAssertTrue(_testCase, ancGenome->getSequence("scaffold" + std::to_string(i)) == seq);
+            CuAssertTrue(_testCase, seq->getStartPosition() == position);
+            CuAssertTrue(_testCase, seq->getSequenceLength() == seqLength(i));
+            for (hal_size_t j = 0; j < seq->getSequenceLength(); ++j) {
+                CuAssertTrue(_testCase, ancGenome->getSequenceBySite(position + j) == seq);
+            }
+            position += seq->getSequenceLength();
+        }
+        CuAssertTrue(_testCase, position == ancGenome->getSequenceLength());
+        CuAssertTrue(_testCase, ancGenome->getSequenceBySite(position) == NULL);
+
+        vector<hal_size_t> positions;
+        for (hal_size_t i = 0; i <= position; i += 3) {
+            positions.push_back(i);
+        }
+        vector<const Sequence *> sequences;
+        ancGenome->getSequencesBySite(positions, sequences);
+        CuAssertTrue(_testCase, sequences.size() == positions.size());
+        for (size_t i = 0; i < positions.size(); ++i) {
+            CuAssertTrue(_testCase, sequences[i] == ancGenome->getSequenceBySite(positions[i]));
+        }
+        CuAssertTrue(_testCase, ancGenome->getSequenceBySite(0)->getName() == "scaffold0");
+        CuAssertTrue(_testCase, ancGenome->getSequence("scaffold2000") == NULL);
+        CuAssertTrue(_testCase, ancGenome->getSequence("") == NULL);
+    }
+};
+
+// an mmap site map index pointing past the end of the file is rejected
+struct SequenceCorruptIndexTest : public SequenceLookupTest {
+    void checkCallBack(AlignmentConstPtr alignment) {
+        if (alignment->getStorageFormat() != STORAGE_FORMAT_MMAP) {
+            return;
+        }
+        // the index header starts with its magic and has the nodes offset
+        // as its fifth field
+        fstream halFile(_checkPath.c_str(), ios::in | ios::out | ios::binary);
+        string bytes((istreambuf_iterator<char>(halFile)), istreambuf_iterator<char>());
+        const size_t magic = 0x7865646e4d53472eULL;
+        size_t indexPos = bytes.find(string(reinterpret_cast<const char *>(&magic), sizeof(magic)));
+        CuAssertTrue(_testCase, indexPos != string::npos);
+        size_t nodesOffset;
+        memcpy(&nodesOffset, bytes.data() + indexPos + 4 * sizeof(size_t), sizeof(nodesOffset));
+        nodesOffset += 64 * ((bytes.size() + 63) / 64);
+        halFile.seekp(indexPos + 4 * sizeof(size_t));
+        halFile.write(reinterpret_cast<const char *>(&nodesOffset), sizeof(nodesOffset));
+        halFile.close();
+
+        AlignmentPtr corrupt(getTestAlignmentInstances(STORAGE_FORMAT_MMAP, _checkPath, READ_ACCESS));
+        bool thrown = false;
+        try {
+            corrupt->openGenome("AncGenome");
+        } catch (const hal_exception &e) {
+            thrown = true;
+        }
+        CuAssertTrue(_testCase, thrown);
+    }
+};
+
 static void halSequenceCreateTest(CuTest *testCase) {
     SequenceCreateTest tester;
     tester.check(testCase);
@@ -283,12 +373,24 @@ static void halSequenceRenameTest(CuTest *testCase) {
     tester.check(testCase);
 }
 
+static void halSequenceLookupTest(CuTest *testCase) {
+    SequenceLookupTest tester;
+    tester.check(testCase);
+}
+
+static void halSequenceCorruptIndexTest(CuTest *testCase) {
+    SequenceCorruptIndexTest tester;
+    tester.check(testCase);
+}
+
 static CuSuite *halSequenceTestSuite(void) {
     CuSuite *suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, halSequenceCreateTest);
     SUITE_ADD_TEST(suite, halSequenceIteratorTest);
     SUITE_ADD_TEST(suite, halSequenceUpdateTest);
     SUITE_ADD_TEST(suite, halSequenceRenameTest);
+    SUITE_ADD_TEST(suite, halSequenceLookupTest);
+    SUITE_ADD_TEST(suite, halSequenceCorruptIndexTest);
     return suite;
 }
 
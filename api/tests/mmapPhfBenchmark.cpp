@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+#include "halParallel.h"
+#include "mmapPhf.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace hal;
+
+/*
+ * Benchmark of building the perfect hash functions used for the sequence
+ * names of mmap genomes, and of looking names up in them.  The names look
+ * like the unplaced contigs of a large assembly.
+ *
+ *   mmapPhfBenchmark [numThreads [numKeys ...]]
+ *
+ * A numThreads of 0 uses all hardware threads.  The default key counts are
+ * 1M, 3M and 10M.
+ */
+
+static const size_t DEFAULT_NUM_KEYS[] = {1000000, 3000000, 10000000};
+static const size_t NUM_LOOKUPS = 10000000;
+
+static double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+static vector<string> makeKeys(size_t numKeys) {
+    vector<string> keys(numKeys);
+    for (size_t i = 0; i < numKeys; ++i) {
+        keys[i] = "JAKXYZ" + to_string(10000000 + i) + ".1";
+    }
+    return keys;
+}
+
+static void benchmark(size_t numKeys, unsigned numThreads) {
+    vector<string> keys = makeKeys(numKeys);
+
+    struct phf phf;
+    memset(&phf, 0, sizeof(phf));
+    auto start = chrono::steady_clock::now();
+    phf_error_t err = PHF::init<string, true>(&phf, keys.data(), keys.size(), 1, 80, 0, numThreads);
+    if (err != 0) {
+        throw hal_exception("can't create perfect hash function: " + string(strerror(err)));
+    }
+    PHF::compact(&phf);
+    double buildTime = secondsSince(start);
+
+    // check that the function is perfect, which also fills in the table
+    vector<hal_index_t> table(phf.m, NULL_INDEX);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        hal_index_t &slot = table[PHF::hash(&phf, keys[i])];
+        if (slot != NULL_INDEX) {
+            throw hal_exception("perfect hash collision between " + keys[slot] + " and " + keys[i]);
+        }
+        slot = i;
+    }
+
+    // look up random names, the way getSequence() does
+    mt19937_64 rng(numKeys);
+    vector<size_t> lookups(NUM_LOOKUPS);
+    for (size_t &lookup : lookups) {
+        lookup = rng() % numKeys;
+    }
+    start = chrono::steady_clock::now();
+    size_t numFound = 0;
+    for (size_t lookup : lookups) {
+        numFound += (table[PHF::hash(&phf, keys[lookup])] == (hal_index_t)lookup);
+    }
+    double lookupTime = secondsSince(start);
+    if (numFound != lookups.size()) {
+        throw hal_exception("perfect hash lookup failed");
+    }
+
+    cout << numKeys << "\tbuild " << buildTime << "s\tlookups " << (lookups.size() / lookupTime / 1e6) << "M/s\tr " << phf.r
+         << "\tm " << phf.m << "\td_max " << phf.d_max << endl;
+    PHF::destroy(&phf);
+}
+
+int main(int argc, char **argv) {
+    unsigned numThreads = (argc > 1) ? strtoul(argv[1], NULL, 10) : 0;
+    if (numThreads == 0) {
+        numThreads = max(thread::hardware_concurrency(), 1u);
+    }
+    vector<size_t> numKeysList;
+    for (int i = 2; i < argc; ++i) {
+        numKeysList.push_back(strtoul(argv[i], NULL, 10));
+    }
+    if (numKeysList.empty()) {
+        numKeysList.assign(DEFAULT_NUM_KEYS, DEFAULT_NUM_KEYS + sizeof(DEFAULT_NUM_KEYS) / sizeof(DEFAULT_NUM_KEYS[0]));
+    }
+    try {
+        cout << "threads " << numThreads << endl;
+        for (size_t numKeys : numKeysList) {
+            benchmark(numKeys, numThreads);
+        }
+    } catch (const exception &ex) {
+        cerr << ex.what() << endl;
+        return 1;
+    }
+    return 0;
+}
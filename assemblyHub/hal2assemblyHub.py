@@ -128,19 +128,22 @@ class GetBasicFiles( Job ):
             getChromSizesFromHal(self.halfile, self.genome, os.path.join(genomedir, "chrom.sizes"))
 
     def makeTwoBitSeqFile(self, outdir):
+        twobitfile = os.path.join(outdir, "%s.2bit" %self.genome)
+        if not self.options.ucscNames:
+            #no renaming needed, so convert straight from the hal file
+            system("hal2twobit %s %s %s" %(self.halfile, self.genome, twobitfile))
+            return
+
         fafile = os.path.join(outdir, "%s.fa" %self.genome)
         system("hal2fasta --outFaPath %s %s %s" %(fafile, self.halfile, self.genome))
-        fafile2 = fafile
-        if self.options.ucscNames:
-            #if sequence headers have "." (e.g genome.chr), reformat
-            #the header to only have "chr"
-            fafile2 = "%s2" %fafile
-            cmd = "awk '{ if($0 ~/>/){split($1, arr, \".\"); if(length(arr) > 1 ){print \">\" arr[2]}else{print $0} }else{ print $0} }' %s > %s" %(fafile, fafile2)
-            system(cmd)
-            system("rm %s" %fafile)
+        #if sequence headers have "." (e.g genome.chr), reformat
+        #the header to only have "chr"
+        fafile2 = "%s2" %fafile
+        cmd = "awk '{ if($0 ~/>/){split($1, arr, \".\"); if(length(arr) > 1 ){print \">\" arr[2]}else{print $0} }else{ print $0} }' %s > %s" %(fafile, fafile2)
+        system(cmd)
+        system("rm %s" %fafile)
 
         #convert to 2bit files
-        twobitfile = os.path.join(outdir, "%s.2bit" %self.genome)
         system("faToTwoBit %s %s" %(fafile2, twobitfile))
         system("rm %s" %fafile2)
 
@@ -9,7 +9,7 @@ Requires jobTree, sonLib, and bedtools.
 import os
 from argparse import ArgumentParser
 
-from sonLib.bioio import system, popenCatch, getTempFile
+from sonLib.bioio import system, popenCatch
 from toil.job import Job
 from toil.common import Toil
 from functools import reduce
@@ -113,11 +113,8 @@ def writeSequenceData(target, genome, hal, hubDir):
     """Write the .2bit and chrom.sizes for a genome."""
     if not os.path.isdir(os.path.join(hubDir, genome)):
         os.makedirs(os.path.join(hubDir, genome))
-    fasta = getTempFile()
-    system("hal2fasta %s %s > %s" % (hal, genome, fasta))
-    system("faToTwoBit %s %s" % (fasta, os.path.join(hubDir, genome, genome + '.2bit')))
+    system("hal2twobit %s %s %s" % (hal, genome, os.path.join(hubDir, genome, genome + '.2bit')))
     system("twoBitInfo %s %s" % (os.path.join(hubDir, genome, genome + '.2bit'), os.path.join(hubDir, genome, 'chrom.sizes')))
-    os.remove(fasta)
 
 def linkHals(hubDir, hals):
     """Symlink the hals to the hub directory."""
@@ -71,6 +71,8 @@ def getLod(options, localHalfile, outdir):
         options.lodOpts += '--minCovFrac %f ' % options.lodMinCovFrac
     if options.lodChunk is not None:
         options.lodOpts += '--chunk %d ' % options.lodChunk
+    if options.lodSinglePass is True:
+        options.lodOpts += '--singlePass '
     if options.maxCores and int(options.maxCores) > 1 and (options.lod or len(options.lodOpts) > 0):
         options.lodOpts += '--numProc %d ' % int(options.maxCores)
     if len(options.lodOpts) > 0:
@@ -108,6 +110,7 @@ def addLodOptions(parser):
     group.add_argument('--lodMinSeqFrac', dest='lodMinSeqFrac', type=float, help='Minumum sequence length to sample as fraction of step size for level of detail generation: ie sequences with length <= floor(minSeqFrac * step) are ignored (see halLodExtract --help for default value).', default=None)
     group.add_argument('--lodMinCovFrac', dest='lodMinCovFrac', type=float, help='Minimum fraction of a genome that must be covered by sequences that exceed --minSeqFrac * step.  LODs that would violate this threshold will not be generated (or displayed in  the browser).  This is seen a better than the alternative, which is to produce unreasonably sparse LODs because half the sequences were not sampled (see halLodInterpolate.py --help for default value).', default=None)
     group.add_argument('--lodChunk', dest='lodChunk', type=int, help='HDF5 chunk size for generated levels of detail (see halLodExtract --help for default value).', default=None)
+    group.add_argument('--lodSinglePass', dest='lodSinglePass', action='store_true', help='Generate all levels of detail with a single halLodExtract run, each level being interpolated from the previous one instead of from the input hal file (see halLodInterpolate.py --singlePass).', default=False)
     #group.add_argument('--snpwidth', dest='snpwidth', type=int, default=5000, help='Maximum window size to display SNPs. ')
     group = parser.add_argument_group(group)
 
@@ -50,6 +50,7 @@ using namespace hal;
 typedef map<int, pair<string, LodManagerPtr>> HandleMap;
 static HandleMap handleMap;
 
+static int findHandle(char *inputPath);
 static int openLodOrHal(char *inputPath, bool isLod, char **errStr);
 static void checkHandle(int handle);
 static void checkGenomes(int halHandle, AlignmentConstPtr alignment, const string &qSpecies, const string &tSpecies,
@@ -92,8 +93,12 @@ static bool isHalFile(char *lodFilePath) {
 extern "C" int halOpenHalOrLod(char *lodFilePath, char **errStr) {
     halLock();
     try {
-        bool isHal = isHalFile(lodFilePath);
-        int handle = openLodOrHal(lodFilePath, !isHal, errStr);
+        // reopening a path just returns its handle, without reading it again
+        int handle = findHandle(lodFilePath);
+        if (handle < 0) {
+            bool isHal = isHalFile(lodFilePath);
+            handle = openLodOrHal(lodFilePath, !isHal, errStr);
+        }
         halUnlock();
         return handle;
     } catch (...) {
@@ -120,12 +125,20 @@ extern "C" int halOpen(char *halFilePath, char **errStr) {
     }
 }
 
-static int findOrAllocHandle(char *inputPath) {
+static int findHandle(char *inputPath) {
     for (HandleMap::iterator mapIt = handleMap.begin(); mapIt != handleMap.end(); ++mapIt) {
         if (mapIt->second.first == string(inputPath)) {
             return mapIt->first;
         }
     }
+    return -1;
+}
+
+static int findOrAllocHandle(char *inputPath) {
+    int handle = findHandle(inputPath);
+    if (handle >= 0) {
+        return handle;
+    }
     HandleMap::reverse_iterator mapIt = handleMap.rbegin();
     if (mapIt == handleMap.rend()) {
         return 0;
@@ -136,6 +149,9 @@ static int findOrAllocHandle(char *inputPath) {
 
 static int openLodOrHal(char *inputPath, bool isLod, char **errStr) {
     int handle = findOrAllocHandle(inputPath);
+    if (handleMap.find(handle) != handleMap.end()) {
+        return handle;
+    }
     try {
         LodManagerPtr lodManager(new LodManager());
         if (isLod == true) {
@@ -679,6 +695,48 @@ extern "C" hal_int_t halGetMaxLODQueryLength(int halHandle, char **errStr) {
     return ret;
 }
 
+extern "C" struct hal_lod_level_t *halGetLODLevels(int halHandle, char **errStr) {
+    halLock();
+    hal_lod_level_t *head = NULL;
+    try {
+        HandleMap::iterator mapIt = handleMap.find(halHandle);
+        if (mapIt == handleMap.end()) {
+            halUnlock();
+            handleError("halGetLODLevels: handle " + std::to_string(halHandle) + ": not found", errStr);
+            return NULL;
+        }
+        vector<LodManager::LevelInfo> levels = mapIt->second.second->getLevelInfo();
+        hal_lod_level_t *prev = NULL;
+        for (size_t i = 0; i < levels.size(); ++i) {
+            hal_lod_level_t *cur = (hal_lod_level_t *)calloc(1, sizeof(hal_lod_level_t));
+            cur->next = NULL;
+            cur->minQueryLength = (hal_int_t)levels[i]._minQueryLength;
+            cur->path = copyCString(levels[i]._path);
+            cur->opened = levels[i]._opened ? 1 : 0;
+            cur->shared = levels[i]._shared ? 1 : 0;
+            cur->openSeconds = levels[i]._openSeconds;
+            if (head == NULL) {
+                head = cur;
+            } else {
+                prev->next = cur;
+            }
+            prev = cur;
+        }
+    } catch (exception &e) {
+        halUnlock();
+        halFreeLODLevels(head);
+        handleError("halGetLODLevels: " + string(e.what()), errStr);
+        return NULL;
+    } catch (...) {
+        halUnlock();
+        halFreeLODLevels(head);
+        handleError("halGetLODLevels: unknown exception", errStr);
+        return NULL;
+    }
+    halUnlock();
+    return head;
+}
+
 static void checkHandle(int handle) {
     HandleMap::iterator mapIt = handleMap.find(handle);
     if (mapIt == handleMap.end()) {
@@ -1139,6 +1197,15 @@ extern "C" void halFreeMetadataList(struct hal_metadata_t *metadata) {
     }
 }
 
+extern "C" void halFreeLODLevels(struct hal_lod_level_t *levels) {
+    while (levels != NULL) {
+        struct hal_lod_level_t *next = levels->next;
+        free(levels->path);
+        free(levels);
+        levels = next;
+    }
+}
+
 extern "C" void halFreeChromList(struct hal_chromosome_t *chroms) {
     while (chroms != NULL) {
         free(chroms->name);
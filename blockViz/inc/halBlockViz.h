@@ -76,6 +76,16 @@ struct hal_chromosome_t {
     hal_int_t length;
 };
 
+/** Open statistics of a level of detail of a handle */
+struct hal_lod_level_t {
+    struct hal_lod_level_t *next;
+    hal_int_t minQueryLength;
+    char *path;
+    int opened; // the level's HAL file was opened by a query
+    int shared; // the file was already open through another handle
+    double openSeconds;
+};
+
 /** Represents genome or alignment metadata as a linked list. */
 struct hal_metadata_t {
     struct hal_metadata_t *next;
@@ -318,6 +328,19 @@ char *halGetDna(int halHandle, char *speciesName, char *chromName, hal_int_t sta
  *         In the event of an error, -1 will be returned. */
 hal_int_t halGetMaxLODQueryLength(int halHandle, char **errStr);
 
+/** Get the levels of detail of a handle, by increasing minimum query
+ * length, with whether and how quickly their HAL files were opened.  Files
+ * are only opened by the first query that needs them.
+ * @param  halHandle handle for the HAL LOD.txt obtained from halOpen or halOpenHalOrLod
+ * @param errStr pointer to a string that contains an error message on
+ * failure. If NULL, throws an exception on failure instead.
+ * @return linked list of levels -- must be freed by client with
+ *         halFreeLODLevels. NULL on failure. */
+struct hal_lod_level_t *halGetLODLevels(int halHandle, char **errStr);
+
+/** Free a linked list of level of detail info. */
+void halFreeLODLevels(struct hal_lod_level_t *levels);
+
 /** Get the metadata for the genome as a linked list instead of a hash.
     Returns NULL if there isn't any metadata for this genome. */
 struct hal_metadata_t *halGetGenomeMetadata(int halHandle, const char *genomeName, char **errStr);
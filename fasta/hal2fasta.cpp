@@ -7,22 +7,45 @@
 
 #include "hal.h"
 #include "halCLParser.h"
+#include "halParallel.h"
 #include <algorithm>
+#include <cassert>
+#include <cctype>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <zlib.h>
 
 using namespace std;
 using namespace hal;
 
-static void printSequenceLine(ostream &outStream, const Sequence *sequence, hal_size_t start, hal_size_t length,
-                              string &buffer, bool upper);
-static void printSequence(ostream &outStream, const Sequence *sequence, hal_size_t lineWidth, hal_size_t start,
-                          hal_size_t length, bool fullNames, bool upper);
-static void printGenome(ostream &outStream, const Genome *genome, const Sequence *sequence, hal_size_t lineWidth,
-                        hal_size_t start, hal_size_t length, bool fullNames, bool upper);
+/* A piece of the output, written by one task: the header of a sequence if
+ * this is its first piece, then length bases of a genome from absolute
+ * position start, which falls on a line boundary of the sequence. */
+struct FastaChunk {
+    size_t _genomeIdx;
+    hal_index_t _start;
+    hal_size_t _length;
+    string _header;
+};
 
-static const hal_size_t StringBufferSize = 1024;
+static void addGenomeChunks(vector<FastaChunk> &chunks, size_t genomeIdx, const Genome *genome, const Sequence *sequence,
+                            hal_size_t lineWidth, hal_size_t start, hal_size_t length, bool fullNames);
+static void writeChunk(const Genome *genome, const FastaChunk &chunk, hal_size_t lineWidth, const char *unpackMap,
+                       vector<uint8_t> &codes, string &outBuffer);
+static void bgzfCompress(z_stream &zs, const string &text, string &outBuffer);
+
+// bases per chunk, rounded down to whole lines
+static const hal_size_t ChunkBases = 1 << 22;
+
+// uncompressed bytes per BGZF block, as used by bgzip
+static const size_t BgzfBlockSize = 0xff00;
+
+static const char BgzfEofBlock[28] = {'\x1f', '\x8b', '\x08', '\x04', '\x00', '\x00', '\x00', '\x00', '\x00', '\xff',
+                                      '\x06', '\x00', '\x42', '\x43', '\x02', '\x00', '\x1b', '\x00', '\x03', '\x00',
+                                      '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00'};
 
 static void initParser(CLParser &optionsParser) {
     optionsParser.addArgument("inHalPath", "input hal file");
@@ -44,6 +67,12 @@ static void initParser(CLParser &optionsParser) {
                             0);
     optionsParser.addOptionFlag("subtree", "Export all sequences in subtree rooted at <genome>", false);
     optionsParser.addOptionFlag("upper", "Convert all bases to uppercase", false);
+    optionsParser.addOptionFlag("bgzip", "Compress the output with BGZF blocks, as bgzip does, so that it can be "
+                                         "indexed with samtools faidx",
+                                false);
+    optionsParser.addOption("numThreads", "number of threads exporting sequences (0 to use all cores).  "
+                                          "Only mmap HAL files can be read by more than one thread",
+                            1);
     optionsParser.setDescription("Export sequences of genome or subtree of genomes from hal database to "
                                  "fasta file.");
 }
@@ -62,6 +91,8 @@ int main(int argc, char **argv) {
     hal_size_t length;
     bool subtree;
     bool upper;
+    bool bgzip;
+    unsigned numThreads;
     try {
         optionsParser.parseOptions(argc, argv);
         halPath = optionsParser.getArgument<string>("inHalPath");
@@ -74,7 +105,12 @@ int main(int argc, char **argv) {
         length = optionsParser.getOption<hal_size_t>("length");
         subtree = optionsParser.getFlag("subtree");
         upper = optionsParser.getFlag("upper");
+        bgzip = optionsParser.getFlag("bgzip");
+        numThreads = optionsParser.getOption<unsigned>("numThreads");
 
+        if (lineWidth == 0) {
+            throw hal_exception("--lineWidth must be greater than 0");
+        }
         if (subtree) {
             if (start != 0) {
                 throw hal_exception("--start cannot be used with --subtree");
@@ -95,16 +131,20 @@ int main(int argc, char **argv) {
         if (alignment->getNumGenomes() == 0) {
             throw hal_exception("input hal alignmenet is empty");
         }
+        numThreads = getReadThreadCount(halPath, &optionsParser, numThreads);
 
         ofstream ofile;
         ostream &outStream = faPath == "stdout" ? cout : ofile;
         if (faPath != "stdout") {
-            ofile.open(faPath.c_str());
+            ofile.open(faPath.c_str(), ios::binary);
             if (!ofile) {
                 throw hal_exception(string("Error opening output file ") + faPath);
             }
         }
 
+        // list the output up front, so that it can be written in parallel
+        vector<string> genomeNames;
+        vector<FastaChunk> chunks;
         deque<string> bfsQueue = {genomeName};
 
         while (!bfsQueue.empty()) {
@@ -125,7 +165,8 @@ int main(int argc, char **argv) {
                 }
             }
 
-            printGenome(outStream, genome, sequence, lineWidth, start, length, fullNames, upper);
+            addGenomeChunks(chunks, genomeNames.size(), genome, sequence, lineWidth, start, length, fullNames);
+            genomeNames.push_back(curName);
 
             if (subtree) {
                 vector<string> childs = alignment->getChildNames(curName);
@@ -137,6 +178,61 @@ int main(int argc, char **argv) {
             alignment->closeGenome(genome);
         }
 
+        char unpackMap[16];
+        for (int code = 0; code < 16; ++code) {
+            unpackMap[code] = upper ? std::toupper(dnaUnpackMap[code]) : dnaUnpackMap[code];
+        }
+
+        // each thread keeps the genome of its last chunk open
+        ThreadAlignments threadAlignments(alignment, halPath, &optionsParser, numThreads);
+        vector<size_t> openGenomeIdxs(numThreads, genomeNames.size());
+        vector<const Genome *> openGenomes(numThreads, NULL);
+        vector<vector<uint8_t>> codeBuffers(numThreads);
+        vector<string> textBuffers(numThreads), zipBuffers(numThreads);
+        vector<z_stream> zStreams(numThreads);
+        if (bgzip) {
+            for (unsigned threadIdx = 0; threadIdx < numThreads; ++threadIdx) {
+                z_stream &zs = zStreams[threadIdx];
+                zs.zalloc = Z_NULL;
+                zs.zfree = Z_NULL;
+                zs.opaque = Z_NULL;
+                if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                    throw hal_exception("Error initializing zlib");
+                }
+            }
+        }
+
+        OrderedOutput output(outStream, chunks.size());
+        parallelFor(chunks.size(), numThreads, [&](size_t chunkIdx, unsigned threadIdx) {
+            const FastaChunk &chunk = chunks[chunkIdx];
+            AlignmentConstPtr threadAlignment = threadAlignments.get(threadIdx);
+            if (openGenomeIdxs[threadIdx] != chunk._genomeIdx) {
+                if (openGenomes[threadIdx] != NULL) {
+                    threadAlignment->closeGenome(openGenomes[threadIdx]);
+                }
+                openGenomes[threadIdx] = threadAlignment->openGenome(genomeNames[chunk._genomeIdx]);
+                openGenomeIdxs[threadIdx] = chunk._genomeIdx;
+            }
+            string &textBuffer = textBuffers[threadIdx];
+            writeChunk(openGenomes[threadIdx], chunk, lineWidth, unpackMap, codeBuffers[threadIdx], textBuffer);
+            if (bgzip) {
+                bgzfCompress(zStreams[threadIdx], textBuffer, zipBuffers[threadIdx]);
+                output.commit(chunkIdx, zipBuffers[threadIdx]);
+            } else {
+                output.commit(chunkIdx, textBuffer);
+            }
+        });
+
+        if (bgzip) {
+            for (unsigned threadIdx = 0; threadIdx < numThreads; ++threadIdx) {
+                deflateEnd(&zStreams[threadIdx]);
+            }
+            outStream.write(BgzfEofBlock, sizeof(BgzfEofBlock));
+        }
+        outStream.flush();
+        if (!outStream) {
+            throw hal_exception("Error writing " + faPath);
+        }
     } catch (hal_exception &e) {
         cerr << "hal exception caught: " << e.what() << endl;
         return 1;
@@ -148,22 +244,10 @@ int main(int argc, char **argv) {
     return 0;
 }
 
-void printSequenceLine(ostream &outStream, const Sequence *sequence, hal_size_t start, hal_size_t length, string &buffer, bool upper) {
-    hal_size_t last = start + length;
-    hal_size_t readLen;
-    for (hal_size_t i = start; i < last; i += StringBufferSize) {
-        readLen = std::min(StringBufferSize, last - i);
-        sequence->getSubString(buffer, i, readLen);
-        if (upper) {
-            for (int j = 0; j < buffer.size(); ++j) {
-                buffer[j] = std::toupper(buffer[j]);
-            }
-        }
-        outStream << buffer;
-    }
-}
-
-void printSequence(ostream &outStream, const Sequence *sequence, hal_size_t lineWidth, hal_size_t start, hal_size_t length, bool fullNames, bool upper) {
+/* Split length bases of a sequence from start (the whole sequence from
+ * start if length is 0) into chunks of whole lines */
+static void addSequenceChunks(vector<FastaChunk> &chunks, size_t genomeIdx, const Sequence *sequence, hal_size_t lineWidth,
+                              hal_size_t start, hal_size_t length, bool fullNames) {
     hal_size_t seqLen = sequence->getSequenceLength();
     if (length == 0) {
         length = seqLen - start;
@@ -174,20 +258,27 @@ void printSequence(ostream &outStream, const Sequence *sequence, hal_size_t line
                             "out of range for sequence " + sequence->getName() + ", which has length " +
                             std::to_string(seqLen));
     }
-    outStream << '>' << (fullNames ? sequence->getFullName() : sequence->getName()) << '\n';
-    hal_size_t readLen;
-    string buffer;
-    for (hal_size_t i = start; i < last; i += lineWidth) {
-        readLen = std::min(lineWidth, last - i);
-        printSequenceLine(outStream, sequence, i, readLen, buffer, upper);
-        outStream << '\n';
-    }
+    hal_size_t chunkLen = std::max(ChunkBases / lineWidth, (hal_size_t)1) * lineWidth;
+    hal_size_t i = start;
+    do {
+        FastaChunk chunk;
+        chunk._genomeIdx = genomeIdx;
+        chunk._start = sequence->getStartPosition() + i;
+        // start can be past last when addGenomeChunks wraps the range
+        // around, which leaves only the header
+        chunk._length = i < last ? std::min(chunkLen, last - i) : 0;
+        if (i == start) {
+            chunk._header = '>' + (fullNames ? sequence->getFullName() : sequence->getName()) + '\n';
+        }
+        chunks.push_back(chunk);
+        i += chunk._length;
+    } while (i < last);
 }
 
-void printGenome(ostream &outStream, const Genome *genome, const Sequence *sequence, hal_size_t lineWidth, hal_size_t start,
-                 hal_size_t length, bool fullNames, bool upper) {
+static void addGenomeChunks(vector<FastaChunk> &chunks, size_t genomeIdx, const Genome *genome, const Sequence *sequence,
+                            hal_size_t lineWidth, hal_size_t start, hal_size_t length, bool fullNames) {
     if (sequence != NULL) {
-        printSequence(outStream, sequence, lineWidth, start, length, fullNames, upper);
+        addSequenceChunks(chunks, genomeIdx, sequence, lineWidth, start, length, fullNames);
     } else {
         if (start + length > genome->getSequenceLength()) {
             throw hal_exception("Specified range [" + std::to_string(start) + "," + std::to_string(length) + "] is" +
@@ -208,9 +299,73 @@ void printGenome(ostream &outStream, const Genome *genome, const Sequence *seque
                 hal_size_t readStart = seqStart >= start ? 0 : seqStart - start;
                 hal_size_t readLen = std::min(seqLen - start, length - runningLength);
 
-                printSequence(outStream, sequence, lineWidth, readStart, readLen, fullNames, upper);
+                addSequenceChunks(chunks, genomeIdx, sequence, lineWidth, readStart, readLen, fullNames);
                 runningLength += readLen;
             }
         }
     }
 }
+
+/* Decode the bases of a chunk a buffer at a time, writing whole lines */
+static void writeChunk(const Genome *genome, const FastaChunk &chunk, hal_size_t lineWidth, const char *unpackMap,
+                       vector<uint8_t> &codes, string &outBuffer) {
+    outBuffer = chunk._header;
+    if (chunk._length == 0) {
+        return;
+    }
+    DnaIteratorPtr dnaIt = genome->getDnaIterator(chunk._start);
+    dnaIt->readCodes(codes, chunk._length);
+    hal_size_t numLines = (chunk._length + lineWidth - 1) / lineWidth;
+    size_t pos = outBuffer.size();
+    outBuffer.resize(pos + chunk._length + numLines);
+    char *out = &outBuffer[pos];
+    for (hal_size_t i = 0; i < chunk._length; i += lineWidth) {
+        hal_size_t lineEnd = std::min(i + lineWidth, chunk._length);
+        for (hal_size_t j = i; j < lineEnd; ++j) {
+            *out++ = unpackMap[codes[j]];
+        }
+        *out++ = '\n';
+    }
+}
+
+/* Compress text as a series of BGZF blocks: gzip members of at most 64kb
+ * with the block size in a "BC" extra field, which can be decompressed
+ * independently, so that chunks compressed by different threads can be
+ * concatenated */
+static void bgzfCompress(z_stream &zs, const string &text, string &outBuffer) {
+    static const size_t headerSize = 18;
+    static const size_t footerSize = 8;
+    outBuffer.clear();
+    for (size_t pos = 0; pos < text.size(); pos += BgzfBlockSize) {
+        size_t inSize = std::min(BgzfBlockSize, text.size() - pos);
+        size_t blockStart = outBuffer.size();
+        outBuffer.resize(blockStart + headerSize + deflateBound(&zs, inSize) + footerSize);
+        unsigned char *block = reinterpret_cast<unsigned char *>(&outBuffer[blockStart]);
+
+        if (deflateReset(&zs) != Z_OK) {
+            throw hal_exception("Error resetting zlib");
+        }
+        zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(text.data() + pos));
+        zs.avail_in = inSize;
+        zs.next_out = block + headerSize;
+        zs.avail_out = outBuffer.size() - blockStart - headerSize - footerSize;
+        if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+            throw hal_exception("Error compressing output");
+        }
+        size_t blockSize = headerSize + zs.total_out + footerSize;
+        assert(blockSize <= 0x10000);
+
+        static const unsigned char header[headerSize - 2] = {0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00,
+                                                             0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00};
+        memcpy(block, header, sizeof(header));
+        block[16] = (blockSize - 1) & 0xff;
+        block[17] = (blockSize - 1) >> 8;
+        uint32_t crc = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(text.data() + pos), inSize);
+        unsigned char *footer = block + headerSize + zs.total_out;
+        for (int i = 0; i < 4; ++i) {
+            footer[i] = (crc >> (8 * i)) & 0xff;
+            footer[4 + i] = (inSize >> (8 * i)) & 0xff;
+        }
+        outBuffer.resize(blockStart + blockSize);
+    }
+}
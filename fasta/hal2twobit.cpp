@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "hal.h"
+#include "halCLParser.h"
+#include "halParallel.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+using namespace std;
+using namespace hal;
+
+/* Runs of bases, as the start and size arrays of a 2bit sequence record.
+ * Adjacent runs are merged as they are added, so runs found in
+ * consecutive chunks of a sequence join up. */
+struct TwoBitBlocks {
+    vector<uint32_t> _starts;
+    vector<uint32_t> _sizes;
+
+    void add(hal_size_t start, hal_size_t size) {
+        if (!_starts.empty() && _starts.back() + _sizes.back() == start) {
+            _sizes.back() += size;
+        } else {
+            _starts.push_back(start);
+            _sizes.push_back(size);
+        }
+    }
+    void append(const TwoBitBlocks &other) {
+        for (size_t i = 0; i < other._starts.size(); ++i) {
+            add(other._starts[i], other._sizes[i]);
+        }
+    }
+};
+
+struct TwoBitRecord {
+    string _name;
+    hal_index_t _genomeStart;
+    hal_size_t _length;
+    TwoBitBlocks _nBlocks;
+    TwoBitBlocks _maskBlocks;
+};
+
+/* length bases of a sequence starting at offset start within it.  start
+ * is a multiple of 4 so that each chunk packs into whole bytes. */
+struct TwoBitChunk {
+    size_t _recordIdx;
+    hal_size_t _start;
+    hal_size_t _length;
+};
+
+static void scanBlocks(const uint8_t *codes, hal_size_t length, hal_size_t offset, TwoBitBlocks &nBlocks,
+                       TwoBitBlocks &maskBlocks);
+static void packTwoBit(const uint8_t *codes, hal_size_t length, char *out);
+static void writeRecordHeader(const TwoBitRecord &record, string &outBuffer);
+static hal_size_t recordSize(const TwoBitRecord &record);
+
+static const uint32_t TwoBitSignature = 0x1A412743;
+
+// default bases per chunk, a multiple of 4
+static const hal_size_t DefaultChunkBases = 1 << 22;
+
+static void initParser(CLParser &optionsParser) {
+    optionsParser.addArgument("inHalPath", "input hal file");
+    optionsParser.addArgument("genome", "genome to export");
+    optionsParser.addArgument("out2bitPath", "output 2bit file");
+    optionsParser.addOptionFlag("noMask", "Don't record soft-masked (lower case) bases", false);
+    optionsParser.addOption("numThreads", "number of threads exporting sequences (0 to use all cores).  "
+                                          "Only mmap HAL files can be read by more than one thread",
+                            1);
+    optionsParser.addOption("chunkBases", "number of bases exported by a thread at a time, a multiple of 4.  "
+                                          "Mostly useful for testing",
+                            DefaultChunkBases);
+    optionsParser.setDescription("Export the sequences of a genome from hal database to a UCSC 2bit file, "
+                                 "as faToTwoBit would from the output of hal2fasta.");
+}
+
+int main(int argc, char **argv) {
+    CLParser optionsParser;
+    initParser(optionsParser);
+
+    string halPath;
+    string genomeName;
+    string twoBitPath;
+    bool noMask;
+    unsigned numThreads;
+    hal_size_t chunkBases;
+    try {
+        optionsParser.parseOptions(argc, argv);
+        halPath = optionsParser.getArgument<string>("inHalPath");
+        genomeName = optionsParser.getArgument<string>("genome");
+        twoBitPath = optionsParser.getArgument<string>("out2bitPath");
+        noMask = optionsParser.getFlag("noMask");
+        numThreads = optionsParser.getOption<unsigned>("numThreads");
+        chunkBases = optionsParser.getOption<hal_size_t>("chunkBases");
+        if (chunkBases == 0 || chunkBases % 4 != 0) {
+            throw hal_exception("--chunkBases must be a positive multiple of 4");
+        }
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        optionsParser.printUsage(cerr);
+        exit(1);
+    }
+
+    try {
+        AlignmentConstPtr alignment(openHalAlignment(halPath, &optionsParser));
+        numThreads = getReadThreadCount(halPath, &optionsParser, numThreads);
+        const Genome *genome = alignment->openGenome(genomeName);
+        if (genome == NULL) {
+            throw hal_exception(string("Genome ") + genomeName + " not found");
+        }
+
+        vector<TwoBitRecord> records;
+        vector<TwoBitChunk> chunks;
+        for (SequenceIteratorPtr seqIt = genome->getSequenceIterator(); not seqIt->atEnd(); seqIt->toNext()) {
+            const Sequence *sequence = seqIt->getSequence();
+            TwoBitRecord record;
+            record._name = sequence->getName();
+            record._genomeStart = sequence->getStartPosition();
+            record._length = sequence->getSequenceLength();
+            if (record._name.size() > numeric_limits<uint8_t>::max()) {
+                throw hal_exception("Sequence name " + record._name + " is too long for a 2bit file");
+            }
+            if (record._length > numeric_limits<uint32_t>::max()) {
+                throw hal_exception("Sequence " + record._name + " is too long for a 2bit file");
+            }
+            // empty sequences get an empty chunk to write their header
+            hal_size_t start = 0;
+            do {
+                chunks.push_back({records.size(), start, std::min(chunkBases, record._length - start)});
+                start += chunkBases;
+            } while (start < record._length);
+            records.push_back(record);
+        }
+
+        ThreadAlignments threadAlignments(alignment, halPath, &optionsParser, numThreads);
+        vector<const Genome *> threadGenomes(numThreads, NULL);
+        threadGenomes[0] = genome;
+        vector<vector<uint8_t>> codeBuffers(numThreads);
+        auto readChunk = [&](const TwoBitChunk &chunk, unsigned threadIdx) -> const vector<uint8_t> & {
+            if (threadGenomes[threadIdx] == NULL) {
+                threadGenomes[threadIdx] = threadAlignments.get(threadIdx)->openGenome(genomeName);
+            }
+            DnaIteratorPtr dnaIt = threadGenomes[threadIdx]->getDnaIterator(records[chunk._recordIdx]._genomeStart + chunk._start);
+            dnaIt->readCodes(codeBuffers[threadIdx], chunk._length);
+            return codeBuffers[threadIdx];
+        };
+
+        // the record sizes, and so the file offsets, depend on the N and
+        // mask blocks, so these are found in a first pass
+        vector<TwoBitBlocks> chunkNBlocks(chunks.size()), chunkMaskBlocks(chunks.size());
+        parallelFor(chunks.size(), numThreads, [&](size_t chunkIdx, unsigned threadIdx) {
+            const TwoBitChunk &chunk = chunks[chunkIdx];
+            if (chunk._length == 0) {
+                return;
+            }
+            const vector<uint8_t> &codes = readChunk(chunk, threadIdx);
+            scanBlocks(codes.data(), chunk._length, chunk._start, chunkNBlocks[chunkIdx], chunkMaskBlocks[chunkIdx]);
+        });
+        for (size_t chunkIdx = 0; chunkIdx < chunks.size(); ++chunkIdx) {
+            TwoBitRecord &record = records[chunks[chunkIdx]._recordIdx];
+            record._nBlocks.append(chunkNBlocks[chunkIdx]);
+            if (!noMask) {
+                record._maskBlocks.append(chunkMaskBlocks[chunkIdx]);
+            }
+        }
+        chunkNBlocks.clear();
+        chunkMaskBlocks.clear();
+
+        // version 1 files have 64-bit offsets, which are only used when
+        // the last record starts past 4GB, as faToTwoBit -long would
+        uint32_t header[4] = {TwoBitSignature, 0, uint32_t(records.size()), 0};
+        hal_size_t indexSize = 0;
+        hal_size_t lastOffset = 0;
+        for (const TwoBitRecord &record : records) {
+            indexSize += 1 + record._name.size() + sizeof(uint32_t);
+        }
+        for (size_t recordIdx = 0; recordIdx + 1 < records.size(); ++recordIdx) {
+            lastOffset += recordSize(records[recordIdx]);
+        }
+        if (sizeof(header) + indexSize + lastOffset > numeric_limits<uint32_t>::max()) {
+            header[1] = 1;
+            indexSize += records.size() * (sizeof(uint64_t) - sizeof(uint32_t));
+        }
+
+        ofstream outStream(twoBitPath.c_str(), ios::binary);
+        if (!outStream) {
+            throw hal_exception(string("Error opening output file ") + twoBitPath);
+        }
+        string index(reinterpret_cast<const char *>(header), sizeof(header));
+        uint64_t offset = sizeof(header) + indexSize;
+        for (const TwoBitRecord &record : records) {
+            index += char(record._name.size());
+            index += record._name;
+            if (header[1] == 1) {
+                index.append(reinterpret_cast<const char *>(&offset), sizeof(uint64_t));
+            } else {
+                uint32_t shortOffset = offset;
+                index.append(reinterpret_cast<const char *>(&shortOffset), sizeof(uint32_t));
+            }
+            offset += recordSize(record);
+        }
+        outStream.write(index.data(), index.size());
+
+        // the header of each record goes with its first chunk
+        vector<string> outBuffers(numThreads);
+        OrderedOutput output(outStream, chunks.size());
+        parallelFor(chunks.size(), numThreads, [&](size_t chunkIdx, unsigned threadIdx) {
+            const TwoBitChunk &chunk = chunks[chunkIdx];
+            string &outBuffer = outBuffers[threadIdx];
+            outBuffer.clear();
+            if (chunk._start == 0) {
+                writeRecordHeader(records[chunk._recordIdx], outBuffer);
+            }
+            if (chunk._length > 0) {
+                const vector<uint8_t> &codes = readChunk(chunk, threadIdx);
+                size_t pos = outBuffer.size();
+                outBuffer.resize(pos + (chunk._length + 3) / 4);
+                packTwoBit(codes.data(), chunk._length, &outBuffer[pos]);
+            }
+            output.commit(chunkIdx, outBuffer);
+        });
+
+        outStream.flush();
+        if (!outStream) {
+            throw hal_exception("Error writing " + twoBitPath);
+        }
+    } catch (hal_exception &e) {
+        cerr << "hal exception caught: " << e.what() << endl;
+        return 1;
+    } catch (exception &e) {
+        cerr << "Exception caught: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Find the runs of N and of lower case bases in length codes of a sequence
+ * that start at offset within it.  Codes are tested 8 at a time, packed
+ * in a word, and only runs of identical bases are skipped at once: the N
+ * bit (0x4) and the upper case bit (0x8) must match the current runs
+ * across the whole word. */
+static void scanBlocks(const uint8_t *codes, hal_size_t length, hal_size_t offset, TwoBitBlocks &nBlocks,
+                       TwoBitBlocks &maskBlocks) {
+    static const uint64_t NBits = 0x0404040404040404ULL;
+    static const uint64_t UpperBits = 0x0808080808080808ULL;
+    bool inN = false, inMask = false;
+    hal_size_t nStart = 0, maskStart = 0;
+    hal_size_t i = 0;
+    while (i < length) {
+        if (i + sizeof(uint64_t) <= length) {
+            uint64_t word;
+            memcpy(&word, codes + i, sizeof(word));
+            if ((word & NBits) == (inN ? NBits : 0) && (word & UpperBits) == (inMask ? 0 : UpperBits)) {
+                i += sizeof(uint64_t);
+                continue;
+            }
+        }
+        hal_size_t end = std::min(i + sizeof(uint64_t), length);
+        for (; i < end; ++i) {
+            bool isN = (codes[i] & 0x04) != 0;
+            bool isMask = (codes[i] & 0x08) == 0;
+            if (isN != inN) {
+                if (inN) {
+                    nBlocks.add(offset + nStart, i - nStart);
+                }
+                nStart = i;
+                inN = isN;
+            }
+            if (isMask != inMask) {
+                if (inMask) {
+                    maskBlocks.add(offset + maskStart, i - maskStart);
+                }
+                maskStart = i;
+                inMask = isMask;
+            }
+        }
+    }
+    if (inN) {
+        nBlocks.add(offset + nStart, length - nStart);
+    }
+    if (inMask) {
+        maskBlocks.add(offset + maskStart, length - maskStart);
+    }
+}
+
+/* Pack codes into 2bit bytes, first base in the high bits.  Ns are stored
+ * as Ts, and the last byte is padded with zeros. A pair of codes indexes
+ * a table giving their four bits, so each byte takes two lookups. */
+static void packTwoBit(const uint8_t *codes, hal_size_t length, char *out) {
+    // 2bit values of codes a, c, g, t and n: T=0, C=1, A=2, G=3
+    static const uint8_t codeValues[16] = {2, 1, 3, 0, 0, 0, 0, 0, 2, 1, 3, 0, 0, 0, 0, 0};
+    static uint8_t pairValues[256];
+    static bool pairValuesInit = [] {
+        for (int pair = 0; pair < 256; ++pair) {
+            pairValues[pair] = (codeValues[pair >> 4] << 2) | codeValues[pair & 0x0F];
+        }
+        return true;
+    }();
+    (void)pairValuesInit;
+
+    hal_size_t i = 0;
+    for (; i + 4 <= length; i += 4) {
+        *out++ = (pairValues[(codes[i] << 4) | codes[i + 1]] << 4) | pairValues[(codes[i + 2] << 4) | codes[i + 3]];
+    }
+    if (i < length) {
+        uint8_t packed = 0;
+        for (int j = 0; j < 4; ++j) {
+            packed = (packed << 2) | (i + j < length ? codeValues[codes[i + j]] : 0);
+        }
+        *out++ = packed;
+    }
+}
+
+/* Write the fields of a 2bit sequence record that come before its DNA */
+static void writeRecordHeader(const TwoBitRecord &record, string &outBuffer) {
+    vector<uint32_t> fields;
+    fields.push_back(record._length);
+    fields.push_back(record._nBlocks._starts.size());
+    fields.insert(fields.end(), record._nBlocks._starts.begin(), record._nBlocks._starts.end());
+    fields.insert(fields.end(), record._nBlocks._sizes.begin(), record._nBlocks._sizes.end());
+    fields.push_back(record._maskBlocks._starts.size());
+    fields.insert(fields.end(), record._maskBlocks._starts.begin(), record._maskBlocks._starts.end());
+    fields.insert(fields.end(), record._maskBlocks._sizes.begin(), record._maskBlocks._sizes.end());
+    fields.push_back(0);
+    outBuffer.append(reinterpret_cast<const char *>(fields.data()), fields.size() * sizeof(uint32_t));
+}
+
+static hal_size_t recordSize(const TwoBitRecord &record) {
+    return sizeof(uint32_t) * (4 + 2 * (record._nBlocks._starts.size() + record._maskBlocks._starts.size())) +
+           (record._length + 3) / 4;
+}
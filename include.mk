@@ -53,7 +53,7 @@ ifeq (${CXX_ABI_DEF},)
 endif
 
 CFLAGS += -I${sonLibDir}
-CXXFLAGS += -I${sonLibDir} ${CXX_ABI_DEF} -std=c++11 -Wno-sign-compare
+CXXFLAGS += -I${sonLibDir} ${CXX_ABI_DEF} -std=c++11 -Wno-sign-compare -pthread
 
 LDLIBS += ${sonLibDir}/sonLib.a ${sonLibDir}/cuTest.a
 LIBDEPENDS += ${sonLibDir}/sonLib.a ${sonLibDir}/cuTest.a
@@ -6,8 +6,11 @@
  */
 #include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <limits>
 #include <iostream>
-#include <sstream>
 #include <stdexcept>
 
 #include "halBedLine.h"
@@ -22,131 +25,238 @@ BedLine::BedLine() : _start(NULL_INDEX), _end(NULL_INDEX), _strand('+'), _bedTyp
 BedLine::~BedLine() {
 }
 
+namespace {
+    /* A column of a BED line, pointing into the line buffer so that
+     * tokenizing never allocates. */
+    struct BedField {
+        const char *_begin;
+        const char *_end;
+        bool empty() const {
+            return _begin == _end;
+        }
+    };
+
+    /* Count the fields of a range the same way chopString() does: a trailing
+     * separator doesn't start a new (empty) field. */
+    size_t countFields(const char *begin, const char *end, char separator) {
+        size_t count = 0;
+        const char *pos = begin;
+        while (pos < end) {
+            const char *sep = static_cast<const char *>(memchr(pos, separator, end - pos));
+            ++count;
+            if (sep == NULL) {
+                break;
+            }
+            pos = sep + 1;
+        }
+        return count;
+    }
+
+    /* Get the field starting at pos and move pos past its separator. */
+    BedField nextField(const char *&pos, const char *end, char separator) {
+        BedField field;
+        field._begin = pos;
+        const char *sep = static_cast<const char *>(memchr(pos, separator, end - pos));
+        field._end = sep == NULL ? end : sep;
+        pos = sep == NULL ? end : sep + 1;
+        return field;
+    }
+
+    /* Parse an integer with the same rules as strToInt(): leading white
+     * space and a sign are allowed, and parsing stops at the first
+     * character that isn't a digit. */
+    hal_index_t parseInt(const BedField &field) {
+        const char *pos = field._begin;
+        while (pos < field._end && isspace(*pos)) {
+            ++pos;
+        }
+        bool negative = false;
+        if (pos < field._end && (*pos == '-' || *pos == '+')) {
+            negative = *pos == '-';
+            ++pos;
+        }
+        const char *digits = pos;
+        uint64_t value = 0;
+        bool overflow = false;
+        for (; pos < field._end && *pos >= '0' && *pos <= '9'; ++pos) {
+            overflow = overflow || value > (numeric_limits<uint64_t>::max() - 9) / 10;
+            value = value * 10 + (*pos - '0');
+        }
+        uint64_t limit = uint64_t(numeric_limits<hal_index_t>::max()) + (negative ? 1 : 0);
+        if (pos == digits || overflow || value > limit) {
+            throw hal_exception("Error converting string to int: " + string(field._begin, field._end));
+        }
+        return negative ? hal_index_t(0 - value) : hal_index_t(value);
+    }
+
+    /* Format an integer at the end of a buffer, returning its first
+     * character. */
+    char *formatInt(hal_index_t value, char *bufEnd) {
+        uint64_t magnitude = value < 0 ? 0 - uint64_t(value) : uint64_t(value);
+        char *pos = bufEnd;
+        do {
+            *--pos = char('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude != 0);
+        if (value < 0) {
+            *--pos = '-';
+        }
+        return pos;
+    }
+
+    /* Write an integer, optionally preceded by a separator, with a single
+     * unformatted write. */
+    void writeInt(ostream &os, hal_index_t value, char separator = '\0') {
+        char buffer[24];
+        char *end = buffer + sizeof(buffer);
+        char *begin = formatInt(value, end);
+        if (separator != '\0') {
+            *--begin = separator;
+        }
+        os.write(begin, end - begin);
+    }
+
+    void writeString(ostream &os, const string &value, char separator) {
+        os.put(separator);
+        os.write(value.data(), value.size());
+    }
+}
+
 /* bedType is zero or the number of standard bed columns.  All others
- * are saved as extra */
+ * are saved as extra.  The line is tokenized in place in lineBuffer and
+ * the string members are assigned rather than rebuilt, so reading a file
+ * through the same BedLine doesn't allocate once its buffers have grown */
 istream &BedLine::read(istream &is, string &lineBuffer, int bedType) {
     _bedType = bedType;
     std::getline(is, lineBuffer);
-    std::vector<std::string> row = chopString(lineBuffer, "\t");
-    if (row.size() < 3) {
+    const char *lineEnd = lineBuffer.data() + lineBuffer.size();
+    const char *pos = lineBuffer.data();
+    size_t numColumns = countFields(pos, lineEnd, '\t');
+    if (numColumns < 3) {
         throw hal_exception("Expected at least three columns in BED record: " + lineBuffer);
     }
     if (_bedType == 0) {
-        _bedType = min(int(row.size()), 12);
+        _bedType = min(int(numColumns), 12);
+    }
+    if (size_t(_bedType) > numColumns) {
+        throw hal_exception("Expected at least " + std::to_string(_bedType) + " columns in BED record: " + lineBuffer);
     }
-    _chrName = row[0];
-    _start = strToInt(row[1]);
-    _end = strToInt(row[2]);
+    BedField field = nextField(pos, lineEnd, '\t');
+    _chrName.assign(field._begin, field._end);
+    _start = parseInt(nextField(pos, lineEnd, '\t'));
+    _end = parseInt(nextField(pos, lineEnd, '\t'));
     if (_start >= _end) {
         throw hal_exception("Error zero or negative length BED range: " + lineBuffer);
     }
     if (_bedType > 3) {
-        _name = row[3];
+        field = nextField(pos, lineEnd, '\t');
+        _name.assign(field._begin, field._end);
     }
     if (_bedType > 4) {
-        _score = strToInt(row[4]);
+        _score = parseInt(nextField(pos, lineEnd, '\t'));
     }
     if (_bedType > 5) {
-        _strand = row[5][0];
+        field = nextField(pos, lineEnd, '\t');
+        _strand = field.empty() ? '\0' : *field._begin;
         if (_strand != '.' && _strand != '+' && _strand != '-') {
             throw hal_exception("Strand character must be + or - or ." + lineBuffer);
         }
     }
     if (_bedType > 6) {
-        _thickStart = strToInt(row[6]);
+        _thickStart = parseInt(nextField(pos, lineEnd, '\t'));
     }
     if (_bedType > 7) {
-        _thickEnd = strToInt(row[7]);
+        _thickEnd = parseInt(nextField(pos, lineEnd, '\t'));
     }
-   if (_bedType > 8) {
-        vector<string> rgbTokens = chopString(row[8], ",");
-        if (rgbTokens.size() > 3 || rgbTokens.size() == 0) {
+    if (_bedType > 8) {
+        field = nextField(pos, lineEnd, '\t');
+        size_t numRGB = countFields(field._begin, field._end, ',');
+        if (numRGB > 3 || numRGB == 0) {
             throw hal_exception("Error parsing BED itemRGB: " + lineBuffer);
         }
-        _itemR = strToInt(rgbTokens[0]);
+        const char *rgbPos = field._begin;
+        _itemR = parseInt(nextField(rgbPos, field._end, ','));
         _itemG = _itemB = _itemR;
-        if (rgbTokens.size() > 1) {
-            _itemG = strToInt(rgbTokens[1]);
+        if (numRGB > 1) {
+            _itemG = parseInt(nextField(rgbPos, field._end, ','));
         }
-        if (rgbTokens.size() == 3) {
-            _itemB= strToInt(rgbTokens[2]);;
+        if (numRGB == 3) {
+            _itemB = parseInt(nextField(rgbPos, field._end, ','));
         }
     }
     if (_bedType > 9) {
         if (_bedType < 12) {
             throw hal_exception("Error parsing BED, insufficient columns for blocks: " + lineBuffer);
         }
-        size_t numBlocks = strToInt(row[9]);
-        vector<string> blockSizes = chopString(row[10], ",");
-        if (blockSizes.size() != numBlocks) {
+        size_t numBlocks = parseInt(nextField(pos, lineEnd, '\t'));
+        BedField blockSizes = nextField(pos, lineEnd, '\t');
+        if (countFields(blockSizes._begin, blockSizes._end, ',') != numBlocks) {
             throw hal_exception("Error parsing BED blockSizes: " + lineBuffer);
         }
-        vector<string> blockStarts = chopString(row[11], ",");
-        if (blockStarts.size() != numBlocks) {
+        BedField blockStarts = nextField(pos, lineEnd, '\t');
+        if (countFields(blockStarts._begin, blockStarts._end, ',') != numBlocks) {
             throw hal_exception("Error parsing BED blockStarts: " + lineBuffer);
         }
         _blocks.resize(numBlocks);
+        const char *sizePos = blockSizes._begin;
+        const char *startPos = blockStarts._begin;
         for (size_t i = 0; i < numBlocks; ++i) {
-            _blocks[i]._length = strToInt(blockSizes[i]);
-            _blocks[i]._start = strToInt(blockStarts[i]);
+            _blocks[i]._length = parseInt(nextField(sizePos, blockSizes._end, ','));
+            _blocks[i]._start = parseInt(nextField(startPos, blockStarts._end, ','));
             if (_start + _blocks[i]._start + _blocks[i]._length > _end) {
                 throw hal_exception("Error BED block out of range: " + lineBuffer);
             }
         }
     }
-    _extra.clear();
-    for (int i = _bedType; i < row.size(); i++) {
-        _extra.push_back(row[i]);
+    _extra.resize(numColumns - _bedType);
+    for (size_t i = 0; i < _extra.size(); ++i) {
+        field = nextField(pos, lineEnd, '\t');
+        _extra[i].assign(field._begin, field._end);
     }
     return is;
 }
 
 ostream &BedLine::write(ostream &os) {
-    os << _chrName << '\t' << _start << '\t' << _end;
+    os.write(_chrName.data(), _chrName.size());
+    writeInt(os, _start, '\t');
+    writeInt(os, _end, '\t');
 
     if (_bedType > 3) {
-        os << '\t' << _name;
+        writeString(os, _name, '\t');
     }
     if (_bedType > 4) {
-        os << '\t' << _score;
+        writeInt(os, _score, '\t');
     }
     if (_bedType > 5) {
-        os << '\t' << _strand;
+        os.put('\t');
+        os.put(_strand);
     }
     if (_bedType > 6) {
-        os << '\t' << _thickStart;
+        writeInt(os, _thickStart, '\t');
     }
     if (_bedType > 7) {
-        os << '\t' << _thickEnd;
+        writeInt(os, _thickEnd, '\t');
     }
     if (_bedType > 8) {
-        os << '\t' << _itemR << ',' << _itemG << ',' << _itemB;
+        writeInt(os, _itemR, '\t');
+        writeInt(os, _itemG, ',');
+        writeInt(os, _itemB, ',');
     }
     if (_bedType > 9) {
-        os << '\t' << _blocks.size();
+        writeInt(os, _blocks.size(), '\t');
         for (size_t i = 0; i < _blocks.size(); ++i) {
-            if (i == 0) {
-                os << '\t';
-            } else {
-                os << ',';
-            }
-            os << _blocks[i]._length;
+            writeInt(os, _blocks[i]._length, i == 0 ? '\t' : ',');
         }
         for (size_t i = 0; i < _blocks.size(); ++i) {
-            if (i == 0) {
-                os << '\t';
-            } else {
-                os << ',';
-            }
-            os << _blocks[i]._start;
+            writeInt(os, _blocks[i]._start, i == 0 ? '\t' : ',');
         }
     }
 
     for (size_t i = 0; i < _extra.size(); ++i) {
-        os << '\t' << _extra[i];
+        writeString(os, _extra[i], '\t');
     }
 
-    os << '\n';
+    os.put('\n');
     return os;
 }
 
@@ -214,18 +324,36 @@ ostream &BedLine::writePSL(ostream &os, bool prefixWithName) {
     }
 
     if (prefixWithName == true) {
-        os << _name << '\t';
-    }
-    os << psl._matches << '\t' << psl._misMatches << '\t' << psl._repMatches << '\t' << psl._nCount << '\t' << psl._qNumInsert
-       << '\t' << psl._qBaseInsert << '\t' << psl._tNumInsert << '\t' << psl._tBaseInsert << '\t' << psl._qStrand << _strand
-       << '\t' << psl._qSeqName << '\t' << psl._qSeqSize << '\t' << (_srcStart - psl._qChromOffset) << '\t'
-       << (psl._qEnd - psl._qChromOffset) << '\t' << _chrName << '\t' << psl._tSeqSize << '\t' << _start << '\t' << _end << '\t'
-       << _blocks.size() << '\t';
+        os.write(_name.data(), _name.size());
+        os.put('\t');
+    }
+    writeInt(os, psl._matches);
+    writeInt(os, psl._misMatches, '\t');
+    writeInt(os, psl._repMatches, '\t');
+    writeInt(os, psl._nCount, '\t');
+    writeInt(os, psl._qNumInsert, '\t');
+    writeInt(os, psl._qBaseInsert, '\t');
+    writeInt(os, psl._tNumInsert, '\t');
+    writeInt(os, psl._tBaseInsert, '\t');
+    os.put('\t');
+    os.put(psl._qStrand);
+    os.put(_strand);
+    writeString(os, psl._qSeqName, '\t');
+    writeInt(os, psl._qSeqSize, '\t');
+    writeInt(os, _srcStart - psl._qChromOffset, '\t');
+    writeInt(os, psl._qEnd - psl._qChromOffset, '\t');
+    writeString(os, _chrName, '\t');
+    writeInt(os, psl._tSeqSize, '\t');
+    writeInt(os, _start, '\t');
+    writeInt(os, _end, '\t');
+    writeInt(os, _blocks.size(), '\t');
+    os.put('\t');
 
     for (size_t i = 0; i < _blocks.size(); ++i) {
-        os << _blocks[i]._length << ',';
+        writeInt(os, _blocks[i]._length);
+        os.put(',');
     }
-    os << '\t';
+    os.put('\t');
 
     for (size_t i = 0; i < psl._qBlockStarts.size(); ++i) {
         assert(psl._qBlockStarts[i] >= (hal_index_t)psl._qChromOffset);
@@ -233,19 +361,21 @@ ostream &BedLine::writePSL(ostream &os, bool prefixWithName) {
         if (psl._qStrand == '-') {
             start = psl._qSeqSize - start - _blocks[i]._length;
         }
-        os << start << ',';
+        writeInt(os, start);
+        os.put(',');
     }
-    os << '\t';
+    os.put('\t');
 
     for (size_t i = 0; i < _blocks.size(); ++i) {
         hal_index_t start = _blocks[i]._start + _start;
         if (_strand == '-') {
             start = psl._tSeqSize - start - _blocks[i]._length;
         }
-        os << start << ',';
+        writeInt(os, start);
+        os.put(',');
     }
 
-    os << '\n';
+    os.put('\n');
     return os;
 }
 
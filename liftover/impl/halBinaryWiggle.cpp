@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+#include "halBinaryWiggle.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+using namespace std;
+using namespace hal;
+
+const char hal::BinaryWiggleMagic[8] = {'\x89', 'H', 'A', 'L', 'W', 'I', 'G', '\n'};
+
+namespace {
+    template <typename T> void readValue(istream &is, T &value) {
+        is.read(reinterpret_cast<char *>(&value), sizeof(T));
+        if (is.gcount() != sizeof(T)) {
+            throw hal_exception("Truncated binary wiggle file");
+        }
+    }
+
+    template <typename T> void writeValue(ostream &os, T value) {
+        os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+}
+
+bool hal::isBinaryWiggle(istream &is) {
+    return is.peek() == (unsigned char)BinaryWiggleMagic[0];
+}
+
+void hal::readBinaryWiggleHeader(istream &is) {
+    char magic[sizeof(BinaryWiggleMagic)];
+    is.read(magic, sizeof(magic));
+    if (is.gcount() != sizeof(magic) || memcmp(magic, BinaryWiggleMagic, sizeof(magic)) != 0) {
+        throw hal_exception("Invalid binary wiggle header");
+    }
+    uint32_t version;
+    readValue(is, version);
+    if (version != BinaryWiggleVersion) {
+        throw hal_exception("Unsupported binary wiggle version " + std::to_string(version));
+    }
+}
+
+bool hal::readBinaryWiggleSection(istream &is, BinaryWiggleSection &section) {
+    if (is.peek() == char_traits<char>::eof()) {
+        return false;
+    }
+    uint32_t nameLength;
+    readValue(is, nameLength);
+    section._sequenceName.resize(nameLength);
+    if (nameLength > 0) {
+        is.read(&section._sequenceName[0], nameLength);
+        if (is.gcount() != nameLength) {
+            throw hal_exception("Truncated binary wiggle file");
+        }
+    }
+    uint64_t start, numValues;
+    uint32_t step, span;
+    readValue(is, start);
+    readValue(is, step);
+    readValue(is, span);
+    readValue(is, numValues);
+    section._start = start;
+    section._step = step;
+    section._span = span;
+    section._numValues = numValues;
+    return true;
+}
+
+void hal::readBinaryWiggleValues(istream &is, hal_size_t remaining, hal_size_t maxValues, vector<float> &values) {
+    values.resize(std::min(remaining, maxValues));
+    streamsize bytes = values.size() * sizeof(float);
+    is.read(reinterpret_cast<char *>(values.data()), bytes);
+    if (is.gcount() != bytes) {
+        throw hal_exception("Truncated binary wiggle file");
+    }
+}
+
+void hal::writeBinaryWiggleHeader(ostream &os) {
+    os.write(BinaryWiggleMagic, sizeof(BinaryWiggleMagic));
+    writeValue(os, BinaryWiggleVersion);
+}
+
+void hal::writeBinaryWiggleSection(ostream &os, const string &sequenceName, hal_index_t start, hal_index_t step,
+                                   hal_index_t span, const vector<float> &values) {
+    assert(sequenceName.size() <= numeric_limits<uint32_t>::max());
+    writeValue(os, uint32_t(sequenceName.size()));
+    os.write(sequenceName.data(), sequenceName.size());
+    writeValue(os, uint64_t(start));
+    writeValue(os, uint32_t(step));
+    writeValue(os, uint32_t(span));
+    writeValue(os, uint64_t(values.size()));
+    os.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(float));
+}
@@ -6,6 +6,7 @@
  */
 
 #include "halWiggleLiftover.h"
+#include "halBinaryWiggle.h"
 #include "halBlockMapper.h"
 #include "halWiggleLoader.h"
 #include <cassert>
@@ -23,6 +24,11 @@ WiggleLiftover::WiggleLiftover() {
 WiggleLiftover::~WiggleLiftover() {
 }
 
+void WiggleLiftover::setValueStorage(hal_size_t maxBytes, WigglePrecision precision, const string &spillDir) {
+    _outVals.setMemoryLimit(maxBytes, spillDir);
+    _outVals.setPrecision(precision);
+}
+
 void WiggleLiftover::preloadOutput(AlignmentConstPtr alignment, const Genome *tgtGenome, istream *inputFile) {
     WiggleLoader loader;
     _outVals.init(tgtGenome->getSequenceLength(), DefaultValue, DefaultTileSize);
@@ -30,13 +36,14 @@ void WiggleLiftover::preloadOutput(AlignmentConstPtr alignment, const Genome *tg
 }
 
 void WiggleLiftover::convert(AlignmentConstPtr alignment, const Genome *srcGenome, istream *inputFile, const Genome *tgtGenome,
-                             ostream *outputFile, bool traverseDupes, bool unique) {
+                             ostream *outputFile, bool traverseDupes, bool unique, bool binaryOutput) {
     _alignment = alignment;
     _srcGenome = srcGenome;
     _tgtGenome = tgtGenome;
     _outStream = outputFile;
     _traverseDupes = traverseDupes;
     _unique = unique;
+    _binaryOutput = binaryOutput;
     _srcSequence = NULL;
 
     if (_srcGenome->getNumTopSegments() > 0) {
@@ -56,7 +63,11 @@ void WiggleLiftover::convert(AlignmentConstPtr alignment, const Genome *srcGenom
         _outVals.init(tgtGenome->getSequenceLength(), DefaultValue, DefaultTileSize);
     }
     scan(inputFile);
-    write();
+    if (_binaryOutput) {
+        writeBinary();
+    } else {
+        write();
+    }
     _outVals.clear();
 }
 
@@ -196,3 +207,43 @@ void WiggleLiftover::write() {
         }
     }
 }
+
+/* Same traversal as write(), but each run of consecutive positions becomes
+ * one binary section */
+void WiggleLiftover::writeBinary() {
+    writeBinaryWiggleHeader(*_outStream);
+    const Sequence *outSequence = NULL;
+    hal_size_t ogSize = _tgtGenome->getSequenceLength();
+    hal_index_t prevPos = NULL_INDEX;
+    hal_index_t runStart = NULL_INDEX;
+    vector<float> runValues;
+    for (hal_size_t i = 0; i < _outVals.getNumTiles(); ++i) {
+        if (_outVals.isTileEmpty(i) == false) {
+            hal_index_t pos = i * _outVals.getTileSize();
+            for (hal_size_t j = 0; pos < ogSize && j < _outVals.getTileSize(); ++j, ++pos) {
+                if (_outVals.exists(pos) == true) {
+                    bool newSequence =
+                        outSequence == NULL || pos < outSequence->getStartPosition() || pos > outSequence->getEndPosition();
+                    if (newSequence || pos != prevPos + 1) {
+                        if (!runValues.empty()) {
+                            writeBinaryWiggleSection(*_outStream, outSequence->getName(),
+                                                     runStart - outSequence->getStartPosition(), 1, 1, runValues);
+                            runValues.clear();
+                        }
+                        if (newSequence) {
+                            outSequence = _tgtGenome->getSequenceBySite(pos);
+                            assert(outSequence != NULL);
+                        }
+                        runStart = pos;
+                    }
+                    runValues.push_back(_outVals.get(pos));
+                    prevPos = pos;
+                }
+            }
+        }
+    }
+    if (!runValues.empty()) {
+        writeBinaryWiggleSection(*_outStream, outSequence->getName(), runStart - outSequence->getStartPosition(), 1, 1,
+                                 runValues);
+    }
+}
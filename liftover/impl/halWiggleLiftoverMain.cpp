@@ -16,8 +16,9 @@ using namespace hal;
 static void initParser(CLParser &optionsParser) {
     optionsParser.addArgument("halFile", "input hal file");
     optionsParser.addArgument("srcGenome", "source genome name");
-    optionsParser.addArgument("srcWig", "path of input .wig file.  set as stdin "
-                                        "to stream from standard input");
+    optionsParser.addArgument("srcWig", "path of input .wig file, in text or binary "
+                                        "wiggle format.  set as stdin to stream from "
+                                        "standard input");
     optionsParser.addArgument("tgtGenome", "target genome name");
     optionsParser.addArgument("tgtWig", "path of output .wig file.  set as stdout"
                                         " to stream to standard output.");
@@ -29,6 +30,20 @@ static void initParser(CLParser &optionsParser) {
                                           " memory then overwritten, so this data can be lost "
                                           "in event of a crash",
                                 false);
+    optionsParser.addOptionFlag("outBinary", "write tgtWig in HAL's compact binary "
+                                             "wiggle format rather than as text.  "
+                                             "Binary input is detected automatically",
+                                false);
+    optionsParser.addOption("maxMemory", "approximate memory limit, in megabytes, for the "
+                                         "mapped values (0 for no limit).  Values beyond it are "
+                                         "compressed and then moved to a temporary file",
+                            0);
+    optionsParser.addOption("precision", "bits of floating point precision to keep mapped "
+                                         "values at: 16, 32 or 64",
+                            64);
+    optionsParser.addOption("tempDir", "directory for the temporary file used with --maxMemory "
+                                       "(directory of tgtWig if empty)",
+                            "");
 #if 0
   optionsParser.addOptionFlag("unique",
                                "only map block if its left-most paralog is in"
@@ -53,6 +68,10 @@ int main(int argc, char **argv) {
     string tgtWigPath;
     bool noDupes;
     bool append;
+    bool outBinary;
+    hal_size_t maxMemory;
+    int precision;
+    string tempDir;
     bool unique;
     try {
         optionsParser.parseOptions(argc, argv);
@@ -63,6 +82,13 @@ int main(int argc, char **argv) {
         tgtWigPath = optionsParser.getArgument<string>("tgtWig");
         noDupes = optionsParser.getFlag("noDupes");
         append = optionsParser.getFlag("append");
+        outBinary = optionsParser.getFlag("outBinary");
+        maxMemory = optionsParser.getOption<hal_size_t>("maxMemory");
+        precision = optionsParser.getOption<int>("precision");
+        tempDir = optionsParser.getOption<string>("tempDir");
+        if (precision != WiggleFloat16 && precision != WiggleFloat32 && precision != WiggleFloat64) {
+            throw hal_exception("--precision must be 16, 32 or 64");
+        }
         //  unique = optionsParser.getFlag("unique");
         unique = false;
     } catch (exception &e) {
@@ -91,18 +117,23 @@ int main(int argc, char **argv) {
         if (srcWigPath == "stdin") {
             srcWigPtr = &cin;
         } else {
-            srcWig.open(srcWigPath.c_str());
+            srcWig.open(srcWigPath.c_str(), ios::binary);
             srcWigPtr = &srcWig;
             if (!srcWig) {
                 throw hal_exception("Error opening srcWig, " + srcWigPath);
             }
         }
 
+        if (tempDir.empty()) {
+            size_t slashPos = tgtWigPath.rfind('/');
+            tempDir = tgtWigPath == "stdout" || slashPos == string::npos ? "." : tgtWigPath.substr(0, slashPos + 1);
+        }
         WiggleLiftover liftover;
+        liftover.setValueStorage(maxMemory * 1024 * 1024, WigglePrecision(precision), tempDir);
         if (append == true && tgtWigPath != "stdout") {
             // load the wig data into memory so that it can be properly merged
             // with the new data from the liftover.
-            ifstream tgtWig(tgtWigPath.c_str());
+            ifstream tgtWig(tgtWigPath.c_str(), ios::binary);
             if (tgtWig) {
                 liftover.preloadOutput(alignment, tgtGenome, &tgtWig);
             }
@@ -113,14 +144,14 @@ int main(int argc, char **argv) {
         if (tgtWigPath == "stdout") {
             tgtWigPtr = &cout;
         } else {
-            tgtWig.open(tgtWigPath.c_str());
+            tgtWig.open(tgtWigPath.c_str(), ios::binary);
             tgtWigPtr = &tgtWig;
             if (!tgtWig) {
                 throw hal_exception("Error opening tgtWig, " + tgtWigPath);
             }
         }
 
-        liftover.convert(alignment, srcGenome, srcWigPtr, tgtGenome, tgtWigPtr, !noDupes, unique);
+        liftover.convert(alignment, srcGenome, srcWigPtr, tgtGenome, tgtWigPtr, !noDupes, unique, outBinary);
     } catch (hal_exception &e) {
         cerr << "hal exception caught: " << e.what() << endl;
         return 1;
@@ -12,6 +12,7 @@
 #include <stdexcept>
 
 #include "halWiggleScanner.h"
+#include "halBinaryWiggle.h"
 
 using namespace std;
 using namespace hal;
@@ -45,23 +46,27 @@ void WiggleScanner::scan(istream *is) {
     if (_wiggleStream->bad()) {
         throw hal_exception("Error reading wiggle input stream");
     }
-    string lineBuffer;
-    _lineNumber = 0;
-    try {
-        skipWhiteSpaces(_wiggleStream);
-        while (_wiggleStream->good()) {
-            ++_lineNumber;
-            std::getline(*is, lineBuffer);
-            if (scanHeader(lineBuffer) == true) {
-                visitHeader();
-            } else {
-                scanLine(lineBuffer);
-                visitLine();
-            }
+    if (isBinaryWiggle(*_wiggleStream)) {
+        scanBinary();
+    } else {
+        string lineBuffer;
+        _lineNumber = 0;
+        try {
             skipWhiteSpaces(_wiggleStream);
+            while (_wiggleStream->good()) {
+                ++_lineNumber;
+                std::getline(*is, lineBuffer);
+                if (scanHeader(lineBuffer) == true) {
+                    visitHeader();
+                } else {
+                    scanLine(lineBuffer);
+                    visitLine();
+                }
+                skipWhiteSpaces(_wiggleStream);
+            }
+        } catch (hal_exception &e) {
+            throw hal_exception(string(e.what()) + " in input wiggle line " + std::to_string(_lineNumber));
         }
-    } catch (hal_exception &e) {
-        throw hal_exception(string(e.what()) + " in input wiggle line " + std::to_string(_lineNumber));
     }
     visitEOF();
     _wiggleStream = NULL;
@@ -170,6 +175,38 @@ void WiggleScanner::scanLine(const string &lineBuffer) {
     }
 }
 
+void WiggleScanner::scanBinary() {
+    static const hal_size_t valuesPerRead = 1 << 16;
+    readBinaryWiggleHeader(*_wiggleStream);
+    BinaryWiggleSection section;
+    try {
+        for (_lineNumber = 1; readBinaryWiggleSection(*_wiggleStream, section); ++_lineNumber) {
+            _sequenceName = section._sequenceName;
+            _fixedStep = true;
+            _start = section._start;
+            _step = section._step;
+            _span = section._span;
+            _offset = 0;
+            visitHeader();
+            for (hal_size_t remaining = section._numValues; remaining > 0; remaining -= _binaryValues.size()) {
+                readBinaryWiggleValues(*_wiggleStream, remaining, valuesPerRead, _binaryValues);
+                for (size_t i = 0; i < _binaryValues.size(); ++i) {
+                    _first = _start + _offset * _step;
+                    ++_offset;
+                    _value = _binaryValues[i];
+                    _last = _first;
+                    if (_span > 1) {
+                        _last += _span - 1;
+                    }
+                    visitLine();
+                }
+            }
+        }
+    } catch (hal_exception &e) {
+        throw hal_exception(string(e.what()) + " in binary wiggle section " + std::to_string(_lineNumber));
+    }
+}
+
 void WiggleScanner::visitBegin() {
 }
 
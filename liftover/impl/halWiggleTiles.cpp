@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+#include "halWiggleTiles.h"
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+using namespace std;
+using namespace hal;
+
+uint16_t hal::floatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    uint32_t exponent = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (exponent == 0xff) {
+        // infinity, or nan kept quiet
+        return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+    }
+    int halfExponent = int(exponent) - 127 + 15;
+    if (halfExponent >= 0x1f) {
+        return sign | 0x7c00;
+    }
+    if (halfExponent <= 0) {
+        // subnormal half, or too small for one
+        if (halfExponent < -10) {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - halfExponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1) != 0)) {
+            ++half;
+        }
+        return sign | half;
+    }
+    // rounding up can carry into the exponent, up to infinity
+    uint32_t half = (uint32_t(halfExponent) << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1) != 0)) {
+        ++half;
+    }
+    return sign | half;
+}
+
+float hal::halfToFloat(uint16_t value) {
+    uint32_t sign = uint32_t(value & 0x8000) << 16;
+    uint32_t exponent = (value >> 10) & 0x1f;
+    uint32_t mantissa = value & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // normalize the subnormal
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400) == 0) {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+    } else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+WiggleSpillFile::WiggleSpillFile(const string &dir) : _end(0) {
+    _path = (dir.empty() ? string(".") : dir) + "/halWiggleTiles.spill.XXXXXX";
+    vector<char> pathBuf(_path.begin(), _path.end());
+    pathBuf.push_back('\0');
+    _fd = mkstemp(pathBuf.data());
+    if (_fd < 0) {
+        throw hal_errno_exception(_path, "error creating temporary file", errno);
+    }
+    _path = pathBuf.data();
+    unlink(_path.c_str());
+}
+
+WiggleSpillFile::~WiggleSpillFile() {
+    close(_fd);
+}
+
+void WiggleSpillFile::write(const string &data, hal_size_t &offset, hal_size_t &capacity) {
+    if (data.size() > capacity) {
+        offset = _end;
+        capacity = data.size();
+        _end += capacity;
+    }
+    const char *pos = data.data();
+    size_t left = data.size();
+    off_t fileOffset = offset;
+    while (left > 0) {
+        ssize_t written = pwrite(_fd, pos, left, fileOffset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw hal_errno_exception(_path, "error writing temporary file", errno);
+        }
+        pos += written;
+        left -= written;
+        fileOffset += written;
+    }
+}
+
+void WiggleSpillFile::read(hal_size_t offset, hal_size_t size, string &data) {
+    data.resize(size);
+    char *pos = size > 0 ? &data[0] : NULL;
+    size_t left = size;
+    off_t fileOffset = offset;
+    while (left > 0) {
+        ssize_t numRead = pread(_fd, pos, left, fileOffset);
+        if (numRead < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw hal_errno_exception(_path, "error reading temporary file", errno);
+        }
+        if (numRead == 0) {
+            throw hal_exception(_path + ": unexpected end of temporary file");
+        }
+        pos += numRead;
+        left -= numRead;
+        fileOffset += numRead;
+    }
+}
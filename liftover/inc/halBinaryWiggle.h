@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef _HALBINARYWIGGLE_H
+#define _HALBINARYWIGGLE_H
+
+#include "hal.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace hal {
+
+    /** Compact binary alternative to the wiggle text format, for tracks
+     * with too many values to parse and format as text.  The file starts
+     * with BinaryWiggleMagic and a 32-bit version, followed by any number
+     * of sections, each the equivalent of a fixedStep block:
+     *
+     *   uint32 nameLength, char name[nameLength],
+     *   uint64 start (0-based), uint32 step, uint32 span,
+     *   uint64 numValues, float values[numValues]
+     *
+     * All integers and values are stored in native (little-endian) byte
+     * order.  The magic starts with a byte that can't begin a text wiggle
+     * file, so readers can tell the formats apart by peeking at it. */
+    extern const char BinaryWiggleMagic[8];
+    const uint32_t BinaryWiggleVersion = 1;
+
+    /** header of a section of a binary wiggle file */
+    struct BinaryWiggleSection {
+        std::string _sequenceName;
+        hal_index_t _start;
+        hal_index_t _step;
+        hal_index_t _span;
+        hal_size_t _numValues;
+    };
+
+    /** Test if a stream is positioned at the start of a binary wiggle
+     * file, without consuming anything */
+    bool isBinaryWiggle(std::istream &is);
+
+    /** Read and check the file header */
+    void readBinaryWiggleHeader(std::istream &is);
+
+    /** Read the header of the next section, returning false at the end of
+     * the file.  Its values must then be read with readBinaryWiggleValues */
+    bool readBinaryWiggleSection(std::istream &is, BinaryWiggleSection &section);
+
+    /** Read up to maxValues values of the current section into values,
+     * where remaining is the number of values of the section left to read */
+    void readBinaryWiggleValues(std::istream &is, hal_size_t remaining, hal_size_t maxValues, std::vector<float> &values);
+
+    void writeBinaryWiggleHeader(std::ostream &os);
+
+    void writeBinaryWiggleSection(std::ostream &os, const std::string &sequenceName, hal_index_t start, hal_index_t step,
+                                  hal_index_t span, const std::vector<float> &values);
+}
+
+#endif
+// Local Variables:
+// mode: c++
+// End:
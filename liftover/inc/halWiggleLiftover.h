@@ -22,10 +22,17 @@ namespace hal {
         WiggleLiftover();
         virtual ~WiggleLiftover();
 
+        /** Keep the mapped values in about maxBytes of memory (0 for no limit),
+         * spilling to a temporary file in spillDir, and round them to
+         * precision.  Call before preloadOutput() or convert() */
+        void setValueStorage(hal_size_t maxBytes, WigglePrecision precision, const std::string &spillDir);
+
         void preloadOutput(AlignmentConstPtr alignment, const Genome *tgtGenome, std::istream *inputFile);
 
+        /** Map inputFile, in text or binary wiggle format, to outputFile.  If
+         * binaryOutput is set, write the binary format of halBinaryWiggle.h */
         void convert(AlignmentConstPtr alignment, const Genome *srcGenome, std::istream *inputFile, const Genome *tgtGenome,
-                     std::ostream *outputFile, bool traverseDupes = true, bool unique = false);
+                     std::ostream *outputFile, bool traverseDupes = true, bool unique = false, bool binaryOutput = false);
 
         static const double DefaultValue;
         static const hal_size_t DefaultTileSize;
@@ -38,6 +45,7 @@ namespace hal {
         void mapSegment();
         void mapFragments(std::vector<MappedSegmentPtr> &fragments);
         void write();
+        void writeBinary();
 
       protected:
         struct CoordVal {
@@ -52,6 +60,7 @@ namespace hal {
         std::ostream *_outStream;
         bool _traverseDupes;
         bool _unique;
+        bool _binaryOutput;
 
         const Genome *_srcGenome;
         const Genome *_tgtGenome;
@@ -17,7 +17,9 @@
 
 namespace hal {
 
-    /** Parse a WIGGLE file line by line */
+    /** Parse a WIGGLE file line by line.  Binary wiggle files (see
+     * halBinaryWiggle.h) are detected from their first byte and visited
+     * as if they were fixedStep text */
     class WiggleScanner {
       public:
         WiggleScanner();
@@ -33,6 +35,7 @@ namespace hal {
 
         virtual bool scanHeader(const std::string &lineBuffer);
         virtual void scanLine(const std::string &lineBuffer);
+        virtual void scanBinary();
         static void skipWhiteSpaces(std::istream *wiggleStream);
 
       protected:
@@ -51,6 +54,7 @@ namespace hal {
         hal_index_t _lineNumber;
         std::string _buffer;
         hal_index_t _offset;
+        std::vector<float> _binaryValues;
     };
 }
 
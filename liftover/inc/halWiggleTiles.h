@@ -9,17 +9,52 @@
 #define _HALWIGGLETILES_H
 
 #include "hal.h"
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <list>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace hal {
 
+    /** Precision at which WiggleTiles keeps its values */
+    enum WigglePrecision { WiggleFloat16 = 16, WiggleFloat32 = 32, WiggleFloat64 = 64 };
+
+    /** IEEE half precision conversions, rounding to nearest even */
+    uint16_t floatToHalf(float value);
+    float halfToFloat(uint16_t value);
+
+    /** Temporary file holding the encoded tiles that don't fit in memory.
+     * It is removed as soon as it is created. */
+    class WiggleSpillFile {
+      public:
+        /** create the file in directory dir (current directory if empty) */
+        WiggleSpillFile(const std::string &dir);
+        ~WiggleSpillFile();
+
+        /** write data at offset if capacity is large enough for it, otherwise
+         * at the end of the file, updating offset and capacity */
+        void write(const std::string &data, hal_size_t &offset, hal_size_t &capacity);
+        void read(hal_size_t offset, hal_size_t size, std::string &data);
+
+      private:
+        std::string _path;
+        int _fd;
+        hal_size_t _end;
+    };
+
     /** Memory structure to keep track of wiggle results by tiling the genome
      * into regular intervals.  The idea is that if we are only writing a
-     * subregion, then we don't bother allocating space for the whole genome
-    */
+     * subregion, then we don't bother allocating space for the whole genome.
+     *
+     * With a memory limit, only the most recently used tiles are kept as
+     * arrays.  Older ones are run-length encoded, and once the encoded tiles
+     * outgrow their share of the limit too, the oldest of them are moved to
+     * a temporary file.  Tiles are decoded again when accessed.
+     */
     template <class T> class WiggleTiles {
       public:
         WiggleTiles();
@@ -30,6 +65,14 @@ namespace hal {
         void init(hal_size_t genomeSize, T defualtValue, hal_size_t tileSize);
         void clear();
 
+        /** Keep the tiles within about maxBytes (0 for no limit), spilling
+         * to a file in spillDir.  Call before init() */
+        void setMemoryLimit(hal_size_t maxBytes, const std::string &spillDir);
+
+        /** Round values to precision as they are set, so that they encode
+         * compactly and results don't depend on the memory limit */
+        void setPrecision(WigglePrecision precision);
+
         /** Get a value.  If the position does not exist in a tile, then we return
          * the default value */
         T get(hal_index_t pos) const;
@@ -52,8 +95,43 @@ namespace hal {
         T getDefaultValue() const;
 
       protected:
-        std::vector<std::vector<T>> _tiles;
-        std::vector<std::vector<bool>> _bits;
+        enum TileState { EmptyTile, LoadedTile, PackedTile, SpilledTile };
+
+        struct Tile {
+            Tile() : _state(EmptyTile), _spillOffset(0), _spillCapacity(0), _packedSize(0) {
+            }
+            TileState _state;
+            std::vector<T> _values;
+            std::vector<bool> _bits;
+            typename std::list<hal_size_t>::iterator _loadedPos;
+            // run-length encoding of a packed tile
+            std::string _packed;
+            typename std::list<hal_size_t>::iterator _packedPos;
+            hal_size_t _spillOffset;
+            hal_size_t _spillCapacity;
+            hal_size_t _packedSize;
+        };
+
+        Tile &loadTile(hal_size_t tile) const;
+        void evictTile() const;
+        void packTile(Tile &tile) const;
+        void unpackTile(Tile &tile, hal_size_t len) const;
+        T quantize(T val) const;
+        hal_size_t getTileLength(hal_size_t tile) const;
+
+        // tiles are loaded and packed on access, so even const methods
+        // change how they are stored
+        mutable std::vector<Tile> _tiles;
+        // loaded and packed tiles, least recently used first
+        mutable std::list<hal_size_t> _loadedTiles;
+        mutable std::list<hal_size_t> _packedTiles;
+        mutable hal_size_t _packedBytes;
+        mutable std::unique_ptr<WiggleSpillFile> _spillFile;
+        hal_size_t _maxBytes;
+        hal_size_t _maxLoadedTiles;
+        hal_size_t _maxPackedBytes;
+        std::string _spillDir;
+        WigglePrecision _precision;
         hal_size_t _tileSize;
         hal_size_t _genomeSize;
         hal_size_t _lastTileSize;
@@ -61,7 +139,11 @@ namespace hal {
     };
 
     // INLINE METHODS
-    template <class T> inline WiggleTiles<T>::WiggleTiles() : _tileSize(0), _genomeSize(0), _lastTileSize(0) {
+    template <class T>
+    inline WiggleTiles<T>::WiggleTiles()
+        : _packedBytes(0), _maxBytes(0), _maxLoadedTiles(std::numeric_limits<hal_size_t>::max()),
+          _maxPackedBytes(std::numeric_limits<hal_size_t>::max()), _precision(WiggleFloat64), _tileSize(0), _genomeSize(0),
+          _lastTileSize(0) {
     }
 
     template <class T> inline WiggleTiles<T>::~WiggleTiles() {
@@ -78,59 +160,74 @@ namespace hal {
         } else {
             _lastTileSize = _tileSize;
         }
-        for (size_t i = 0; i < _tiles.size(); ++i) {
-            _tiles[i].clear();
-            _bits[i].clear();
-        }
+        _tiles.clear();
         _tiles.resize(numTiles);
-        _bits.resize(numTiles);
+        _loadedTiles.clear();
+        _packedTiles.clear();
+        _packedBytes = 0;
+        _spillFile.reset();
+        if (_maxBytes > 0) {
+            // half the budget for decoded tiles (values and presence bits),
+            // the other half for encoded ones
+            hal_size_t tileBytes = _tileSize * sizeof(T) + _tileSize / 8 + 1;
+            _maxLoadedTiles = std::max(hal_size_t(2), _maxBytes / 2 / tileBytes);
+            _maxPackedBytes = _maxBytes / 2;
+        } else {
+            _maxLoadedTiles = std::numeric_limits<hal_size_t>::max();
+            _maxPackedBytes = std::numeric_limits<hal_size_t>::max();
+        }
     }
 
     template <class T> inline void WiggleTiles<T>::clear() {
         _tiles.clear();
-        _bits.clear();
+        _loadedTiles.clear();
+        _packedTiles.clear();
+        _packedBytes = 0;
+        _spillFile.reset();
         _tileSize = 0;
         _genomeSize = 0;
         _lastTileSize = 0;
     }
 
+    template <class T> inline void WiggleTiles<T>::setMemoryLimit(hal_size_t maxBytes, const std::string &spillDir) {
+        _maxBytes = maxBytes;
+        _spillDir = spillDir;
+    }
+
+    template <class T> inline void WiggleTiles<T>::setPrecision(WigglePrecision precision) {
+        _precision = precision;
+    }
+
     template <class T> inline T WiggleTiles<T>::get(hal_index_t pos) const {
         assert(pos < _genomeSize);
         hal_size_t tile = pos / _tileSize;
         assert(tile < _tiles.size());
-        assert(_tiles[tile].size() == 0 || _tiles[tile].size() == _tileSize || _tiles[tile].size() == _lastTileSize);
-        if (_tiles[tile].size() == 0) {
+        if (_tiles[tile]._state == EmptyTile) {
             return _defaultValue;
         }
         hal_size_t offset = pos % _tileSize;
-        return _tiles[tile][offset];
+        return loadTile(tile)._values[offset];
     }
 
     template <class T> inline void WiggleTiles<T>::set(hal_index_t pos, T val) {
         assert(pos < _genomeSize);
         hal_size_t tile = pos / _tileSize;
         assert(tile < _tiles.size());
-        assert(_tiles[tile].size() == 0 || _tiles[tile].size() == _tileSize || _tiles[tile].size() == _lastTileSize);
-        if (_tiles[tile].size() == 0) {
-            hal_size_t len = tile == _tiles.size() - 1 ? _lastTileSize : _tileSize;
-            _tiles[tile].assign(len, _defaultValue);
-            _bits[tile].assign(len, false);
-        }
+        Tile &t = loadTile(tile);
         hal_size_t offset = pos % _tileSize;
-        _tiles[tile][offset] = val;
-        _bits[tile][offset] = true;
+        t._values[offset] = quantize(val);
+        t._bits[offset] = true;
     }
 
     template <class T> inline bool WiggleTiles<T>::exists(hal_index_t pos) const {
         assert(pos < _genomeSize);
         hal_size_t tile = pos / _tileSize;
         assert(tile < _tiles.size());
-        assert(_tiles[tile].size() == 0 || _tiles[tile].size() == _tileSize || _tiles[tile].size() == _lastTileSize);
-        if (_tiles[tile].size() == 0) {
+        if (_tiles[tile]._state == EmptyTile) {
             return false;
         }
         hal_size_t offset = pos % _tileSize;
-        return _bits[tile][offset];
+        return loadTile(tile)._bits[offset];
     }
 
     template <class T> inline hal_size_t WiggleTiles<T>::getGenomeSize() const {
@@ -147,12 +244,157 @@ namespace hal {
 
     template <class T> inline bool WiggleTiles<T>::isTileEmpty(hal_size_t tile) const {
         assert(tile < _tiles.size());
-        return _tiles[tile].empty();
+        return _tiles[tile]._state == EmptyTile;
     }
 
     template <class T> inline T WiggleTiles<T>::getDefaultValue() const {
         return _defaultValue;
     }
+
+    template <class T> inline hal_size_t WiggleTiles<T>::getTileLength(hal_size_t tile) const {
+        return tile == _tiles.size() - 1 ? _lastTileSize : _tileSize;
+    }
+
+    template <class T> inline T WiggleTiles<T>::quantize(T val) const {
+        switch (_precision) {
+        case WiggleFloat16:
+            return T(halfToFloat(floatToHalf(float(val))));
+        case WiggleFloat32:
+            return T(float(val));
+        default:
+            return val;
+        }
+    }
+
+    /* Get a tile as arrays, allocating it if empty and decoding it if
+     * packed or spilled.  Tiles are only evicted here, so a reference
+     * returned for one position stays valid until the next call */
+    template <class T> inline typename WiggleTiles<T>::Tile &WiggleTiles<T>::loadTile(hal_size_t tile) const {
+        Tile &t = _tiles[tile];
+        if (t._state == LoadedTile) {
+            if (t._loadedPos != --_loadedTiles.end()) {
+                _loadedTiles.splice(_loadedTiles.end(), _loadedTiles, t._loadedPos);
+            }
+            return t;
+        }
+        if (_loadedTiles.size() >= _maxLoadedTiles) {
+            evictTile();
+        }
+        hal_size_t len = getTileLength(tile);
+        if (t._state == EmptyTile) {
+            t._values.assign(len, _defaultValue);
+            t._bits.assign(len, false);
+        } else {
+            if (t._state == SpilledTile) {
+                _spillFile->read(t._spillOffset, t._packedSize, t._packed);
+            } else {
+                _packedTiles.erase(t._packedPos);
+                _packedBytes -= t._packed.size();
+            }
+            unpackTile(t, len);
+        }
+        t._state = LoadedTile;
+        t._loadedPos = _loadedTiles.insert(_loadedTiles.end(), tile);
+        return t;
+    }
+
+    /* Pack the least recently used loaded tile, then spill the oldest
+     * packed tiles until they fit in their share of the memory limit */
+    template <class T> inline void WiggleTiles<T>::evictTile() const {
+        hal_size_t tile = _loadedTiles.front();
+        _loadedTiles.pop_front();
+
+        Tile &t = _tiles[tile];
+        packTile(t);
+        t._state = PackedTile;
+        t._packedPos = _packedTiles.insert(_packedTiles.end(), tile);
+        _packedBytes += t._packed.size();
+
+        while (_packedBytes > _maxPackedBytes && !_packedTiles.empty()) {
+            Tile &oldest = _tiles[_packedTiles.front()];
+            _packedTiles.pop_front();
+            if (_spillFile.get() == NULL) {
+                _spillFile.reset(new WiggleSpillFile(_spillDir));
+            }
+            _spillFile->write(oldest._packed, oldest._spillOffset, oldest._spillCapacity);
+            oldest._packedSize = oldest._packed.size();
+            _packedBytes -= oldest._packedSize;
+            std::string().swap(oldest._packed);
+            oldest._state = SpilledTile;
+        }
+    }
+
+    /* Encode a tile as runs of equal values: a 32-bit length, a presence
+     * byte and, for present runs, the value at the tile's precision.
+     * Absent positions always hold the default value. */
+    template <class T> inline void WiggleTiles<T>::packTile(Tile &t) const {
+        t._packed.clear();
+        size_t len = t._values.size();
+        for (size_t i = 0; i < len;) {
+            size_t j = i + 1;
+            // compare bits rather than values, to keep the sign of zeros
+            while (j < len && t._bits[j] == t._bits[i] &&
+                   (!t._bits[i] || memcmp(&t._values[j], &t._values[i], sizeof(T)) == 0)) {
+                ++j;
+            }
+            uint32_t runLength = j - i;
+            char present = t._bits[i] ? 1 : 0;
+            t._packed.append(reinterpret_cast<const char *>(&runLength), sizeof(runLength));
+            t._packed.push_back(present);
+            if (present) {
+                if (_precision == WiggleFloat16) {
+                    uint16_t value = floatToHalf(float(t._values[i]));
+                    t._packed.append(reinterpret_cast<const char *>(&value), sizeof(value));
+                } else if (_precision == WiggleFloat32) {
+                    float value = float(t._values[i]);
+                    t._packed.append(reinterpret_cast<const char *>(&value), sizeof(value));
+                } else {
+                    T value = t._values[i];
+                    t._packed.append(reinterpret_cast<const char *>(&value), sizeof(value));
+                }
+            }
+            i = j;
+        }
+        std::vector<T>().swap(t._values);
+        std::vector<bool>().swap(t._bits);
+    }
+
+    template <class T> inline void WiggleTiles<T>::unpackTile(Tile &t, hal_size_t len) const {
+        t._values.resize(len);
+        t._bits.resize(len);
+        const char *pos = t._packed.data();
+        const char *end = pos + t._packed.size();
+        size_t i = 0;
+        while (pos < end) {
+            uint32_t runLength;
+            memcpy(&runLength, pos, sizeof(runLength));
+            pos += sizeof(runLength);
+            bool present = *pos++ != 0;
+            T value = _defaultValue;
+            if (present) {
+                if (_precision == WiggleFloat16) {
+                    uint16_t half;
+                    memcpy(&half, pos, sizeof(half));
+                    pos += sizeof(half);
+                    value = T(halfToFloat(half));
+                } else if (_precision == WiggleFloat32) {
+                    float single;
+                    memcpy(&single, pos, sizeof(single));
+                    pos += sizeof(single);
+                    value = T(single);
+                } else {
+                    memcpy(&value, pos, sizeof(value));
+                    pos += sizeof(value);
+                }
+            }
+            assert(i + runLength <= len);
+            std::fill(t._values.begin() + i, t._values.begin() + i + runLength, value);
+            std::fill(t._bits.begin() + i, t._bits.begin() + i + runLength, present);
+            i += runLength;
+        }
+        assert(i == len);
+        std::string().swap(t._packed);
+    }
 }
 #endif
 // Local Variables:
@@ -7,7 +7,12 @@
 #include "halApiTestSupport.h"
 #include "halLiftoverTests.h"
 #include "halBlockLiftover.h"
+#include "halBedLine.h"
+#include "halWiggleTiles.h"
+#include <cmath>
 #include <cstdio>
+#include <cstring>
+#include <sstream>
 
 using namespace std;
 using namespace hal;
@@ -461,10 +466,87 @@ void halWiggleLiftoverTest(CuTest *testCase) {
     }
 }
 
+void halBedLineReadWriteTest(CuTest *testCase) {
+    // one BedLine is reused across records, as BedScanner does.  trailing
+    // commas are dropped and a single itemRGB value is expanded on output
+    BedLine bedLine;
+    string lineBuffer;
+    const char *records[][2] = {
+        {"chr1\t10\t20\n", "chr1\t10\t20\n"},
+        {"chr2\t-5\t100\tname\t7\t-\t0\t90\t1,2,3\t2\t10,20,\t0,80,\textra1\t\textra3\n",
+         "chr2\t-5\t100\tname\t7\t-\t0\t90\t1,2,3\t2\t10,20\t0,80\textra1\t\textra3\n"},
+        {"chr1\t0\t1\tn\t0\t.\t0\t1\t4\t1\t1\t0\n", "chr1\t0\t1\tn\t0\t.\t0\t1\t4,4,4\t1\t1\t0\n"},
+        {"chr3\t1\t2\ta\t9\n", "chr3\t1\t2\ta\t9\n"}};
+    for (size_t i = 0; i < sizeof(records) / sizeof(records[0]); ++i) {
+        stringstream in(records[i][0]), out;
+        bedLine.read(in, lineBuffer, 0);
+        bedLine.write(out);
+        CuAssertStrEquals(testCase, records[i][1], out.str().c_str());
+    }
+    CuAssertIntEquals(testCase, 5, bedLine._bedType);
+    CuAssertTrue(testCase, bedLine._extra.empty());
+
+    const char *badRecords[] = {"chr1\t10\n",           "chr1\t20\t10\n",        "chr1\tx\t10\n",
+                                "chr1\t1\t2\tn\t\t+\n", "chr1\t1\t2\tn\t0\t*\n", "chr1\t0\t99999999999999999999\n"};
+    for (size_t i = 0; i < sizeof(badRecords) / sizeof(badRecords[0]); ++i) {
+        stringstream in(badRecords[i]);
+        bool caught = false;
+        try {
+            bedLine.read(in, lineBuffer, 0);
+        } catch (hal_exception &e) {
+            caught = true;
+        }
+        CuAssertTrue(testCase, caught);
+    }
+}
+
+void halWiggleTilesTest(CuTest *testCase) {
+    CuAssertTrue(testCase, halfToFloat(floatToHalf(1.5f)) == 1.5f);
+    CuAssertTrue(testCase, halfToFloat(floatToHalf(-65504.0f)) == -65504.0f);
+    CuAssertTrue(testCase, halfToFloat(floatToHalf(1e6f)) == numeric_limits<float>::infinity());
+    CuAssertTrue(testCase, halfToFloat(floatToHalf(0.1f)) == 0.0999755859375f);
+    // subnormal: 1e-7 is 1.68 times the smallest half
+    CuAssertTrue(testCase, halfToFloat(floatToHalf(1e-7f)) == ldexp(1.0f, -23));
+
+    // the same writes and reads, with all tiles in memory and with a limit
+    // small enough that most are packed or spilled
+    const hal_size_t genomeSize = 10007;
+    const int precisions[] = {WiggleFloat16, WiggleFloat32, WiggleFloat64};
+    for (size_t p = 0; p < 3; ++p) {
+        WiggleTiles<double> unlimited, limited;
+        unlimited.setPrecision(WigglePrecision(precisions[p]));
+        limited.setPrecision(WigglePrecision(precisions[p]));
+        limited.setMemoryLimit(1024, "");
+        unlimited.init(genomeSize, -1.0, 100);
+        limited.init(genomeSize, -1.0, 100);
+        srand(p);
+        for (size_t i = 0; i < 20000; ++i) {
+            hal_index_t pos = rand() % genomeSize;
+            // runs of equal values, and values that differ in sign only
+            double val = (rand() % 4 == 0) ? -0.0 : double(rand() % 7) / 3.0;
+            for (hal_index_t j = pos; j < min(pos + rand() % 20, (hal_index_t)genomeSize); ++j) {
+                unlimited.set(j, val);
+                limited.set(j, val);
+            }
+            hal_index_t query = rand() % genomeSize;
+            double a = unlimited.get(query), b = limited.get(query);
+            CuAssertTrue(testCase, unlimited.exists(query) == limited.exists(query));
+            CuAssertTrue(testCase, memcmp(&a, &b, sizeof(double)) == 0);
+        }
+        for (hal_size_t pos = 0; pos < genomeSize; ++pos) {
+            CuAssertTrue(testCase, unlimited.exists(pos) == limited.exists(pos));
+            double a = unlimited.get(pos), b = limited.get(pos);
+            CuAssertTrue(testCase, memcmp(&a, &b, sizeof(double)) == 0);
+        }
+    }
+}
+
 CuSuite *halLiftoverTestSuite(void) {
     CuSuite *suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, halBedLiftoverTest);
     SUITE_ADD_TEST(suite, halWiggleLiftoverTest);
+    SUITE_ADD_TEST(suite, halBedLineReadWriteTest);
+    SUITE_ADD_TEST(suite, halWiggleTilesTest);
     return suite;
 }
 
@@ -47,6 +47,25 @@ def getHalLodExtractCmd(inHalPath, outHalPath, scale, keepSeq, inMemory,
 
     return cmd
 
+# Wrapper for halLodExtract creating all levels of detail in one run, each
+# level from the previous one.  levels is a list of (scale, outHalPath,
+# keepSequences) tuples, where sequences can only be kept in a prefix
+def getHalLodExtractLevelsCmd(inHalPath, levels, inMemory, probeFrac,
+                              minSeqFrac, chunk, numThreads):
+    scale, outHalPath, keepSeq = levels[0]
+    cmd = getHalLodExtractCmd(inHalPath, outHalPath, scale, keepSeq, inMemory,
+                              probeFrac, minSeqFrac, chunk, None)
+    if len(levels) > 1:
+        cmd += " --coarserLevels %s" % ",".join(
+            ["%s:%s" % (s, p) for s, p, k in levels[1:]])
+    numSeqLevels = len([k for s, p, k in levels if k is True])
+    assert all(k is True for s, p, k in levels[:numSeqLevels])
+    if numSeqLevels > 0:
+        cmd += " --sequenceLevels %d" % numSeqLevels
+    if numThreads > 1:
+        cmd += " --numThreads %d" % numThreads
+    return cmd
+
 # All created paths get put in the same place using the same logic
 def makePath(inHalPath, outDir, step, name, ext):
     inFileName = os.path.splitext(os.path.basename(inHalPath))[0]
@@ -133,13 +152,15 @@ def formatOutHalPath(outLodPath, outHalPath, absPath):
 # Run halLodExtract for each level of detail.
 def createLods(halPath, outLodPath, outDir, maxBlock, scale, overwrite,
                maxDNA, absPath, trans, inMemory, probeFrac, minSeqFrac,
-               scaleCorFac, numProc, chunk, minLod0, cutOff, minCovFrac):
+               scaleCorFac, numProc, chunk, minLod0, cutOff, minCovFrac,
+               singlePass):
     lodFile = open(outLodPath, "w")
     lodFile.write("0 %s\n" % formatOutHalPath(outLodPath, halPath, absPath))
     steps, lastIsMax = getSteps(halPath, maxBlock, scale, minLod0, cutOff,
                                 minSeqFrac, minCovFrac)
     curStepFactor = scaleCorFac
     lodExtractCmds = []
+    lodLevels = []
     prevStep = None
     for stepIdx in range(1,len(steps)):
         step = int(max(1, steps[stepIdx] * curStepFactor))
@@ -155,8 +176,10 @@ def createLods(halPath, outLodPath, outDir, maxBlock, scale, overwrite,
         if trans is True and stepIdx > 1:
             srcPath = makePath(halPath, outDir, prevStep, "lod", "hal")
         isMaxLod = stepIdx == len(steps) - 1 and lastIsMax is True
-        if not isMaxLod and (overwrite is True or
-                             not os.path.isfile(outHalPath)):
+        if not isMaxLod and singlePass is True:
+            lodLevels.append((stepScale, outHalPath, keepSequences))
+        elif not isMaxLod and (overwrite is True or
+                               not os.path.isfile(outHalPath)):
             lodExtractCmds.append(
                 getHalLodExtractCmd(srcPath, outHalPath, stepScale,
                                     keepSequences, inMemory, probeFrac,
@@ -172,6 +195,11 @@ def createLods(halPath, outLodPath, outDir, maxBlock, scale, overwrite,
         prevStep = step
         curStepFactor *= scaleCorFac
     lodFile.close()
+    if len(lodLevels) > 0:
+        lodExtractCmds.append(
+            getHalLodExtractLevelsCmd(halPath, lodLevels, inMemory, probeFrac,
+                                      minSeqFrac, chunk, numProc))
+        numProc = 1
     runParallelShellCommands(lodExtractCmds, numProc)
     
 def main(argv=None):
@@ -266,6 +294,12 @@ def main(argv=None):
                         "the LOD generation process will be cut off, and the"
                         " more fine-grained the highest LOD will be",
                         default=0.75, type=float)
+    parser.add_argument("--singlePass", help="Generate all levels of detail "
+                        "with one halLodExtract run that scans the input "
+                        "once, each level being interpolated from the previous"
+                        " one (as with --trans).  --numProc is passed to it as"
+                        " its number of threads",
+                        action="store_true", default=False)
 
     args = parser.parse_args()
 
@@ -282,6 +316,9 @@ def main(argv=None):
     if args.trans is True and args.numProc > 1:
         raise RuntimeError("--numProc > 1 not supported when --trans option is "
                            "set")
+    if args.singlePass is True and args.resume is True:
+        raise RuntimeError("--resume not supported when --singlePass option is "
+                           "set")
 
     if args.maxDNA < 0:
         args.maxDNA = sys.maxsize
@@ -290,7 +327,7 @@ def main(argv=None):
                args.maxBlock, args.scale, not args.resume, args.maxDNA,
                args.absPath, args.trans, args.inMemory, args.probeFrac,
                args.minSeqFrac, args.scaleCorFac, args.numProc, args.chunk,
-               args.minLod0, args.cutOff, args.minCovFrac)
+               args.minLod0, args.cutOff, args.minCovFrac, args.singlePass)
     
 if __name__ == "__main__":
     sys.exit(main())
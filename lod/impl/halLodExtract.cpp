@@ -10,6 +10,7 @@
 #include <cassert>
 #include <deque>
 #include <limits>
+#include <memory>
 extern "C" {
 #include "sonLibTree.h"
 }
@@ -17,41 +18,82 @@ extern "C" {
 using namespace std;
 using namespace hal;
 
-LodExtract::LodExtract() {
+LodExtract::LodExtract() : _graph(NULL) {
 }
 
 LodExtract::~LodExtract() {
 }
 
-void LodExtract::createInterpolatedAlignment(AlignmentConstPtr inAlignment, AlignmentPtr outAlignment, double scale,
+void LodExtract::createInterpolatedAlignment(const ThreadAlignments &inAlignments, AlignmentPtr outAlignment, double scale,
                                              const string &tree, const string &rootName, bool keepSequences, bool allSequences,
                                              double probeFrac, double minSeqFrac) {
-    _inAlignment = inAlignment;
+    _inAlignment = inAlignments.get(0);
     _outAlignment = outAlignment;
     _keepSequences = keepSequences;
     _allSequences = allSequences;
     _probeFrac = probeFrac;
     _minSeqFrac = minSeqFrac;
 
-    string newTree = tree.empty() ? inAlignment->getNewickTree() : tree;
+    string newTree = tree.empty() ? _inAlignment->getNewickTree() : tree;
     createTree(newTree, rootName);
     cout << "tree = " << _outAlignment->getNewickTree() << endl;
 
-    deque<string> bfQueue;
-    bfQueue.push_front(_outAlignment->getRootName());
-    while (!bfQueue.empty()) {
-        string genomeName = bfQueue.back();
-        bfQueue.pop_back();
-        vector<string> childNames = _outAlignment->getChildNames(genomeName);
-        if (!childNames.empty()) {
-            convertInternalNode(genomeName, scale);
-            for (size_t childIdx = 0; childIdx < childNames.size(); childIdx++) {
-                bfQueue.push_back(childNames[childIdx]);
+    // breadth-first, one level at a time.  the internal nodes of a level
+    // are converted in batches of (at most) one per input alignment: the
+    // graphs of a batch are built in parallel, then written in order.
+    vector<NodeGraph> nodes(inAlignments.size());
+    vector<string> level(1, _outAlignment->getRootName());
+    while (!level.empty()) {
+        vector<string> internalNames;
+        vector<string> nextLevel;
+        for (size_t i = 0; i < level.size(); ++i) {
+            vector<string> childNames = _outAlignment->getChildNames(level[i]);
+            if (!childNames.empty()) {
+                internalNames.push_back(level[i]);
+                nextLevel.insert(nextLevel.end(), childNames.begin(), childNames.end());
+            }
+        }
+        for (size_t first = 0; first < internalNames.size(); first += nodes.size()) {
+            size_t batchSize = std::min(nodes.size(), internalNames.size() - first);
+            for (size_t i = 0; i < batchSize; ++i) {
+                openInternalNode(inAlignments.get(i), internalNames[first + i], scale, nodes[i]);
+            }
+            parallelFor(batchSize, inAlignments.size(), [&](size_t i, unsigned) { buildInternalNode(nodes[i]); });
+            for (size_t i = 0; i < batchSize; ++i) {
+                writeInternalNode(nodes[i]);
             }
         }
+        level.swap(nextLevel);
     }
 }
 
+void LodExtract::createInterpolatedLevels(const ThreadAlignments &inAlignments, const vector<string> &outPaths,
+                                          const vector<double> &scales, const CLParser *options, const string &tree,
+                                          const string &rootName, size_t numSequenceLevels, bool allSequences,
+                                          double probeFrac, double minSeqFrac, AlignmentConstPtr scaleAlignment) {
+    assert(outPaths.size() == scales.size());
+    _minAvgBlockSizes.clear();
+    _scaleAlignment = scaleAlignment;
+    const ThreadAlignments *srcAlignments = &inAlignments;
+    unique_ptr<ThreadAlignments> levelAlignments;
+    for (size_t level = 0; level < outPaths.size(); ++level) {
+        AlignmentPtr outAlignment(openHalAlignment(outPaths[level], options, CREATE_ACCESS));
+        // the tree of the first level is kept by the following ones
+        createInterpolatedAlignment(*srcAlignments, outAlignment, scales[level], level == 0 ? tree : "",
+                                    level == 0 ? rootName : "", level < numSequenceLevels, allSequences, probeFrac,
+                                    minSeqFrac);
+        outAlignment->close();
+        if (level + 1 < outPaths.size()) {
+            levelAlignments.reset();
+            AlignmentConstPtr levelAlignment(openHalAlignment(outPaths[level], options));
+            unsigned numThreads = supportsParallelRead(outPaths[level], options) ? inAlignments.size() : 1;
+            levelAlignments.reset(new ThreadAlignments(levelAlignment, outPaths[level], options, numThreads));
+            srcAlignments = levelAlignments.get();
+        }
+    }
+    _scaleAlignment.reset();
+}
+
 void LodExtract::createTree(const string &tree, const string &rootName) {
     if (_outAlignment->getNumGenomes() != 0) {
         throw hal_exception("Output alignment not empty");
@@ -119,19 +161,60 @@ void LodExtract::createTree(const string &tree, const string &rootName) {
     stTree_destruct(root);
 }
 
-void LodExtract::convertInternalNode(const string &genomeName, double scale) {
-    const Genome *parent = _inAlignment->openGenome(genomeName);
-    assert(parent != NULL);
+void LodExtract::openInternalNode(AlignmentConstPtr inAlignment, const string &genomeName, double scale,
+                                  NodeGraph &node) {
+    node._alignment = inAlignment;
+    node._parent = inAlignment->openGenome(genomeName);
+    assert(node._parent != NULL);
     vector<string> childNames = _outAlignment->getChildNames(genomeName);
-    vector<const Genome *> children;
+    node._children.clear();
     for (hal_size_t i = 0; i < childNames.size(); ++i) {
-        children.push_back(_inAlignment->openGenome(childNames[i]));
+        node._children.push_back(inAlignment->openGenome(childNames[i]));
     }
-    const Genome *grandParent = NULL; // TEMP HACK  parent->getParent();
-    hal_size_t minAvgBlockSize = getMinAvgBlockSize(parent, children, grandParent);
-    hal_size_t step = (hal_size_t)(scale * minAvgBlockSize);
-    _graph.build(_inAlignment, parent, children, grandParent, step, _allSequences, _probeFrac, _minSeqFrac);
+    node._grandParent = NULL; // TEMP HACK  parent->getParent();
+    // coarser levels use the block sizes of the input they were derived from
+    map<string, hal_size_t>::iterator blockSizeIt = _minAvgBlockSizes.find(genomeName);
+    if (blockSizeIt == _minAvgBlockSizes.end()) {
+        hal_size_t minAvgBlockSize;
+        if (_scaleAlignment.get() == NULL) {
+            minAvgBlockSize = getMinAvgBlockSize(node._parent, node._children, node._grandParent);
+        } else {
+            vector<const Genome *> scaleChildren;
+            const Genome *scaleParent = _scaleAlignment->openGenome(genomeName);
+            if (scaleParent == NULL) {
+                throw hal_exception("Genome " + genomeName + " not found in the alignment the scale is relative to");
+            }
+            for (hal_size_t i = 0; i < childNames.size(); ++i) {
+                scaleChildren.push_back(_scaleAlignment->openGenome(childNames[i]));
+                if (scaleChildren.back() == NULL) {
+                    throw hal_exception("Genome " + childNames[i] + " not found in the alignment the scale is relative to");
+                }
+            }
+            minAvgBlockSize = getMinAvgBlockSize(scaleParent, scaleChildren, NULL);
+        }
+        blockSizeIt = _minAvgBlockSizes.insert(make_pair(genomeName, minAvgBlockSize)).first;
+    }
+    node._step = (hal_size_t)(scale * blockSizeIt->second);
+    node._log.str("");
+}
 
+void LodExtract::buildInternalNode(NodeGraph &node) {
+    node._graph.build(node._alignment, node._parent, node._children, node._grandParent, node._step, _allSequences,
+                      _probeFrac, _minSeqFrac, node._log);
+}
+
+void LodExtract::writeInternalNode(NodeGraph &node) {
+    _inAlignment = node._alignment;
+    _graph = &node._graph;
+    const Genome *parent = node._parent;
+    const vector<const Genome *> &children = node._children;
+    const Genome *grandParent = node._grandParent;
+    cout << node._log.str();
+
+    vector<string> childNames;
+    for (hal_size_t i = 0; i < children.size(); ++i) {
+        childNames.push_back(children[i]->getName());
+    }
     map<const Sequence *, hal_size_t> segmentCounts;
     countSegmentsInGraph(segmentCounts);
 
@@ -146,7 +229,7 @@ void LodExtract::convertInternalNode(const string &genomeName, double scale) {
     // if we're gonna print anything out, do it before this:
     // (not necesssary but by closing genomes we erase their hdf5 caches
     // which can make a difference on huge trees
-    _graph.erase();
+    node._graph.erase();
     _outAlignment->closeGenome(_outAlignment->openGenome(parent->getName()));
     _inAlignment->closeGenome(parent);
     for (hal_size_t i = 0; i < children.size(); ++i) {
@@ -164,8 +247,8 @@ void LodExtract::countSegmentsInGraph(map<const Sequence *, hal_size_t> &segment
     const LodSegment *segment;
     pair<map<const Sequence *, hal_size_t>::iterator, bool> res;
 
-    for (hal_size_t blockIdx = 0; blockIdx < _graph.getNumBlocks(); ++blockIdx) {
-        block = _graph.getBlock(blockIdx);
+    for (hal_size_t blockIdx = 0; blockIdx < _graph->getNumBlocks(); ++blockIdx) {
+        block = _graph->getBlock(blockIdx);
         for (hal_size_t segIdx = 0; segIdx < block->getNumSegments(); ++segIdx) {
             segment = block->getSegment(segIdx);
             res = segmentCounts.insert(pair<const Sequence *, hal_size_t>(segment->getSequence(), 0));
@@ -176,7 +259,7 @@ void LodExtract::countSegmentsInGraph(map<const Sequence *, hal_size_t> &segment
 
     // add unsampled non-zero sequences to dimensions, by looking for
     // sequences who have telomeres but no segments.
-    const LodBlock *telomeres = _graph.getTelomeres();
+    const LodBlock *telomeres = _graph->getTelomeres();
     for (hal_size_t telIdx = 0; telIdx < telomeres->getNumSegments(); ++telIdx) {
         segment = telomeres->getSegment(telIdx);
         if (segment->getSequence()->getSequenceLength() > 0) {
@@ -299,7 +382,7 @@ void LodExtract::writeSegments(const Genome *inParent, const vector<const Genome
                 bottom = const_pointer_cast<BottomSegmentIterator>(outSequence->getBottomSegmentIterator());
                 outSegment = bottom;
             }
-            const LodGraph::SegmentSet *segSet = _graph.getSegmentSet(inSequence);
+            const LodGraph::SegmentSet *segSet = _graph->getSegmentSet(inSequence);
             assert(segSet != NULL);
             LodGraph::SegmentSet::const_iterator segIt = segSet->begin();
             if (segSet->size() > 2) {
@@ -358,9 +441,9 @@ void LodExtract::writeHomologies(const Genome *inParent, const vector<const Geno
     TopSegmentIteratorPtr top = outChild->getTopSegmentIterator();
 
     // FOR EVERY BLOCK
-    for (hal_size_t blockIdx = 0; blockIdx < _graph.getNumBlocks(); ++blockIdx) {
+    for (hal_size_t blockIdx = 0; blockIdx < _graph->getNumBlocks(); ++blockIdx) {
         SegmentMap segMap;
-        const LodBlock *block = _graph.getBlock(blockIdx);
+        const LodBlock *block = _graph->getBlock(blockIdx);
 
         for (hal_size_t segIdx = 0; segIdx < block->getNumSegments(); ++segIdx) {
             const LodSegment *segment = block->getSegment(segIdx);
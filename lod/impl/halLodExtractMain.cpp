@@ -7,10 +7,38 @@
 
 #include "halLodExtract.h"
 #include <cassert>
+#include <sstream>
 
 using namespace std;
 using namespace hal;
 
+static void parseLevels(const string &outHalPath, double scale, const string &coarserLevels, vector<string> &outPaths,
+                        vector<double> &scales) {
+    outPaths.push_back(outHalPath);
+    scales.push_back(scale);
+    if (coarserLevels == "\"\"") {
+        return;
+    }
+    vector<string> levels = chopString(coarserLevels, ",");
+    for (size_t i = 0; i < levels.size(); ++i) {
+        size_t colon = levels[i].find(':');
+        if (colon == string::npos || colon == 0 || colon + 1 == levels[i].length()) {
+            throw hal_exception("Invalid level " + levels[i] + " in --coarserLevels: expected scale:outHalPath");
+        }
+        stringstream ss(levels[i].substr(0, colon));
+        double levelScale;
+        ss >> levelScale;
+        if (!ss || !ss.eof()) {
+            throw hal_exception("Invalid scale in --coarserLevels level " + levels[i]);
+        }
+        if (levelScale <= scales.back()) {
+            throw hal_exception("Scales in --coarserLevels must be increasing and larger than the scale argument");
+        }
+        outPaths.push_back(levels[i].substr(colon + 1));
+        scales.push_back(levelScale);
+    }
+}
+
 static void initParser(CLParser &optionsParser) {
     optionsParser.addArgument("inHalPath", "Input hal file");
     optionsParser.addArgument("outHalPath", "output hal file");
@@ -39,6 +67,22 @@ static void initParser(CLParser &optionsParser) {
                                                 "By default, small sequences may be skipped if "
                                                 "they fall within the step size.",
                                 false);
+    optionsParser.addOption("coarserLevels", "comma-separated list of scale:outHalPath pairs of coarser levels of detail "
+                                             "to create in the same run.  Each level is interpolated from the one "
+                                             "before it, but its scale is relative to the input like the scale "
+                                             "argument (which gives the first level, outHalPath)",
+                            "\"\"");
+    optionsParser.addOption("sequenceLevels", "with --keepSequences and --coarserLevels, only write the sequences of "
+                                              "the first sequenceLevels levels (0 for all).",
+                            0);
+    optionsParser.addOption("scaleInput", "HAL file whose block sizes the scales are relative to (the input if "
+                                          "empty).  Giving the original input makes a level from the level "
+                                          "before it the same as with --coarserLevels",
+                            "\"\"");
+    optionsParser.addOption("numThreads", "number of threads building the graphs of internal nodes at the same depth "
+                                          "of the tree (0 to use all cores).  Only mmap HAL files can be read by more "
+                                          "than one thread",
+                            1);
     optionsParser.setDescription("Generate a new HAL file at a coarser "
                                  "Level of Detail (LOD) by interpolation. "
                                  "The scale parameter is used to estimate "
@@ -59,6 +103,10 @@ int main(int argc, char **argv) {
     bool allSequences;
     double probeFrac;
     double minSeqFrac;
+    unsigned numThreads;
+    string coarserLevels;
+    size_t sequenceLevels;
+    string scaleInput;
     try {
         optionsParser.parseOptions(argc, argv);
         inHalPath = optionsParser.getArgument<string>("inHalPath");
@@ -70,6 +118,10 @@ int main(int argc, char **argv) {
         allSequences = optionsParser.getFlag("allSequences");
         probeFrac = optionsParser.getOption<double>("probeFrac");
         minSeqFrac = optionsParser.getOption<double>("minSeqFrac");
+        numThreads = optionsParser.getOption<unsigned>("numThreads");
+        coarserLevels = optionsParser.getOption<string>("coarserLevels");
+        sequenceLevels = optionsParser.getOption<size_t>("sequenceLevels");
+        scaleInput = optionsParser.getOption<string>("scaleInput");
         if (allSequences == true) {
             minSeqFrac = 0.;
         }
@@ -84,11 +136,9 @@ int main(int argc, char **argv) {
             throw hal_exception("Input hal alignment is empty");
         }
 
-        AlignmentPtr outAlignment(openHalAlignment(outHalPath, &optionsParser, hal::CREATE_ACCESS));
-
-        if (outAlignment->getNumGenomes() != 0) {
-            throw hal_exception("Output hal Alignmnent cannot be initialized");
-        }
+        vector<string> outPaths;
+        vector<double> scales;
+        parseLevels(outHalPath, scale, coarserLevels, outPaths, scales);
         if (rootName != "\"\"" && inAlignment->openGenome(rootName) == NULL) {
             throw hal_exception(string("Genome ") + rootName + " not found");
         }
@@ -99,9 +149,22 @@ int main(int argc, char **argv) {
             outTree = "";
         }
 
+        numThreads = getReadThreadCount(inHalPath, &optionsParser, numThreads);
+        ThreadAlignments inAlignments(inAlignment, inHalPath, &optionsParser, numThreads);
+
+        size_t numSequenceLevels = 0;
+        if (keepSequences == true) {
+            numSequenceLevels = sequenceLevels == 0 ? outPaths.size() : sequenceLevels;
+        }
+
+        AlignmentConstPtr scaleAlignment;
+        if (scaleInput != "\"\"") {
+            scaleAlignment = openHalAlignment(scaleInput, &optionsParser);
+        }
+
         LodExtract lodExtract;
-        lodExtract.createInterpolatedAlignment(inAlignment, outAlignment, scale, outTree, rootName, keepSequences,
-                                               allSequences, probeFrac, minSeqFrac);
+        lodExtract.createInterpolatedLevels(inAlignments, outPaths, scales, &optionsParser, outTree, rootName,
+                                            numSequenceLevels, allSequences, probeFrac, minSeqFrac, scaleAlignment);
     } catch (hal_exception &e) {
         cerr << "hal exception caught: " << e.what() << endl;
         return 1;
@@ -38,7 +38,8 @@ void LodGraph::erase() {
 }
 
 void LodGraph::build(AlignmentConstPtr alignment, const Genome *parent, const vector<const Genome *> &children,
-                     const Genome *grandParent, hal_size_t step, bool allSequences, double probeFrac, double minSeqFrac) {
+                     const Genome *grandParent, hal_size_t step, bool allSequences, double probeFrac, double minSeqFrac,
+                     ostream &os) {
     erase();
     _alignment = AlignmentConstPtr(alignment);
     _parent = parent;
@@ -60,18 +61,25 @@ void LodGraph::build(AlignmentConstPtr alignment, const Genome *parent, const ve
         _genomes.insert(_grandParent);
     }
 
-    for (set<const Genome *>::iterator gi = _genomes.begin(); gi != _genomes.end(); ++gi) {
-        scanGenome(*gi);
+    // the columns sampled depend on the genomes scanned before, so scan
+    // them in tree order rather than by address: the graph must not
+    // depend on where the genomes were allocated
+    scanGenome(parent);
+    for (vector<const Genome *>::const_iterator child = children.begin(); child != children.end(); ++child) {
+        scanGenome(*child);
+    }
+    if (_grandParent != NULL) {
+        scanGenome(_grandParent);
     }
 
     computeAdjacencies();
-    printDimensions(cout);
+    printDimensions(os);
     optimizeByExtension();
-    printDimensions(cout);
+    printDimensions(os);
     optimizeByMerging();
-    printDimensions(cout);
+    printDimensions(os);
     optimizeByInsertion();
-    printDimensions(cout);
+    printDimensions(os);
     assert(checkCoverage() == true);
 }
 
@@ -9,9 +9,11 @@
 #include "halCLParser.h"
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <deque>
 #include <fstream>
 #include <limits>
+#include <mutex>
 #include <sstream>
 
 #ifdef ENABLE_UDC
@@ -36,21 +38,80 @@ const unsigned long LodManager::MaxAgeSec = 432000;
 // hal/lod/halLodInterpolate.py)
 const string LodManager::MaxLodToken = "max";
 
+// alignments opened by all LodManagers, by path and open settings.  the
+// entries don't own the alignments: one is closed and its entry removed when
+// the last pointer to it is released, be it held by a manager or by a caller
+// of getAlignment()
+typedef pair<string, string> SharedAlignmentKey;
+typedef map<SharedAlignmentKey, weak_ptr<const Alignment>> SharedAlignmentMap;
+static SharedAlignmentMap sharedAlignments;
+static mutex sharedAlignmentsMutex;
+
+// levels are opened read-only
+static const unsigned lodAccessMode = READ_ACCESS;
+
+// options and flags that change how an alignment is opened
+static const char *const openOptionNames[] = {"format", "hdf5CacheMDC", "cacheMDC", "hdf5CacheRDC",
+                                              "cacheRDC", "hdf5CacheBytes", "cacheBytes", "hdf5CacheW0",
+                                              "cacheW0", "mmapFileSize", "mmapSizeIncrease", "udcCacheDir"};
+static const char *const openFlagNames[] = {"hdf5InMemory", "inMemory", "udcVerbose"};
+
+// describe the settings an alignment is opened with, so that it is only
+// shared by managers that would open it the same way, whichever parser
+// holds their options
+static string getOpenSettings(const CLParser *options) {
+    stringstream settings;
+    settings << "mode=" << lodAccessMode;
+    if (options != NULL) {
+        for (const char *name : openOptionNames) {
+            if (options->hasOption(name)) {
+                settings << '\0' << name << '=' << options->getOption<const string &>(name);
+            }
+        }
+        for (const char *name : openFlagNames) {
+            if (options->hasFlag(name)) {
+                settings << '\0' << name << '=' << options->getFlag(name);
+            }
+        }
+    }
+    return settings.str();
+}
+
+// wrap an opened alignment in a pointer that closes it and removes it from
+// the shared alignments when the last copy goes
+static AlignmentConstPtr shareAlignment(const SharedAlignmentKey &key, AlignmentConstPtr alignment) {
+    return AlignmentConstPtr(alignment.get(), [key, alignment](const Alignment *) mutable {
+        {
+            lock_guard<mutex> lock(sharedAlignmentsMutex);
+            SharedAlignmentMap::iterator sharedIt = sharedAlignments.find(key);
+            // the path may have been opened again since this pointer expired
+            if (sharedIt != sharedAlignments.end() && sharedIt->second.expired()) {
+                sharedAlignments.erase(sharedIt);
+            }
+        }
+        const_cast<Alignment *>(alignment.get())->close();
+        alignment.reset();
+    });
+}
+
+// get the shared alignment of a path, or NULL if it isn't open.  must be
+// called with the lock held
+static AlignmentConstPtr findSharedAlignment(const SharedAlignmentKey &key) {
+    SharedAlignmentMap::iterator sharedIt = sharedAlignments.find(key);
+    return sharedIt != sharedAlignments.end() ? sharedIt->second.lock() : AlignmentConstPtr();
+}
+
 LodManager::LodManager() : _options(NULL), _maxLodLowerBound((hal_size_t)numeric_limits<hal_index_t>::max()) {
     // FIXME: the way options work is weird.
 }
 
 LodManager::~LodManager() {
-    for (AlignmentMap::iterator mapIt = _map.begin(); mapIt != _map.end(); ++mapIt) {
-        if (mapIt->second.second.get() != NULL) {
-            const_cast<Alignment *>(mapIt->second.second.get())->close();
-        }
-    }
+    closeLevels();
 }
 
 void LodManager::loadLODFile(const string &lodPath, const CLParser *options) {
+    closeLevels();
     _options = options;
-    _map.clear();
 
 #ifdef ENABLE_UDC
     char *cpath = const_cast<char *>(lodPath.c_str());
@@ -101,7 +162,7 @@ void LodManager::loadLODFile(const string &lodPath, const CLParser *options) {
         } else {
             fullHalPath = resolvePath(lodPath, path);
         }
-        _map.insert(pair<hal_size_t, PathAlign>(minLen, PathAlign(fullHalPath, AlignmentConstPtr())));
+        _map.insert(pair<hal_size_t, Level>(minLen, Level(fullHalPath)));
         ++lineNum;
     }
 
@@ -109,9 +170,9 @@ void LodManager::loadLODFile(const string &lodPath, const CLParser *options) {
 }
 
 void LodManager::loadSingeHALFile(const string &halPath, const CLParser *options) {
+    closeLevels();
     _options = options;
-    _map.clear();
-    _map.insert(pair<hal_size_t, PathAlign>(0, PathAlign(halPath, AlignmentConstPtr())));
+    _map.insert(pair<hal_size_t, Level>(0, Level(halPath)));
     _maxLodLowerBound = (hal_size_t)numeric_limits<hal_index_t>::max();
     checkMap(halPath);
 }
@@ -126,17 +187,63 @@ AlignmentConstPtr LodManager::getAlignment(hal_size_t queryLength, bool needDNA)
         --mapIt;
     }
     assert(mapIt->first <= queryLength);
-    AlignmentConstPtr &alignment = mapIt->second.second;
     if (mapIt->first == _maxLodLowerBound) {
         throw hal_exception("Query length " + std::to_string(queryLength) + " above maximum LOD size of " +
                             std::to_string(getMaxQueryLength()));
     }
-    if (alignment.get() == NULL) {
-        alignment = AlignmentConstPtr(openHalAlignment(mapIt->second.first, _options));
-        checkAlignment(mapIt->first, mapIt->second.first, alignment);
+    if (mapIt->second._alignment.get() == NULL) {
+        openLevel(mapIt->first, mapIt->second);
+    }
+    assert(mapIt->second._alignment.get() != NULL);
+    return mapIt->second._alignment;
+}
+
+vector<LodManager::LevelInfo> LodManager::getLevelInfo() const {
+    vector<LevelInfo> levels;
+    for (AlignmentMap::const_iterator mapIt = _map.begin(); mapIt != _map.end(); ++mapIt) {
+        if (mapIt->first != _maxLodLowerBound) {
+            LevelInfo info;
+            info._minQueryLength = mapIt->first;
+            info._path = mapIt->second._path;
+            info._opened = mapIt->second._alignment.get() != NULL;
+            info._shared = mapIt->second._shared;
+            info._openSeconds = mapIt->second._openSeconds;
+            levels.push_back(info);
+        }
     }
-    assert(mapIt->second.second.get() != NULL);
-    return alignment;
+    return levels;
+}
+
+void LodManager::openLevel(hal_size_t minQuery, Level &level) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    SharedAlignmentKey key(level._path, getOpenSettings(_options));
+    {
+        lock_guard<mutex> lock(sharedAlignmentsMutex);
+        level._alignment = findSharedAlignment(key);
+    }
+    level._shared = level._alignment.get() != NULL;
+    if (level._shared == false) {
+        // open without holding the lock, so other files can be opened
+        // at the same time
+        AlignmentConstPtr alignment(openHalAlignment(level._path, _options, lodAccessMode));
+        checkAlignment(minQuery, level._path, alignment);
+        lock_guard<mutex> lock(sharedAlignmentsMutex);
+        level._alignment = findSharedAlignment(key);
+        if (level._alignment.get() != NULL) {
+            // another manager opened it in the meantime
+            level._shared = true;
+            const_cast<Alignment *>(alignment.get())->close();
+        } else {
+            level._alignment = shareAlignment(key, alignment);
+            sharedAlignments[key] = level._alignment;
+        }
+    }
+    level._openSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void LodManager::closeLevels() {
+    // the alignments are closed as the last pointers to them are released
+    _map.clear();
 }
 
 bool LodManager::isLod0(hal_size_t queryLength) const {
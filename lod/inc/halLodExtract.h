@@ -10,9 +10,11 @@
 
 #include "hal.h"
 #include "halLodGraph.h"
+#include "halParallel.h"
 #include <iostream>
 #include <map>
 #include <set>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -27,23 +29,56 @@ namespace hal {
      *
      * The output alignment is created from an arbitrary subset of genomes from
      * the input, linked together in an arbitrary tree.  By default, the
-     * identical tree is used. */
+     * identical tree is used.
+     *
+     * The internal nodes at the same depth of the output tree are independent,
+     * so their graphs are built in parallel, one per input alignment in
+     * inAlignments.  Only the writing is serial. */
     class LodExtract {
       public:
         LodExtract();
         ~LodExtract();
 
-        void createInterpolatedAlignment(AlignmentConstPtr inAlignment, AlignmentPtr outAlignment, double scale,
+        void createInterpolatedAlignment(const ThreadAlignments &inAlignments, AlignmentPtr outAlignment, double scale,
                                          const std::string &tree, const std::string &rootName, bool keepSequences,
                                          bool allSequences, double probeFrac, double minSeqFrac);
 
+        /** Create a series of increasingly coarse alignments in one run.
+         * The first level is interpolated from inAlignments, and each
+         * following level from the level before it, reopened from its
+         * path, so the input is only scanned once.  The scales are all
+         * relative to the input: the step of an internal node is its scale
+         * times the minimum average block size it has in the input, or in
+         * scaleAlignment if it is given (so that a level can be made again
+         * from the one before it).  Sequences are kept in the first
+         * numSequenceLevels levels. */
+        void createInterpolatedLevels(const ThreadAlignments &inAlignments, const std::vector<std::string> &outPaths,
+                                      const std::vector<double> &scales, const CLParser *options,
+                                      const std::string &tree, const std::string &rootName, size_t numSequenceLevels,
+                                      bool allSequences, double probeFrac, double minSeqFrac,
+                                      AlignmentConstPtr scaleAlignment = AlignmentConstPtr());
+
       protected:
         typedef std::set<const LodSegment *, LodSegmentPLess> SegmentSet;
         typedef std::map<const Genome *, SegmentSet *> SegmentMap;
 
+        /** An internal node and the graph built for it from one of the
+         * input alignments */
+        struct NodeGraph {
+            AlignmentConstPtr _alignment;
+            const Genome *_parent;
+            std::vector<const Genome *> _children;
+            const Genome *_grandParent;
+            hal_size_t _step;
+            LodGraph _graph;
+            std::ostringstream _log;
+        };
+
       protected:
         void createTree(const std::string &tree, const std::string &rootName);
-        void convertInternalNode(const std::string &genomeName, double scale);
+        void openInternalNode(AlignmentConstPtr inAlignment, const std::string &genomeName, double scale, NodeGraph &node);
+        void buildInternalNode(NodeGraph &node);
+        void writeInternalNode(NodeGraph &node);
         void countSegmentsInGraph(std::map<const Sequence *, hal_size_t> &segmentCounts);
         void writeDimensions(const std::map<const Sequence *, hal_size_t> &segmentCounts, const std::string &parentName,
                              const std::vector<std::string> &childNames);
@@ -60,7 +95,11 @@ namespace hal {
         AlignmentConstPtr _inAlignment;
         AlignmentPtr _outAlignment;
 
-        LodGraph _graph;
+        const LodGraph *_graph;
+        // minimum average block size of each internal node in the input
+        // (or _scaleAlignment)
+        std::map<std::string, hal_size_t> _minAvgBlockSizes;
+        AlignmentConstPtr _scaleAlignment;
         bool _keepSequences;
         bool _allSequences;
         double _probeFrac;
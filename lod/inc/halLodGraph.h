@@ -37,9 +37,12 @@ namespace hal {
         /** Build the LOD graph for a given subtree of the alignment.  The
          * entire graph is stored in memory in a special structure (ie not within
          * HAL).  The step parameter dictates how coarse-grained the interpolation
-         * is:  every step bases are sampled.  */
+         * is:  every step bases are sampled.  The dimensions of the graph
+         * after each pass are printed to os.  Graphs built from different
+         * Alignment objects can be built at the same time. */
         void build(AlignmentConstPtr alignment, const Genome *parent, const std::vector<const Genome *> &children,
-                   const Genome *grandParent, hal_size_t step, bool allSequences, double probeFrac, double minSeqFrac);
+                   const Genome *grandParent, hal_size_t step, bool allSequences, double probeFrac, double minSeqFrac,
+                   std::ostream &os);
 
         /** Help debuggin and tuning */
         void printDimensions(std::ostream &os) const;
@@ -20,9 +20,29 @@ namespace hal {
 
     /** This is a container that keeps track of LOD alignments as generated
      * by halLodExtract.py
+     *
+     * The alignment of a level is only opened by the first query that needs
+     * it.  Opened alignments are shared by all the LodManagers that load the
+     * same HAL file with the same opening options (storage format, caches,
+     * UDC and mmap settings), whichever CLParser holds them, so each file
+     * is opened once however many handles refer to it.  It is closed when
+     * the last manager using it, or the last pointer returned by
+     * getAlignment(), is released, in whatever order that happens.
      */
     class LodManager {
       public:
+        /** Open statistics of a level of detail */
+        struct LevelInfo {
+            hal_size_t _minQueryLength;
+            std::string _path;
+            // alignment opened by this manager
+            bool _opened;
+            // alignment was already opened by another manager
+            bool _shared;
+            // time spent opening (and checking) the alignment
+            double _openSeconds;
+        };
+
         LodManager();
         virtual ~LodManager();
 
@@ -48,6 +68,10 @@ namespace hal {
         /** Any query greater than this is disabled */
         hal_size_t getMaxQueryLength() const;
 
+        /** Get the open statistics of each level, by increasing minimum
+         * query length (the max token is not included) */
+        std::vector<LevelInfo> getLevelInfo() const;
+
         /** Maximum age of a URL in seconds such that we dont try to
          * preload headers for all the HAL files */
         static const unsigned long MaxAgeSec;
@@ -56,13 +80,21 @@ namespace hal {
         static const std::string MaxLodToken;
 
       private:
+        struct Level {
+            Level(const std::string &path) : _path(path), _shared(false), _openSeconds(0.) {
+            }
+            std::string _path;
+            AlignmentConstPtr _alignment;
+            bool _shared;
+            double _openSeconds;
+        };
+        typedef std::map<hal_size_t, Level> AlignmentMap;
+
         std::string resolvePath(const std::string &lodPath, const std::string &halPath);
         void checkMap(const std::string &lodPath);
         void checkAlignment(hal_size_t minQuery, const std::string &path, AlignmentConstPtr alignment);
-        void preloadAlignments();
-
-        typedef std::pair<std::string, AlignmentConstPtr> PathAlign;
-        typedef std::map<hal_size_t, PathAlign> AlignmentMap;
+        void openLevel(hal_size_t minQuery, Level &level);
+        void closeLevels();
 
         const CLParser *_options;
         AlignmentMap _map;
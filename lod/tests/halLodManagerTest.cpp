@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+#include "halApiTestSupport.h"
+#include "halCLParser.h"
+#include "halLodManager.h"
+#include "halRandNumberGen.h"
+#include "halRandomData.h"
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+using namespace std;
+using namespace hal;
+
+static RandNumberGen rng;
+
+/* LOD file with two levels over two random alignments, removed with the
+ * alignments when the test is done */
+struct LodFiles {
+    LodFiles() {
+        _halPaths.push_back(getTempFile());
+        _halPaths.push_back(getTempFile());
+        for (size_t i = 0; i < _halPaths.size(); ++i) {
+            AlignmentPtr alignment(getTestAlignmentInstances(STORAGE_FORMAT_MMAP, _halPaths[i], CREATE_ACCESS));
+            createRandomAlignment(rng, alignment, 10, 1e-10, 2, 3, 10, 100, 5, 10);
+            alignment->close();
+        }
+        _lodPath = getTempFile();
+        ofstream lodFile(_lodPath.c_str());
+        lodFile << "0 " << _halPaths[0] << endl << "1000 " << _halPaths[1] << endl << "5000 " << LodManager::MaxLodToken << endl;
+    }
+    ~LodFiles() {
+        for (size_t i = 0; i < _halPaths.size(); ++i) {
+            ::unlink(_halPaths[i].c_str());
+        }
+        ::unlink(_lodPath.c_str());
+    }
+    vector<string> _halPaths;
+    string _lodPath;
+};
+
+static void checkLevel(CuTest *testCase, const LodManager &lodManager, size_t levelIdx, bool opened, bool shared) {
+    vector<LodManager::LevelInfo> levels = lodManager.getLevelInfo();
+    CuAssertTrue(testCase, levels.size() == 2);
+    CuAssertTrue(testCase, levels[levelIdx]._opened == opened);
+    CuAssertTrue(testCase, levels[levelIdx]._shared == shared);
+}
+
+/* levels are only opened by the queries that need them */
+static void halLodManagerLazyOpenTest(CuTest *testCase) {
+    try {
+        LodFiles lodFiles;
+        LodManager lodManager;
+        lodManager.loadLODFile(lodFiles._lodPath);
+        CuAssertTrue(testCase, lodManager.getMaxQueryLength() == 4999);
+        vector<LodManager::LevelInfo> levels = lodManager.getLevelInfo();
+        CuAssertTrue(testCase, levels.size() == 2);
+        CuAssertTrue(testCase, levels[0]._minQueryLength == 0 && levels[0]._path == lodFiles._halPaths[0]);
+        CuAssertTrue(testCase, levels[1]._minQueryLength == 1000 && levels[1]._path == lodFiles._halPaths[1]);
+        checkLevel(testCase, lodManager, 0, false, false);
+        checkLevel(testCase, lodManager, 1, false, false);
+
+        lodManager.getAlignment(2000, false);
+        checkLevel(testCase, lodManager, 0, false, false);
+        checkLevel(testCase, lodManager, 1, true, false);
+        lodManager.getAlignment(2000, true);
+        checkLevel(testCase, lodManager, 0, true, false);
+    } catch (const exception &e) {
+        CuFail(testCase, stString_print("Caught exception while testing: %s", e.what()));
+    }
+}
+
+/* two managers on the same LOD file share its alignments, which stay open
+ * until both managers are destroyed, in either order */
+static void halLodManagerSharedTest(CuTest *testCase) {
+    try {
+        LodFiles lodFiles;
+        LodManager *lodManager1 = new LodManager();
+        LodManager *lodManager2 = new LodManager();
+        lodManager1->loadLODFile(lodFiles._lodPath);
+        lodManager2->loadLODFile(lodFiles._lodPath);
+
+        AlignmentConstPtr alignment1 = lodManager1->getAlignment(10, false);
+        checkLevel(testCase, *lodManager1, 0, true, false);
+        checkLevel(testCase, *lodManager2, 0, false, false);
+        AlignmentConstPtr alignment2 = lodManager2->getAlignment(10, false);
+        CuAssertTrue(testCase, alignment1 == alignment2);
+        checkLevel(testCase, *lodManager2, 0, true, true);
+        checkLevel(testCase, *lodManager2, 1, false, false);
+        alignment1.reset();
+        alignment2.reset();
+
+        // the manager that opened the alignment goes first
+        delete lodManager1;
+        alignment2 = lodManager2->getAlignment(10, false);
+        CuAssertTrue(testCase, alignment2->getRootName() == "Genome_0");
+
+        // a pointer from getAlignment() outlives its manager
+        delete lodManager2;
+        CuAssertTrue(testCase, alignment2->getRootName() == "Genome_0");
+        LodManager lodManager3;
+        lodManager3.loadLODFile(lodFiles._lodPath);
+        CuAssertTrue(testCase, lodManager3.getAlignment(10, false) == alignment2);
+        checkLevel(testCase, lodManager3, 0, true, true);
+
+        // once closed, the file is opened again rather than shared
+        alignment2.reset();
+        lodManager3.loadLODFile(lodFiles._lodPath);
+        LodManager lodManager4;
+        lodManager4.loadLODFile(lodFiles._lodPath);
+        lodManager4.getAlignment(10, false);
+        checkLevel(testCase, lodManager4, 0, true, false);
+    } catch (const exception &e) {
+        CuFail(testCase, stString_print("Caught exception while testing: %s", e.what()));
+    }
+}
+
+/* alignments are shared by managers whose options open them the same way,
+ * even when the options come from different parsers */
+static void halLodManagerOptionsTest(CuTest *testCase) {
+    try {
+        LodFiles lodFiles;
+        CLParser options1, options2, cacheOptions;
+        const char *cacheArgv[] = {"halLodManagerTest", "--hdf5CacheMDC", "7"};
+        cacheOptions.parseOptions(3, const_cast<char **>(cacheArgv));
+        LodManager lodManager1, lodManager2, cacheLodManager;
+        lodManager1.loadLODFile(lodFiles._lodPath, &options1);
+        lodManager2.loadLODFile(lodFiles._lodPath, &options2);
+        cacheLodManager.loadLODFile(lodFiles._lodPath, &cacheOptions);
+
+        AlignmentConstPtr alignment1 = lodManager1.getAlignment(10, false);
+        AlignmentConstPtr alignment2 = lodManager2.getAlignment(10, false);
+        CuAssertTrue(testCase, alignment1 == alignment2);
+        checkLevel(testCase, lodManager2, 0, true, true);
+
+        AlignmentConstPtr cacheAlignment = cacheLodManager.getAlignment(10, false);
+        CuAssertTrue(testCase, cacheAlignment != alignment1);
+        checkLevel(testCase, cacheLodManager, 0, true, false);
+    } catch (const exception &e) {
+        CuFail(testCase, stString_print("Caught exception while testing: %s", e.what()));
+    }
+}
+
+static CuSuite *halLodManagerTestSuite(void) {
+    CuSuite *suite = CuSuiteNew();
+    SUITE_ADD_TEST(suite, halLodManagerLazyOpenTest);
+    SUITE_ADD_TEST(suite, halLodManagerSharedTest);
+    SUITE_ADD_TEST(suite, halLodManagerOptionsTest);
+    return suite;
+}
+
+int main(int argc, char *argv[]) {
+    CuString *output = CuStringNew();
+    CuSuite *suite = CuSuiteNew();
+    CuSuiteAddSuite(suite, halLodManagerTestSuite());
+    CuSuiteRun(suite);
+    CuSuiteSummary(suite, output);
+    CuSuiteDetails(suite, output);
+    printf("%s\n", output->buffer);
+    return suite->failCount > 0;
+}
@@ -15,7 +15,7 @@ using namespace hal;
 
 const hal_index_t MafBlock::defaultMaxLength = 1000;
 
-MafBlock::MafBlock(hal_index_t maxLength) : _maxLength(maxLength), _fullNames(false), _tree(NULL) {
+MafBlock::MafBlock(hal_index_t maxLength) : _maxLength(maxLength), _fullNames(false), _tree(NULL), _treeNumBuilds(0) {
     if (_maxLength <= 0) {
         _maxLength = numeric_limits<hal_index_t>::max();
     }
@@ -157,12 +157,9 @@ static void prioritizeNodeInTree(stTree *node) {
     prioritizeNodeInTree(parent);
 }
 
-stTree *MafBlock::getTreeNode(SegmentIteratorPtr segIt, bool modifyEntries) {
-    // Make sure the segment is sliced to only 1 base.
-    assert(segIt->getStartPosition() == segIt->getEndPosition());
+stTree *MafBlock::getTreeNode(const Genome *genome, hal_index_t position, bool modifyEntries) {
     stTree *ret = stTree_construct();
-    const Genome *genome = segIt->getGenome();
-    const Sequence *seq = genome->getSequenceBySite(segIt->getStartPosition());
+    const Sequence *seq = genome->getSequenceBySite(position);
     Entries::const_iterator entryIt = _entries.lower_bound(seq);
     if (entryIt != _entries.end() && entryIt->first == seq) {
         MafBlockEntry *entry = NULL;
@@ -172,7 +169,7 @@ stTree *MafBlock::getTreeNode(SegmentIteratorPtr segIt, bool modifyEntries) {
             if (curEntry->_strand == '-') {
                 curEntryPos = curEntry->_srcLength - 1 - curEntryPos;
             }
-            if (curEntryPos == segIt->getStartPosition() - seq->getStartPosition() || curEntry->_start == NULL_INDEX) {
+            if (curEntryPos == position - seq->getStartPosition() || curEntry->_start == NULL_INDEX) {
                 entry = curEntry;
                 break;
             }
@@ -191,104 +188,25 @@ stTree *MafBlock::getTreeNode(SegmentIteratorPtr segIt, bool modifyEntries) {
             entryIt++;
         }
         assert(genome->getNumChildren() != 0);
-        stTree_setLabel(ret, stString_copy(segIt->getGenome()->getName().c_str()));
+        stTree_setLabel(ret, stString_copy(genome->getName().c_str()));
         stTree_setClientData(ret, NULL);
     }
 
     return ret;
 }
 
-// tree parameter represents node corresponding to the genome with
-// bottom segment botIt
-void MafBlock::buildTreeR(BottomSegmentIteratorPtr botIt, stTree *tree, bool modifyEntries) {
-    const Genome *genome = botIt->getGenome();
-
-    // attach a node and recurse for each of this segment's children
-    // (and paralogous segments)
-    for (hal_size_t i = 0; i < botIt->bseg()->getNumChildren(); i++) {
-        if (botIt->bseg()->hasChild(i)) {
-            const Genome *child = genome->getChild(i);
-            TopSegmentIteratorPtr topIt = child->getTopSegmentIterator();
-            topIt->toChild(botIt, i);
-            stTree *canonicalParalog = getTreeNode(topIt, modifyEntries);
-            stTree_setParent(canonicalParalog, tree);
-            if (topIt->tseg()->hasParseDown()) {
-                BottomSegmentIteratorPtr childBotIt = child->getBottomSegmentIterator();
-                childBotIt->toParseDown(topIt);
-                buildTreeR(childBotIt, canonicalParalog, modifyEntries);
-            }
-            // Traverse the paralogous segments cycle and add those segments as well
-            assert(topIt->tseg()->isCanonicalParalog());
-            if (topIt->tseg()->hasNextParalogy()) {
-                topIt->toNextParalogy();
-                while (!topIt->tseg()->isCanonicalParalog()) {
-                    stTree *paralog = getTreeNode(topIt, modifyEntries);
-                    stTree_setParent(paralog, tree);
-                    if (topIt->tseg()->hasParseDown()) {
-                        BottomSegmentIteratorPtr childBotIt = child->getBottomSegmentIterator();
-                        childBotIt->toParseDown(topIt);
-                        buildTreeR(childBotIt, paralog, modifyEntries);
-                    }
-                    topIt->toNextParalogy();
-                }
-            }
-        }
-    }
-}
-
+// Label the nodes of the column's gene tree with the block entries.
 stTree *MafBlock::buildTree(ColumnIteratorPtr colIt, bool modifyEntries) {
-    // Get any base from the column to begin building the tree
-    const ColumnMap *colMap = colIt->getColumnMap();
-    ColumnMap::const_iterator colMapIt = colMap->begin();
-    const Sequence *sequence = NULL;
-    hal_index_t index = NULL_INDEX;
-    while (colMapIt != colMap->end()) {
-        if (!colMapIt->second->empty()) {
-            // Found a non-empty column map entry, just take the index and
-            // sequence of the first base found
-            sequence = colMapIt->first;
-            index = colMapIt->second->at(0)->getArrayIndex();
-            break;
+    const ColumnTree *columnTree = colIt->getColumnTree();
+    _treeNodes.resize(columnTree->getNumNodes());
+    for (hal_size_t i = 0; i < columnTree->getNumNodes(); i++) {
+        _treeNodes[i] = getTreeNode(columnTree->getGenome(i), columnTree->getArrayIndex(i), modifyEntries);
+        if (columnTree->getParent(i) != NULL_INDEX) {
+            stTree_setParent(_treeNodes[i], _treeNodes[columnTree->getParent(i)]);
         }
-        colMapIt++;
     }
-    assert(sequence != NULL && index != NULL_INDEX);
-    const Genome *genome = sequence->getGenome();
-
-    // Get the bottom segment that is the common ancestor of all entries
-    TopSegmentIteratorPtr topIt = genome->getTopSegmentIterator();
-    BottomSegmentIteratorPtr botIt;
-    if (genome->getNumTopSegments() == 0) {
-        // The reference is the root genome.
-        botIt = genome->getBottomSegmentIterator();
-        botIt->toSite(index);
-    } else {
-        // Keep heading up the tree until we hit the root segment.
-        topIt->toSite(index);
-        while (topIt->tseg()->hasParent()) {
-            const Genome *parent = topIt->getGenome()->getParent();
-            botIt = parent->getBottomSegmentIterator();
-            botIt->toParent(topIt);
-            if (parent->getParent() == NULL || !botIt->bseg()->hasParseUp()) {
-                // Reached root genome
-                break;
-            }
-            topIt = parent->getTopSegmentIterator();
-            topIt->toParseUp(botIt);
-        }
-    }
-
-    stTree *tree = NULL;
-    if (topIt->tseg()->hasParent() == false && topIt->getGenome() == genome && genome->getNumBottomSegments() == 0) {
-        // Handle insertions in leaves. botIt doesn't point anywhere since
-        // there are no bottom segments.
-        tree = getTreeNode(topIt, modifyEntries);
-    } else {
-        tree = getTreeNode(botIt, modifyEntries);
-        buildTreeR(botIt, tree, modifyEntries);
-    }
-    assert(tree != NULL);
-    return tree;
+    assert(!_treeNodes.empty());
+    return _treeNodes[0];
 }
 
 void MafBlock::initBlock(ColumnIteratorPtr col, bool fullNames, bool printTree) {
@@ -364,6 +282,8 @@ void MafBlock::initBlock(ColumnIteratorPtr col, bool fullNames, bool printTree)
 
     if (_printTree) {
         _tree = buildTree(col, true);
+        _treeColIt = col;
+        _treeNumBuilds = col->getColumnTree()->getNumBuilds();
     }
 }
 
@@ -441,9 +361,16 @@ bool MafBlock::canAppendColumn(ColumnIteratorPtr col) {
         }
     }
     if (_printTree) {
+        if (col == _treeColIt && col->getColumnTree()->getNumBuilds() == _treeNumBuilds) {
+            // only shifted within the same segments, so same tree
+            return true;
+        }
         stTree *tree = buildTree(col, false);
         bool ret = stTree_equals(tree, _tree);
         stTree_destruct(tree);
+        if (ret) {
+            _treeNumBuilds = col->getColumnTree()->getNumBuilds();
+        }
         return ret;
     }
     return true;
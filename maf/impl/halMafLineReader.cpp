@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+#include "halMafLineReader.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace hal;
+
+// initial size of the buffer when not mapping; it grows to fit longer lines
+static const size_t bufferSize = 16 * 1024 * 1024;
+
+MafLineReader::MafLineReader(const string &path)
+    : _path(path), _fd(-1), _map(NULL), _mapSize(0), _pos(0), _end(0), _eof(false) {
+    _fd = ::open(path.c_str(), O_RDONLY);
+    if (_fd < 0) {
+        throw hal_errno_exception(path, "error opening path", errno);
+    }
+    struct stat fileStat;
+    if (fstat(_fd, &fileStat) == 0 && S_ISREG(fileStat.st_mode) && fileStat.st_size > 0) {
+        void *ptr = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+        if (ptr != MAP_FAILED) {
+            _map = static_cast<const char *>(ptr);
+            _mapSize = fileStat.st_size;
+            _end = _mapSize;
+            _eof = true;
+            madvise(ptr, _mapSize, MADV_SEQUENTIAL);
+        }
+    }
+    if (_map == NULL) {
+        _buffer.resize(bufferSize);
+    }
+}
+
+MafLineReader::~MafLineReader() {
+    if (_map != NULL) {
+        munmap(const_cast<char *>(_map), _mapSize);
+    }
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+}
+
+bool MafLineReader::nextLine(const char *&begin, const char *&end) {
+    const char *data = _map != NULL ? _map : _buffer.data();
+    const char *newline = static_cast<const char *>(memchr(data + _pos, '\n', _end - _pos));
+    while (newline == NULL && !_eof) {
+        size_t searched = _end - _pos;
+        readMore();
+        data = _buffer.data();
+        newline = static_cast<const char *>(memchr(data + _pos + searched, '\n', _end - _pos - searched));
+    }
+    if (newline == NULL && _pos == _end) {
+        return false;
+    }
+    begin = data + _pos;
+    end = newline != NULL ? newline : data + _end;
+    _pos = end - data + (newline != NULL ? 1 : 0);
+    if (end > begin && *(end - 1) == '\r') {
+        --end;
+    }
+    return true;
+}
+
+// move the unread part of the buffer to its start and fill the rest,
+// growing the buffer if it is all one line
+void MafLineReader::readMore() {
+    memmove(_buffer.data(), _buffer.data() + _pos, _end - _pos);
+    _end -= _pos;
+    _pos = 0;
+    if (_end == _buffer.size()) {
+        _buffer.resize(_buffer.size() * 2);
+    }
+    ssize_t bytesRead;
+    do {
+        bytesRead = ::read(_fd, _buffer.data() + _end, _buffer.size() - _end);
+    } while (bytesRead < 0 && errno == EINTR);
+    if (bytesRead < 0) {
+        throw hal_errno_exception(_path, "read failed", errno);
+    }
+    _end += bytesRead;
+    _eof = bytesRead == 0;
+}
@@ -5,6 +5,7 @@
  * Released under the MIT license, see LICENSE.txt
  */
 #include "halMafScanDimensions.h"
+#include "halMafSpill.h"
 #include <algorithm>
 #include <cassert>
 #include <iostream>
@@ -13,7 +14,7 @@
 using namespace std;
 using namespace hal;
 
-MafScanDimensions::MafScanDimensions() : MafScanner() {
+MafScanDimensions::MafScanDimensions() : MafScanner(), _spill(NULL) {
     assert(sizeof(ArrayInfo) == sizeof(hal_size_t));
 }
 
@@ -34,6 +35,17 @@ void MafScanDimensions::scan(const string &mafPath, const set<string> &targets)
     updateArrayIndices();
 }
 
+void MafScanDimensions::scan(const string &mafPath, const set<string> &targets, MafSpill &spill) {
+    _spill = &spill;
+    try {
+        scan(mafPath, targets);
+    } catch (...) {
+        _spill = NULL;
+        throw;
+    }
+    _spill = NULL;
+}
+
 const MafScanDimensions::DimMap &MafScanDimensions::getDimensions() const {
     return _dimMap;
 }
@@ -91,7 +103,16 @@ void MafScanDimensions::end() {
 
 void MafScanDimensions::updateDimensionsFromBlock() {
     assert(_rows > 0 && !_block.empty());
+    if (_spill != NULL) {
+        _spill->writeBlock(_block, _rows);
+    }
     size_t length = _block[0]._line.length();
+    _maskColumns.clear();
+    for (size_t j = 0; j < length; ++j) {
+        if (_mask[j] == true) {
+            _maskColumns.push_back(j);
+        }
+    }
     for (size_t i = 0; i < _rows; ++i) {
         Row &row = _block[i];
         pair<string, Record *> newRec(row._sequenceName, NULL);
@@ -177,7 +198,7 @@ void MafScanDimensions::updateDimensionsFromBlock() {
                 if (smResult.second == true) {
                     rec->_startMap.erase(smIt);
                 }
-                rec->_badPosSet.insert(FilePosition(_mafFile.tellg(), i));
+                rec->_badPosSet.insert(FilePosition(_numBlocks, i));
             } else {
                 smIt->second._empty = 0;
                 assert(smIt->second._count == 1);
@@ -188,21 +209,15 @@ void MafScanDimensions::updateDimensionsFromBlock() {
                     rec->_startMap.insert(startIndex);
                 }
 
-                size_t numGaps = 0;
-                hal_size_t interiorStart;
-
-                for (size_t j = 0; j < length; ++j) {
-                    if (row._line[j] == '-') {
-                        ++numGaps;
-                    }
-                    // valid segmentation between j-1 and j:
-                    // we add the start coordinate of the segment beginning at
-                    // j in forward segment coordinates.
-                    else if (_mask[j] == true && (row._line[j] != '-')) {
-                        interiorStart = start + j - numGaps;
-                        if (interiorStart > start) {
-                            ++smIt->second._count;
-                        }
+                // valid segmentation between j-1 and j, where j is a masked
+                // column with a base: we add the segment beginning at j,
+                // unless there are no bases before it in the row (ie it begins
+                // at start)
+                size_t firstBase = row._line.find_first_not_of('-');
+                for (size_t k = 0; k < _maskColumns.size(); ++k) {
+                    size_t j = _maskColumns[k];
+                    if (j > firstBase && row._line[j] != '-') {
+                        ++smIt->second._count;
                     }
                 }
             }
@@ -36,7 +36,7 @@ void MafScanReference::sLine() {
     }
 
     _name = genomeName(row._sequenceName);
-    _mafFile.seekg(0, ios_base::end);
+    stopScan();
 }
 
 void MafScanReference::end() {
@@ -6,10 +6,16 @@
  */
 #include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <exception>
 #include <iostream>
 #include <stdexcept>
+#include <thread>
 
 #include "halMafScanner.h"
+#include "halMafLineReader.h"
+#include "halMafSpill.h"
+#include "halParallel.h"
 
 using namespace std;
 using namespace hal;
@@ -22,65 +28,200 @@ MafScanner::~MafScanner() {
 
 void MafScanner::scan(const string &mafFilePath, const set<string> &targets) {
     _targets = targets;
-    _mafFile.open(mafFilePath.c_str());
-    _numBlocks = 0;
+    MafLineReader mafReader(mafFilePath);
+
+    string genomeBuffer;
+    scanBlocks([&](Block &block, size_t &rows) { return readMafBlock(mafReader, genomeBuffer, block, rows); });
+}
+
+void MafScanner::scanSpill(MafSpill &spill) {
+    _targets.clear();
+    spill.rewind();
+    scanBlocks([&](Block &block, size_t &rows) { return spill.readBlock(block, rows); });
+}
+
+void MafScanner::stopScan() {
+    _stopped = true;
+}
 
-    if (!_mafFile) {
-        throw runtime_error("error opening path: " + mafFilePath);
+// find the next whitespace-separated field of [pos, end), returning false
+// if there are no more.
+static bool nextField(const char *&pos, const char *end, const char *&fieldBegin, const char *&fieldEnd) {
+    while (pos < end && (*pos == ' ' || *pos == '\t')) {
+        ++pos;
+    }
+    fieldBegin = pos;
+    while (pos < end && *pos != ' ' && *pos != '\t') {
+        ++pos;
     }
+    fieldEnd = pos;
+    return fieldBegin < fieldEnd;
+}
 
-    _rows = 0;
-    _block.clear();
-    string buffer;
-    while (!_mafFile.eof() && _mafFile.good()) {
-        buffer.clear();
-        _mafFile >> buffer;
-        if (buffer == "a") {
-            if (_rows > 0) {
-                updateMask();
-                aLine();
-                ++_numBlocks;
-                nextLine();
+static bool parseSize(const char *begin, const char *end, hal_size_t &value) {
+    value = 0;
+    if (begin == end) {
+        return false;
+    }
+    for (; begin < end; ++begin) {
+        if (*begin < '0' || *begin > '9') {
+            return false;
+        }
+        value = value * 10 + (*begin - '0');
+    }
+    return true;
+}
+
+// read the rows of the next block that has any in the target set.  lines
+// are split into fields in place, and only the rows that are kept are
+// copied into the block.  the "a" line of the following block is
+// consumed, which is harmless as it carries nothing but a score.
+bool MafScanner::readMafBlock(MafLineReader &mafReader, string &genomeBuffer, Block &block, size_t &rows) {
+    enum { NAME, START, LENGTH, STRAND, SRC_LENGTH, LINE, NUM_FIELDS };
+    const char *fieldBegin[NUM_FIELDS];
+    const char *fieldEnd[NUM_FIELDS];
+    const char *line, *lineEnd;
+    rows = 0;
+    while (mafReader.nextLine(line, lineEnd)) {
+        const char *pos = line;
+        const char *typeBegin, *typeEnd;
+        if (!nextField(pos, lineEnd, typeBegin, typeEnd) || typeEnd - typeBegin != 1) {
+            continue;
+        }
+        if (*typeBegin == 'a') {
+            if (rows > 0) {
+                return true;
+            }
+        } else if (*typeBegin == 's') {
+            size_t numFields = 0;
+            while (numFields < LINE && nextField(pos, lineEnd, fieldBegin[numFields], fieldEnd[numFields])) {
+                ++numFields;
+            }
+            while (pos < lineEnd && (*pos == ' ' || *pos == '\t')) {
+                ++pos;
+            }
+            if (numFields == LINE && pos < lineEnd) {
+                // the alignment line is most of the text, so find its end with
+                // memchr rather than a character at a time
+                fieldBegin[LINE] = pos;
+                fieldEnd[LINE] = lineEnd;
+                const char *space = static_cast<const char *>(memchr(pos, ' ', lineEnd - pos));
+                const char *tab = static_cast<const char *>(memchr(pos, '\t', lineEnd - pos));
+                if (space != NULL) {
+                    fieldEnd[LINE] = space;
+                }
+                if (tab != NULL && tab < fieldEnd[LINE]) {
+                    fieldEnd[LINE] = tab;
+                }
+                ++numFields;
+            }
+            if (numFields < NUM_FIELDS) {
+                throw hal_exception("error parsing sequence " +
+                                    (numFields > NAME ? string(fieldBegin[NAME], fieldEnd[NAME]) : string()));
             }
-            _rows = 0;
-        } else if (buffer == "s") {
-            ++_rows;
-            if (_rows > _block.size()) {
-                _block.resize(_rows);
+            size_t lineLength = fieldEnd[LINE] - fieldBegin[LINE];
+            if (rows > 0 && lineLength != block[rows - 1]._line.length()) {
+                hal_size_t startPosition;
+                parseSize(fieldBegin[START], fieldEnd[START], startPosition);
+                throw hal_exception("two lines in same block have different lengths: " +
+                                    string(fieldBegin[NAME], fieldEnd[NAME]) + " " +
+                                    std::to_string(startPosition) + " and " + block[rows - 1]._sequenceName + " " +
+                                    std::to_string(block[rows - 1]._startPosition));
             }
-            Row &row = _block[_rows - 1];
-            _mafFile >> row._sequenceName >> row._startPosition >> row._length >> row._strand >> row._srcLength >> row._line;
-            if (_mafFile.bad() || _mafFile.fail()) {
+
+            if (_targets.size() > 1) { // (will always include reference)
+                const char *dot = static_cast<const char *>(memchr(fieldBegin[NAME], '.', fieldEnd[NAME] - fieldBegin[NAME]));
+                genomeBuffer.assign(fieldBegin[NAME], dot != NULL ? dot : fieldEnd[NAME]);
+                if (_targets.find(genomeBuffer) == _targets.end()) {
+                    // genome not in targets, pretend like it never happened.
+                    continue;
+                }
+            }
+
+            ++rows;
+            if (rows > block.size()) {
+                block.resize(rows);
+            }
+            Row &row = block[rows - 1];
+            row._sequenceName.assign(fieldBegin[NAME], fieldEnd[NAME]);
+            if (!parseSize(fieldBegin[START], fieldEnd[START], row._startPosition) ||
+                !parseSize(fieldBegin[LENGTH], fieldEnd[LENGTH], row._length) || fieldEnd[STRAND] - fieldBegin[STRAND] != 1 ||
+                !parseSize(fieldBegin[SRC_LENGTH], fieldEnd[SRC_LENGTH], row._srcLength)) {
                 throw hal_exception("error parsing sequence " + row._sequenceName);
             }
-            if (_rows > 1 && row._line.length() != _block[_rows - 2]._line.length()) {
-                throw hal_exception("two lines in same block have different lengths: " + row._sequenceName + " " +
-                                    std::to_string(row._startPosition) + " and " + _block[_rows - 2]._sequenceName + " " +
-                                    std::to_string(_block[_rows - 2]._startPosition));
+            row._strand = *fieldBegin[STRAND];
+            row._line.assign(fieldBegin[LINE], lineLength);
+        }
+    }
+    return rows > 0;
+}
+
+// blocks are read by a separate thread into a fixed pool, so parsing the
+// input overlaps with the (usually much slower) work done in aLine().  we
+// stay one block ahead of aLine() in order to know when to call end()
+// instead for the last block.
+void MafScanner::scanBlocks(const BlockReader &readBlock) {
+    static const size_t queueSize = 64;
+    vector<ParsedBlock> pool(queueSize + 1);
+    BoundedQueue<ParsedBlock *> parsed(queueSize);
+    BoundedQueue<ParsedBlock *> unused(pool.size());
+    for (size_t i = 0; i < pool.size(); ++i) {
+        unused.push(&pool[i]);
+    }
+
+    exception_ptr readError;
+    thread reader([&]() {
+        try {
+            ParsedBlock *parsedBlock;
+            while (unused.pop(parsedBlock) && readBlock(parsedBlock->_block, parsedBlock->_rows)) {
+                if (!parsed.push(parsedBlock)) {
+                    break;
+                }
             }
+        } catch (...) {
+            readError = current_exception();
+        }
+        parsed.close();
+    });
 
-            if (_targets.size() > 1 && // (will always include reference)
-                _targets.find(genomeName(row._sequenceName)) == _targets.end()) {
-                // genome not in targets, pretend like it never happened.
-                --_rows;
-            } else {
+    _numBlocks = 0;
+    _rows = 0;
+    _stopped = false;
+    try {
+        ParsedBlock *next = NULL;
+        bool more = parsed.pop(next);
+        while (more && !_stopped) {
+            swap(_block, next->_block);
+            size_t rows = next->_rows;
+            unused.push(next);
+            for (_rows = 0; _rows < rows && !_stopped;) {
+                ++_rows;
                 sLine();
             }
-        } else {
-            nextLine();
+            if (_stopped) {
+                break;
+            }
+            updateMask();
+            more = parsed.pop(next);
+            if (more) {
+                aLine();
+            }
+            ++_numBlocks;
         }
+    } catch (...) {
+        unused.close();
+        parsed.close();
+        reader.join();
+        throw;
     }
-    if (_rows > 0) {
-        updateMask();
-        ++_numBlocks;
+    unused.close();
+    parsed.close();
+    reader.join();
+    if (readError) {
+        rethrow_exception(readError);
     }
-    end();
-    _mafFile.close();
-}
-
-void MafScanner::nextLine() {
-    while (!_mafFile.eof() && !_mafFile.bad() && _mafFile.peek() != '\n') {
-        _mafFile.get();
+    if (!_stopped) {
+        end();
     }
 }
 
@@ -93,18 +234,17 @@ void MafScanner::updateMask() {
         _mask.resize(length);
         fill(_mask.begin(), _mask.end(), false);
 
-        // scan left to right
-        for (size_t i = 1; i < length; ++i) {
-            // scan up to down
-            for (size_t j = 0; j < _rows && _mask[i] == false; ++j) {
-                // beginning of gap run. add position of first gap to mask
-                if (_block[j]._line[i] == '-' && _block[j]._line[i - 1] != '-') {
-                    _mask[i] = true;
-                }
-                // end of gap run. add position of first non gap to mask
-                else if (_block[j]._line[i] != '-' && _block[j]._line[i - 1] == '-') {
+        // scan each row left to right, marking the beginning and end of
+        // each gap run (ie where gap-ness differs from the previous column)
+        for (size_t j = 0; j < _rows; ++j) {
+            const char *line = _block[j]._line.data();
+            bool prevGap = line[0] == '-';
+            for (size_t i = 1; i < length; ++i) {
+                bool gap = line[i] == '-';
+                if (gap != prevGap) {
                     _mask[i] = true;
                 }
+                prevGap = gap;
             }
         }
     }
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+#include "halMafSpill.h"
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+using namespace std;
+using namespace hal;
+
+/* A block is written as its size in bytes followed by
+ *   lineLength rows
+ * and for each row
+ *   nameId startPosition length strand numGapRuns
+ *   (gapStart gapLength) * numGapRuns
+ *   bases
+ * where all the numbers are varints, gapStart is the column of the first
+ * gap of a run counted from the end of the run before it, strand is a byte
+ * and the bases are packed two per byte as in the HAL DNA arrays.  The
+ * source length of a row is kept in the name table with its name. */
+
+namespace {
+    void putVarint(vector<unsigned char> &buffer, uint64_t value) {
+        while (value >= 0x80) {
+            buffer.push_back((unsigned char)(value | 0x80));
+            value >>= 7;
+        }
+        buffer.push_back((unsigned char)value);
+    }
+}
+
+MafSpill::MafSpill(const string &dir) : _numBlocks(0), _readPos(0) {
+    _path = (dir.empty() ? string(".") : dir) + "/maf2hal.spill.XXXXXX";
+    vector<char> pathBuf(_path.begin(), _path.end());
+    pathBuf.push_back('\0');
+    int fd = mkstemp(pathBuf.data());
+    if (fd < 0) {
+        throw hal_exception("error creating temporary file " + _path + ": " + strerror(errno));
+    }
+    close(fd);
+    _path = pathBuf.data();
+    _file.open(_path.c_str(), ios_base::in | ios_base::out | ios_base::trunc | ios_base::binary);
+    unlink(_path.c_str());
+    checkStream("creating");
+}
+
+MafSpill::~MafSpill() {
+}
+
+void MafSpill::writeBlock(const MafScanner::Block &block, size_t rows) {
+    assert(rows > 0 && rows <= block.size());
+    size_t lineLength = block[0]._line.length();
+    _buffer.clear();
+    putVarint(_buffer, lineLength);
+    putVarint(_buffer, rows);
+    for (size_t i = 0; i < rows; ++i) {
+        const MafScanner::Row &row = block[i];
+        pair<NameMap::iterator, bool> ins =
+            _nameIds.insert(make_pair(make_pair(row._sequenceName, row._srcLength), (uint32_t)_names.size()));
+        if (ins.second) {
+            _names.push_back(ins.first->first);
+        }
+        putVarint(_buffer, ins.first->second);
+        putVarint(_buffer, row._startPosition);
+        putVarint(_buffer, row._length);
+        _buffer.push_back((unsigned char)row._strand);
+        packLine(row._line);
+    }
+    uint64_t numBytes = _buffer.size();
+    _file.write(reinterpret_cast<const char *>(&numBytes), sizeof(numBytes));
+    _file.write(reinterpret_cast<const char *>(_buffer.data()), _buffer.size());
+    checkStream("writing");
+    ++_numBlocks;
+}
+
+void MafSpill::rewind() {
+    _file.flush();
+    _file.clear();
+    _file.seekg(0);
+    checkStream("rewinding");
+}
+
+bool MafSpill::readBlock(MafScanner::Block &block, size_t &rows) {
+    uint64_t numBytes;
+    if (!_file.read(reinterpret_cast<char *>(&numBytes), sizeof(numBytes))) {
+        if (_file.eof() && _file.gcount() == 0) {
+            return false;
+        }
+        checkStream("reading");
+    }
+    _buffer.resize(numBytes);
+    _file.read(reinterpret_cast<char *>(_buffer.data()), numBytes);
+    checkStream("reading");
+    _readPos = 0;
+    size_t lineLength = getVarint();
+    rows = getVarint();
+    if (block.size() < rows) {
+        block.resize(rows);
+    }
+    for (size_t i = 0; i < rows; ++i) {
+        MafScanner::Row &row = block[i];
+        const pair<string, hal_size_t> &name = _names.at(getVarint());
+        row._sequenceName = name.first;
+        row._srcLength = name.second;
+        row._startPosition = getVarint();
+        row._length = getVarint();
+        row._strand = (char)_buffer.at(_readPos++);
+        unpackLine(lineLength, row._length, row._line);
+    }
+    assert(_readPos == _buffer.size());
+    return true;
+}
+
+uint64_t MafSpill::getVarint() {
+    uint64_t value = 0;
+    for (unsigned shift = 0;; shift += 7) {
+        unsigned char byte = _buffer.at(_readPos++);
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+}
+
+void MafSpill::packLine(const string &line) {
+    _gapRuns.clear();
+    for (size_t col = line.find('-'); col != string::npos;) {
+        size_t end = line.find_first_not_of('-', col);
+        if (end == string::npos) {
+            end = line.length();
+        }
+        _gapRuns.push_back(col);
+        _gapRuns.push_back(end - col);
+        col = line.find('-', end);
+    }
+    putVarint(_buffer, _gapRuns.size() / 2);
+    size_t prevEnd = 0;
+    for (size_t i = 0; i < _gapRuns.size(); i += 2) {
+        putVarint(_buffer, _gapRuns[i] - prevEnd);
+        putVarint(_buffer, _gapRuns[i + 1]);
+        prevEnd = _gapRuns[i] + _gapRuns[i + 1];
+    }
+    hal_index_t numBases = 0;
+    for (size_t col = 0; col < line.length(); ++col) {
+        if (line[col] != '-') {
+            if ((numBases & 1) == 0) {
+                _buffer.push_back(0);
+            }
+            _buffer.back() = dnaPack(line[col], numBases, _buffer.back());
+            ++numBases;
+        }
+    }
+}
+
+void MafSpill::unpackLine(size_t lineLength, size_t length, string &line) {
+    line.resize(lineLength);
+    size_t numGapRuns = getVarint();
+    _gapRuns.clear();
+    size_t prevEnd = 0;
+    for (size_t i = 0; i < numGapRuns; ++i) {
+        _gapRuns.push_back(prevEnd + getVarint());
+        _gapRuns.push_back(getVarint());
+        prevEnd = _gapRuns[2 * i] + _gapRuns[2 * i + 1];
+    }
+    if (_readPos + (length + 1) / 2 > _buffer.size()) {
+        throw hal_exception("error reading temporary file " + _path + ": truncated row");
+    }
+    const unsigned char *bases = _buffer.data() + _readPos;
+    _readPos += (length + 1) / 2;
+    hal_index_t numBases = 0;
+    size_t col = 0;
+    for (size_t i = 0; i <= _gapRuns.size(); i += 2) {
+        size_t gapStart = i < _gapRuns.size() ? _gapRuns[i] : lineLength;
+        for (; col < gapStart; ++col, ++numBases) {
+            line[col] = dnaUnpack(numBases, bases[numBases / 2]);
+        }
+        if (i < _gapRuns.size()) {
+            line.replace(col, _gapRuns[i + 1], _gapRuns[i + 1], '-');
+            col += _gapRuns[i + 1];
+        }
+    }
+    assert(col == lineLength && (size_t)numBases == length);
+}
+
+void MafSpill::checkStream(const string &action) {
+    if (!_file) {
+        throw hal_exception("error " + action + " temporary file " + _path + ": " + strerror(errno));
+    }
+}
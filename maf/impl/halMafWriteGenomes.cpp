@@ -6,6 +6,8 @@
  */
 #include "halMafWriteGenomes.h"
 #include "hal.h"
+#include "halMafSpill.h"
+#include "halParallel.h"
 #include <algorithm>
 #include <cassert>
 #include <iostream>
@@ -21,19 +23,52 @@ MafWriteGenomes::~MafWriteGenomes() {
 }
 
 void MafWriteGenomes::convert(const string &mafPath, const string &refGenomeName, const set<string> &targets,
-                              const DimMap &dimMap, AlignmentPtr alignment) {
+                              const DimMap &dimMap, AlignmentPtr alignment, unsigned numThreads) {
+    initConvert(refGenomeName, dimMap, alignment, numThreads);
+    MafScanner::scan(mafPath, targets);
+    writeBlocks();
+    initEmptySegments();
+    updateRefParseInfo();
+}
+
+void MafWriteGenomes::convert(MafSpill &spill, const string &refGenomeName, const DimMap &dimMap, AlignmentPtr alignment,
+                              unsigned numThreads) {
+    initConvert(refGenomeName, dimMap, alignment, numThreads);
+    MafScanner::scanSpill(spill);
+    writeBlocks();
+    initEmptySegments();
+    updateRefParseInfo();
+}
+
+void MafWriteGenomes::initConvert(const string &refGenomeName, const DimMap &dimMap, AlignmentPtr alignment,
+                                  unsigned numThreads) {
     _refName = refGenomeName;
     _dimMap = &dimMap;
     _alignment = alignment;
-    _topSegment = TopSegmentIteratorPtr();
-    _paraTop = TopSegmentIteratorPtr();
-    _bottomSegment = BottomSegmentIteratorPtr();
-    _refBottom = BottomSegmentIteratorPtr();
+    _topGenome = NULL;
     _childIdxMap.clear();
     createGenomes();
-    MafScanner::scan(mafPath, targets);
-    initEmptySegments();
-    updateRefParseInfo();
+
+    // spread the genomes over the writing threads
+    _numThreads = max(numThreads, 1u);
+    _writerMap.clear();
+    _writerMap[_refGenome] = 0;
+    for (size_t i = 0; i < _refGenome->getNumChildren(); ++i) {
+        _writerMap[_refGenome->getChild(i)] = (i + 1) % _numThreads;
+    }
+    _iterators.assign(_numThreads, SegmentIterators());
+    for (size_t i = 0; i < _iterators.size(); ++i) {
+        if (_refGenome->getNumBottomSegments() > 0) {
+            _iterators[i]._bottomSegment = _refGenome->getBottomSegmentIterator();
+            _iterators[i]._refBottom = _refGenome->getBottomSegmentIterator();
+        }
+        if (_topGenome != NULL) {
+            _iterators[i]._topSegment = _topGenome->getTopSegmentIterator();
+            _iterators[i]._paraTop = _topGenome->getTopSegmentIterator();
+        }
+    }
+    _numJobs = 0;
+    _batchBytes = 0;
 }
 
 MafWriteGenomes::MapRange MafWriteGenomes::getRefSequences() const {
@@ -115,10 +150,6 @@ void MafWriteGenomes::createGenomes() {
     } else {
         _refGenome->setDimensions(genomeDimensions);
     }
-    if (_refGenome->getNumBottomSegments() > 0) {
-        _bottomSegment = _refGenome->getBottomSegmentIterator();
-        _refBottom = _refGenome->getBottomSegmentIterator();
-    }
 
     // do the child genome dimensions
     curRange = getNextSequences(_dimMap->begin());
@@ -134,9 +165,8 @@ void MafWriteGenomes::createGenomes() {
             assert(childGenome != NULL);
 
             childGenome->setDimensions(genomeDimensions);
-            if (_topSegment == NULL && childGenome->getNumTopSegments() > 0) {
-                _topSegment = childGenome->getTopSegmentIterator();
-                _paraTop = childGenome->getTopSegmentIterator();
+            if (_topGenome == NULL && childGenome->getNumTopSegments() > 0) {
+                _topGenome = childGenome;
             }
         }
         curRange = getNextSequences(curRange.second);
@@ -150,24 +180,43 @@ void MafWriteGenomes::createGenomes() {
 }
 
 void MafWriteGenomes::convertBlock() {
+    // blocks are written when this many are waiting, or when their lines add
+    // up to this many bytes
+    static const size_t maxBatchBlocks = 1024;
+    static const size_t maxBatchBytes = 256 * 1024 * 1024;
+
     assert(_rows > 0);
     assert(_block[0]._line.length() == _mask.size());
 
-    initParaMap();
+    if (_numJobs == _jobs.size()) {
+        _jobs.resize(_numJobs + 1);
+    }
+    BlockJob &job = _jobs[_numJobs];
+    job._numChunks = 0;
+    initParaMap(job);
 
     for (size_t col = 0; col < _mask.size(); ++col) {
         if (_mask[col] == true || col == 0) {
-            initBlockInfo(col);
-            convertSegments(col);
+            initBlockInfo(col, job);
         }
     }
+
+    // the block's rows are no longer needed by the scanner, so keep them
+    job._rows = _rows;
+    swap(job._block, _block);
+    ++_numJobs;
+    _batchBytes += _rows * _mask.size();
+    if (_numJobs >= maxBatchBlocks || _batchBytes >= maxBatchBytes) {
+        writeBlocks();
+    }
 }
 
-void MafWriteGenomes::initBlockInfo(size_t col) {
+void MafWriteGenomes::initBlockInfo(size_t col, BlockJob &job) {
     if (col == 0) {
         if (_blockInfo.size() < _rows) {
             _blockInfo.resize(_rows);
         }
+        job._gapComps.resize(_rows);
         for (size_t i = 0; i < _rows; ++i) {
             _blockInfo[i]._arrayIndex = NULL_INDEX;
             _blockInfo[i]._gaps = 0;
@@ -177,15 +226,16 @@ void MafWriteGenomes::initBlockInfo(size_t col) {
             _blockInfo[i]._record = _dimMap->find(_block[i]._sequenceName)->second;
             _blockInfo[i]._genome = _alignment->openGenome(genomeName(_block[i]._sequenceName));
             assert(_blockInfo[i]._genome != NULL);
+            _blockInfo[i]._writer = _writerMap.find(_blockInfo[i]._genome)->second;
             _blockInfo[i]._skip = false;
             // correction for - strand: need to iterate index right to left
             // so keep a correctly flipped maf line here (rather than doing it
             // every chunk)
             if (_block[i]._strand == '-') {
-                _blockInfo[i]._gapComp = _block[i]._line;
-                reverseGaps(_blockInfo[i]._gapComp);
+                job._gapComps[i] = _block[i]._line;
+                reverseGaps(job._gapComps[i]);
             } else {
-                _blockInfo[i]._gapComp.erase();
+                job._gapComps[i].erase();
             }
         }
     } else {
@@ -221,7 +271,7 @@ void MafWriteGenomes::initBlockInfo(size_t col) {
                 assert(rowInfo._gaps <= col);
                 StartMap::const_iterator mapIt = startMap.find(rowInfo._start);
                 if (mapIt != startMap.end() && mapIt->second._written == 0 && mapIt->second._empty == 0 &&
-                    posSet.find(FilePosition(_mafFile.tellg(), i)) == posSet.end()) {
+                    posSet.find(FilePosition(_numBlocks, i)) == posSet.end()) {
                     rowInfo._arrayIndex = mapIt->second._index;
 
                     // correction for - strand: need to iterate index right to left
@@ -254,66 +304,105 @@ void MafWriteGenomes::initBlockInfo(size_t col) {
             }
         }
     }
+
+    if (job._numChunks == job._chunks.size()) {
+        job._chunks.resize(job._numChunks + 1);
+    }
+    Chunk &chunk = job._chunks[job._numChunks++];
+    chunk._col = col;
+    chunk._refRow = _refRow;
+    chunk._rowInfo.assign(_blockInfo.begin(), _blockInfo.begin() + _rows);
 }
 
-void MafWriteGenomes::initParaMap() {
-    for (ParaMap::iterator pIt = _paraMap.begin(); pIt != _paraMap.end(); ++pIt) {
+void MafWriteGenomes::initParaMap(BlockJob &job) {
+    for (ParaMap::iterator pIt = job._paraMap.begin(); pIt != job._paraMap.end(); ++pIt) {
         pIt->second.clear();
     }
 
+    job._sequences.resize(_rows);
     for (size_t i = 0; i < _rows; ++i) {
         Row &row = _block[i];
         Genome *genome = _alignment->openGenome(genomeName(row._sequenceName));
         assert(genome != NULL);
         Sequence *sequence = genome->getSequence(sequenceName(row._sequenceName));
         assert(sequence != NULL);
+        job._sequences[i] = sequence;
         Paralogy para = {sequence->getStartPosition() + static_cast<hal_index_t>(row._startPosition), i};
-        pair<ParaMap::iterator, bool> res = _paraMap.insert(pair<Genome *, ParaSet>(genome, ParaSet()));
+        pair<ParaMap::iterator, bool> res = job._paraMap.insert(pair<Genome *, ParaSet>(genome, ParaSet()));
         res.first->second.insert(para);
     }
 }
 
-void MafWriteGenomes::convertSegments(size_t col) {
+// each thread writes the rows of the genomes it was given, so no two
+// threads ever touch the same segment array or DNA.  the reference writer
+// also sets the child indexes of the reference's bottom segments.
+void MafWriteGenomes::writeBlocks() {
+    parallelFor(_numThreads, _numThreads, [&](size_t writer, unsigned threadIdx) {
+        for (size_t j = 0; j < _numJobs; ++j) {
+            const BlockJob &job = _jobs[j];
+            for (size_t c = 0; c < job._numChunks; ++c) {
+                writeChunk(job, job._chunks[c], writer, _iterators[writer]);
+            }
+        }
+    });
+    _numJobs = 0;
+    _batchBytes = 0;
+}
+
+void MafWriteGenomes::writeChunk(const BlockJob &job, const Chunk &chunk, unsigned writer, SegmentIterators &iterators) {
+    const vector<RowInfo> &blockInfo = chunk._rowInfo;
+    size_t col = chunk._col;
+    hal_index_t refRow = chunk._refRow;
+    bool refWriter = writer == _writerMap.find(_refGenome)->second;
+
     // do the reference first
     Sequence *seq;
     size_t numChildren = _refGenome->getNumChildren();
-    if (_refRow != NULL_INDEX) {
-        RowInfo &rowInfo = _blockInfo[_refRow];
-        Row &row = _block[_refRow];
-        _refBottom->setArrayIndex(_refGenome, rowInfo._arrayIndex);
-        seq = _refGenome->getSequence(sequenceName(row._sequenceName));
-        assert(seq != NULL);
-        _refBottom->setCoordinates(seq->getStartPosition() + rowInfo._start, rowInfo._length);
-        _refBottom->bseg()->setTopParseIndex(NULL_INDEX);
+    if (refRow != NULL_INDEX && refWriter) {
+        const RowInfo &rowInfo = blockInfo[refRow];
+        const Row &row = job._block[refRow];
+        iterators._refBottom->setArrayIndex(_refGenome, rowInfo._arrayIndex);
+        seq = job._sequences[refRow];
+        iterators._refBottom->setCoordinates(seq->getStartPosition() + rowInfo._start, rowInfo._length);
+        iterators._refBottom->bseg()->setTopParseIndex(NULL_INDEX);
         for (size_t i = 0; i < numChildren; ++i) {
-            _refBottom->bseg()->setChildIndex(i, NULL_INDEX);
-            _refBottom->bseg()->setChildReversed(i, false);
+            iterators._refBottom->bseg()->setChildIndex(i, NULL_INDEX);
+            iterators._refBottom->bseg()->setChildReversed(i, false);
         }
         seq->setSubString(row._line.substr(col, rowInfo._length), rowInfo._start, rowInfo._length);
     }
 
     hal_size_t childIndex;
-    for (size_t i = 0; i < _rows; ++i) {
-        if ((hal_index_t)i != _refRow && _blockInfo[i]._length > 0 && _blockInfo[i]._skip == false) {
-            RowInfo &rowInfo = _blockInfo[i];
-            Row &row = _block[i];
+    for (size_t i = 0; i < job._rows; ++i) {
+        if ((hal_index_t)i != refRow && blockInfo[i]._length > 0 && blockInfo[i]._skip == false) {
+            const RowInfo &rowInfo = blockInfo[i];
+            const Row &row = job._block[i];
             Genome *genome = rowInfo._genome;
+            bool reversed = refRow != NULL_INDEX && row._strand != job._block[refRow]._strand;
+
+            if (refWriter && refRow != NULL_INDEX && genome != _refGenome) {
+                childIndex = _childIdxMap.find(genome)->second;
+                iterators._refBottom->bseg()->setChildIndex(childIndex, rowInfo._arrayIndex);
+                iterators._refBottom->bseg()->setChildReversed(childIndex, reversed);
+            }
+            if (rowInfo._writer != writer) {
+                continue;
+            }
 
             // we will overwrite these with corrected values for reverse strand
             // at last minute
             hal_index_t genStart = rowInfo._start;
             hal_index_t rowSeqOffset = col;
-            const string &rowLine = row._strand == '-' ? rowInfo._gapComp : row._line;
+            const string &rowLine = row._strand == '-' ? job._gapComps[i] : row._line;
 
-            seq = genome->getSequence(sequenceName(row._sequenceName));
-            assert(seq != NULL);
+            seq = job._sequences[i];
             if (genome == _refGenome) {
-                _bottomSegment->setArrayIndex(rowInfo._genome, rowInfo._arrayIndex);
-                _bottomSegment->setCoordinates(seq->getStartPosition() + rowInfo._start, rowInfo._length);
-                _bottomSegment->bseg()->setTopParseIndex(NULL_INDEX);
+                iterators._bottomSegment->setArrayIndex(rowInfo._genome, rowInfo._arrayIndex);
+                iterators._bottomSegment->setCoordinates(seq->getStartPosition() + rowInfo._start, rowInfo._length);
+                iterators._bottomSegment->bseg()->setTopParseIndex(NULL_INDEX);
                 for (size_t i = 0; i < numChildren; ++i) {
-                    _bottomSegment->bseg()->setChildIndex(i, NULL_INDEX);
-                    _bottomSegment->bseg()->setChildReversed(i, false);
+                    iterators._bottomSegment->bseg()->setChildIndex(i, NULL_INDEX);
+                    iterators._bottomSegment->bseg()->setChildReversed(i, false);
                 }
             } else {
                 // correction for - strand: need to iterate index right to left
@@ -326,24 +415,20 @@ void MafWriteGenomes::convertSegments(size_t col) {
                     genStart = row._startPosition + (row._length - sizeSoFar - rowInfo._length);
                 }
 
-                _topSegment->setArrayIndex(rowInfo._genome, rowInfo._arrayIndex);
-                _topSegment->setCoordinates(seq->getStartPosition() + genStart, rowInfo._length);
-
-                _topSegment->tseg()->setNextParalogyIndex(NULL_INDEX);
-                _topSegment->tseg()->setBottomParseIndex(NULL_INDEX);
-
-                if (_refRow != NULL_INDEX) {
-                    assert(_topSegment->getLength() == _refBottom->getLength());
-                    childIndex = _childIdxMap.find(rowInfo._genome)->second;
-                    bool reversed = row._strand != _block[_refRow]._strand;
-                    _refBottom->bseg()->setChildIndex(childIndex, rowInfo._arrayIndex);
-                    _refBottom->bseg()->setChildReversed(childIndex, reversed);
-                    _topSegment->tseg()->setParentIndex(_refBottom->getArrayIndex());
-                    _topSegment->tseg()->setParentReversed(reversed);
-                    updateParalogy(i);
+                iterators._topSegment->setArrayIndex(rowInfo._genome, rowInfo._arrayIndex);
+                iterators._topSegment->setCoordinates(seq->getStartPosition() + genStart, rowInfo._length);
+
+                iterators._topSegment->tseg()->setNextParalogyIndex(NULL_INDEX);
+                iterators._topSegment->tseg()->setBottomParseIndex(NULL_INDEX);
+
+                if (refRow != NULL_INDEX) {
+                    assert(rowInfo._length == blockInfo[refRow]._length);
+                    iterators._topSegment->tseg()->setParentIndex(blockInfo[refRow]._arrayIndex);
+                    iterators._topSegment->tseg()->setParentReversed(reversed);
+                    updateParalogy(job, chunk, i, iterators);
                 } else {
-                    _topSegment->tseg()->setParentIndex(NULL_INDEX);
-                    _topSegment->tseg()->setParentReversed(false);
+                    iterators._topSegment->tseg()->setParentIndex(NULL_INDEX);
+                    iterators._topSegment->tseg()->setParentReversed(false);
                 }
             }
 
@@ -354,43 +439,62 @@ void MafWriteGenomes::convertSegments(size_t col) {
 
 // _top segment needs to be coherent -- we expect its alreay set.
 // only update paralogy if it's already been created (ie previous row)
-void MafWriteGenomes::updateParalogy(size_t i) {
-    RowInfo &rowInfo = _blockInfo[i];
-    Row &row = _block[i];
+void MafWriteGenomes::updateParalogy(const BlockJob &job, const Chunk &chunk, size_t i, SegmentIterators &iterators) {
+    const RowInfo &rowInfo = chunk._rowInfo[i];
+    const Row &row = job._block[i];
 
-    ParaMap::iterator pIt = _paraMap.find(rowInfo._genome);
-    assert(pIt != _paraMap.end());
-    ParaSet &paraSet = pIt->second;
+    ParaMap::const_iterator pIt = job._paraMap.find(rowInfo._genome);
+    assert(pIt != job._paraMap.end());
+    const ParaSet &paraSet = pIt->second;
     if (paraSet.size() > 1) {
-        Sequence *sequence = rowInfo._genome->getSequence(sequenceName(row._sequenceName));
-        assert(sequence != NULL);
+        Sequence *sequence = job._sequences[i];
         Paralogy query = {sequence->getStartPosition() + static_cast<hal_index_t>(row._startPosition), 0};
-        ParaSet::iterator sIt = paraSet.find(query);
+        ParaSet::const_iterator sIt = paraSet.find(query);
         assert(sIt != paraSet.end());
 
-        ParaSet::iterator next = circularNext(i, paraSet, sIt);
+        ParaSet::const_iterator next = circularNext(chunk._rowInfo, paraSet, sIt);
         if (next->_row < i) {
-            RowInfo &nextInfo = _blockInfo[next->_row];
+            const RowInfo &nextInfo = chunk._rowInfo[next->_row];
             assert(nextInfo._length > 0);
-            _topSegment->tseg()->setNextParalogyIndex(nextInfo._arrayIndex);
+            iterators._topSegment->tseg()->setNextParalogyIndex(nextInfo._arrayIndex);
         }
 
-        ParaSet::iterator prev = circularPrev(i, paraSet, sIt);
+        ParaSet::const_iterator prev = circularPrev(chunk._rowInfo, paraSet, sIt);
         if (prev->_row < i) {
-            RowInfo &prevInfo = _blockInfo[prev->_row];
+            const RowInfo &prevInfo = chunk._rowInfo[prev->_row];
             assert(prevInfo._length > 0);
-            _paraTop->setArrayIndex(prevInfo._genome, prevInfo._arrayIndex);
-            _paraTop->tseg()->setNextParalogyIndex(rowInfo._arrayIndex);
+            iterators._paraTop->setArrayIndex(prevInfo._genome, prevInfo._arrayIndex);
+            iterators._paraTop->tseg()->setNextParalogyIndex(rowInfo._arrayIndex);
         }
     }
 }
 
+// the genomes are independent, so they can be done by different threads
 void MafWriteGenomes::initEmptySegments() {
-    for (DimMap::const_iterator dmIt = _dimMap->begin(); dmIt != _dimMap->end(); ++dmIt) {
-        Genome *genome = _alignment->openGenome(genomeName(dmIt->first));
-        size_t numChildren = genome->getNumChildren();
+    vector<Genome *> genomes;
+    vector<MapRange> genomeRanges;
+    for (MapRange range = getNextSequences(_dimMap->begin()); range.first != _dimMap->end();
+         range = getNextSequences(range.second)) {
+        genomes.push_back(_alignment->openGenome(genomeName(range.first->first)));
+        genomeRanges.push_back(range);
+    }
+    parallelFor(genomes.size(), _numThreads,
+                [&](size_t genomeIdx, unsigned threadIdx) { initEmptySegments(genomes[genomeIdx], genomeRanges[genomeIdx]); });
+}
+
+void MafWriteGenomes::initEmptySegments(Genome *genome, MapRange range) {
+    assert(genome != NULL);
+    size_t numChildren = genome->getNumChildren();
+    TopSegmentIteratorPtr topSegment;
+    BottomSegmentIteratorPtr bottomSegment;
+    if (genome == _refGenome) {
+        bottomSegment = genome->getBottomSegmentIterator();
+    } else {
+        topSegment = genome->getTopSegmentIterator();
+    }
+    for (DimMap::const_iterator dmIt = range.first; dmIt != range.second; ++dmIt) {
         Sequence *sequence = genome->getSequence(sequenceName(dmIt->first));
-        assert(genome != NULL && sequence != NULL);
+        assert(sequence != NULL);
         const StartMap &startMap = dmIt->second->_startMap;
 
         for (StartMap::const_iterator smIt = startMap.begin(); smIt != startMap.end(); ++smIt) {
@@ -415,20 +519,20 @@ void MafWriteGenomes::initEmptySegments() {
                     length = nextIt->first - startPosition;
                 }
                 if (genome == _refGenome) {
-                    _bottomSegment->setArrayIndex(genome, arrayInfo._index);
-                    _bottomSegment->setCoordinates(sequence->getStartPosition() + startPosition, length);
-                    _bottomSegment->bseg()->setTopParseIndex(NULL_INDEX);
+                    bottomSegment->setArrayIndex(genome, arrayInfo._index);
+                    bottomSegment->setCoordinates(sequence->getStartPosition() + startPosition, length);
+                    bottomSegment->bseg()->setTopParseIndex(NULL_INDEX);
                     for (size_t i = 0; i < numChildren; ++i) {
-                        _bottomSegment->bseg()->setChildIndex(i, NULL_INDEX);
-                        _bottomSegment->bseg()->setChildReversed(i, false);
+                        bottomSegment->bseg()->setChildIndex(i, NULL_INDEX);
+                        bottomSegment->bseg()->setChildReversed(i, false);
                     }
                 } else {
-                    _topSegment->setArrayIndex(genome, arrayInfo._index);
-                    _topSegment->setCoordinates(sequence->getStartPosition() + startPosition, length);
-                    _topSegment->tseg()->setBottomParseIndex(NULL_INDEX);
-                    _topSegment->tseg()->setParentIndex(NULL_INDEX);
-                    _topSegment->tseg()->setParentReversed(false);
-                    _topSegment->tseg()->setNextParalogyIndex(NULL_INDEX);
+                    topSegment->setArrayIndex(genome, arrayInfo._index);
+                    topSegment->setCoordinates(sequence->getStartPosition() + startPosition, length);
+                    topSegment->tseg()->setBottomParseIndex(NULL_INDEX);
+                    topSegment->tseg()->setParentIndex(NULL_INDEX);
+                    topSegment->tseg()->setParentReversed(false);
+                    topSegment->tseg()->setNextParalogyIndex(NULL_INDEX);
                 }
                 DnaIteratorPtr dna = sequence->getDnaIterator(startPosition);
                 for (hal_size_t i = 0; i < length; ++i) {
@@ -469,28 +573,30 @@ void MafWriteGenomes::end() {
     }
 }
 
-MafWriteGenomes::ParaSet::iterator MafWriteGenomes::circularNext(size_t row, ParaSet &paraSet, ParaSet::iterator i) {
-    ParaSet::iterator j = i;
+MafWriteGenomes::ParaSet::const_iterator MafWriteGenomes::circularNext(const vector<RowInfo> &rowInfo, const ParaSet &paraSet,
+                                                                       ParaSet::const_iterator i) const {
+    ParaSet::const_iterator j = i;
     do {
         ++j;
         if (j == paraSet.end()) {
             j = paraSet.begin();
         }
-        if (_blockInfo[j->_row]._length > 0) {
+        if (rowInfo[j->_row]._length > 0) {
             break;
         }
     } while (i != j);
     return j;
 }
 
-MafWriteGenomes::ParaSet::iterator MafWriteGenomes::circularPrev(size_t row, ParaSet &paraSet, ParaSet::iterator i) {
-    ParaSet::iterator j = i;
+MafWriteGenomes::ParaSet::const_iterator MafWriteGenomes::circularPrev(const vector<RowInfo> &rowInfo, const ParaSet &paraSet,
+                                                                       ParaSet::const_iterator i) const {
+    ParaSet::const_iterator j = i;
     do {
         if (j == paraSet.begin()) {
             j = paraSet.end();
         }
         --j;
-        if (_blockInfo[j->_row]._length > 0) {
+        if (rowInfo[j->_row]._length > 0) {
             break;
         }
     } while (i != j);
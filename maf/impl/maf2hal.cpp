@@ -7,7 +7,9 @@
 
 #include "halMafScanDimensions.h"
 #include "halMafScanReference.h"
+#include "halMafSpill.h"
 #include "halMafWriteGenomes.h"
+#include "halParallel.h"
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
@@ -29,7 +31,15 @@ static void initParser(CLParser &optionsParser) {
                                           " dabase as a leaf.",
                                 false);
 
-    optionsParser.setDescription("import maf into hal database.");
+    optionsParser.addOption("tempDir", "directory for the temporary copy of the alignment blocks made while scanning the MAF "
+                                       "(directory of halFile if empty)",
+                            "\"\"");
+    optionsParser.addOption("numThreads", "number of threads writing different genomes at the same time (0 to use all "
+                                          "cores).  Only mmap HAL files can be written by more than one thread",
+                            1);
+
+    optionsParser.setDescription("import maf into hal database.  The MAF is parsed once, with the blocks kept in a "
+                                 "compact temporary file until the genome dimensions are known.");
 }
 
 int main(int argc, char **argv) {
@@ -39,6 +49,8 @@ int main(int argc, char **argv) {
     string mafPath;
     string refGenomeName;
     string targetGenomes;
+    string tempDir;
+    unsigned numThreads;
     bool append;
     try {
         optionsParser.parseOptions(argc, argv);
@@ -46,6 +58,8 @@ int main(int argc, char **argv) {
         mafPath = optionsParser.getArgument<string>("mafFile");
         refGenomeName = optionsParser.getOption<string>("refGenome");
         targetGenomes = optionsParser.getOption<string>("targetGenomes");
+        tempDir = optionsParser.getOption<string>("tempDir");
+        numThreads = optionsParser.getOption<unsigned>("numThreads");
         append = optionsParser.getFlag("append");
     } catch (exception &e) {
         cerr << e.what() << endl;
@@ -87,8 +101,13 @@ int main(int argc, char **argv) {
         set<string> targetSet(targetNames.begin(), targetNames.end());
         targetSet.insert(refGenomeName);
 
+        if (tempDir == "\"\"") {
+            size_t slashPos = halPath.rfind('/');
+            tempDir = slashPos == string::npos ? "." : halPath.substr(0, slashPos + 1);
+        }
+        MafSpill spill(tempDir);
         MafScanDimensions dScan;
-        dScan.scan(mafPath, targetSet);
+        dScan.scan(mafPath, targetSet, spill);
 
         string prevGenome, curGenome;
         hal_size_t segmentCount = 0;
@@ -117,7 +136,9 @@ int main(int argc, char **argv) {
         cout << "Total Number of blocks in maf: " << dScan.getNumBlocks() << "\n";
 
         MafWriteGenomes writer;
-        writer.convert(mafPath, refGenomeName, targetSet, dScan.getDimensions(), alignment);
+        writer.convert(spill, refGenomeName, dScan.getDimensions(), alignment,
+                       getWriteThreadCount(alignment.get(), numThreads));
+        alignment->close();
     }
     try {
     } catch (hal_exception &e) {
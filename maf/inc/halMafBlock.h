@@ -150,8 +150,7 @@ namespace hal {
         void initEntry(MafBlockEntry *entry, const Sequence *sequence, DnaIteratorPtr dna, bool clearSequence = true);
         void updateEntry(MafBlockEntry *entry, const Sequence *sequence, DnaIteratorPtr dna);
         stTree *buildTree(ColumnIteratorPtr colIt, bool modifyEntries);
-        void buildTreeR(BottomSegmentIteratorPtr botIt, stTree *tree, bool modifyEntries);
-        stTree *getTreeNode(SegmentIteratorPtr segIt, bool modifyEntries);
+        stTree *getTreeNode(const Genome *genome, hal_index_t position, bool modifyEntries);
 
         std::ostream &printBlock(std::ostream &os) const;
         std::ostream &printBlockWithTree(std::ostream &os) const;
@@ -165,6 +164,12 @@ namespace hal {
         bool _fullNames;
         bool _printTree;
         stTree *_tree;
+        // column iterator of the block's first column, and how many times
+        // its column tree had been built then.  Until the tree is rebuilt,
+        // the columns have the same tree as the block.
+        ColumnIteratorPtr _treeColIt;
+        hal_size_t _treeNumBuilds;
+        std::vector<stTree *> _treeNodes;
 
         typedef hal::ColumnIterator::ColumnMap ColumnMap;
         typedef hal::ColumnIterator::DNASet DNASet;
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef _HALMAFLINEREADER_H
+#define _HALMAFLINEREADER_H
+
+#include "halDefs.h"
+#include <string>
+#include <vector>
+
+namespace hal {
+
+    /** Read the lines of a MAF without copying them.  A regular file is
+     * memory-mapped, anything else (such as a pipe from gzip -dc) is read
+     * in large chunks.  Lines are returned as pointer ranges that stay
+     * valid until the next call. */
+    class MafLineReader {
+      public:
+        MafLineReader(const std::string &path);
+        ~MafLineReader();
+
+        /** get the next line, without its end of line characters,
+         * returning false at the end of the file */
+        bool nextLine(const char *&begin, const char *&end);
+
+      private:
+        void readMore();
+
+        std::string _path;
+        int _fd;
+        const char *_map;
+        size_t _mapSize;
+        std::vector<char> _buffer;
+        size_t _pos;
+        size_t _end;
+        bool _eof;
+    };
+}
+
+#endif
+// Local Variables:
+// mode: c++
+// End:
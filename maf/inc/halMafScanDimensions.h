@@ -30,7 +30,8 @@ namespace hal {
         };
         typedef std::map<hal_size_t, ArrayInfo> StartMap;
 
-        typedef std::pair<std::streampos, size_t> FilePosition;
+        // block number and row of a row in the scan
+        typedef std::pair<hal_size_t, size_t> FilePosition;
         typedef std::set<FilePosition> PosSet;
 
         struct Record {
@@ -45,6 +46,9 @@ namespace hal {
         MafScanDimensions();
         ~MafScanDimensions();
         void scan(const std::string &mafPath, const std::set<std::string> &targetSet);
+        /** scan, also writing the blocks to spill to be converted without
+         * reading the MAF again */
+        void scan(const std::string &mafPath, const std::set<std::string> &targetSet, MafSpill &spill);
         const DimMap &getDimensions() const;
 
       protected:
@@ -56,6 +60,8 @@ namespace hal {
 
       protected:
         DimMap _dimMap;
+        MafSpill *_spill;
+        std::vector<size_t> _maskColumns;
     };
 }
 
@@ -12,14 +12,22 @@
 #include <cstdlib>
 #include <deque>
 #include <fstream>
+#include <functional>
 #include <string>
 #include <vector>
 
 namespace hal {
+    class MafLineReader;
+    class MafSpill;
 
     /** Parse a MAF file line by line
      * written independently from the maf export, and it's too much of a
-     * bother to reuse any of that code. */
+     * bother to reuse any of that code.
+     *
+     * Blocks are parsed by a background thread, a bounded number of
+     * blocks ahead of the scan.  For each block, sLine() is called for
+     * every row, then aLine() once the mask is computed.  end() is called
+     * after the last block. */
     class MafScanner {
       public:
         MafScanner();
@@ -43,19 +51,35 @@ namespace hal {
         typedef std::vector<bool> Mask;
 
       protected:
+        struct ParsedBlock {
+            Block _block;
+            size_t _rows;
+        };
+        typedef std::function<bool(Block &block, size_t &rows)> BlockReader;
+
         virtual void aLine() = 0;
         virtual void sLine() = 0;
         virtual void end() = 0;
-        void nextLine();
+        /** Scan the blocks of a spill file written by an earlier scan.
+         * The rows are the ones of the MAF, before any sLine() changes. */
+        void scanSpill(MafSpill &spill);
+        /** Stop the scan after the current sLine(), without calling aLine()
+         * for the block or end() */
+        void stopScan();
         void updateMask();
 
-        std::ifstream _mafFile;
         std::set<std::string> _targets;
 
         Block _block;
         size_t _rows;
         Mask _mask;
         hal_size_t _numBlocks;
+
+      private:
+        bool readMafBlock(MafLineReader &mafReader, std::string &genomeBuffer, Block &block, size_t &rows);
+        void scanBlocks(const BlockReader &readBlock);
+
+        bool _stopped;
     };
 }
 
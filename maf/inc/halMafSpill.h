@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#ifndef _HALMAFSPILL_H
+#define _HALMAFSPILL_H
+
+#include "halMafScanner.h"
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace hal {
+
+    /** Temporary file holding the blocks of a MAF, so that they can be
+     * read back after the dimensions are known without parsing the MAF
+     * text again.  Sequence names are stored once in a table and rows as
+     * variable length coordinates, the runs of gaps in the alignment line
+     * and the bases packed two per byte, so the file is well under half
+     * the size of the MAF.  The file is removed as soon as it is created,
+     * so it is cleaned up however the program exits. */
+    class MafSpill {
+      public:
+        /** create the file in directory dir (current directory if empty) */
+        MafSpill(const std::string &dir);
+        ~MafSpill();
+
+        void writeBlock(const MafScanner::Block &block, size_t rows);
+        /** go back to the first block, after all blocks are written */
+        void rewind();
+        /** read the next block, returning false after the last one */
+        bool readBlock(MafScanner::Block &block, size_t &rows);
+
+        hal_size_t getNumBlocks() const {
+            return _numBlocks;
+        }
+
+      private:
+        typedef std::map<std::pair<std::string, hal_size_t>, uint32_t> NameMap;
+
+        void checkStream(const std::string &action);
+        uint64_t getVarint();
+        /** append the gap runs and packed bases of an alignment line to
+         * _buffer */
+        void packLine(const std::string &line);
+        /** read back a line of length bases written by packLine() */
+        void unpackLine(size_t lineLength, size_t length, std::string &line);
+
+        std::string _path;
+        std::fstream _file;
+        // sequence names and source lengths
+        NameMap _nameIds;
+        std::vector<std::pair<std::string, hal_size_t>> _names;
+        hal_size_t _numBlocks;
+        // block being written or read
+        std::vector<unsigned char> _buffer;
+        size_t _readPos;
+        // (column, length) pairs of the gaps in a line
+        std::vector<size_t> _gapRuns;
+    };
+}
+
+#endif
+// Local Variables:
+// mode: c++
+// End:
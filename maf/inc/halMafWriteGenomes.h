@@ -36,25 +36,11 @@ namespace hal {
         typedef std::pair<DimMap::const_iterator, DimMap::const_iterator> MapRange;
 
         void convert(const std::string &mafPath, const std::string &refGenomeName, const std::set<std::string> &targets,
-                     const DimMap &dimMap, AlignmentPtr alignment);
-
-      private:
-        MapRange getRefSequences() const;
-        MapRange getNextSequences(DimMap::const_iterator jprev) const;
-
-        void createGenomes();
-        void initGenomes();
-        void convertBlock();
-        void initBlockInfo(size_t col);
-        void initParaMap();
-        void convertSegments(size_t col);
-        void updateParalogy(size_t i);
-        void initEmptySegments();
-        void updateRefParseInfo();
-
-        void aLine();
-        void sLine();
-        void end();
+                     const DimMap &dimMap, AlignmentPtr alignment, unsigned numThreads = 1);
+        /** convert the blocks written to spill by MafScanDimensions, which
+         * were already restricted to the target genomes */
+        void convert(MafSpill &spill, const std::string &refGenomeName, const DimMap &dimMap, AlignmentPtr alignment,
+                     unsigned numThreads = 1);
 
       private:
         struct RowInfo {
@@ -64,8 +50,8 @@ namespace hal {
             hal_size_t _length;
             const Record *_record;
             Genome *_genome;
+            unsigned _writer;
             bool _skip;
-            std::string _gapComp;
         };
 
         struct Paralogy {
@@ -78,21 +64,76 @@ namespace hal {
         typedef std::set<Paralogy> ParaSet;
         typedef std::map<Genome *, ParaSet> ParaMap;
 
+        /** the rows of a block over one segment, from column _col up to the
+         * next column in the mask */
+        struct Chunk {
+            size_t _col;
+            hal_index_t _refRow;
+            std::vector<RowInfo> _rowInfo;
+        };
+
+        /** block whose segments have been assigned array indexes, waiting
+         * to be written */
+        struct BlockJob {
+            Block _block;
+            size_t _rows;
+            std::vector<Sequence *> _sequences;
+            std::vector<std::string> _gapComps;
+            ParaMap _paraMap;
+            std::vector<Chunk> _chunks;
+            size_t _numChunks;
+        };
+
+        struct SegmentIterators {
+            TopSegmentIteratorPtr _topSegment, _paraTop;
+            BottomSegmentIteratorPtr _bottomSegment, _refBottom;
+        };
+
+      private:
+        MapRange getRefSequences() const;
+        MapRange getNextSequences(DimMap::const_iterator jprev) const;
+
+        void initConvert(const std::string &refGenomeName, const DimMap &dimMap, AlignmentPtr alignment, unsigned numThreads);
+        void createGenomes();
+        void convertBlock();
+        void initBlockInfo(size_t col, BlockJob &job);
+        void initParaMap(BlockJob &job);
+        void writeBlocks();
+        void writeChunk(const BlockJob &job, const Chunk &chunk, unsigned writer, SegmentIterators &iterators);
+        void updateParalogy(const BlockJob &job, const Chunk &chunk, size_t i, SegmentIterators &iterators);
+        void initEmptySegments();
+        void initEmptySegments(Genome *genome, MapRange range);
+        void updateRefParseInfo();
+
+        void aLine();
+        void sLine();
+        void end();
+
       private:
-        ParaSet::iterator circularNext(size_t row, ParaSet &paraSet, ParaSet::iterator i);
-        ParaSet::iterator circularPrev(size_t row, ParaSet &paraSet, ParaSet::iterator i);
+        ParaSet::const_iterator circularNext(const std::vector<RowInfo> &rowInfo, const ParaSet &paraSet,
+                                             ParaSet::const_iterator i) const;
+        ParaSet::const_iterator circularPrev(const std::vector<RowInfo> &rowInfo, const ParaSet &paraSet,
+                                             ParaSet::const_iterator i) const;
 
       private:
         std::string _refName;
         Genome *_refGenome;
+        Genome *_topGenome;
         hal_index_t _refRow;
         const DimMap *_dimMap;
         AlignmentPtr _alignment;
         std::vector<RowInfo> _blockInfo;
-        TopSegmentIteratorPtr _topSegment, _paraTop;
-        BottomSegmentIteratorPtr _bottomSegment, _refBottom;
         std::map<Genome *, hal_size_t> _childIdxMap;
-        ParaMap _paraMap;
+
+        // blocks are assigned segments in file order, then written in
+        // batches by _numThreads threads, each writing the genomes for
+        // which it is the _writer
+        unsigned _numThreads;
+        std::map<Genome *, unsigned> _writerMap;
+        std::vector<SegmentIterators> _iterators;
+        std::vector<BlockJob> _jobs;
+        size_t _numJobs;
+        size_t _batchBytes;
     };
 }
 
@@ -3,8 +3,11 @@
 #include "ancestorsML.h"
 #include "hal.h"
 #include "halBedScanner.h"
+#include "halColumnTree.h"
 #include "sonLibTree.h"
 #include "string.h"
+#include <algorithm>
+#include <sstream>
 extern "C" {
 #include "markov_matrix.h"
 #include "tree_model.h"
@@ -15,9 +18,6 @@ extern "C" {
 using namespace std;
 using namespace hal;
 
-// globals -- for convenience
-static double outValue; // for wigs
-
 // sum log-transformed probabilities.
 static inline double log_space_add(double x, double y) {
     if (x == -INFINITY) {
@@ -72,144 +72,6 @@ inline int charToIndex(char dna) {
     }
 }
 
-// find root genome of tree for this position in the genome
-rootInfo *findRoot(const Genome *genome, hal_index_t pos, bool reversed = false) {
-    if (genome->getParent() == NULL) {
-        rootInfo *data = (rootInfo *)malloc(sizeof(rootInfo));
-        data->rootGenome = genome;
-        data->pos = pos;
-        data->reversed = reversed;
-        return data;
-    }
-    TopSegmentIteratorPtr topIt = genome->getTopSegmentIterator();
-    topIt->toSite(pos, false);
-    bool parentReversed = topIt->getTopSegment()->getParentReversed() ? !reversed : reversed;
-    if (!topIt->getTopSegment()->hasParent()) {
-        //    cout << "Root genome for pos: " << pos << " " << genome->getName() << endl;
-        rootInfo *data = (rootInfo *)malloc(sizeof(rootInfo));
-        data->rootGenome = genome;
-        data->pos = pos;
-        data->reversed = reversed;
-        return data;
-    } else {
-        BottomSegmentIteratorPtr botIt = genome->getParent()->getBottomSegmentIterator();
-        botIt->toParent(topIt);
-        hal_index_t parentPos = botIt->getStartPosition();
-        hal_index_t offset = abs(pos - topIt->getStartPosition());
-        parentPos = topIt->getTopSegment()->getParentReversed() ? parentPos - offset : parentPos + offset;
-        //  cout << "Going to parent " << genome->getParent()->getName() << ": start pos " << pos << " parent pos: " <<
-        //  parentPos << "reversed: " << parentReversed << endl;
-        return findRoot(genome->getParent(), parentPos, parentReversed);
-    }
-}
-
-// Remove a node from the tree and prune any unneeded nodes left over
-// (ancestral nodes that would have no children).
-void removeAndPrune(stTree *tree) {
-    felsensteinData *data = (felsensteinData *)stTree_getClientData(tree);
-    free(data);
-    stTree *parentNode = stTree_getParent(tree);
-    if (parentNode != NULL) {
-        stTree_setParent(tree, NULL);
-        // We need to avoid freeing the root so main can know that there
-        // is no point in continuing for this site (root has no children)
-        if (stTree_getChildNumber(parentNode) == 0 && stTree_getParent(parentNode) != NULL) {
-            //      removeAndPrune(parentNode);
-        }
-    }
-    stTree_destruct(tree);
-}
-
-// Build site-specific tree below this genome.
-void buildTree(AlignmentConstPtr alignment, const Genome *genome, hal_index_t pos, stTree *tree, bool reversed,
-               map<string, int> *nameToId = NULL) {
-    stTree_setLabel(tree, genome->getName().c_str());
-    felsensteinData *data = (felsensteinData *)malloc(sizeof(felsensteinData));
-    memset(data, 0, sizeof(felsensteinData));
-    data->pos = pos;
-    data->reversed = reversed;
-    if (nameToId != NULL) {
-        data->phastId = (*nameToId)[genome->getName()];
-    }
-    stTree_setClientData(tree, data);
-    if (genome->getNumChildren() == 0) {
-        DnaIteratorPtr dnaIt = genome->getDnaIterator(pos);
-        if (reversed) {
-            dnaIt->toReverse();
-        }
-        data->dna = dnaIt->getBase();
-        return;
-    }
-    data->dna = 'Z'; // signals an ancestor for the pruning process -- hacky
-    BottomSegmentIteratorPtr botIt = genome->getBottomSegmentIterator();
-    botIt->toSite(pos, false);
-    assert(botIt->getReversed() == false);
-    for (hal_size_t i = 0; i < genome->getNumChildren(); i++) {
-        hal_index_t childIndex = botIt->getBottomSegment()->getChildIndex(i);
-        if (childIndex != NULL_INDEX) {
-            const Genome *childGenome = genome->getChild(i);
-            TopSegmentIteratorPtr topIt = childGenome->getTopSegmentIterator();
-            topIt->toChild(botIt, i);
-            if (topIt->getTopSegment()->getNextParalogyIndex() != NULL_INDEX) {
-                // Go through the paralogy cycle and add the
-                // paralogous sites.
-                // NOTE!: can theoretically run into problems
-                // comparing these iterators if there is an
-                // orientation change between paralogous segments (can
-                // possibly create more duplications than really
-                // exist) Won't happen with the way the iterator
-                // comparison is implemented now though.
-                TopSegmentIteratorPtr original = topIt->clone();
-                for (topIt->toNextParalogy(); !topIt->equals(original); topIt->toNextParalogy()) {
-                    // sanity check
-                    assert(topIt->getLength() == botIt->getLength());
-                    hal_index_t childPos = topIt->getStartPosition();
-                    hal_index_t offset = abs(pos - botIt->getStartPosition());
-                    childPos = topIt->getTopSegment()->getParentReversed() ? childPos - offset : childPos + offset;
-                    stTree *childNode = stTree_construct();
-                    stTree_setParent(childNode, tree);
-                    double branchLength = alignment->getBranchLength(genome->getName(), childGenome->getName());
-                    // TODO: make option for branch length of duplications
-                    // (e.g. as fraction of species-tree branch length)
-                    stTree_setBranchLength(childNode, branchLength);
-                    bool childReversed = topIt->getTopSegment()->getParentReversed() ? !reversed : reversed;
-                    buildTree(alignment, childGenome, childPos, childNode, childReversed, nameToId);
-                }
-            }
-            hal_index_t childPos = topIt->getStartPosition();
-            hal_index_t offset = abs(pos - botIt->getStartPosition());
-            childPos = botIt->getBottomSegment()->getChildReversed(i) ? childPos - offset : childPos + offset;
-            stTree *childNode = stTree_construct();
-            stTree_setParent(childNode, tree);
-            double branchLength = alignment->getBranchLength(genome->getName(), childGenome->getName());
-            stTree_setBranchLength(childNode, branchLength);
-            bool childReversed = botIt->getBottomSegment()->getChildReversed(i) ? !reversed : reversed;
-            buildTree(alignment, childGenome, childPos, childNode, childReversed, nameToId);
-        }
-    }
-}
-
-bool pruneTree(stTree *tree) {
-    // This function removes any ancestral leaf (usually from alignment
-    // slop aligning to the edge of an ancestral scaffold gap).
-    for (int64_t i = 0; i < stTree_getChildNumber(tree); i++) {
-        if (pruneTree(stTree_getChild(tree, i))) {
-            // The child numbers will shift by 1 on deletion.
-            i -= 1;
-        }
-    }
-
-    if (stTree_getChildNumber(tree) == 0 && stTree_getParent(tree) != NULL) {
-        felsensteinData *data = (felsensteinData *)stTree_getClientData(tree);
-        // hack, but check if this is an ancestor in the species tree.
-        if (data->dna == 'Z') {
-            removeAndPrune(tree);
-            return true;
-        }
-    }
-    return false;
-}
-
 double probTransition(TreeModel *mod, int childId, int parentId, char childDNA, char parentDNA) {
     assert(mod->nratecats == 1);
     assert(mod->P[childId][0] != NULL);
@@ -261,179 +123,412 @@ void doFelsenstein(stTree *node, TreeModel *mod) {
     data->done = true;
 }
 
-// Assign nucleotides to each node in the tree.
-void walkFelsenstein(TreeModel *mod, stTree *tree, char assignment, double threshold) {
-    felsensteinData *data = (felsensteinData *)stTree_getClientData(tree);
-    data->dna = assignment;
-    for (int64_t i = 0; i < stTree_getChildNumber(tree); i++) {
-        stTree *childNode = stTree_getChild(tree, i);
-        if (stTree_getChildNumber(childNode) != 0) {
-            felsensteinData *childData = (felsensteinData *)stTree_getClientData(childNode);
 
-            // Find posterior probability of this base.
-            double totalProb = -INFINITY;
+FelsensteinBatch::FelsensteinBatch(TreeModel *mod) : _numSites(0) {
+    _logProbs.assign(mod->tree->nnodes * 16, -INFINITY);
+    for (int id = 0; id < mod->tree->nnodes; id++) {
+        if (mod->P[id] == NULL || mod->P[id][0] == NULL) {
+            // the root has no branch above it
+            continue;
+        }
+        for (int dna = 0; dna < 4; dna++) {
+            for (int childDna = 0; childDna < 4; childDna++) {
+                _logProbs[id * 16 + dna * 4 + childDna] =
+                    log(probTransition(mod, id, NULL_INDEX, indexToChar(childDna), indexToChar(dna)));
+            }
+        }
+    }
+}
+
+void FelsensteinBatch::clear() {
+    _parents.clear();
+    _phastIds.clear();
+    _numSites = 0;
+}
+
+hal_size_t FelsensteinBatch::addNode(hal_index_t parent, int phastId) {
+    hal_size_t node = _parents.size();
+    _parents.push_back(parent);
+    _phastIds.push_back(phastId);
+    // the children lists are kept to reuse their buffers
+    if (_children.size() <= node) {
+        _children.resize(node + 1);
+    }
+    _children[node].clear();
+    if (parent != NULL_INDEX) {
+        _children[parent].push_back(node);
+    }
+    return node;
+}
+
+void FelsensteinBatch::setNumSites(hal_size_t numSites) {
+    _numSites = numSites;
+    _pLeaves.resize(_parents.size() * _numSites * 4);
+    _pOtherLeaves.resize(_parents.size() * _numSites * 4);
+    _posts.resize(_parents.size() * _numSites);
+    _bases.resize(_parents.size() * _numSites);
+}
+
+void FelsensteinBatch::setLeafBase(hal_size_t node, hal_size_t site, char dna) {
+    _bases[node * _numSites + site] = dna;
+    double *pLeaves = &_pLeaves[(node * _numSites + site) * 4];
+    if (dna == 'N' || dna == 'n') {
+        for (int i = 0; i < 4; ++i) {
+            pLeaves[i] = log(0.25);
+        }
+    } else {
+        int index = charToIndex(dna);
+        for (int i = 0; i < 4; ++i) {
+            pLeaves[i] = i == index ? log(1.0) : -INFINITY;
+        }
+    }
+}
+
+// Nodes are in preorder, so going through them backwards visits the
+// children of a node before the node.  The sums are done in the same
+// order as doFelsenstein so the results are the same.
+void FelsensteinBatch::computeLikelihoods() {
+    for (hal_size_t node = _parents.size(); node-- > 0;) {
+        const vector<hal_size_t> &children = _children[node];
+        if (children.empty()) {
+            continue;
+        }
+        double *pLeaves = &_pLeaves[node * _numSites * 4];
+        for (hal_size_t i = 0; i < _numSites * 4; i++) {
+            pLeaves[i] = 0.0;
+        }
+        for (hal_size_t childIdx = 0; childIdx < children.size(); childIdx++) {
+            const double *childPLeaves = &_pLeaves[children[childIdx] * _numSites * 4];
+            const double *logProbs = getLogProbs(children[childIdx]);
+            for (hal_size_t site = 0; site < _numSites; site++) {
+                for (int dna = 0; dna < 4; dna++) {
+                    // sum over the possibile assignments for this node
+                    double probSubtree = -INFINITY;
+                    for (int childDna = 0; childDna < 4; childDna++) {
+                        probSubtree =
+                            log_space_add(probSubtree, childPLeaves[site * 4 + childDna] + logProbs[dna * 4 + childDna]);
+                    }
+                    pLeaves[site * 4 + dna] += probSubtree;
+                }
+            }
+        }
+    }
+}
+
+void FelsensteinBatch::assignBases(double logThreshold) {
+    // Find assignment for root node that maximizes P(leaves)
+    for (hal_size_t site = 0; site < _numSites; site++) {
+        // For prob(tree|char) -> prob(char|tree) (there is only one possible tree)
+        const double *pLeaves = &_pLeaves[site * 4];
+        double *pOtherLeaves = &_pOtherLeaves[site * 4];
+        double totalProbTree = -INFINITY;
+        double maxProb = -INFINITY;
+        int maxDna = -1;
+        for (int dna = 0; dna < 4; dna++) {
+            pOtherLeaves[dna] = log(0.25);
+            totalProbTree = log_space_add(totalProbTree, pLeaves[dna]);
+            if (pLeaves[dna] > maxProb) {
+                maxDna = dna;
+                maxProb = pLeaves[dna];
+            }
+        }
+        _posts[site] = maxProb - totalProbTree;
+        if (maxDna == -1) {
+            _bases[site] = randNuc();
+        } else if (_posts[site] < logThreshold) {
+            _bases[site] = 'N';
+        } else {
+            _bases[site] = indexToChar(maxDna);
+        }
+    }
+
+    // The other internal nodes, in preorder so that the parent's
+    // probabilities of the leaves outside its subtree are known.
+    for (hal_size_t node = 1; node < _parents.size(); node++) {
+        if (_children[node].empty()) {
+            continue;
+        }
+        hal_size_t parent = _parents[node];
+        const vector<hal_size_t> &siblings = _children[parent];
+        const double *logProbs = getLogProbs(node);
+        for (hal_size_t site = 0; site < _numSites; site++) {
+            const double *parentPOtherLeaves = &_pOtherLeaves[(parent * _numSites + site) * 4];
+            const double *pLeaves = &_pLeaves[(node * _numSites + site) * 4];
+            double *pOtherLeaves = &_pOtherLeaves[(node * _numSites + site) * 4];
+
             // trick found from phast code -- saves us some compute time
             double temp[4];
-            for (int thisDna = 0; thisDna < 4; thisDna++) {
-                temp[thisDna] = -INFINITY;
-                for (int64_t j = 0; j < stTree_getChildNumber(tree); j++) {
-                    if (i == j) {
+            for (int parentDna = 0; parentDna < 4; parentDna++) {
+                temp[parentDna] = -INFINITY;
+                for (hal_size_t j = 0; j < siblings.size(); j++) {
+                    if (siblings[j] == node) {
                         continue;
                     }
-                    stTree *siblingNode = stTree_getChild(tree, j);
-                    felsensteinData *siblingData = (felsensteinData *)stTree_getClientData(siblingNode);
+                    const double *siblingPLeaves = &_pLeaves[(siblings[j] * _numSites + site) * 4];
+                    const double *siblingLogProbs = getLogProbs(siblings[j]);
                     for (int siblingDna = 0; siblingDna < 4; siblingDna++) {
-                        temp[thisDna] = log_space_add(temp[thisDna],
-                                                      data->pOtherLeaves[thisDna] + siblingData->pLeaves[siblingDna] +
-                                                          log(probTransition(mod, siblingData->phastId, data->phastId,
-                                                                             indexToChar(siblingDna), indexToChar(thisDna))));
+                        temp[parentDna] =
+                            log_space_add(temp[parentDna], parentPOtherLeaves[parentDna] + siblingPLeaves[siblingDna] +
+                                                               siblingLogProbs[parentDna * 4 + siblingDna]);
                     }
                 }
-                if (stTree_getChildNumber(tree) == 1) {
+                if (siblings.size() == 1) {
                     // Special case -- the sibling isn't in this tree.
-                    temp[thisDna] = data->pOtherLeaves[thisDna];
+                    temp[parentDna] = parentPOtherLeaves[parentDna];
                 }
             }
-            for (int childDna = 0; childDna < 4; childDna++) {
-                childData->pOtherLeaves[childDna] = -INFINITY;
-                for (int thisDna = 0; thisDna < 4; thisDna++) {
-                    childData->pOtherLeaves[childDna] =
-                        log_space_add(childData->pOtherLeaves[childDna],
-                                      temp[thisDna] + log(probTransition(mod, childData->phastId, data->phastId,
-                                                                         indexToChar(childDna), indexToChar(thisDna))));
+
+            // Find posterior probability of this base.
+            double totalProb = -INFINITY;
+            for (int dna = 0; dna < 4; dna++) {
+                pOtherLeaves[dna] = -INFINITY;
+                for (int parentDna = 0; parentDna < 4; parentDna++) {
+                    pOtherLeaves[dna] = log_space_add(pOtherLeaves[dna], temp[parentDna] + logProbs[parentDna * 4 + dna]);
                 }
-                totalProb = log_space_add(totalProb, childData->pOtherLeaves[childDna] + childData->pLeaves[childDna]);
+                totalProb = log_space_add(totalProb, pOtherLeaves[dna] + pLeaves[dna]);
             }
             int maxDna = -1;
             double maxProb = -INFINITY;
-            for (int childDna = 0; childDna < 4; childDna++) {
-                double post = childData->pOtherLeaves[childDna] + childData->pLeaves[childDna] - totalProb;
+            for (int dna = 0; dna < 4; dna++) {
+                double post = pOtherLeaves[dna] + pLeaves[dna] - totalProb;
                 if (post > maxProb) {
-                    maxDna = childDna;
+                    maxDna = dna;
                     maxProb = post;
                 }
             }
-            char childAssignment;
-            if (maxDna == -1) {
-                childAssignment = randNuc();
-            } else {
-                childAssignment = indexToChar(maxDna);
-            }
-            childData->post = maxProb;
-            if (maxProb < threshold) {
-                childAssignment = 'N';
-            }
-            walkFelsenstein(mod, childNode, childAssignment, threshold);
+            char assignment = maxDna == -1 ? randNuc() : indexToChar(maxDna);
+            _posts[node * _numSites + site] = maxProb;
+            _bases[node * _numSites + site] = maxProb < logThreshold ? 'N' : assignment;
         }
     }
 }
 
-void writeNucleotides(stTree *tree, AlignmentConstPtr alignment, const Genome *target, hal_index_t targetPos,
-                      bool printWrites = false) {
-    felsensteinData *data = (felsensteinData *)stTree_getClientData(tree);
-    if (stTree_getChildNumber(tree) == 0) {
-        return;
-    }
-    const Genome *genome = alignment->openGenome(stTree_getLabel(tree));
-    assert(genome != NULL);
-    DnaIteratorPtr dnaIt = genome->getDnaIterator(data->pos);
-    if (data->reversed) {
-        dnaIt->toReverse();
-    }
-    char dna = fastUpper(dnaIt->getBase());
-    if (data->dna != dna) {
-        if (printWrites) {
-            cout << genome->getName() << "\t" << data->pos << "\t" << string(1, dna) << "\t" << string(1, data->dna) << endl;
+namespace {
+    // Consecutive sites with the same tree are run through Felsenstein's
+    // algorithm together, up to this many at a time.
+    const hal_size_t maxBatchSites = 1024;
+
+    /** Re-estimates tiles of a genome with one thread's alignment */
+    struct AncestorsMLThread {
+        AncestorsMLThread(TreeModel *mod) : _batch(mod), _treeBuild(0), _numSites(0) {
         }
+
+        void reEstimateTile(hal_index_t startPos, hal_index_t endPos, ostream &outStream);
+        void setTree();
+        void addTreeNodesR(hal_size_t node, hal_index_t batchParent);
+        void addSite(hal_index_t pos);
+        void writeSites(ostream &outStream);
+
+        const Genome *_genome;
+        const map<string, int> *_nameToId;
+        double _logThreshold;
+        bool _printWrites;
+        bool _outputPosts;
+
+        ColumnTree _columnTree;
+        FelsensteinBatch _batch;
+        // build count of the column tree the batch's tree was made from
+        hal_size_t _treeBuild;
+        // phast id of each column tree genome ordinal (-1 if not looked up)
+        vector<int> _ordinalPhastIds;
+        vector<hal_size_t> _columnChildren;
+        vector<hal_size_t> _columnChildEnds;
+        vector<char> _keep;
+        // column tree node and genome of each batch node
+        vector<hal_size_t> _batchColumnNodes;
+        vector<const Genome *> _batchGenomes;
+        // sites of the current batch: the first position, then the
+        // position and current base of each batch node by site
+        hal_index_t _firstPos;
+        hal_size_t _numSites;
+        vector<hal_index_t> _sitePositions;
+        vector<char> _siteBases;
+    };
+}
+
+void AncestorsMLThread::reEstimateTile(hal_index_t startPos, hal_index_t endPos, ostream &outStream) {
+    for (hal_index_t pos = startPos; pos < endPos; pos++) {
+        _columnTree.update(_genome, pos);
+        if (_numSites > 0 && (_columnTree.getNumBuilds() != _treeBuild || _numSites == maxBatchSites)) {
+            writeSites(outStream);
+        }
+        if (_columnTree.getNumBuilds() != _treeBuild) {
+            setTree();
+        }
+        addSite(pos);
     }
-    if (genome == target && data->pos == targetPos) {
-        // correct genome and correct position
-        outValue = data->post;
+    if (_numSites > 0) {
+        writeSites(outStream);
+    }
+}
+
+// Make the batch's tree from the column tree.  Ancestral leaves (usually
+// from alignment slop aligning to the edge of an ancestral scaffold gap)
+// are pruned, and paralogous children are put in the same order as when
+// the tree was built by following the paralogy cycles, with the
+// segment's own child last.
+void AncestorsMLThread::setTree() {
+    hal_size_t numNodes = _columnTree.getNumNodes();
+    _treeBuild = _columnTree.getNumBuilds();
+    if (_ordinalPhastIds.size() < _columnTree.getNumGenomes()) {
+        _ordinalPhastIds.resize(_columnTree.getNumGenomes(), -1);
     }
-    for (int64_t i = 0; i < stTree_getChildNumber(tree); i++) {
-        stTree *childNode = stTree_getChild(tree, i);
-        writeNucleotides(childNode, alignment, target, targetPos, printWrites);
+
+    // nodes are in preorder, so the children of a node are seen
+    // before it when going backwards
+    _keep.assign(numNodes, 0);
+    for (hal_size_t node = numNodes; node-- > 0;) {
+        if (_columnTree.getGenome(node)->getNumChildren() == 0) {
+            _keep[node] = 1;
+        }
+        if (_keep[node] && node > 0) {
+            _keep[_columnTree.getParent(node)] = 1;
+        }
     }
+    _keep[0] = 1;
+
+    _batch.clear();
+    _batchColumnNodes.clear();
+    _batchGenomes.clear();
+    addTreeNodesR(0, NULL_INDEX);
 }
 
-void freeClientData(stTree *tree) {
-    felsensteinData *data = (felsensteinData *)stTree_getClientData(tree);
-    if (stTree_getChildNumber(tree)) {
-        for (int i = 0; i < 4; i++) {
-            for (int j = 0; j < 4; j++) {
-                //        free(data->childrenCharProbs[i][j]);
-            }
+void AncestorsMLThread::addTreeNodesR(hal_size_t node, hal_index_t batchParent) {
+    hal_size_t ordinal = _columnTree.getGenomeOrdinal(node);
+    if (_ordinalPhastIds[ordinal] == -1) {
+        map<string, int>::const_iterator i = _nameToId->find(_columnTree.getGenome(node)->getName());
+        _ordinalPhastIds[ordinal] = i != _nameToId->end() ? i->second : 0;
+    }
+    hal_size_t batchNode = _batch.addNode(batchParent, _ordinalPhastIds[ordinal]);
+    _batchColumnNodes.push_back(node);
+    _batchGenomes.push_back(_columnTree.getGenome(node));
+
+    // children of the node, with each run of paralogs (which starts with
+    // the segment's own child) rotated by one
+    hal_size_t childrenStart = _columnChildren.size();
+    for (hal_size_t child = node + 1; child < _columnTree.getSubtreeEnd(node); child = _columnTree.getSubtreeEnd(child)) {
+        _columnChildren.push_back(child);
+    }
+    hal_size_t childrenEnd = _columnChildren.size();
+    for (hal_size_t runStart = childrenStart; runStart < childrenEnd;) {
+        hal_size_t runEnd = runStart + 1;
+        while (runEnd < childrenEnd && _columnTree.getGenomeOrdinal(_columnChildren[runEnd]) ==
+                                           _columnTree.getGenomeOrdinal(_columnChildren[runStart])) {
+            runEnd++;
         }
-        for (int64_t i = 0; i < stTree_getChildNumber(tree); i++) {
-            freeClientData(stTree_getChild(tree, i));
+        rotate(_columnChildren.begin() + runStart, _columnChildren.begin() + runStart + 1,
+               _columnChildren.begin() + runEnd);
+        runStart = runEnd;
+    }
+    for (hal_size_t i = childrenStart; i < childrenEnd; i++) {
+        if (_keep[_columnChildren[i]]) {
+            addTreeNodesR(_columnChildren[i], batchNode);
         }
     }
-    free(data);
+    _columnChildren.resize(childrenStart);
 }
 
-void reEstimate(TreeModel *mod, AlignmentConstPtr alignment, const Genome *genome, hal_index_t startPos, hal_index_t endPos,
-                map<string, int> &nameToId, double threshold, bool printWrites, bool writePosts) {
-    threshold = log(threshold);
-    stTree *tree = NULL;
-    bool firstRun = true;
-    for (hal_index_t pos = startPos; pos < endPos; pos++) {
-        outValue = 0.0;
-        if (writePosts && firstRun) {
-            const Sequence *seq = genome->getSequenceBySite(pos);
-            // position + 1 because wigs are 1-based.
-            cout << "fixedStep chrom=" << seq->getName() << " start=" << pos - seq->getStartPosition() + 1 << " step=1" << endl;
-            firstRun = false;
+void AncestorsMLThread::addSite(hal_index_t pos) {
+    if (_numSites == 0) {
+        _firstPos = pos;
+        _sitePositions.clear();
+        _siteBases.clear();
+    }
+    for (hal_size_t batchNode = 0; batchNode < _batch.getNumNodes(); batchNode++) {
+        hal_size_t node = _batchColumnNodes[batchNode];
+        _sitePositions.push_back(_columnTree.getArrayIndex(node));
+        char base = 0;
+        if (_batch.getNumChildren(batchNode) == 0) {
+            base = _columnTree.getDnaIterator(node)->getBase();
+        } else if (_printWrites) {
+            base = fastUpper(_columnTree.getDnaIterator(node)->getBase());
         }
-        tree = stTree_construct();
-        // Find root of tree
-        rootInfo *rootInfo = findRoot(genome, pos);
-        const Genome *root = rootInfo->rootGenome;
-        hal_index_t rootPos = rootInfo->pos;
-        bool rootReversed = rootInfo->reversed;
-        buildTree(alignment, root, rootPos, tree, rootReversed, &nameToId);
-        pruneTree(tree);
-        if (stTree_getChildNumber(tree) == 0) {
-            // No reason to build a tree, there's an insertion in the root
-            // node relative to its children.
-            freeClientData(tree);
-            stTree_destruct(tree);
-            if (writePosts) {
-                // need to keep the wig in order
-                outValue = -INFINITY;
-                cout << outValue << endl;
+        _siteBases.push_back(base);
+    }
+    _numSites++;
+}
+
+// Estimate the batch's sites and write the changed bases and the
+// posteriors of the genome's bases.
+void AncestorsMLThread::writeSites(ostream &outStream) {
+    hal_size_t numNodes = _batch.getNumNodes();
+    _batch.setNumSites(_numSites);
+    if (_batch.getNumChildren(0) == 0) {
+        // No reason to build a tree, there's an insertion in the root
+        // node relative to its children.
+        if (_outputPosts) {
+            // need to keep the wig in order
+            for (hal_size_t site = 0; site < _numSites; site++) {
+                outStream << -INFINITY << endl;
             }
-            continue;
         }
-        doFelsenstein(tree, mod);
-        // Find assignment for root node that maximizes P(leaves)
-        felsensteinData *rootData = (felsensteinData *)stTree_getClientData(tree);
-        // For prob(tree|char) -> prob(char|tree) (there is only one possible tree)
-        double totalProbTree = -INFINITY;
-        double maxProb = -INFINITY;
-        int maxDna = -1;
-        for (int dna = 0; dna < 4; dna++) {
-            rootData->pOtherLeaves[dna] = log(0.25);
-            totalProbTree = log_space_add(totalProbTree, rootData->pLeaves[dna]);
-            if (rootData->pLeaves[dna] > maxProb) {
-                maxDna = dna;
-                maxProb = rootData->pLeaves[dna];
+        _numSites = 0;
+        return;
+    }
+    for (hal_size_t site = 0; site < _numSites; site++) {
+        for (hal_size_t node = 0; node < numNodes; node++) {
+            if (_batch.getNumChildren(node) == 0) {
+                _batch.setLeafBase(node, site, _siteBases[site * numNodes + node]);
             }
         }
-        rootData->post = maxProb - totalProbTree;
-        char assignment;
-        if (maxDna == -1) {
-            assignment = randNuc();
-        } else if (rootData->post < threshold) {
-            assignment = 'N';
-        } else {
-            assignment = indexToChar(maxDna);
+    }
+    _batch.computeLikelihoods();
+    _batch.assignBases(_logThreshold);
+
+    for (hal_size_t site = 0; site < _numSites; site++) {
+        double outValue = 0.0;
+        for (hal_size_t node = 0; node < numNodes; node++) {
+            if (_batch.getNumChildren(node) == 0) {
+                continue;
+            }
+            hal_index_t pos = _sitePositions[site * numNodes + node];
+            char dna = _batch.getBase(node, site);
+            if (_printWrites && dna != _siteBases[site * numNodes + node]) {
+                outStream << _batchGenomes[node]->getName() << "\t" << pos << "\t"
+                          << string(1, _siteBases[site * numNodes + node]) << "\t" << string(1, dna) << endl;
+            }
+            if (_batchGenomes[node] == _genome && pos == _firstPos + (hal_index_t)site) {
+                // correct genome and correct position
+                outValue = _batch.getPosterior(node, site);
+            }
         }
-        walkFelsenstein(mod, tree, assignment, threshold);
-        writeNucleotides(tree, alignment, genome, pos, printWrites);
-        freeClientData(tree);
-        stTree_destruct(tree);
-        if (writePosts) {
-            cout << outValue << endl;
+        if (_outputPosts) {
+            outStream << outValue << endl;
         }
     }
+    _numSites = 0;
+}
+
+void reEstimate(TreeModel *mod, const ThreadAlignments &alignments, const Genome *genome, hal_index_t startPos,
+                hal_index_t endPos, const map<string, int> &nameToId, double threshold, bool printWrites, bool writePosts,
+                hal_size_t tileSize) {
+    if (startPos >= endPos) {
+        return;
+    }
+    if (writePosts) {
+        const Sequence *seq = genome->getSequenceBySite(startPos);
+        // position + 1 because wigs are 1-based.
+        cout << "fixedStep chrom=" << seq->getName() << " start=" << startPos - seq->getStartPosition() + 1 << " step=1"
+             << endl;
+    }
+
+    // the sites are independent, so the tiles are estimated by separate
+    // threads, each writing to a buffer that is output in tile order
+    vector<AncestorsMLThread> threads(alignments.size(), AncestorsMLThread(mod));
+    for (unsigned threadIdx = 0; threadIdx < alignments.size(); ++threadIdx) {
+        AncestorsMLThread &thread = threads[threadIdx];
+        thread._genome = alignments.get(threadIdx)->openGenome(genome->getName());
+        thread._nameToId = &nameToId;
+        thread._logThreshold = log(threshold);
+        thread._printWrites = printWrites;
+        thread._outputPosts = writePosts;
+    }
+    vector<pair<hal_index_t, hal_index_t>> tiles = makeTiles(endPos - startPos, tileSize);
+    OrderedOutput output(cout, tiles.size());
+    parallelFor(tiles.size(), alignments.size(), [&](size_t tileIdx, unsigned threadIdx) {
+        ostringstream tileStream;
+        threads[threadIdx].reEstimateTile(startPos + tiles[tileIdx].first, startPos + tiles[tileIdx].second, tileStream);
+        string buffer = tileStream.str();
+        output.commit(tileIdx, buffer);
+    });
 }
@@ -3,21 +3,17 @@
 #include "halAlignment.h"
 #include "halDefs.h"
 #include "halGenome.h"
+#include "halParallel.h"
 #include "sonLibTree.h"
 #include <map>
+#include <string>
+#include <vector>
 extern "C" {
 #include "tree_model.h"
 }
 // PHAST code defines min, max macros which conflict with the reserved C++ names.
 #undef min
 #undef max
-typedef struct {
-    const hal::Genome *rootGenome;
-    hal_index_t pos;
-    // Reversed with respect to reference?
-    bool reversed;
-} rootInfo;
-
 typedef struct {
     // Position of this site in the genome
     hal_index_t pos;
@@ -42,8 +38,96 @@ using namespace hal;
 
 void doFelsenstein(stTree *node, TreeModel *mod);
 
-void reEstimate(TreeModel *mod, AlignmentConstPtr alignment, const Genome *genome, hal_index_t startPos, hal_index_t endPos,
-                std::map<std::string, int> &nameToId, double threshold, bool printWrites, bool outputPosts);
+/**
+ * Felsenstein's algorithm run on a batch of sites that have the same
+ * tree, such as consecutive columns that are in the same segments.  Each
+ * step of the recursion is done for all the sites of the batch at once,
+ * with the 4-state likelihoods of a node stored contiguously by site, and
+ * the log transition probabilities of the branches are computed once
+ * instead of for every site.
+ */
+class FelsensteinBatch {
+  public:
+    FelsensteinBatch(TreeModel *mod);
+
+    /** Remove all the nodes and sites */
+    void clear();
+
+    /** Add a node to the tree.  Nodes are added in preorder, starting
+     * with the root, and the children of a node are kept in the order
+     * they are added.
+     * @param parent parent node, or NULL_INDEX for the root
+     * @param phastId id of the node's genome in the model
+     * @return the new node */
+    hal_size_t addNode(hal_index_t parent, int phastId);
+
+    /** Set the number of sites in the batch */
+    void setNumSites(hal_size_t numSites);
+
+    /** Set the base of a leaf at a site ('N' if unknown) */
+    void setLeafBase(hal_size_t node, hal_size_t site, char dna);
+
+    /** Compute the likelihood of the leaves below every node given each
+     * of its bases (same as doFelsenstein) */
+    void computeLikelihoods();
+
+    /** Assign the most likely base to the root and the other internal
+     * nodes (or 'N' if its log posterior is below the threshold) */
+    void assignBases(double logThreshold);
+
+    hal_size_t getNumNodes() const {
+        return _parents.size();
+    }
+
+    hal_size_t getNumSites() const {
+        return _numSites;
+    }
+
+    hal_size_t getNumChildren(hal_size_t node) const {
+        return _children[node].size();
+    }
+
+    /** Log likelihood of the leaves below a node given its base */
+    double getLeafLikelihood(hal_size_t node, hal_size_t site, int dna) const {
+        return _pLeaves[(node * _numSites + site) * 4 + dna];
+    }
+
+    /** Base of a node (as set for leaves or assigned for internal nodes) */
+    char getBase(hal_size_t node, hal_size_t site) const {
+        return _bases[node * _numSites + site];
+    }
+
+    /** Log posterior probability of an internal node's assigned base */
+    double getPosterior(hal_size_t node, hal_size_t site) const {
+        return _posts[node * _numSites + site];
+    }
+
+  private:
+    const double *getLogProbs(hal_size_t node) const {
+        return &_logProbs[_phastIds[node] * 16];
+    }
+
+    // log transition probabilities by phast id of the child, then base
+    // of the parent and base of the child
+    std::vector<double> _logProbs;
+    std::vector<hal_index_t> _parents;
+    std::vector<int> _phastIds;
+    std::vector<std::vector<hal_size_t>> _children;
+    hal_size_t _numSites;
+    // by node, then site, then base
+    std::vector<double> _pLeaves;
+    std::vector<double> _pOtherLeaves;
+    std::vector<double> _posts;
+    std::vector<char> _bases;
+};
+
+/** Re-estimate the bases of a range of a genome, writing the changes
+ * and/or the posteriors to stdout.  The range is split into tiles that
+ * are run in parallel, one thread per alignment, with the output written
+ * in order. */
+void reEstimate(TreeModel *mod, const ThreadAlignments &alignments, const Genome *genome, hal_index_t startPos,
+                hal_index_t endPos, const std::map<std::string, int> &nameToId, double threshold, bool printWrites,
+                bool outputPosts, hal_size_t tileSize);
 
 #endif
 // Local Variables:
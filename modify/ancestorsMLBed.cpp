@@ -27,7 +27,7 @@ void AncestorsMLBed::visitLine() {
     startPos += sequence->getStartPosition();
     endPos += sequence->getStartPosition();
 
-    reEstimate(_mod, _alignment, _genome, startPos, endPos, _nameToId, _threshold, _printWrites, _outputPosts);
+    reEstimate(_mod, _alignments, _genome, startPos, endPos, _nameToId, _threshold, _printWrites, _outputPosts, _tileSize);
 }
 
 #endif
@@ -1,4 +1,5 @@
 #include "halBedScanner.h"
+#include "halParallel.h"
 extern "C" {
 #include "tree_model.h"
 }
@@ -10,18 +11,20 @@ using namespace hal;
 
 class AncestorsMLBed : public hal::BedScanner {
   public:
-    AncestorsMLBed(TreeModel *mod, AlignmentConstPtr alignment, const Genome *genome, std::map<std::string, int> &nameToId,
-                   double threshold, bool printWrites, bool outputPosts)
-        : _mod(mod), _alignment(alignment), _genome(genome), _nameToId(nameToId), _threshold(threshold),
-          _printWrites(printWrites), _outputPosts(outputPosts){};
+    AncestorsMLBed(TreeModel *mod, const ThreadAlignments &alignments, const Genome *genome,
+                   std::map<std::string, int> &nameToId, double threshold, bool printWrites, bool outputPosts,
+                   hal_size_t tileSize)
+        : _mod(mod), _alignments(alignments), _genome(genome), _nameToId(nameToId), _threshold(threshold),
+          _printWrites(printWrites), _outputPosts(outputPosts), _tileSize(tileSize){};
     void visitLine();
     TreeModel *_mod;
-    AlignmentConstPtr _alignment;
+    const ThreadAlignments &_alignments;
     const Genome *_genome;
     std::map<std::string, int> &_nameToId;
     double _threshold;
     bool _printWrites;
     bool _outputPosts;
+    hal_size_t _tileSize;
 };
 // Local Variables:
 // mode: c++
@@ -23,6 +23,10 @@ static void initParser(CLParser &optionsParser) {
                                                " format",
                                 false);
     optionsParser.addOptionFlag("printWrites", "print base changes", false);
+    optionsParser.addOption("numThreads", "number of threads estimating tiles of the genome (0 to use all cores).  "
+                                          "Only mmap HAL files can be read by more than one thread",
+                            1);
+    optionsParser.addOption("tileSize", "number of genome positions estimated by a thread at a time", 100000);
 }
 
 int main(int argc, char *argv[]) {
@@ -33,6 +37,8 @@ int main(int argc, char *argv[]) {
     hal_index_t startPos = 0;
     hal_index_t endPos = -1;
     double threshold = 0.0;
+    unsigned numThreads = 1;
+    hal_size_t tileSize = 0;
     try {
         optParser.parseOptions(argc, argv);
         halPath = optParser.getArgument<string>("halFile");
@@ -45,7 +51,13 @@ int main(int argc, char *argv[]) {
         bedPath = optParser.getOption<string>("bed");
         outputPosts = optParser.getFlag("outputPosts");
         printWrites = optParser.getFlag("printWrites");
+        numThreads = optParser.getOption<unsigned>("numThreads");
+        tileSize = optParser.getOption<hal_size_t>("tileSize");
+        if (tileSize == 0) {
+            throw hal_exception("--tileSize must be greater than 0");
+        }
     } catch (exception &e) {
+        cerr << e.what() << endl;
         optParser.printUsage(cerr);
         return 1;
     }
@@ -72,9 +84,11 @@ int main(int argc, char *argv[]) {
     if (genome->getNumChildren() == 0) {
         throw hal_exception("Genome " + genomeName + " is a leaf genome.");
     }
+    numThreads = getReadThreadCount(halPath, &optParser, numThreads);
+    ThreadAlignments threadAlignments(alignment, halPath, &optParser, numThreads);
 
     if (bedPath != "") {
-        AncestorsMLBed bedScanner(mod, alignment, genome, nameToId, threshold, printWrites, outputPosts);
+        AncestorsMLBed bedScanner(mod, threadAlignments, genome, nameToId, threshold, printWrites, outputPosts, tileSize);
         bedScanner.scan(bedPath);
         return 0;
     }
@@ -95,7 +109,7 @@ int main(int argc, char *argv[]) {
     if (endPos == -1 || endPos > genome->getSequenceLength()) {
         endPos = genome->getSequenceLength();
     }
-    reEstimate(mod, alignment, genome, startPos, endPos, nameToId, threshold, printWrites, outputPosts);
+    reEstimate(mod, threadAlignments, genome, startPos, endPos, nameToId, threshold, printWrites, outputPosts, tileSize);
     alignment->close();
     return 0;
 }
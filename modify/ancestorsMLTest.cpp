@@ -61,10 +61,74 @@ static void doFelsensteinWorkedExampleTest(CuTest *testCase) {
     CuAssertDblEquals(testCase, -12.253583, log2(likelihood), 0.001);
 }
 
+// Check that the batched algorithm gives the same likelihoods as the
+// recursive one on the worked example tree, for a few different sites.
+static void felsensteinBatchTest(CuTest *testCase) {
+    FILE *modFile = fopen("../testdata/mammals.mod", "r");
+    if (modFile == NULL) {
+        throw hal_exception("can't find ../testdata/mammals.mod");
+    }
+    TreeModel *mod = tm_new_from_file(modFile, true);
+    map<string, int> nameToId;
+    List *phastList = tr_postorder(mod->tree);
+    for (int i = 0; i < mod->tree->nnodes; i++) {
+        TreeNode *n = (TreeNode *)lst_get_ptr(phastList, i);
+        nameToId[n->name] = n->id;
+    }
+    lst_free(phastList);
+    tm_set_subst_matrices(mod);
+
+    // preorder of (((rat,mouse)mr,human)e,(cow,pig)l)b
+    const char *names[] = {"b", "e", "mr", "rat", "mouse", "human", "l", "cow", "pig"};
+    const hal_index_t parents[] = {NULL_INDEX, 0, 1, 2, 2, 1, 0, 6, 6};
+    // leaf bases of rat, mouse, human, cow, pig at each site
+    const char *sites[] = {"AGAAC", "AAAAA", "TNCGG", "NNNNN"};
+    const hal_size_t numSites = 4;
+    FelsensteinBatch batch(mod);
+    for (hal_size_t node = 0; node < 9; node++) {
+        batch.addNode(parents[node], nameToId[names[node]]);
+    }
+    batch.setNumSites(numSites);
+    const hal_size_t leaves[] = {3, 4, 5, 7, 8};
+    for (hal_size_t site = 0; site < numSites; site++) {
+        for (hal_size_t i = 0; i < 5; i++) {
+            batch.setLeafBase(leaves[i], site, sites[site][i]);
+        }
+    }
+    batch.computeLikelihoods();
+    batch.assignBases(log(0.9));
+
+    for (hal_size_t site = 0; site < numSites; site++) {
+        stTree *tree = stTree_parseNewickString("(((rat:0.2,mouse:0.2)mr:0.1,human:0.1)e:0.1,(cow:0.1,pig:0.1)l:0.1)b;");
+        for (hal_size_t node = 0; node < 9; node++) {
+            char dna = 'Z';
+            for (hal_size_t i = 0; i < 5; i++) {
+                if (leaves[i] == node) {
+                    dna = sites[site][i];
+                }
+            }
+            labelTestTreeNode(stTree_findChild(tree, names[node]), &nameToId, dna);
+        }
+        doFelsenstein(tree, mod);
+        felsensteinData *data = (felsensteinData *)stTree_getClientData(tree);
+        for (int dna = 0; dna < 4; dna++) {
+            CuAssertDblEquals(testCase, data->pLeaves[dna], batch.getLeafLikelihood(0, site, dna), 1e-12);
+        }
+        CuAssertTrue(testCase, batch.getPosterior(0, site) <= 0.0);
+    }
+    // with all the leaves agreeing, every ancestor gets their base
+    for (hal_size_t node = 0; node < 9; node++) {
+        if (batch.getNumChildren(node) != 0) {
+            CuAssertIntEquals(testCase, 'A', batch.getBase(node, 1));
+        }
+    }
+}
+
 int main(int argc, char *argv[]) {
     CuString *output = CuStringNew();
     CuSuite *suite = CuSuiteNew();
     SUITE_ADD_TEST(suite, doFelsensteinWorkedExampleTest);
+    SUITE_ADD_TEST(suite, felsensteinBatchTest);
     CuSuiteRun(suite);
     CuSuiteSummary(suite, output);
     CuSuiteDetails(suite, output);
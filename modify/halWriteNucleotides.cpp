@@ -33,6 +33,7 @@ int main(int argc, char *argv[]) {
 
     ifstream tsv(tsvFile.c_str());
     string line;
+    set<Genome *> modifiedGenomes;
     int64_t lineNum = 0;
     while (getline(tsv, line)) {
         stringstream lineStream(line);
@@ -59,8 +60,13 @@ int main(int argc, char *argv[]) {
         }
 
         dnaIt->setBase(newChar);
+        dnaIt->flush();
+        modifiedGenomes.insert(genome);
     }
     tsv.close();
+    for (set<Genome *>::iterator i = modifiedGenomes.begin(); i != modifiedGenomes.end(); ++i) {
+        invalidateCachedStats(*i);
+    }
     alignment->close();
     return 0;
 }
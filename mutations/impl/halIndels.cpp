@@ -2,6 +2,8 @@
 // TODO: merge into halBranchMutations
 #include "hal.h"
 #include "halCLParser.h"
+#include "halParallel.h"
+#include <mutex>
 
 using namespace std;
 using namespace hal;
@@ -19,8 +21,37 @@ static void initParser(CLParser &optionsParser) {
     optionsParser.setDescription("Count (filtered) insertions/deletions in the "
                                  "branch above the reference genome.");
     optionsParser.addOptionFlag("onlyExtantTargets", "Use only extant genomes for 'sibling'/outgroup", false);
+    optionsParser.addOption("numThreads", "number of threads scanning tiles of the reference (0 to use all cores).  "
+                                          "Only mmap HAL files can be read by more than one thread",
+                            1);
+    optionsParser.addOption("tileSize", "number of reference positions scanned by a thread at a time", 100000);
 }
 
+// Result of scanning a tile of reference positions.  Only positions that
+// are good sites or have an indel are recorded.
+struct IndelSite {
+    hal_index_t refPos;
+    bool goodSite;
+    size_t outputEnd; // end of the position's lines in IndelTile::output
+};
+
+// Known good columns from a position on, as (first, last) intervals
+typedef vector<pair<hal_index_t, hal_index_t>> CacheIntervals;
+
+struct IndelTile {
+    vector<IndelSite> sites;
+    string output;
+    // first position of the tile that the scan visited, and the known good
+    // columns it could look at then
+    hal_index_t firstPos;
+    CacheIntervals startCache;
+    // first position after the tile that the scan would visit; insertions
+    // are skipped over so this can be past the end of the tile
+    hal_index_t nextPos;
+    // known good columns the scan of the next tile could look at
+    CacheIntervals endCache;
+};
+
 // check (inclusive) interval startPos--endPos for Ns.
 static bool regionIsNotAmbiguous(const Genome *genome, hal_index_t startPos, hal_index_t endPos) {
     if (startPos > endPos) {
@@ -299,13 +330,47 @@ static pair<indelType, hal_size_t> getIndel(hal_index_t refPos, const Genome *re
     return make_pair(NONE, 0);
 }
 
-static void printIndels(const Genome *refGenome, const set<const Genome *> targets, hal_size_t adjacentBases) {
-    hal_size_t refLength = refGenome->getSequenceLength();
-    hal_size_t numSites = 0;
+// Get the known good columns from minPos on.  A position only looks at the
+// columns adjacentBases before it or after it, so these are all that the
+// scan from minPos + adjacentBases on depends on.
+static void getCacheIntervals(const PositionCache &knownGoodSites, hal_index_t minPos, CacheIntervals &intervals) {
+    const PositionCache::IntervalSet *intervalSet = knownGoodSites.getIntervalSet();
+    intervals.clear();
+    for (PositionCache::IntervalSet::const_iterator i = intervalSet->lower_bound(minPos); i != intervalSet->end(); ++i) {
+        intervals.push_back(make_pair(max(i->second, minPos), i->first));
+    }
+}
+
+// Scan the reference positions from scanStart to tileEnd (exclusive),
+// recording the sites from tileStart on.  The columns found to be good
+// are cached and not checked again by the positions after them, so the
+// sites depend on where the scan started.  The scan of a tile starts a
+// little before it with an empty cache, and the merge in printIndels()
+// checks that this reached the same state as the scan of the tiles before
+// it, or the tile is scanned again from that state (seedCache).
+static void scanIndels(const Genome *refGenome, const set<const Genome *> &targets, hal_size_t adjacentBases,
+                       hal_index_t scanStart, hal_index_t tileStart, hal_index_t tileEnd,
+                       const CacheIntervals *seedCache, IndelTile &tile) {
     ColumnIteratorPtr colIt = refGenome->getColumnIterator(&targets);
     // good flanking site
     PositionCache knownGoodSites;
-    for (hal_index_t refPos = adjacentBases; refPos < refLength - adjacentBases; refPos++) {
+    if (seedCache != NULL) {
+        for (CacheIntervals::const_iterator i = seedCache->begin(); i != seedCache->end(); ++i) {
+            for (hal_index_t pos = i->first; pos <= i->second; ++pos) {
+                knownGoodSites.insert(pos);
+            }
+        }
+    }
+    tile.sites.clear();
+    tile.output.clear();
+    tile.firstPos = NULL_INDEX;
+    hal_index_t refPos;
+    for (refPos = scanStart; refPos < tileEnd; refPos++) {
+        if (tile.firstPos == NULL_INDEX && refPos >= tileStart) {
+            tile.firstPos = refPos;
+            getCacheIntervals(knownGoodSites, tileStart - (hal_index_t)adjacentBases, tile.startCache);
+        }
+        hal_index_t sitePos = refPos;
         pair<indelType, hal_size_t> indel;
         indel = getIndel(refPos, refGenome, &targets);
         hal_index_t start = refPos - adjacentBases;
@@ -356,23 +421,107 @@ static void printIndels(const Genome *refGenome, const set<const Genome *> targe
             }
             colIt->toRight();
         }
+        if (sitePos < tileStart) {
+            if (indel.first == INSERTION && !failedFiltering) {
+                refPos += indel.second;
+            }
+            continue;
+        }
+        size_t outputStart = tile.output.size();
         if (indel.first != NONE && !failedFiltering) {
+            const Sequence *seq = refGenome->getSequenceBySite(refPos);
+            tile.output.append(seq->getName());
+            tile.output.push_back('\t');
+            appendInt(tile.output, refPos - seq->getStartPosition());
+            tile.output.push_back('\t');
             if (indel.first == DELETION) {
-                const Sequence *seq = refGenome->getSequenceBySite(refPos);
-                cout << seq->getName() << "\t" << refPos - seq->getStartPosition() << "\t" << refPos - seq->getStartPosition()
-                     << "\tD\t" << indel.second << endl;
+                appendInt(tile.output, refPos - seq->getStartPosition());
+                tile.output.append("\tD\t");
+                appendInt(tile.output, indel.second);
+                tile.output.push_back('\n');
             } else {
-                const Sequence *seq = refGenome->getSequenceBySite(refPos);
                 assert(seq == refGenome->getSequenceBySite(refPos + indel.second));
-                cout << seq->getName() << "\t" << refPos - seq->getStartPosition() << "\t"
-                     << refPos + indel.second - seq->getStartPosition() << "\tI\t" << endl;
+                appendInt(tile.output, refPos + indel.second - seq->getStartPosition());
+                tile.output.append("\tI\t\n");
                 refPos += indel.second;
             }
         }
-        if (!failedFiltering) {
-            numSites++;
+        if (!failedFiltering || tile.output.size() > outputStart) {
+            IndelSite site = {sitePos, !failedFiltering, tile.output.size()};
+            tile.sites.push_back(site);
         }
     }
+    if (tile.firstPos == NULL_INDEX) {
+        // an insertion skipped over the whole tile
+        tile.firstPos = refPos;
+        getCacheIntervals(knownGoodSites, tileStart - (hal_index_t)adjacentBases, tile.startCache);
+    }
+    tile.nextPos = refPos;
+    getCacheIntervals(knownGoodSites, tileEnd - (hal_index_t)adjacentBases, tile.endCache);
+}
+
+// Scan the reference in tiles, printing the indels and the number of
+// good sites.  The tiles are merged in order, and a tile whose scan did
+// not start from the same position and known good columns as the scan of
+// the tiles before it ended with is scanned again from there, so the
+// output is the same as a scan of the whole genome.
+static void printIndels(const vector<const Genome *> &refGenomes, const vector<set<const Genome *>> &targets,
+                        hal_size_t adjacentBases, hal_size_t tileSize) {
+    hal_index_t refLength = refGenomes[0]->getSequenceLength();
+    hal_index_t firstPos = adjacentBases;
+    hal_index_t endPos = refLength - (hal_index_t)adjacentBases;
+    // positions scanned before a tile to fill in the known good columns
+    hal_index_t warmUp = 4 * (2 * adjacentBases + 1);
+    vector<pair<hal_index_t, hal_index_t>> tiles = makeTiles(max(endPos - firstPos, (hal_index_t)0), tileSize);
+    vector<IndelTile> results(tiles.size());
+    vector<bool> done(tiles.size(), false);
+    size_t nextTile = 0;
+    hal_index_t nextPos = firstPos;
+    CacheIntervals nextCache;
+    hal_size_t numSites = 0;
+    mutex mergeMutex;
+
+    parallelFor(tiles.size(), refGenomes.size(), [&](size_t tileIdx, unsigned threadIdx) {
+        hal_index_t tileStart = firstPos + tiles[tileIdx].first;
+        hal_index_t tileEnd = firstPos + tiles[tileIdx].second;
+        scanIndels(refGenomes[threadIdx], targets[threadIdx], adjacentBases, max(firstPos, tileStart - warmUp), tileStart,
+                   tileEnd, NULL, results[tileIdx]);
+
+        lock_guard<mutex> lock(mergeMutex);
+        done[tileIdx] = true;
+        for (; nextTile < tiles.size() && done[nextTile]; ++nextTile) {
+            IndelTile &tile = results[nextTile];
+            hal_index_t nextTileStart = firstPos + tiles[nextTile].first;
+            hal_index_t nextTileEnd = firstPos + tiles[nextTile].second;
+            if (nextPos >= nextTileEnd) {
+                // a long insertion can be skipped over by more than one tile
+                hal_index_t minPos = nextTileEnd - (hal_index_t)adjacentBases;
+                tile.sites.clear();
+                tile.nextPos = nextPos;
+                tile.endCache.clear();
+                for (CacheIntervals::const_iterator i = nextCache.begin(); i != nextCache.end(); ++i) {
+                    if (i->second >= minPos) {
+                        tile.endCache.push_back(make_pair(max(i->first, minPos), i->second));
+                    }
+                }
+            } else if (tile.firstPos != nextPos || tile.startCache != nextCache) {
+                scanIndels(refGenomes[threadIdx], targets[threadIdx], adjacentBases, nextPos, nextTileStart, nextTileEnd,
+                           &nextCache, tile);
+            }
+            size_t outputStart = 0;
+            for (size_t i = 0; i < tile.sites.size(); ++i) {
+                cout.write(tile.output.data() + outputStart, tile.sites[i].outputEnd - outputStart);
+                numSites += tile.sites[i].goodSite ? 1 : 0;
+                outputStart = tile.sites[i].outputEnd;
+            }
+            nextPos = tile.nextPos;
+            nextCache.swap(tile.endCache);
+            IndelTile().sites.swap(tile.sites);
+            string().swap(tile.output);
+            CacheIntervals().swap(tile.startCache);
+            CacheIntervals().swap(tile.endCache);
+        }
+    });
     cout << "# num sites possible: " << numSites << endl;
 }
 
@@ -405,12 +554,19 @@ int main(int argc, char *argv[]) {
     string halPath, refGenomeName;
     hal_size_t adjacentBases;
     bool onlyExtantTargets;
+    unsigned numThreads;
+    hal_size_t tileSize;
     try {
         optionsParser.parseOptions(argc, argv);
         halPath = optionsParser.getArgument<string>("halFile");
         refGenomeName = optionsParser.getArgument<string>("refGenome");
         adjacentBases = optionsParser.getOption<hal_size_t>("adjacentBases");
         onlyExtantTargets = optionsParser.getFlag("onlyExtantTargets");
+        numThreads = optionsParser.getOption<unsigned>("numThreads");
+        tileSize = optionsParser.getOption<hal_size_t>("tileSize");
+        if (tileSize == 0) {
+            throw hal_exception("--tileSize must be greater than 0");
+        }
     } catch (exception &e) {
         cerr << e.what() << endl;
         optionsParser.printUsage(cerr);
@@ -467,5 +623,18 @@ int main(int argc, char *argv[]) {
             }
         }
     }
-    printIndels(refGenome, targets, adjacentBases);
+
+    // each thread scans with its own alignment
+    numThreads = getReadThreadCount(halPath, &optionsParser, numThreads);
+    ThreadAlignments threadAlignments(alignment, halPath, &optionsParser, numThreads);
+    vector<const Genome *> threadRefGenomes;
+    vector<set<const Genome *>> threadTargets(numThreads);
+    for (unsigned threadIdx = 0; threadIdx < numThreads; ++threadIdx) {
+        AlignmentConstPtr threadAlignment = threadAlignments.get(threadIdx);
+        threadRefGenomes.push_back(threadAlignment->openGenome(refGenomeName));
+        for (set<const Genome *>::const_iterator i = targets.begin(); i != targets.end(); ++i) {
+            threadTargets[threadIdx].insert(threadAlignment->openGenome((*i)->getName()));
+        }
+    }
+    printIndels(threadRefGenomes, threadTargets, adjacentBases, tileSize);
 }
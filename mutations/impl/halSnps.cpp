@@ -7,6 +7,8 @@
 
 #include "hal.h"
 #include "halCLParser.h"
+#include "halParallel.h"
+#include <algorithm>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
@@ -14,9 +16,32 @@
 using namespace std;
 using namespace hal;
 
-static void countSnps(const Genome *refGenome, set<const Genome *> &targetGenomes, hal_index_t start, hal_size_t length,
-                      bool doDupes, ostream &refTsvStream, map<const Genome *, hal_size_t> *numSnps,
-                      map<const Genome *, hal_size_t> *numOrthologousPairs, bool unique, hal_size_t minSpeciesForSnp);
+// Per-thread state for counting snps in tiles of the reference.  Counts
+// are kept by field, ie the order of the target genomes in the tsv
+// header.  The buffers are reused from column to column so that, once
+// they have grown to the size of the largest column, the scan does no
+// heap allocation of its own.
+struct SnpCounter {
+    const Genome *refGenome;
+    set<const Genome *> targetGenomes;
+    map<const Genome *, hal_size_t> fieldForGenome;
+    vector<hal_size_t> numSnps;
+    vector<hal_size_t> numOrthologousPairs;
+
+    // field (or NULL_INDEX) and whether it is the reference, by the
+    // genome ordinals of the column trees
+    vector<hal_index_t> fieldForOrdinal;
+    vector<char> refOrdinal;
+    // number of reference nodes in the subtree of each column tree node
+    vector<hal_size_t> numRefNodes;
+
+    // (field, base) of the orthologs of one reference base
+    vector<pair<hal_size_t, const DnaIterator *>> orthologs;
+    vector<char> orthologFields;
+};
+
+static void countSnps(SnpCounter &counter, hal_index_t start, hal_index_t last, hal_index_t tileStart, hal_index_t tileLast,
+                      bool doDupes, string *tsvBuffer, bool unique, hal_size_t minSpeciesForSnp);
 
 static void initParser(CLParser &optionsParser) {
     optionsParser.addArgument("halFile", "input hal file");
@@ -44,6 +69,10 @@ static void initParser(CLParser &optionsParser) {
     optionsParser.addOptionFlag("unique", "Whether to ignore columns that are not "
                                           "canonical on the reference genome",
                                 false);
+    optionsParser.addOption("numThreads", "number of threads scanning tiles of the reference (0 to use all cores).  "
+                                          "Only mmap HAL files can be read by more than one thread",
+                            1);
+    optionsParser.addOption("tileSize", "number of reference bases scanned by a thread at a time", 100000);
     optionsParser.setDescription("Count snps between orthologous positions "
                                  "in multiple genomes.  Outputs "
                                  "targetGenome totalSnps totalCleanOrthologousPairs");
@@ -63,6 +92,8 @@ int main(int argc, char **argv) {
     hal_size_t length;
     bool unique;
     hal_size_t minSpeciesForSnp;
+    unsigned numThreads;
+    hal_size_t tileSize;
     try {
         optionsParser.parseOptions(argc, argv);
         halPath = optionsParser.getArgument<string>("halFile");
@@ -75,6 +106,11 @@ int main(int argc, char **argv) {
         length = optionsParser.getOption<hal_size_t>("length");
         minSpeciesForSnp = optionsParser.getOption<hal_size_t>("minSpeciesForSnp");
         unique = optionsParser.getFlag("unique");
+        numThreads = optionsParser.getOption<unsigned>("numThreads");
+        tileSize = optionsParser.getOption<hal_size_t>("tileSize");
+        if (tileSize == 0) {
+            throw hal_exception("--tileSize must be greater than 0");
+        }
     } catch (exception &e) {
         cerr << e.what() << endl;
         optionsParser.printUsage(cerr);
@@ -129,32 +165,60 @@ int main(int argc, char **argv) {
         }
 
         ofstream refTsvStream;
-        if (tsvPath != "\"\"") {
+        bool writeTsv = tsvPath != "\"\"";
+        if (writeTsv) {
             refTsvStream.open(tsvPath.c_str());
             if (!refTsvStream) {
                 throw hal_exception("Error opening " + tsvPath);
             }
+            refTsvStream << "refSequence\trefPosition\t" << refGenome->getName();
+            for (set<const Genome *>::const_iterator i = targetGenomes.begin(); i != targetGenomes.end(); i++) {
+                refTsvStream << "\t" << (*i)->getName();
+            }
+            refTsvStream << endl;
         }
-        // build and initialize the snps/orthologous pairs maps per
-        // genome.
-        map<const Genome *, hal_size_t> numSnps;
-        map<const Genome *, hal_size_t> numOrthologousPairs;
 
-        for (set<const Genome *>::const_iterator i = targetGenomes.begin(); i != targetGenomes.end(); i++) {
-            numSnps[*i] = 0;
-            numOrthologousPairs[*i] = 0;
+        // the tiles of the reference are independent, so each thread counts
+        // snps with its own alignment and counters.  Counts are summed by
+        // target field (header order) and tsv lines written in tile order
+        numThreads = getReadThreadCount(halPath, &optionsParser, numThreads);
+        ThreadAlignments threadAlignments(alignment, halPath, &optionsParser, numThreads);
+        vector<SnpCounter> counters(numThreads);
+        for (unsigned threadIdx = 0; threadIdx < numThreads; ++threadIdx) {
+            AlignmentConstPtr threadAlignment = threadAlignments.get(threadIdx);
+            SnpCounter &counter = counters[threadIdx];
+            counter.refGenome = threadAlignment->openGenome(refGenomeName);
+            hal_size_t field = 0;
+            for (set<const Genome *>::const_iterator i = targetGenomes.begin(); i != targetGenomes.end(); i++, field++) {
+                const Genome *genome = threadAlignment->openGenome((*i)->getName());
+                counter.targetGenomes.insert(genome);
+                counter.fieldForGenome[genome] = field;
+            }
+            counter.numSnps.assign(targetGenomes.size(), 0);
+            counter.numOrthologousPairs.assign(targetGenomes.size(), 0);
         }
 
-        countSnps(refGenome, targetGenomes, start, length, !noDupes, refTsvStream, &numSnps, &numOrthologousPairs, unique,
-                  minSpeciesForSnp);
-
-        assert(numSnps.size() == numOrthologousPairs.size());
-
-        for (map<const Genome *, hal_size_t>::const_iterator snpIt = numSnps.begin(); snpIt != numSnps.end(); snpIt++) {
-            const Genome *genome = snpIt->first;
-            hal_size_t numSnps = snpIt->second;
-            hal_size_t orthologousPairs = numOrthologousPairs[genome];
-            cout << genome->getName() << " " << numSnps << " " << orthologousPairs << endl;
+        vector<pair<hal_index_t, hal_index_t>> tiles = makeTiles(length, tileSize);
+        vector<string> tsvBuffers(numThreads);
+        OrderedOutput tsvOutput(refTsvStream, tiles.size());
+        hal_index_t last = start + length - 1;
+        parallelFor(tiles.size(), numThreads, [&](size_t tileIdx, unsigned threadIdx) {
+            countSnps(counters[threadIdx], start, last, start + tiles[tileIdx].first, start + tiles[tileIdx].second - 1,
+                      !noDupes, writeTsv ? &tsvBuffers[threadIdx] : NULL, unique, minSpeciesForSnp);
+            if (writeTsv) {
+                tsvOutput.commit(tileIdx, tsvBuffers[threadIdx]);
+            }
+        });
+
+        hal_size_t field = 0;
+        for (set<const Genome *>::const_iterator i = targetGenomes.begin(); i != targetGenomes.end(); i++, field++) {
+            hal_size_t numSnps = 0;
+            hal_size_t orthologousPairs = 0;
+            for (unsigned threadIdx = 0; threadIdx < numThreads; ++threadIdx) {
+                numSnps += counters[threadIdx].numSnps[field];
+                orthologousPairs += counters[threadIdx].numOrthologousPairs[field];
+            }
+            cout << (*i)->getName() << " " << numSnps << " " << orthologousPairs << endl;
         }
     } catch (hal_exception &e) {
         cerr << "hal exception caught: " << e.what() << endl;
@@ -167,254 +231,187 @@ int main(int argc, char **argv) {
     return 0;
 }
 
-// Recursively find nodes that are from the reference genome in the
-// tree and add them to the refNodes set.
-static void getReferenceNodes_R(stTree *colTree, const Genome *refGenome, set<stTree *> *refNodes) {
-    for (int64_t i = 0; i < stTree_getChildNumber(colTree); i++) {
-        getReferenceNodes_R(stTree_getChild(colTree, i), refGenome, refNodes);
-    }
-
-    DnaIteratorPtr *dnaIt = (DnaIteratorPtr *)stTree_getClientData(colTree);
-    if ((*dnaIt)->getGenome() == refGenome) {
-        assert((refGenome->getNumChildren() != 0) ^ (stTree_getChildNumber(colTree) == 0));
-        refNodes->insert(colTree);
-    }
+static bool fieldLess(const pair<hal_size_t, const DnaIterator *> &a, const pair<hal_size_t, const DnaIterator *> &b) {
+    return a.first < b.first;
 }
 
-// copy of stTree_getMRCA since phylogeny branch isn't merged in yet.
-static stTree *stTree_getMRCA_tmp(stTree *node1, stTree *node2) {
-    // Find all of node 1's parents (inclusive of node 1)
-    stSet *parents = stSet_construct();
-    stTree *curNode = node1;
-    do {
-        stSet_insert(parents, curNode);
-    } while ((curNode = stTree_getParent(curNode)) != NULL);
-
-    // Find the first parent of node 2 that is a parent of node 1
-    stTree *ret = NULL;
-    curNode = node2;
-    do {
-        if (stSet_search(parents, curNode) != NULL) {
-            ret = curNode;
-            break;
+// Remove the orthologs that belong to the same genome as another
+// ortholog.  The orthologs are left sorted by field.
+static void removeDuplicatedGenomes(vector<pair<hal_size_t, const DnaIterator *>> &orthologs) {
+    sort(orthologs.begin(), orthologs.end(), fieldLess);
+    size_t numKept = 0;
+    for (size_t i = 0; i < orthologs.size();) {
+        size_t j = i + 1;
+        while (j < orthologs.size() && orthologs[j].first == orthologs[i].first) {
+            ++j;
         }
-    } while ((curNode = stTree_getParent(curNode)) != NULL);
-
-    stSet_destruct(parents);
-    return ret;
-}
-
-static void addSubtreeToOrthologSet(stTree *tree, set<const Genome *> &targetGenomes, set<DnaIteratorPtr *> *orthologSet) {
-    DnaIteratorPtr *dnaIt = (DnaIteratorPtr *)stTree_getClientData(tree);
-    if (targetGenomes.count((*dnaIt)->getGenome())) {
-        orthologSet->insert(dnaIt);
-    }
-    for (int64_t i = 0; i < stTree_getChildNumber(tree); i++) {
-        addSubtreeToOrthologSet(stTree_getChild(tree, i), targetGenomes, orthologSet);
+        if (j == i + 1) {
+            orthologs[numKept++] = orthologs[i];
+        }
+        i = j;
     }
+    orthologs.resize(numKept);
 }
 
-// Remove any ptrs to DnaIteratorPtrs that belong to the same
-// genome as another entry in the set.
-static void removeDuplicatedGenomes(set<DnaIteratorPtr *> *orthologSet) {
-    set<const Genome *> seen, genomesToRemove;
-
-    // Find genomes that have more than one DnaIterator in the set.
-    for (set<DnaIteratorPtr *>::const_iterator i = orthologSet->begin(); i != orthologSet->end(); i++) {
-        const Genome *genome = (**i)->getGenome();
-        if (seen.count(genome)) {
-            genomesToRemove.insert(genome);
-        }
-        seen.insert(genome);
+// Count the snps between a reference base and its orthologs (in
+// counter.orthologs), writing a tsv line if requested.
+static void callSnps(const DnaIterator *refDnaIt, SnpCounter &counter, string *tsvBuffer, hal_size_t minSpeciesForSnp) {
+    char refDna = tolower(refDnaIt->getBase());
+    if (refDna == 'n') {
+        // Obviously shouldn't call snps here.
+        return;
     }
-
-    // Go through the set again and remove any genomes that have more
-    // than one element.
-    for (set<DnaIteratorPtr *>::const_iterator i = orthologSet->begin(); i != orthologSet->end();) {
-        const Genome *genome = (**i)->getGenome();
-        if (genomesToRemove.count(genome)) {
-            // remove the current element, but advance the iterator first so
-            // it doesn't become invalidated by erase()
-            orthologSet->erase(i++);
-        } else {
-            i++;
+    hal_size_t numDifferentSpecies = 0; // # of species w/ base
+                                        // different from ref
+    for (size_t i = 0; i < counter.orthologs.size(); i++) {
+        char targetDna = tolower(counter.orthologs[i].second->getBase());
+        if (targetDna == 'n') {
+            continue;
+        } else if (targetDna != refDna) {
+            // This is a SNP for this species, but we have to wait until
+            // the numDifferentSpecies is >= minSpeciesForSnp to call an
+            // overall SNP.
+            numDifferentSpecies++;
+            counter.numSnps[counter.orthologs[i].first]++;
         }
+        counter.numOrthologousPairs[counter.orthologs[i].first]++;
     }
-}
-
-// Get a mapping from ref genome base -> orthologous non-reference
-// bases from a column tree. Only clear orthologs are added.
-static void getOrthologs(stTree *colTree, const Genome *refGenome, set<const Genome *> &targetGenomes,
-                         map<DnaIteratorPtr *, set<DnaIteratorPtr *> *> *orthologs) {
-    set<stTree *> refNodes;
-    getReferenceNodes_R(colTree, refGenome, &refNodes);
-
-    // now find all orthologous bases. Additionally we get rid of any
-    // duplications that have happened after diverging from the MRCA.
 
-    // Get the set of coalescences of all pairs of the ref nodes.
-    set<stTree *> refCoalescences;
-    for (set<stTree *>::const_iterator refNodeIt = refNodes.begin(); refNodeIt != refNodes.end(); refNodeIt++) {
-        for (set<stTree *>::const_iterator refNodeIt2 = refNodeIt; refNodeIt2 != refNodes.end(); refNodeIt2++) {
-            refCoalescences.insert(stTree_getMRCA_tmp(*refNodeIt, *refNodeIt2));
+    if (tsvBuffer != NULL && numDifferentSpecies >= minSpeciesForSnp) {
+        // Report a SNP to the TSV for this ortholog set.
+        // First the sequence and position:
+        const Sequence *refSeq = refDnaIt->getSequence();
+        tsvBuffer->append(refSeq->getName());
+        tsvBuffer->push_back('\t');
+        appendInt(*tsvBuffer, refDnaIt->getArrayIndex() - refSeq->getStartPosition());
+        // then the reference base:
+        tsvBuffer->push_back('\t');
+        tsvBuffer->push_back(refDnaIt->getBase());
+        // then finally the orthologs, in the same order that they
+        // were spit out in the header.
+        counter.orthologFields.assign(counter.targetGenomes.size(), '\0');
+        for (size_t i = 0; i < counter.orthologs.size(); i++) {
+            assert(counter.orthologFields[counter.orthologs[i].first] == '\0');
+            counter.orthologFields[counter.orthologs[i].first] = counter.orthologs[i].second->getBase();
         }
-
-        // Use those coalescences as "stops" and traverse up the tree from
-        // the ref nodes. The maximal subtrees below a ref node containing
-        // one ref node will contain the orthologs.
-        DnaIteratorPtr *refDnaIt = (DnaIteratorPtr *)stTree_getClientData(*refNodeIt);
-        set<DnaIteratorPtr *> *orthologSet = new set<DnaIteratorPtr *>();
-        (*orthologs)[refDnaIt] = orthologSet;
-        stTree *curNode = *refNodeIt;
-        while (stTree_getParent(curNode) != NULL && refCoalescences.count(stTree_getParent(curNode)) == 0) {
-            curNode = stTree_getParent(curNode);
+        for (size_t i = 0; i < counter.orthologFields.size(); i++) {
+            tsvBuffer->push_back('\t');
+            if (counter.orthologFields[i] != '\0') {
+                tsvBuffer->push_back(counter.orthologFields[i]);
+            }
         }
-
-        // OK, we've found the root of the subtree containing the
-        // orthologs, add them to the set
-        addSubtreeToOrthologSet(curNode, targetGenomes, orthologSet);
-
-        // Get rid of cases where there is more than one ortholog per
-        // genome, i.e. there has been a duplication since the MRCA of the
-        // reference node and a target node.
-        removeDuplicatedGenomes(orthologSet);
+        tsvBuffer->push_back('\n');
     }
 }
 
-static void countSnps(const Genome *refGenome, set<const Genome *> &targetGenomes, hal_index_t start, hal_size_t length,
-                      bool doDupes, ostream &refTsvStream, map<const Genome *, hal_size_t> *numSnps,
-                      map<const Genome *, hal_size_t> *numOrthologousPairs, bool unique, hal_size_t minSpeciesForSnp) {
-
-    // A bit annoying, but we have to build a map from genome to tsv
-    // field position so that the ordering is consistent in the tsv.
-    // We also print out the tsv header while we're at it.
-    map<const Genome *, hal_size_t> fieldForGenome;
-    if (refTsvStream) {
-        refTsvStream << "refSequence\trefPosition\t";
-        fieldForGenome[refGenome] = 2;
-        refTsvStream << refGenome->getName();
-        int64_t fieldNum = 3;
-        for (set<const Genome *>::const_iterator i = targetGenomes.begin(); i != targetGenomes.end(); i++) {
-            refTsvStream << "\t" << (*i)->getName();
-            fieldForGenome[*i] = fieldNum;
-            fieldNum++;
+// Find the clear orthologs of each reference base in the column tree
+// and call snps on them.  The orthologs of a reference node are the
+// target bases in the largest subtree above it that contains no other
+// reference node, minus any genome that appears more than once there
+// (ie there has been a duplication since the MRCA of the reference
+// node and a target node).
+static void callTreeSnps(const ColumnTree *colTree, SnpCounter &counter, string *tsvBuffer, hal_size_t minSpeciesForSnp) {
+    for (hal_size_t ordinal = counter.fieldForOrdinal.size(); ordinal < colTree->getNumGenomes(); ordinal++) {
+        const Genome *genome = colTree->getGenomeByOrdinal(ordinal);
+        map<const Genome *, hal_size_t>::const_iterator field = counter.fieldForGenome.find(genome);
+        counter.fieldForOrdinal.push_back(field != counter.fieldForGenome.end() ? (hal_index_t)field->second : NULL_INDEX);
+        counter.refOrdinal.push_back(genome == counter.refGenome ? 1 : 0);
+    }
+    hal_size_t numNodes = colTree->getNumNodes();
+    counter.numRefNodes.assign(numNodes, 0);
+    for (hal_size_t node = numNodes; node-- > 0;) {
+        counter.numRefNodes[node] += counter.refOrdinal[colTree->getGenomeOrdinal(node)];
+        if (colTree->getParent(node) != NULL_INDEX) {
+            counter.numRefNodes[colTree->getParent(node)] += counter.numRefNodes[node];
         }
-        refTsvStream << endl;
     }
 
-    hal_index_t lastPos = start + length - 1;
-
-    ColumnIteratorPtr colIt = refGenome->getColumnIterator(&targetGenomes, 0, start, lastPos, !doDupes, false);
-    while (1) {
-        if (unique && !colIt->isCanonicalOnRef()) {
-            // This column isn't unique (if we iterate over the reference
-            // segments separately, we will have visited this column
-            // already).
+    for (hal_size_t refNode = 0; refNode < numNodes; refNode++) {
+        if (!counter.refOrdinal[colTree->getGenomeOrdinal(refNode)]) {
             continue;
         }
-
-        map<DnaIteratorPtr *, set<DnaIteratorPtr *> *> orthologs;
-        if (doDupes) {
-            stTree *colTree = colIt->getTree();
-            getOrthologs(colTree, refGenome, targetGenomes, &orthologs);
-        } else {
-            const ColumnIterator::ColumnMap *cols = colIt->getColumnMap();
-            ColumnIterator::ColumnMap::const_iterator colMapIt;
-            DnaIteratorPtr *refDnaIt = NULL;
-            set<DnaIteratorPtr *> *orthologSet = new set<DnaIteratorPtr *>();
-            for (colMapIt = cols->begin(); colMapIt != cols->end(); colMapIt++) {
-                const Genome *genome = colMapIt->first->getGenome();
-                ColumnIterator::DNASet *dnaIts = colMapIt->second;
-                if (dnaIts->empty()) {
-                    continue;
-                }
-                if (dnaIts->size() != 1) {
-                    throw hal_exception("column iterator with noDupes has target dup");
-                }
-                DnaIteratorPtr dnaIt = dnaIts->at(0);
-                DnaIteratorPtr *dnaItToInsert = new DnaIteratorPtr(genome->getDnaIterator(dnaIt->getArrayIndex()));
-                if (dnaIt->getReversed()) {
-                    (*dnaItToInsert)->toReverse();
-                }
-                if (genome == refGenome) {
-                    if (refDnaIt != NULL) {
-                        throw hal_exception("column iterator with noDupes has reference dup");
-                    }
-                    refDnaIt = dnaItToInsert;
-                } else {
-                    orthologSet->insert(dnaItToInsert);
-                }
-            }
-            if ((*refDnaIt)->getArrayIndex() !=
-                colIt->getReferenceSequencePosition() + colIt->getReferenceSequence()->getStartPosition()) {
-                throw hal_exception("reference dna is in wrong place");
+        hal_index_t subtreeRoot = refNode;
+        while (colTree->getParent(subtreeRoot) != NULL_INDEX && counter.numRefNodes[colTree->getParent(subtreeRoot)] == 1) {
+            subtreeRoot = colTree->getParent(subtreeRoot);
+        }
+        counter.orthologs.clear();
+        for (hal_size_t i = subtreeRoot; i < colTree->getSubtreeEnd(subtreeRoot); i++) {
+            hal_index_t field = counter.fieldForOrdinal[colTree->getGenomeOrdinal(i)];
+            if (field != NULL_INDEX) {
+                counter.orthologs.push_back(make_pair((hal_size_t)field, colTree->getDnaIterator(i)));
             }
-            orthologs.insert(make_pair(refDnaIt, orthologSet));
         }
+        removeDuplicatedGenomes(counter.orthologs);
+        callSnps(colTree->getDnaIterator(refNode), counter, tsvBuffer, minSpeciesForSnp);
+    }
+}
 
-        // Now that we have the set of reference bases and their
-        // orthologs, just call SNPs.
-        for (map<DnaIteratorPtr *, set<DnaIteratorPtr *> *>::const_iterator orthologsIt = orthologs.begin();
-             orthologsIt != orthologs.end(); orthologsIt++) {
-            DnaIteratorPtr refDnaIt = *orthologsIt->first;
-            set<DnaIteratorPtr *> *orthologSet = orthologsIt->second;
-            char refDna = tolower(refDnaIt->getBase());
-            hal_size_t numDifferentSpecies = 0; // # of species w/ base
-                                                // different from ref
-            if (refDna == 'n') {
-                // Obviously shouldn't call snps here.
-                goto cleanup;
-            }
-            for (set<DnaIteratorPtr *>::const_iterator orthologIt = orthologSet->begin(); orthologIt != orthologSet->end();
-                 orthologIt++) {
-                DnaIteratorPtr targetDnaIt = **orthologIt;
-                char targetDna = tolower(targetDnaIt->getBase());
-                if (targetDna == 'n') {
-                    continue;
-                } else if (targetDna != refDna) {
-                    // This is a SNP for this species, but we have to wait until
-                    // the numDifferentSpecies is >= minSpeciesForSnp to call an
-                    // overall SNP.
-                    numDifferentSpecies++;
-                    (*numSnps)[targetDnaIt->getGenome()]++;
-                }
-                (*numOrthologousPairs)[targetDnaIt->getGenome()]++;
+// Call snps on a column of a noDupes iterator, in which each genome has
+// at most one base.
+static void callColumnSnps(const ColumnIterator *colIt, SnpCounter &counter, string *tsvBuffer, hal_size_t minSpeciesForSnp) {
+    const ColumnIterator::ColumnMap *cols = colIt->getColumnMap();
+    const DnaIterator *refDnaIt = NULL;
+    counter.orthologs.clear();
+    for (ColumnIterator::ColumnMap::const_iterator colMapIt = cols->begin(); colMapIt != cols->end(); colMapIt++) {
+        const Genome *genome = colMapIt->first->getGenome();
+        ColumnIterator::DNASet *dnaIts = colMapIt->second;
+        if (dnaIts->empty()) {
+            continue;
+        }
+        if (dnaIts->size() != 1) {
+            throw hal_exception("column iterator with noDupes has target dup");
+        }
+        if (genome == counter.refGenome) {
+            if (refDnaIt != NULL) {
+                throw hal_exception("column iterator with noDupes has reference dup");
             }
-            //      printf("-----------\n");
+            refDnaIt = dnaIts->at(0).get();
+        } else {
+            counter.orthologs.push_back(make_pair(counter.fieldForGenome.find(genome)->second, dnaIts->at(0).get()));
+        }
+    }
+    if (refDnaIt == NULL ||
+        refDnaIt->getArrayIndex() != colIt->getReferenceSequencePosition() + colIt->getReferenceSequence()->getStartPosition()) {
+        throw hal_exception("reference dna is in wrong place");
+    }
+    callSnps(refDnaIt, counter, tsvBuffer, minSpeciesForSnp);
+}
 
-            if (refTsvStream && numDifferentSpecies >= minSpeciesForSnp) {
-                // Report a SNP to the TSV for this ortholog set.
-                // First the sequence and position:
-                const Sequence *refSeq = refDnaIt->getGenome()->getSequenceBySite(refDnaIt->getArrayIndex());
-                refTsvStream << refSeq->getName() << "\t" << refDnaIt->getArrayIndex() - refSeq->getStartPosition();
-                // then the reference base:
-                refTsvStream << "\t" << refDnaIt->getBase();
-                // then finally the orthologs, in the same order that they
-                // were spit out in the header.
-                vector<char> orthologFields(targetGenomes.size()); // initialized to '\0'
-                for (set<DnaIteratorPtr *>::const_iterator i = orthologSet->begin(); i != orthologSet->end(); i++) {
-                    char targetDna = (**i)->getBase();
-                    // - 3 because of the 3 fields preceding the target base fields
-                    assert(orthologFields[fieldForGenome[(**i)->getGenome()] - 3] == '\0');
-                    orthologFields[fieldForGenome[(**i)->getGenome()] - 3] = targetDna;
-                }
-                for (hal_size_t i = 0; i < orthologFields.size(); i++) {
-                    refTsvStream << "\t";
-                    if (orthologFields[i] != '\0') {
-                        refTsvStream << orthologFields[i];
-                    }
-                }
-                refTsvStream << endl;
+// Check that the leftmost reference base of the column is in the
+// (inclusive) range, like ColumnIterator::isCanonicalOnRef() does for the
+// iterator's own range.  Tiles need the check against the whole range.
+static bool isCanonicalOnRange(const ColumnIterator *colIt, const Genome *refGenome, hal_index_t start, hal_index_t last) {
+    hal_index_t leftmostRefPos = colIt->getReferenceSequencePosition() + colIt->getReferenceSequence()->getStartPosition();
+    const ColumnIterator::ColumnMap *cols = colIt->getColumnMap();
+    for (ColumnIterator::ColumnMap::const_iterator colMapIt = cols->begin(); colMapIt != cols->end(); colMapIt++) {
+        if (colMapIt->first->getGenome() == refGenome) {
+            for (size_t i = 0; i < colMapIt->second->size(); i++) {
+                leftmostRefPos = min(leftmostRefPos, colMapIt->second->at(i)->getArrayIndex());
             }
-        cleanup:
-            if (!doDupes) {
-                for (set<DnaIteratorPtr *>::const_iterator orthologIt = orthologSet->begin(); orthologIt != orthologSet->end();
-                     orthologIt++) {
-                    delete *orthologIt;
-                }
-                delete orthologsIt->first;
+        }
+    }
+    return leftmostRefPos >= start && leftmostRefPos <= last;
+}
+
+// Count the snps in the reference columns [tileStart, tileLast], adding
+// the tsv lines to tsvBuffer if it isn't NULL.  start and last are the
+// whole range being scanned, used to pick the unique columns.
+static void countSnps(SnpCounter &counter, hal_index_t start, hal_index_t last, hal_index_t tileStart, hal_index_t tileLast,
+                      bool doDupes, string *tsvBuffer, bool unique, hal_size_t minSpeciesForSnp) {
+    ColumnIteratorPtr colIt =
+        counter.refGenome->getColumnIterator(&counter.targetGenomes, 0, tileStart, tileLast, !doDupes, false);
+    // genome ordinals are particular to the iterator's column tree
+    counter.fieldForOrdinal.clear();
+    counter.refOrdinal.clear();
+    while (1) {
+        // If the column isn't unique we will have visited it already if
+        // we iterate over the reference segments separately.
+        if (!unique || isCanonicalOnRange(colIt.get(), counter.refGenome, start, last)) {
+            if (doDupes) {
+                callTreeSnps(colIt->getColumnTree(), counter, tsvBuffer, minSpeciesForSnp);
+            } else {
+                callColumnSnps(colIt.get(), counter, tsvBuffer, minSpeciesForSnp);
             }
-            delete orthologSet;
         }
 
         if (colIt->lastColumn()) {
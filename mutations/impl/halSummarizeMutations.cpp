@@ -52,57 +52,74 @@ void SummarizeMutations::printCsv(ostream &outStream) const {
 
 void SummarizeMutations::analyzeAlignmentPtr(AlignmentConstPtr alignment, hal_size_t gapThreshold, double nThreshold, bool justSubs,
                                           const set<string> *targetSet) {
+    analyzeAlignment(ThreadAlignments(alignment, string(), NULL, 1), gapThreshold, nThreshold, justSubs, targetSet);
+}
+
+void SummarizeMutations::analyzeAlignment(const ThreadAlignments &alignments, hal_size_t gapThreshold, double nThreshold,
+                                          bool justSubs, const set<string> *targetSet) {
     _gapThreshold = gapThreshold;
     _nThreshold = nThreshold;
     _justSubs = justSubs;
     _targetSet = targetSet;
     _branchMap.clear();
-    _alignment = alignment;
+    _alignment = alignments.get(0);
+
+    if (_alignment->getNumGenomes() == 0) {
+        return;
+    }
+    vector<string> genomeNames;
+    collectGenomesRecursive(_alignment->getRootName(), genomeNames);
 
-    if (_alignment->getNumGenomes() > 0) {
-        string root = _alignment->getRootName();
-        analyzeGenomeRecursive(root);
+    // each branch only reads its own genome and its parent, so the stats
+    // are filled in independently and only merged into the map at the end
+    vector<MutationsStats> branchStats(genomeNames.size());
+    vector<StrPair> branchNames(genomeNames.size());
+    parallelFor(genomeNames.size(), alignments.size(), [&](size_t genomeIdx, unsigned threadIdx) {
+        AlignmentConstPtr alignment = alignments.get(threadIdx);
+        const Genome *genome = alignment->openGenome(genomeNames[genomeIdx]);
+        assert(genome != NULL);
+        const Genome *parent = genome->getParent();
+        branchNames[genomeIdx] = StrPair(genome->getName(), parent != NULL ? parent->getName() : string());
+        analyzeGenome(alignment, genome, branchStats[genomeIdx]);
+        alignment->closeGenome(genome);
+        if (parent != NULL) {
+            alignment->closeGenome(parent);
+        }
+    });
+
+    for (size_t i = 0; i < genomeNames.size(); ++i) {
+        _branchMap.insert(pair<StrPair, MutationsStats>(branchNames[i], branchStats[i]));
+    }
+}
+
+void SummarizeMutations::collectGenomesRecursive(const string &genomeName, vector<string> &genomeNames) const {
+    genomeNames.push_back(genomeName);
+    vector<string> children = _alignment->getChildNames(genomeName);
+    for (hal_size_t i = 0; i < children.size(); ++i) {
+        collectGenomesRecursive(children[i], genomeNames);
     }
 }
 
-void SummarizeMutations::analyzeGenomeRecursive(const string &genomeName) {
-    const Genome *genome = _alignment->openGenome(genomeName);
-    assert(genome != NULL);
+void SummarizeMutations::analyzeGenome(AlignmentConstPtr alignment, const Genome *genome, MutationsStats &stats) const {
     const Genome *parent = genome->getParent();
-    MutationsStats stats = {0};
+    stats = MutationsStats();
     stats._genomeLength = genome->getSequenceLength();
     if (parent != NULL) {
         stats._parentLength = parent->getSequenceLength();
-        stats._branchLength = _alignment->getBranchLength(parent->getName(), genome->getName());
+        stats._branchLength = alignment->getBranchLength(parent->getName(), genome->getName());
     }
 
     if (_justSubs == true) {
         substitutionAnalysis(genome, stats);
-    } else if (parent != NULL && (!_targetSet || _targetSet->find(genomeName) != _targetSet->end())) {
-        TopSegmentIteratorPtr topIt = genome->getTopSegmentIterator();
-        BottomSegmentIteratorPtr parIt = parent->getBottomSegmentIterator();
-
+    } else if (parent != NULL && (!_targetSet || _targetSet->find(genome->getName()) != _targetSet->end())) {
         rearrangementAnalysis(genome, stats);
     }
-
-    string pname = parent != NULL ? parent->getName() : string();
-    StrPair branchName(genome->getName(), pname);
-    _branchMap.insert(pair<StrPair, MutationsStats>(branchName, stats));
-
-    _alignment->closeGenome(genome);
-    if (parent != NULL) {
-        _alignment->closeGenome(parent);
-    }
-    vector<string> children = _alignment->getChildNames(genomeName);
-    for (hal_size_t i = 0; i < children.size(); ++i) {
-        analyzeGenomeRecursive(children[i]);
-    }
 }
 
 // quickly count subsitutions without loading rearrangement machinery.
 // used for benchmarks for basic file scanning... and not much else since
 // the interface is still a bit wonky.
-void SummarizeMutations::substitutionAnalysis(const Genome *genome, MutationsStats &stats) {
+void SummarizeMutations::substitutionAnalysis(const Genome *genome, MutationsStats &stats) const {
     assert(stats._subs == 0);
     if (genome->getNumChildren() == 0 || genome->getNumBottomSegments() == 0 ||
         (_targetSet && _targetSet->find(genome->getName()) == _targetSet->end())) {
@@ -152,7 +169,7 @@ void SummarizeMutations::substitutionAnalysis(const Genome *genome, MutationsSta
     }
 }
 
-void SummarizeMutations::rearrangementAnalysis(const Genome *genome, MutationsStats &stats) {
+void SummarizeMutations::rearrangementAnalysis(const Genome *genome, MutationsStats &stats) const {
     const Genome *parent = genome->getParent();
     hal_index_t childIndex = parent->getChildIndex(genome);
 
@@ -204,7 +221,7 @@ void SummarizeMutations::rearrangementAnalysis(const Genome *genome, MutationsSt
     } while (r->identifyNext() == true);
 }
 
-void SummarizeMutations::subsAndGapInserts(GappedTopSegmentIteratorPtr gappedTop, MutationsStats &stats) {
+void SummarizeMutations::subsAndGapInserts(GappedTopSegmentIteratorPtr gappedTop, MutationsStats &stats) const {
     assert(gappedTop->getReversed() == false);
     hal_size_t numGaps = gappedTop->getNumGaps();
     if (numGaps > 0) {
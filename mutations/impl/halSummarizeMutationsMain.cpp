@@ -32,6 +32,9 @@ static void initParser(CLParser &optionsParser) {
                                             " when using the normal interface.  For tuning "
                                             " and performance checking only",
                                 false);
+    optionsParser.addOption("numThreads", "number of branches to analyze in parallel (0 to use all cores). "
+                                          "Only mmap HAL files can be read by more than one thread",
+                            1);
     optionsParser.setDescription("Print summary table of mutation events "
                                  "in the alignemt.");
 }
@@ -47,6 +50,7 @@ int main(int argc, char **argv) {
     hal_size_t maxGap;
     double nThreshold;
     bool justSubs;
+    unsigned numThreads;
     try {
         optionsParser.parseOptions(argc, argv);
         halPath = optionsParser.getArgument<string>("halFile");
@@ -55,6 +59,7 @@ int main(int argc, char **argv) {
         maxGap = optionsParser.getOption<hal_size_t>("maxGap");
         nThreshold = optionsParser.getOption<double>("maxNFraction");
         justSubs = optionsParser.getFlag("justSubs");
+        numThreads = optionsParser.getOption<unsigned>("numThreads");
 
         if (rootGenomeName != "\"\"" && targetGenomes != "\"\"") {
             throw hal_exception("--rootGenome and --targetGenomes options are "
@@ -106,8 +111,10 @@ int main(int argc, char **argv) {
             }
         }
 
+        numThreads = getReadThreadCount(halPath, &optionsParser, numThreads);
+        ThreadAlignments threadAlignments(alignment, halPath, &optionsParser, numThreads);
         SummarizeMutations mutations;
-        mutations.analyzeAlignmentPtr(alignment, maxGap, nThreshold, justSubs, targetSet.empty() ? NULL : &targetNames);
+        mutations.analyzeAlignment(threadAlignments, maxGap, nThreshold, justSubs, targetSet.empty() ? NULL : &targetNames);
 
         cout << endl << mutations;
     } catch (hal_exception &e) {
@@ -11,6 +11,7 @@
 #include "hal.h"
 #include "halAverage.h"
 #include "halMutationsStats.h"
+#include "halParallel.h"
 #include <iostream>
 #include <string>
 #include <vector>
@@ -26,11 +27,19 @@ namespace hal {
         void analyzeAlignmentPtr(AlignmentConstPtr alignment, hal_size_t gapThreshold, double nThreshold, bool justSubs,
                               const std::set<std::string> *targetSet = NULL);
 
+        /** Analyze the alignment with one thread per alignment in
+         * alignments.  Branches are independent, so they are handed out
+         * to the threads and their stats collected by branch name, giving
+         * the same table for any number of threads. */
+        void analyzeAlignment(const ThreadAlignments &alignments, hal_size_t gapThreshold, double nThreshold, bool justSubs,
+                              const std::set<std::string> *targetSet = NULL);
+
       protected:
-        void analyzeGenomeRecursive(const std::string &genomeName);
-        void substitutionAnalysis(const Genome *genome, MutationsStats &stats);
-        void rearrangementAnalysis(const Genome *genome, MutationsStats &stats);
-        void subsAndGapInserts(GappedTopSegmentIteratorPtr gappedTop, MutationsStats &stats);
+        void collectGenomesRecursive(const std::string &genomeName, std::vector<std::string> &genomeNames) const;
+        void analyzeGenome(AlignmentConstPtr alignment, const Genome *genome, MutationsStats &stats) const;
+        void substitutionAnalysis(const Genome *genome, MutationsStats &stats) const;
+        void rearrangementAnalysis(const Genome *genome, MutationsStats &stats) const;
+        void subsAndGapInserts(GappedTopSegmentIteratorPtr gappedTop, MutationsStats &stats) const;
 
         typedef std::pair<std::string, std::string> StrPair;
         typedef std::map<StrPair, MutationsStats> BranchMap;
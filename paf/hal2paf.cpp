@@ -11,12 +11,16 @@
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <unordered_set>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 using namespace hal;
 
-static void genome2PAF(ostream& outStream, const Genome* genome, bool fullNames);
+static void genome2PAF(string& buffer, const Genome* genome, bool fullNames, bool csTag, bool eqxCigar);
 
 static void initParser(CLParser &optionsParser) {
     optionsParser.addArgument("inHalPath", "input hal file");
@@ -28,6 +32,17 @@ static void initParser(CLParser &optionsParser) {
                                 "for output names.  By default, the UCSC convention of Genome.Sequence "
                                 "is used",
                                 false);
+    optionsParser.addOptionFlag("cs", "compare the aligned bases and output the cs:Z difference string "
+                                "and NM:i edit distance tags.  The residue matches column is set to the "
+                                "number of identical bases rather than the number of aligned bases",
+                                false);
+    optionsParser.addOptionFlag("eqx", "compare the aligned bases and use =/X instead of M in the cg:Z "
+                                "cigar.  The residue matches column is set as with --cs",
+                                false);
+    optionsParser.addOption("numThreads", "number of branches to process in parallel (0 to use all cores). "
+                            "Only mmap HAL files can be read by more than one thread.  Output order "
+                            "does not depend on the number of threads",
+                            1);
     optionsParser.setDescription("Export pairwise alignment (with no softclips) of each branch to PAF");
 }
 
@@ -38,12 +53,18 @@ int main(int argc, char **argv) {
     string halPath;
     string rootGenomeName;
     bool fullNames;
+    bool csTag;
+    bool eqxCigar;
+    unsigned numThreads;
 
     try {
         optionsParser.parseOptions(argc, argv);
         halPath = optionsParser.getArgument<string>("inHalPath");
         rootGenomeName = optionsParser.getOption<string>("rootGenome");
         fullNames = !optionsParser.getFlag("onlySequenceNames");
+        csTag = optionsParser.getFlag("cs");
+        eqxCigar = optionsParser.getFlag("eqx");
+        numThreads = optionsParser.getOption<unsigned>("numThreads");
     } catch (exception &e) {
         cerr << e.what() << endl;
         optionsParser.printUsage(cerr);
@@ -68,30 +89,45 @@ int main(int argc, char **argv) {
             throw hal_exception(string("Root genome, ") + rootGenomeName + 
                                 ", not found in alignment");
         }
-        const Genome* parentGenome = rootGenome;
 
+        // branches are identified by their child genome and are output in
+        // breadth-first order
+        vector<string> branches;
         vector<string> childs = alignment->getChildNames(rootGenome->getName());
         deque<string> queue(childs.begin(), childs.end());
-
         while (!queue.empty()) {
             string childName = queue.front();
             queue.pop_front();
-            const Genome* childGenome = alignment->openGenome(childName);
-            string parentName = alignment->getParentName(childName);
-            if (parentName != parentGenome->getName()) {
-                alignment->closeGenome(parentGenome);
-                parentGenome = childGenome->getParent();
-            }
-
-            genome2PAF(cout, childGenome, fullNames);
-
+            branches.push_back(childName);
             childs = alignment->getChildNames(childName);
             for (int i = 0; i < childs.size(); ++i) {
                 queue.push_back(childs[i]);
             }
-
-            alignment->closeGenome(childGenome);
         }
+
+        // each branch only reads its child's top segments and its parent's bottom
+        // segments, so they are converted independently, each thread with its own
+        // alignment handle and output buffer
+        numThreads = getReadThreadCount(halPath, &optionsParser, numThreads);
+        ThreadAlignments threadAlignments(alignment, halPath, &optionsParser, numThreads);
+        vector<string> buffers(numThreads);
+        vector<const Genome*> parentGenomes(numThreads, NULL);
+        OrderedOutput output(cout, branches.size());
+
+        parallelFor(branches.size(), numThreads, [&](size_t branchIdx, unsigned threadIdx) {
+            AlignmentConstPtr threadAlignment = threadAlignments.get(threadIdx);
+            const Genome* childGenome = threadAlignment->openGenome(branches[branchIdx]);
+            const Genome* parentGenome = childGenome->getParent();
+            if (parentGenomes[threadIdx] != NULL && parentGenomes[threadIdx] != parentGenome) {
+                threadAlignment->closeGenome(parentGenomes[threadIdx]);
+            }
+            parentGenomes[threadIdx] = parentGenome;
+
+            genome2PAF(buffers[threadIdx], childGenome, fullNames, csTag, eqxCigar);
+            output.commit(branchIdx, buffers[threadIdx]);
+
+            threadAlignment->closeGenome(childGenome);
+        });
     }
     catch(exception& e) {
         cerr << e.what() << endl;
@@ -179,7 +215,192 @@ static char blockCat(const TopSegmentIteratorPtr& topIt1, const BottomSegmentIte
 }
 
 
-void genome2PAF(ostream& outStream, const Genome* genome, bool fullNames) {
+/// find positions where two arrays of DNA codes differ, ignoring case, and add them to mismatches
+static void findMismatches(const uint8_t* codes1, const uint8_t* codes2, size_t length, vector<size_t>& mismatches) {
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i baseMask = _mm_set1_epi8(0x07);
+    for (; i + 16 <= length; i += 16) {
+        __m128i bases1 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(codes1 + i)), baseMask);
+        __m128i bases2 = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(codes2 + i)), baseMask);
+        unsigned diffBits = ~_mm_movemask_epi8(_mm_cmpeq_epi8(bases1, bases2)) & 0xFFFF;
+        while (diffBits != 0) {
+            mismatches.push_back(i + __builtin_ctz(diffBits));
+            diffBits &= diffBits - 1;
+        }
+    }
+#endif
+    for (; i < length; ++i) {
+        if ((codes1[i] ^ codes2[i]) & 0x07) {
+            mismatches.push_back(i);
+        }
+    }
+}
+
+/// lower case base of a DNA code
+static inline char codeToLower(uint8_t code) {
+    return dnaUnpackMap[code & 0x07];
+}
+
+/**
+ * Compare the bases of the blocks making up a PAF line to produce the
+ * cs:Z string, the =/X cigar and the edit distance.  Blocks are added in
+ * query order as they are found, and compared when the line is written
+ * so the output is in target order.  Bases are read in bulk as 4-bit codes
+ * rather than through per-base DnaIterator calls.
+ */
+class PafBaseComparer {
+public:
+    PafBaseComparer(const Genome* genome) :
+        _queryDna(genome->getDnaIterator()),
+        _targetDna(genome->getParent()->getDnaIterator()) {
+    }
+
+    /// start a new line
+    void clear() {
+        _blocks.clear();
+    }
+
+    /// add an aligned block, positions are forward genome coordinates of the first bases
+    void addMatch(hal_index_t queryStart, hal_index_t targetStart, hal_size_t length) {
+        _blocks.push_back(Block('M', queryStart, targetStart, length));
+    }
+    /// add an insertion of query bases
+    void addInsertion(hal_index_t queryStart, hal_size_t length) {
+        _blocks.push_back(Block('I', queryStart, NULL_INDEX, length));
+    }
+    /// add a deletion of target bases
+    void addDeletion(hal_index_t targetStart, hal_size_t length) {
+        _blocks.push_back(Block('D', NULL_INDEX, targetStart, length));
+    }
+
+    /// compare all bases of the line, reversed is the strand of the query
+    void compare(bool reversed) {
+        _cs.clear();
+        _eqx.clear();
+        _editDistance = 0;
+        _numMatches = 0;
+        _csRun = 0;
+        for (size_t i = 0; i < _blocks.size(); ++i) {
+            const Block& block = _blocks[reversed ? _blocks.size() - 1 - i : i];
+            if (block._op == 'M') {
+                compareMatch(block, reversed);
+            } else if (block._op == 'I') {
+                readQuery(block, reversed);
+                flushCsRun();
+                _cs.push_back('+');
+                appendBases(_cs, _queryCodes);
+                addEqx('I', block._length);
+                _editDistance += block._length;
+            } else {
+                readTarget(block);
+                flushCsRun();
+                _cs.push_back('-');
+                appendBases(_cs, _targetCodes);
+                addEqx('D', block._length);
+                _editDistance += block._length;
+            }
+        }
+        flushCsRun();
+    }
+
+    const string& getCs() const {
+        return _cs;
+    }
+    const vector<pair<hal_size_t, char>>& getEqxCigar() const {
+        return _eqx;
+    }
+    hal_size_t getEditDistance() const {
+        return _editDistance;
+    }
+    hal_size_t getNumMatches() const {
+        return _numMatches;
+    }
+
+private:
+    struct Block {
+        Block(char op, hal_index_t queryStart, hal_index_t targetStart, hal_size_t length) :
+            _op(op), _queryStart(queryStart), _targetStart(targetStart), _length(length) {
+        }
+        char _op;
+        hal_index_t _queryStart;
+        hal_index_t _targetStart;
+        hal_size_t _length;
+    };
+
+    /// read query bases in target orientation
+    void readQuery(const Block& block, bool reversed) {
+        _queryDna->setReversed(reversed);
+        _queryDna->jumpTo(reversed ? block._queryStart + block._length - 1 : block._queryStart);
+        _queryDna->readCodes(_queryCodes, block._length);
+    }
+
+    void readTarget(const Block& block) {
+        _targetDna->jumpTo(block._targetStart);
+        _targetDna->readCodes(_targetCodes, block._length);
+    }
+
+    void compareMatch(const Block& block, bool reversed) {
+        readQuery(block, reversed);
+        readTarget(block);
+        _mismatches.clear();
+        findMismatches(_targetCodes.data(), _queryCodes.data(), block._length, _mismatches);
+        size_t prev = 0;
+        for (size_t i = 0; i < _mismatches.size(); ++i) {
+            size_t pos = _mismatches[i];
+            _csRun += pos - prev;
+            addEqx('=', pos - prev);
+            flushCsRun();
+            _cs.push_back('*');
+            _cs.push_back(codeToLower(_targetCodes[pos]));
+            _cs.push_back(codeToLower(_queryCodes[pos]));
+            addEqx('X', 1);
+            prev = pos + 1;
+        }
+        _csRun += block._length - prev;
+        addEqx('=', block._length - prev);
+        _editDistance += _mismatches.size();
+        _numMatches += block._length - _mismatches.size();
+    }
+
+    void flushCsRun() {
+        if (_csRun > 0) {
+            _cs.push_back(':');
+            appendInt(_cs, _csRun);
+            _csRun = 0;
+        }
+    }
+
+    void addEqx(char op, hal_size_t length) {
+        if (length > 0) {
+            if (!_eqx.empty() && _eqx.back().second == op) {
+                _eqx.back().first += length;
+            } else {
+                _eqx.push_back(make_pair(length, op));
+            }
+        }
+    }
+
+    static void appendBases(string& buffer, const vector<uint8_t>& codes) {
+        for (size_t i = 0; i < codes.size(); ++i) {
+            buffer.push_back(codeToLower(codes[i]));
+        }
+    }
+
+    DnaIteratorPtr _queryDna;
+    DnaIteratorPtr _targetDna;
+    vector<Block> _blocks;
+    vector<uint8_t> _queryCodes;
+    vector<uint8_t> _targetCodes;
+    vector<size_t> _mismatches;
+    string _cs;
+    vector<pair<hal_size_t, char>> _eqx;
+    hal_size_t _csRun;
+    hal_size_t _editDistance;
+    hal_size_t _numMatches;
+};
+
+void genome2PAF(string& buffer, const Genome* genome, bool fullNames, bool csTag, bool eqxCigar) {
     TopSegmentIteratorPtr topIt1 = genome->getTopSegmentIterator();
     TopSegmentIteratorPtr topIt2 = genome->getTopSegmentIterator();
     TopSegmentIteratorPtr topIt3 = genome->getTopSegmentIterator();
@@ -218,6 +439,9 @@ void genome2PAF(ostream& outStream, const Genome* genome, bool fullNames) {
         botIt1->copy(botIt2);
     }
 
+    bool baseTags = csTag || eqxCigar;
+    unique_ptr<PafBaseComparer> comparer(baseTags ? new PafBaseComparer(genome) : NULL);
+
     // start up a fresh paf line
     string queryName = fullNames ? topIt1->getSequence()->getFullName() : topIt1->getSequence()->getName();
     size_t queryLength = topIt1->getSequence()->getSequenceLength();
@@ -229,7 +453,11 @@ void genome2PAF(ostream& outStream, const Genome* genome, bool fullNames) {
     hal_index_t targetEnd = botIt1->bseg()->getEndPosition();
     size_t matches = topIt1->getLength();
     size_t runningMatch = topIt1->getLength();
-    vector<string> cigar;
+    // cigar operations as (length, operation) pairs
+    vector<pair<hal_size_t, char>> cigar;
+    if (baseTags) {
+        comparer->addMatch(queryStart, targetStart, topIt1->getLength());
+    }
         
     // go forward
     while (!cigar.empty() || runningMatch > 0) {
@@ -259,36 +487,67 @@ void genome2PAF(ostream& outStream, const Genome* genome, bool fullNames) {
         if (newLine) {
             // resolve the running match
             if (runningMatch > 0) {
-                cigar.push_back(std::to_string(runningMatch) + "M");
+                cigar.push_back(make_pair(runningMatch, 'M'));
                 runningMatch = 0;
             }
 
+            if (baseTags) {
+                comparer->compare(botIt1->getReversed());
+                matches = comparer->getNumMatches();
+            }
+
+            // write out the current paf line
+            buffer.append(queryName);
+            buffer.push_back('\t');
+            appendInt(buffer, queryLength);
+            buffer.push_back('\t');
+            appendInt(buffer, queryStart - topIt1->getSequence()->getStartPosition());
+            buffer.push_back('\t');
+            appendInt(buffer, queryEnd - topIt1->getSequence()->getStartPosition() + 1);
+            buffer.append(botIt1->getReversed() ? "\t-\t" : "\t+\t");
+            buffer.append(targetName);
+            buffer.push_back('\t');
+            appendInt(buffer, targetLength);
+            buffer.push_back('\t');
+            appendInt(buffer, targetStart - botIt1->getSequence()->getStartPosition());
+            buffer.push_back('\t');
+            appendInt(buffer, targetEnd - botIt1->getSequence()->getStartPosition() + 1);
+            buffer.push_back('\t');
+            appendInt(buffer, matches);
+            buffer.push_back('\t');
+            appendInt(buffer, queryEnd - queryStart + 1); // shoudl we include deletions?
+            buffer.append("\t255\tcg:Z:");
+
             // make our cigar
-            string cigar_string;
-            if (botIt1->getReversed()) {
-                for (vector<string>::reverse_iterator ci = cigar.rbegin(); ci != cigar.rend(); ++ci) {
-                    cigar_string += *ci;
+            if (eqxCigar) {
+                const vector<pair<hal_size_t, char>>& eqx = comparer->getEqxCigar();
+                for (auto ci = eqx.begin(); ci != eqx.end(); ++ci) {
+                    appendInt(buffer, ci->first);
+                    buffer.push_back(ci->second);
+                }
+            } else if (botIt1->getReversed()) {
+                for (auto ci = cigar.rbegin(); ci != cigar.rend(); ++ci) {
+                    appendInt(buffer, ci->first);
+                    buffer.push_back(ci->second);
                 }
             } else {
-                for (vector<string>::iterator ci = cigar.begin(); ci != cigar.end(); ++ci) {
-                    cigar_string += *ci;
+                for (auto ci = cigar.begin(); ci != cigar.end(); ++ci) {
+                    appendInt(buffer, ci->first);
+                    buffer.push_back(ci->second);
                 }
             }
-            
-            // write out the current paf line
-            outStream << queryName << "\t" << queryLength << "\t"
-                      << (queryStart - topIt1->getSequence()->getStartPosition()) << "\t"
-                      << (queryEnd - topIt1->getSequence()->getStartPosition() + 1) << "\t"
-                      << (botIt1->getReversed() ? "-" : "+") << "\t"
-                      << targetName << "\t" << targetLength << "\t"
-                      << (targetStart - botIt1->getSequence()->getStartPosition()) << "\t"
-                      << (targetEnd - botIt1->getSequence()->getStartPosition() + 1) << "\t"
-                      << matches << "\t"
-                      << (queryEnd - queryStart + 1) << "\t" // shoudl we include deletions? 
-                      << 255 << "\t"
-                      << "cg:Z:" << cigar_string << endl;
+            if (csTag) {
+                buffer.append("\tNM:i:");
+                appendInt(buffer, comparer->getEditDistance());
+                buffer.append("\tcs:Z:");
+                buffer.append(comparer->getCs());
+            }
+            buffer.push_back('\n');
 
             cigar.clear();
+            if (baseTags) {
+                comparer->clear();
+            }
             
             if (found_match) {
                 // start a new cigar
@@ -303,11 +562,14 @@ void genome2PAF(ostream& outStream, const Genome* genome, bool fullNames) {
                 targetEnd = botIt2->bseg()->getEndPosition();
                 matches = topIt2->getLength();
                 runningMatch = topIt2->getLength();
+                if (baseTags) {
+                    comparer->addMatch(queryStart, targetStart, topIt2->getLength());
+                }
             } 
         } else if (found_match) {
             // dump out a running match before we add to the cigar
             if ((cat == 'i' || cat == 'd') && runningMatch > 0) {
-                cigar.push_back(std::to_string(runningMatch) + "M");
+                cigar.push_back(make_pair(runningMatch, 'M'));
                 runningMatch = 0;
             }
             // extend current paf line
@@ -315,7 +577,10 @@ void genome2PAF(ostream& outStream, const Genome* genome, bool fullNames) {
                 // extend with inseriton
                 hal_index_t ins_len = topIt2->getStartPosition() - topIt1->getEndPosition() - 1;
                 assert(ins_len > 0);
-                cigar.push_back(std::to_string(ins_len) + "I");
+                cigar.push_back(make_pair(ins_len, 'I'));
+                if (baseTags) {
+                    comparer->addInsertion(topIt1->getEndPosition() + 1, ins_len);
+                }
             } else if (cat == 'd') {
                 // extend with deltion
                 hal_index_t del_len;
@@ -325,12 +590,20 @@ void genome2PAF(ostream& outStream, const Genome* genome, bool fullNames) {
                     del_len = botIt2->getStartPosition() - botIt1->getEndPosition() - 1; 
                 }
                 assert(del_len > 0);
-                cigar.push_back(std::to_string(del_len) + "D");
+                cigar.push_back(make_pair(del_len, 'D'));
+                if (baseTags) {
+                    comparer->addDeletion(botIt1->getReversed() ? botIt2->bseg()->getEndPosition() + 1 :
+                                          botIt1->getEndPosition() + 1, del_len);
+                }
             }
             if (cat != 'o') {
                 // no softclips, so always bookended by a match
                 matches += topIt2->getLength();
                 runningMatch += topIt2->getLength();
+                if (baseTags) {
+                    comparer->addMatch(topIt2->getStartPosition(), botIt2->bseg()->getStartPosition(),
+                                       topIt2->getLength());
+                }
             }
 
             // update the range
@@ -7,12 +7,14 @@
  */
 
 #include "halPhyloP.h"
+#include <sstream>
 
 using namespace std;
 using namespace hal;
 
 PhyloP::PhyloP()
-    : _mod(NULL), _softMaskDups(false), _maskAllDups(false), _seqnameHash(NULL), _colfitdata(NULL), _mode(CONACC), _msa(NULL) {
+    : _mod(NULL), _softMaskDups(false), _maskAllDups(false), _seqnameHash(NULL), _colfitdata(NULL), _mode(CONACC), _msa(NULL),
+      _tileSize(0), _warnPruned(true) {
 }
 
 PhyloP::~PhyloP() {
@@ -30,6 +32,11 @@ void PhyloP::clear() {
         hsh_free(_seqnameHash);
     }
     _targetSet.clear();
+    _patternCache.clear();
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        delete _workers[i];
+    }
+    _workers.clear();
 
     // need to free _mod?
 }
@@ -80,7 +87,9 @@ void PhyloP::init(AlignmentConstPtr alignment, const string &modFilePath, ostrea
         string targetName = string(((String *)lst_get_ptr(leafNames, i))->chars);
         const Genome *tgtGenome = _alignment->openGenome(targetName);
         if (tgtGenome == NULL) {
-            cerr << "Genome" << targetName << " not found in alignment; pruning from tree" << endl;
+            if (_warnPruned) {
+                cerr << "Genome" << targetName << " not found in alignment; pruning from tree" << endl;
+            }
             lst_push(pruneNames, lst_get_ptr(leafNames, i));
         } else {
             String *leafName = (String *)lst_get_ptr(leafNames, i);
@@ -130,6 +139,18 @@ void PhyloP::init(AlignmentConstPtr alignment, const string &modFilePath, ostrea
     _colfitdata->tupleidx = 0;
 }
 
+void PhyloP::init(const ThreadAlignments &alignments, hal_size_t tileSize, const string &modFilePath, ostream *outStream,
+                  bool softMaskDups, const string &dupType, const string &phyloPMode, const string &subtree) {
+    init(alignments.get(0), modFilePath, outStream, softMaskDups, dupType, phyloPMode, subtree);
+    _tileSize = tileSize;
+    for (unsigned threadIdx = 1; threadIdx < alignments.size(); ++threadIdx) {
+        PhyloP *worker = new PhyloP();
+        _workers.push_back(worker);
+        worker->_warnPruned = false;
+        worker->init(alignments.get(threadIdx), modFilePath, NULL, softMaskDups, dupType, phyloPMode, subtree);
+    }
+}
+
 /** Given a Sequence (chromosome) and a (sequence-relative) coordinate
  * range, print the phyloP wiggle with respect to the genomes
  * in the target set
@@ -176,10 +197,44 @@ void PhyloP::processSequence(const Sequence *sequence, hal_index_t start, hal_si
                             std::to_string(seqLen));
     }
 
-    const Genome *genome = sequence->getGenome();
     string sequenceName = sequence->getName();
-    string genomeName = genome->getName();
+    string genomeName = sequence->getGenome()->getName();
 
+    // note wig coordinates are 1-based for some reason so we shift to right
+    *_outStream << "fixedStep chrom=" << sequenceName << " start=" << start + 1 << " step=" << step << "\n";
+
+    hal_size_t numColumns = (length + step - 1) / step;
+    if (_workers.empty()) {
+        processColumns(sequence, start, numColumns, step, *_outStream);
+        return;
+    }
+
+    /** Columns are scored independently, so the range is cut into tiles
+     * that are scored in parallel, each thread on its own alignment.  The
+     * tiles are written out in order as they complete. */
+    hal_size_t tileColumns = _tileSize == 0 ? 0 : max(_tileSize / step, (hal_size_t)1);
+    vector<pair<hal_index_t, hal_index_t>> tiles = makeTiles(numColumns, tileColumns);
+    OrderedOutput output(*_outStream, tiles.size());
+    vector<string> buffers(_workers.size() + 1);
+    parallelFor(tiles.size(), _workers.size() + 1, [&](size_t tileIdx, unsigned threadIdx) {
+        PhyloP *phyloP = threadIdx == 0 ? this : _workers[threadIdx - 1];
+        const Sequence *threadSequence = phyloP->_alignment->openGenome(genomeName)->getSequence(sequenceName);
+        ostringstream tileStream;
+        tileStream.copyfmt(*_outStream);
+        phyloP->processColumns(threadSequence, start + tiles[tileIdx].first * step, tiles[tileIdx].second - tiles[tileIdx].first,
+                               step, tileStream);
+        buffers[threadIdx] = tileStream.str();
+        output.commit(tileIdx, buffers[threadIdx]);
+    });
+}
+
+/** Print the phyloP scores of the numColumns columns at start, start + step,
+ * ... (sequence-relative) of sequence, one per line. */
+void PhyloP::processColumns(const Sequence *sequence, hal_index_t start, hal_size_t numColumns, hal_size_t step,
+                            ostream &outStream) {
+    if (numColumns == 0) {
+        return;
+    }
     /** The ColumnIterator is fundamental structure used in this example to
      * traverse the alignment.  It essientially generates the multiple alignment
      * on the fly according to the given reference (in this case the target
@@ -187,51 +242,40 @@ void PhyloP::processSequence(const Sequence *sequence, hal_index_t start, hal_si
      * are sequence relative.  Note that we must specify the last position
      * in advance when we get the iterator.  This will limit it following
      * duplications out of the desired range while we are iterating. */
-    hal_size_t pos = start;
-    ColumnIteratorPtr colIt = sequence->getColumnIterator(&_targetSet, 0, pos, last - 1);
-
-    // note wig coordinates are 1-based for some reason so we shift to right
-    *_outStream << "fixedStep chrom=" << sequenceName << " start=" << start + 1 << " step=" << step << "\n";
+    hal_index_t last = start + (numColumns - 1) * step;
+    ColumnIteratorPtr colIt = sequence->getColumnIterator(&_targetSet, 0, start, last);
 
     /** Since the column iterator stores coordinates in Genome coordinates
      * internally, we have to switch back to genome coordinates.  */
     // convert to genome coordinates
-    pos += sequence->getStartPosition();
+    hal_index_t pos = start + sequence->getStartPosition();
     last += sequence->getStartPosition();
-    while (pos <= last) {
+    for (hal_size_t i = 0; i < numColumns; ++i) {
+        if (i > 0) {
+            pos += step;
+            if (step == 1) {
+                /** Move the iterator one position to the right */
+                colIt->toRight();
+
+                /** This is some tuning code that will probably be hidden from
+                 * the interface at some point.  It is a good idea to use for now
+                 * though */
+                // erase empty entries from the column.  helps when there are
+                // millions of sequences (ie from fastas with lots of scaffolds)
+                if (pos % 1000 == 0) {
+                    colIt->defragment();
+                }
+            } else {
+                /** Reset the iterator to a non-contiguous position */
+                colIt->toSite(pos, last);
+            }
+        }
+
         /** ColumnIterator::ColumnMap maps a Sequence to a list of bases
          * the bases in the map form the alignment column.  Some sequences
          * in the map can have no bases (for efficiency reasons) */
         const ColumnIterator::ColumnMap *cmap = colIt->getColumnMap();
-        double pval = this->pval(cmap);
-
-        *_outStream << pval << '\n';
-
-        /** lastColumn checks if we are at the last column (inclusive)
-         * in range.  So we need to check at end of iteration instead
-         * of beginning (which would be more convenient).  Need to
-         * merge global fix from other branch */
-        if (colIt->lastColumn() == true) {
-            break;
-        }
-
-        pos += step;
-        if (step == 1) {
-            /** Move the iterator one position to the right */
-            colIt->toRight();
-
-            /** This is some tuning code that will probably be hidden from
-             * the interface at some point.  It is a good idea to use for now
-             * though */
-            // erase empty entries from the column.  helps when there are
-            // millions of sequences (ie from fastas with lots of scaffolds)
-            if (pos % 1000 == 0) {
-                colIt->defragment();
-            }
-        } else {
-            /** Reset the iterator to a non-contiguous position */
-            colIt->toSite(pos, last - 1);
-        }
+        outStream << pval(cmap) << '\n';
     }
 }
 
@@ -272,12 +316,27 @@ double PhyloP::pval(const ColumnIterator::ColumnMap *cmap) {
         }
     }
 
+    _patternKey.assign((_msa->nseqs + 1) / 2, 0);
     for (int i = 0; i < _msa->nseqs; i++) {
         if (_msa->ss->col_tuples[0][i] == '*') {
             _msa->ss->col_tuples[0][i] = 'N';
         }
+        _patternKey[i / 2] = dnaPack(_msa->ss->col_tuples[0][i], i, _patternKey[i / 2]);
     }
 
+    unordered_map<string, double>::const_iterator cached = _patternCache.find(_patternKey);
+    if (cached != _patternCache.end()) {
+        return cached->second;
+    }
+    if (_patternCache.size() >= MaxCachedPatterns) {
+        _patternCache.clear();
+    }
+    double score = computePval();
+    _patternCache[_patternKey] = score;
+    return score;
+}
+
+double PhyloP::computePval() {
     // finally, compute the score!
     double alt_lnl, null_lnl, this_scale, delta_lnl, pval;
     int sigfigs = 4; // same value used in phyloP code
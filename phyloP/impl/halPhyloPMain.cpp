@@ -65,6 +65,12 @@ static void initParser(CLParser &optionsParser) {
                                        "relative to the rest of the tree",
                             "\"\"");
     optionsParser.addOption("prec", "Number of decimal places in wig output", 3);
+    optionsParser.addOption("numThreads", "number of threads used to score columns (0 to use all cores).  "
+                                          "Only mmap HAL files can be read by more than one thread",
+                            1);
+    optionsParser.addOption("tileSize", "number of reference bases scored by a thread at a time "
+                                        "when --numThreads is not 1",
+                            100000);
 
     optionsParser.setDescription("Make PhyloP wiggle plot for a genome.");
 }
@@ -85,6 +91,8 @@ int main(int argc, char **argv) {
     hal_size_t step;
     string refBedPath;
     hal_size_t prec;
+    unsigned numThreads;
+    hal_size_t tileSize;
     try {
         optionsParser.parseOptions(argc, argv);
         modPath = optionsParser.getArgument<string>("modPath");
@@ -101,6 +109,11 @@ int main(int argc, char **argv) {
         std::transform(dupMask.begin(), dupMask.end(), dupMask.begin(), ::tolower);
         refBedPath = optionsParser.getOption<string>("refBed");
         prec = optionsParser.getOption<hal_size_t>("prec");
+        numThreads = optionsParser.getOption<unsigned>("numThreads");
+        tileSize = optionsParser.getOption<hal_size_t>("tileSize");
+        if (tileSize == 0) {
+            throw hal_exception("--tileSize must be greater than 0");
+        }
     } catch (exception &e) {
         cerr << e.what() << endl;
         optionsParser.printUsage(cerr);
@@ -152,8 +165,10 @@ int main(int argc, char **argv) {
         outStream.setf(ios::fixed, ios::floatfield);
         outStream.precision(prec);
 
+        numThreads = getReadThreadCount(halPath, &optionsParser, numThreads);
+        ThreadAlignments threadAlignments(alignment, halPath, &optionsParser, numThreads);
         PhyloP phyloP;
-        phyloP.init(alignment, modPath, &outStream, dupMask == "soft", dupType, "CONACC", subtree);
+        phyloP.init(threadAlignments, tileSize, modPath, &outStream, dupMask == "soft", dupType, "CONACC", subtree);
 
         ifstream refBedStream;
         if (refBedPath != "\"\"") {
@@ -10,8 +10,11 @@
 #define _HALPHYLOP_H
 
 #include "hal.h"
+#include "halParallel.h"
 #include <cstdlib>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #undef __cplusplus
 extern "C" {
@@ -49,14 +52,35 @@ namespace hal {
                   bool softMaskDups = true, const std::string &dupType = "ambiguous", const std::string &phyloPMode = "CONACC",
                   const std::string &subtree = "\"\"");
 
+        /** Same as above, but processSequence splits its range into tiles
+         * of tileSize columns that are scored by one thread per alignment
+         * in alignments.  Each thread gets its own copy of the model and
+         * column buffers.  The output is the same for any number of
+         * threads. */
+        void init(const ThreadAlignments &alignments, hal_size_t tileSize, const std::string &modFilePath,
+                  std::ostream *outStream, bool softMaskDups = true, const std::string &dupType = "ambiguous",
+                  const std::string &phyloPMode = "CONACC", const std::string &subtree = "\"\"");
+
         void processSequence(const Sequence *sequence, hal_index_t start, hal_size_t length, hal_size_t step);
 
       protected:
+        // print the scores of numColumns columns, step apart, starting at start
+        void processColumns(const Sequence *sequence, hal_index_t start, hal_size_t numColumns, hal_size_t step,
+                            std::ostream &outStream);
+
         // return phyloP score
         double pval(const ColumnIterator::ColumnMap *cmap);
 
+        // score the column loaded in _msa
+        double computePval();
+
         void clear();
 
+        // columns with the same bases (after masking) have the same score, so
+        // scores are cached by column pattern, packed 4 bits per species.
+        // the cache is flushed when it reaches this many patterns
+        static const size_t MaxCachedPatterns = 1 << 18;
+
       protected:
         AlignmentConstPtr _alignment;
         TreeModel *_mod;
@@ -76,6 +100,14 @@ namespace hal {
         List *_outsideNodes;
         mode_type _mode;
         MSA *_msa;
+
+        std::unordered_map<std::string, double> _patternCache;
+        std::string _patternKey;
+
+        // scorers for threads other than the calling one
+        std::vector<PhyloP *> _workers;
+        hal_size_t _tileSize;
+        bool _warnPruned;
     };
 }
 #endif
@@ -4,6 +4,9 @@
 using namespace std;
 using namespace hal;
 
+// number of samples processed by one task
+static const hal_size_t sampleChunkSize = 10000;
+
 int main(int argc, char **argv) {
     CLParser optionsParser;
     optionsParser.setDescription("Calculate coverage by sampling bases.");
@@ -11,16 +14,21 @@ int main(int argc, char **argv) {
     optionsParser.addArgument("refGenome", "genome to calculate coverage on");
     optionsParser.addOption("numSamples", "Number of bases to sample when calculating coverage", 1000000);
     optionsParser.addOption("seed", "Random seed (integer)", 0);
+    optionsParser.addOption("numThreads",
+                            "Number of threads to use (0 to use all cores). Only mmap files can be read by more than one thread",
+                            1);
     string path;
     string refGenome;
     hal_size_t numSamples;
     int64_t seed;
+    unsigned numThreads;
     try {
         optionsParser.parseOptions(argc, argv);
         path = optionsParser.getArgument<string>("halFile");
         refGenome = optionsParser.getArgument<string>("refGenome");
         numSamples = optionsParser.getOption<hal_size_t>("numSamples");
         seed = optionsParser.getOption<int64_t>("seed");
+        numThreads = optionsParser.getOption<unsigned>("numThreads");
     } catch (exception &e) {
         cerr << e.what() << endl;
         optionsParser.printUsage(cerr);
@@ -38,35 +46,58 @@ int main(int argc, char **argv) {
     const Genome *ref = alignment->openGenome(refGenome);
     vector<const Genome *> leafGenomes = getLeafGenomes(alignment.get());
 
-    map<const Genome *, vector<hal_size_t>> coverage;
-    for (size_t i = 0; i < leafGenomes.size(); i++) {
-        coverage.insert(make_pair(leafGenomes[i], vector<hal_size_t>()));
+    // Sample (with replacement) random positions in the reference genome.
+    // They are all drawn up front so that they don't depend on the number
+    // of threads.
+    vector<hal_index_t> samples(numSamples);
+    for (hal_size_t i = 0; i < numSamples; i++) {
+        samples[i] = st_randomInt64(0, ref->getSequenceLength());
     }
 
-    hal_size_t maxDepth = 0;
-
-    for (hal_size_t i = 0; i < numSamples; i++) {
-        // Sample (with replacement) a random position in the reference genome.
-        hal_index_t pos = st_randomInt64(0, ref->getSequenceLength());
-        SegmentIteratorPtr refSeg = ref->getTopSegmentIterator();
-        refSeg->toSite(pos, true);
-        assert(refSeg->getLength() == 1);
-        for (size_t j = 0; j < leafGenomes.size(); j++) {
-            const Genome *leafGenome = leafGenomes[j];
-            MappedSegmentSet segments;
-            halMapSegmentSP(refSeg, segments, leafGenome, NULL, true, 0, NULL, NULL);
-            vector<hal_size_t> &histogram = coverage[leafGenome];
-            hal_size_t depth = segments.size();
-            if (depth > maxDepth) {
-                maxDepth = depth;
+    // Per-thread coverage histograms, indexed by leaf genome.
+    ThreadAlignments threadAlignments(alignment, path, &optionsParser, getReadThreadCount(path, &optionsParser, numThreads));
+    vector<vector<vector<hal_size_t>>> threadCoverage(threadAlignments.size(),
+                                                      vector<vector<hal_size_t>>(leafGenomes.size()));
+    vector<pair<hal_index_t, hal_index_t>> chunks = makeTiles(numSamples, sampleChunkSize);
+    parallelFor(chunks.size(), threadAlignments.size(), [&](size_t chunkIdx, unsigned threadIdx) {
+        AlignmentConstPtr threadAlignment = threadAlignments.get(threadIdx);
+        const Genome *threadRef = threadAlignment->openGenome(refGenome);
+        vector<const Genome *> threadLeafGenomes = getLeafGenomes(threadAlignment.get());
+        SegmentIteratorPtr refSeg = threadRef->getTopSegmentIterator();
+        for (hal_index_t i = chunks[chunkIdx].first; i < chunks[chunkIdx].second; i++) {
+            refSeg->toSite(samples[i], true);
+            assert(refSeg->getLength() == 1);
+            for (size_t j = 0; j < threadLeafGenomes.size(); j++) {
+                MappedSegmentSet segments;
+                halMapSegmentSP(refSeg, segments, threadLeafGenomes[j], NULL, true, 0, NULL, NULL);
+                vector<hal_size_t> &histogram = threadCoverage[threadIdx][j];
+                hal_size_t depth = segments.size();
+                if (histogram.size() < depth) {
+                    histogram.resize(depth, 0);
+                }
+                for (size_t k = 0; k < depth; k++) {
+                    histogram[k] += 1;
+                }
             }
-            if (histogram.size() < depth) {
-                histogram.resize(depth, 0);
+        }
+    });
+
+    map<const Genome *, vector<hal_size_t>> coverage;
+    hal_size_t maxDepth = 0;
+    for (size_t i = 0; i < leafGenomes.size(); i++) {
+        vector<hal_size_t> &histogram = coverage[leafGenomes[i]];
+        for (size_t threadIdx = 0; threadIdx < threadCoverage.size(); threadIdx++) {
+            const vector<hal_size_t> &threadHistogram = threadCoverage[threadIdx][i];
+            if (histogram.size() < threadHistogram.size()) {
+                histogram.resize(threadHistogram.size(), 0);
             }
-            for (size_t k = 0; k < depth; k++) {
-                histogram[k] += 1;
+            for (size_t k = 0; k < threadHistogram.size(); k++) {
+                histogram[k] += threadHistogram[k];
             }
         }
+        if (histogram.size() > maxDepth) {
+            maxDepth = histogram.size();
+        }
     }
 
     cout << "Genome";
@@ -4,6 +4,9 @@
 using namespace std;
 using namespace hal;
 
+// number of samples processed by one task
+static const hal_size_t sampleChunkSize = 10000;
+
 int main(int argc, char **argv) {
     CLParser optionsParser;
     optionsParser.setDescription("Calculate % identity by sampling bases.");
@@ -11,16 +14,21 @@ int main(int argc, char **argv) {
     optionsParser.addArgument("refGenome", "genome to calculate coverage on");
     optionsParser.addOption("numSamples", "Number of bases to sample when calculating % ID", 1000000);
     optionsParser.addOption("seed", "Random seed (integer)", 0);
+    optionsParser.addOption("numThreads",
+                            "Number of threads to use (0 to use all cores). Only mmap files can be read by more than one thread",
+                            1);
     string path;
     string refGenome;
     hal_size_t numSamples;
     int64_t seed;
+    unsigned numThreads;
     try {
         optionsParser.parseOptions(argc, argv);
         path = optionsParser.getArgument<string>("halFile");
         refGenome = optionsParser.getArgument<string>("refGenome");
         numSamples = optionsParser.getOption<hal_size_t>("numSamples");
         seed = optionsParser.getOption<int64_t>("seed");
+        numThreads = optionsParser.getOption<unsigned>("numThreads");
     } catch (exception &e) {
         cerr << e.what() << endl;
         optionsParser.printUsage(cerr);
@@ -38,43 +46,62 @@ int main(int argc, char **argv) {
     const Genome *ref = alignment->openGenome(refGenome);
     vector<const Genome *> leafGenomes = getLeafGenomes(alignment.get());
 
-    // Genome -> <# of identical bases to ref, # of total bases aligned to ref>
-    map<const Genome *, pair<hal_size_t, hal_size_t>> idStats;
-    for (size_t i = 0; i < leafGenomes.size(); i++) {
-        idStats.insert(make_pair(leafGenomes[i], make_pair(0, 0)));
+    // Sample (with replacement) random positions in the reference genome.
+    // They are all drawn up front so that they don't depend on the number
+    // of threads.
+    vector<hal_index_t> samples(numSamples);
+    for (hal_size_t i = 0; i < numSamples; i++) {
+        samples[i] = st_randomInt64(0, ref->getSequenceLength());
     }
 
-    for (hal_size_t i = 0; i < numSamples; i++) {
-        // Sample (with replacement) a random position in the reference genome.
-        hal_index_t pos = st_randomInt64(0, ref->getSequenceLength());
-        SegmentIteratorPtr refSeg = ref->getTopSegmentIterator();
-        refSeg->toSite(pos, true);
-        assert(refSeg->getLength() == 1);
+    // Per-thread <# of identical bases to ref, # of total bases aligned to ref>,
+    // indexed by leaf genome.
+    ThreadAlignments threadAlignments(alignment, path, &optionsParser, getReadThreadCount(path, &optionsParser, numThreads));
+    vector<vector<pair<hal_size_t, hal_size_t>>> threadIdStats(threadAlignments.size(),
+                                                               vector<pair<hal_size_t, hal_size_t>>(leafGenomes.size()));
+    vector<pair<hal_index_t, hal_index_t>> chunks = makeTiles(numSamples, sampleChunkSize);
+    parallelFor(chunks.size(), threadAlignments.size(), [&](size_t chunkIdx, unsigned threadIdx) {
+        AlignmentConstPtr threadAlignment = threadAlignments.get(threadIdx);
+        const Genome *threadRef = threadAlignment->openGenome(refGenome);
+        vector<const Genome *> threadLeafGenomes = getLeafGenomes(threadAlignment.get());
+        vector<pair<hal_size_t, hal_size_t>> &idStats = threadIdStats[threadIdx];
+        SegmentIteratorPtr refSeg = threadRef->getTopSegmentIterator();
         string refString;
-        refSeg->getString(refString);
-        assert(refString.size() == 1);
-        if (toupper(refString[0]) == 'N') {
-            continue;
-        }
-        for (size_t j = 0; j < leafGenomes.size(); j++) {
-            const Genome *leafGenome = leafGenomes[j];
-            MappedSegmentSet segments;
-            halMapSegmentSP(refSeg, segments, leafGenome, NULL, true, 0, NULL, NULL);
-            if (segments.size() == 1) {
-                auto i = segments.begin();
-                string tgtString;
-                (*i)->getString(tgtString);
-                if (toupper(tgtString[0]) == 'N') {
-                    continue;
-                }
-                bool identical = toupper(refString[0]) == toupper(tgtString[0]);
-                auto mapIt = idStats.find(leafGenome);
-                if (identical) {
-                    mapIt->second.first++;
+        string tgtString;
+        for (hal_index_t i = chunks[chunkIdx].first; i < chunks[chunkIdx].second; i++) {
+            refSeg->toSite(samples[i], true);
+            assert(refSeg->getLength() == 1);
+            refSeg->getString(refString);
+            assert(refString.size() == 1);
+            if (toupper(refString[0]) == 'N') {
+                continue;
+            }
+            for (size_t j = 0; j < threadLeafGenomes.size(); j++) {
+                MappedSegmentSet segments;
+                halMapSegmentSP(refSeg, segments, threadLeafGenomes[j], NULL, true, 0, NULL, NULL);
+                if (segments.size() == 1) {
+                    (*segments.begin())->getString(tgtString);
+                    if (toupper(tgtString[0]) == 'N') {
+                        continue;
+                    }
+                    bool identical = toupper(refString[0]) == toupper(tgtString[0]);
+                    if (identical) {
+                        idStats[j].first++;
+                    }
+                    idStats[j].second++;
                 }
-                mapIt->second.second++;
             }
         }
+    });
+
+    // Genome -> <# of identical bases to ref, # of total bases aligned to ref>
+    map<const Genome *, pair<hal_size_t, hal_size_t>> idStats;
+    for (size_t i = 0; i < leafGenomes.size(); i++) {
+        pair<hal_size_t, hal_size_t> &stats = idStats[leafGenomes[i]];
+        for (size_t threadIdx = 0; threadIdx < threadIdStats.size(); threadIdx++) {
+            stats.first += threadIdStats[threadIdx][i].first;
+            stats.second += threadIdStats[threadIdx][i].second;
+        }
     }
 
     cout << "Genome, IdenticalSites, AlignedSites, PercentIdentity" << endl;
@@ -7,6 +7,7 @@
 
 #include "halCLParser.h"
 #include "halStats.h"
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 
@@ -29,10 +30,17 @@ static void printBaseComp(ostream &os, AlignmentConstPtr alignment, const string
 static void printGenomeMetaData(ostream &os, AlignmentConstPtr alignment, const string &genomeName);
 static void printAlignmentPtrMetaData(ostream &os, AlignmentConstPtr alignment);
 static void printChromSizes(ostream &os, AlignmentConstPtr alignment, const string &genomeName);
-static void printPercentID(ostream &os, AlignmentConstPtr alignment, const string &genomeName);
-static void printCoverage(ostream &os, AlignmentConstPtr alignment, const string &genomeName);
+static void printPercentID(ostream &os, const ThreadAlignments &threadAlignments, const string &genomeName,
+                           hal_size_t tileSize);
+static void printCoverage(ostream &os, const ThreadAlignments &threadAlignments, const string &genomeName,
+                          hal_size_t tileSize);
 static void printSegments(ostream &os, AlignmentConstPtr alignment, const string &genomeName, bool top);
-static void printAllCoverage(ostream &os, AlignmentConstPtr alignment);
+static void printAllCoverage(ostream &os, const ThreadAlignments &threadAlignments, hal_size_t tileSize);
+static void materializeStats(const string &path, const CLParser &optionsParser, unsigned numThreads, hal_size_t tileSize);
+
+// names of the statistics stored by --materialize
+static const string BASE_COMP_STAT = "baseComp";
+static const string COVERAGE_STAT = "coverage";
 
 int main(int argc, char **argv) {
     CLParser optionsParser;
@@ -80,7 +88,8 @@ int main(int argc, char **argv) {
                                         "value is of the form genome,step.  Ex: "
                                         "--baseComp human,1000.  The ouptut is of the form "
                                         "fraction_of_As fraction_of_Gs fraction_of_Cs "
-                                        "fraction_of_Ts.",
+                                        "fraction_of_Ts.  With a step of 1, the exact counts "
+                                        "stored by --materialize are used if up to date.",
                             "\"\"");
     optionsParser.addOption("genomeMetaData", "print metadata for given genome, "
                                               "one entry per line, tab-seperated.",
@@ -109,6 +118,18 @@ int main(int argc, char **argv) {
     optionsParser.addOptionFlag("allCoverage", "print histogram of coverage from all genomes to"
                                                " all genomes",
                                 false);
+    optionsParser.addOptionFlag("materialize", "compute the base composition and coverage of every genome"
+                                               " and store them in the hal file, where --baseComp (with a step"
+                                               " of 1) and --coverage will use them until the alignment is modified."
+                                               " Statistics that are still up to date are not recomputed",
+                                false);
+    optionsParser.addOption("numThreads", "number of threads to use for --percentID, --coverage,"
+                                          " --allCoverage and --materialize (0 to use all cores). Only mmap"
+                                          " files can be read by more than one thread",
+                            1);
+    optionsParser.addOption("tileSize", "number of reference bases scanned by one task of --percentID,"
+                                        " --coverage and --allCoverage",
+                            1000000);
 
     string path;
     bool listGenomes;
@@ -133,6 +154,9 @@ int main(int argc, char **argv) {
     string topSegments;
     string bottomSegments;
     bool allCoverage;
+    bool materialize;
+    unsigned numThreads;
+    hal_size_t tileSize;
     try {
         optionsParser.parseOptions(argc, argv);
         path = optionsParser.getArgument<string>("halFile");
@@ -158,6 +182,12 @@ int main(int argc, char **argv) {
         topSegments = optionsParser.getOption<string>("topSegments");
         bottomSegments = optionsParser.getOption<string>("bottomSegments");
         allCoverage = optionsParser.getFlag("allCoverage");
+        materialize = optionsParser.getFlag("materialize");
+        numThreads = optionsParser.getOption<unsigned>("numThreads");
+        tileSize = optionsParser.getOption<hal_size_t>("tileSize");
+        if (tileSize == 0) {
+            throw hal_exception("--tileSize must be greater than 0");
+        }
 
         size_t optCount = listGenomes == true ? 1 : 0;
         if (sequencesFromGenome != "\"\"")
@@ -202,13 +232,15 @@ int main(int argc, char **argv) {
             ++optCount;
         if (allCoverage)
             ++optCount;
+        if (materialize)
+            ++optCount;
         if (optCount > 1) {
             throw hal_exception("--genomes, --sequences, --tree, --span, --spanRoot, "
                                 "--branches, --sequenceStats, --children, --parent, "
                                 "--bedSequences, --root, --numSegments, --baseComp, "
                                 "--genomeMetaData, --chromSizes, --percentID, "
                                 "--coverage,  --topSegments, --bottomSegments, "
-                                "--allCoverage, --metaData "
+                                "--allCoverage, --metaData, --materialize "
                                 "and --branchLength options are exclusive");
         }
     } catch (exception &e) {
@@ -217,6 +249,10 @@ int main(int argc, char **argv) {
         exit(1);
     }
     try {
+        if (materialize) {
+            materializeStats(path, optionsParser, numThreads, tileSize);
+            return 0;
+        }
         AlignmentConstPtr alignment(openHalAlignment(path, &optionsParser));
         // FIXME: why are strings of '""' used for no value instead of empty strings.
         if (listGenomes == true && alignment->getNumGenomes() > 0) {
@@ -252,15 +288,21 @@ int main(int argc, char **argv) {
         } else if (chromSizesFromGenome != "\"\"") {
             printChromSizes(cout, alignment, chromSizesFromGenome);
         } else if (percentID != "\"\"") {
-            printPercentID(cout, alignment, percentID);
+            ThreadAlignments threadAlignments(alignment, path, &optionsParser,
+                                              getReadThreadCount(path, &optionsParser, numThreads));
+            printPercentID(cout, threadAlignments, percentID, tileSize);
         } else if (coverage != "\"\"") {
-            printCoverage(cout, alignment, coverage);
+            ThreadAlignments threadAlignments(alignment, path, &optionsParser,
+                                              getReadThreadCount(path, &optionsParser, numThreads));
+            printCoverage(cout, threadAlignments, coverage, tileSize);
         } else if (topSegments != "\"\"") {
             printSegments(cout, alignment, topSegments, true);
         } else if (bottomSegments != "\"\"") {
             printSegments(cout, alignment, bottomSegments, false);
         } else if (allCoverage) {
-            printAllCoverage(cout, alignment);
+            ThreadAlignments threadAlignments(alignment, path, &optionsParser,
+                                              getReadThreadCount(path, &optionsParser, numThreads));
+            printAllCoverage(cout, threadAlignments, tileSize);
         } else if (metaData) {
             printAlignmentPtrMetaData(cout, alignment);
         } else {
@@ -444,28 +486,9 @@ void printNumSegments(ostream &os, AlignmentConstPtr alignment, const string &ge
     os << genome->getNumTopSegments() << " " << genome->getNumBottomSegments() << endl;
 }
 
-void printBaseComp(ostream &os, AlignmentConstPtr alignment, const string &baseCompPair) {
-    string genomeName;
-    hal_size_t step = 0;
-    vector<string> tokens = chopString(baseCompPair, ",");
-    if (tokens.size() == 2) {
-        genomeName = tokens[0];
-        stringstream ss(tokens[1]);
-        ss >> step;
-    }
-    if (step == 0) {
-        throw hal_exception("Invalid value for --baseComp: " + baseCompPair + ".  Must be of" + " format genomeName,step");
-    }
-
-    const Genome *genome = alignment->openGenome(genomeName);
-    if (genome == NULL) {
-        throw hal_exception(string("Genome ") + genomeName + " not found.");
-    }
-    hal_size_t numA = 0;
-    hal_size_t numC = 0;
-    hal_size_t numG = 0;
-    hal_size_t numT = 0;
-
+// Count bases of a genome by sampling every step bases.
+static void sampleBaseComp(const Genome *genome, hal_size_t step, hal_size_t &numA, hal_size_t &numC, hal_size_t &numG,
+                           hal_size_t &numT) {
     hal_size_t len = genome->getSequenceLength();
     if (step >= len) {
         step = len - 1;
@@ -496,6 +519,60 @@ void printBaseComp(ostream &os, AlignmentConstPtr alignment, const string &baseC
         }
     }
 
+}
+
+// Count all bases of a genome, as stored by --materialize.
+static string countBaseComp(const Genome *genome) {
+    static const hal_size_t chunkSize = 1000000;
+    hal_size_t counts[4] = {0, 0, 0, 0};
+    hal_size_t len = genome->getSequenceLength();
+    if (len > 0) {
+        DnaIteratorPtr dna = genome->getDnaIterator();
+        vector<uint8_t> codes;
+        for (hal_size_t i = 0; i < len; i += chunkSize) {
+            dna->readCodes(codes, min(chunkSize, len - i));
+            for (size_t j = 0; j < codes.size(); j++) {
+                // low bits of the code: a=0, c=1, g=2, t=3, n=4
+                uint8_t base = codes[j] & 0x7;
+                if (base < 4) {
+                    ++counts[base];
+                }
+            }
+        }
+    }
+    return to_string(counts[0]) + " " + to_string(counts[1]) + " " + to_string(counts[2]) + " " + to_string(counts[3]);
+}
+
+void printBaseComp(ostream &os, AlignmentConstPtr alignment, const string &baseCompPair) {
+    string genomeName;
+    hal_size_t step = 0;
+    vector<string> tokens = chopString(baseCompPair, ",");
+    if (tokens.size() == 2) {
+        genomeName = tokens[0];
+        stringstream ss(tokens[1]);
+        ss >> step;
+    }
+    if (step == 0) {
+        throw hal_exception("Invalid value for --baseComp: " + baseCompPair + ".  Must be of" + " format genomeName,step");
+    }
+
+    const Genome *genome = alignment->openGenome(genomeName);
+    if (genome == NULL) {
+        throw hal_exception(string("Genome ") + genomeName + " not found.");
+    }
+    hal_size_t numA = 0;
+    hal_size_t numC = 0;
+    hal_size_t numG = 0;
+    hal_size_t numT = 0;
+
+    string cachedBaseComp;
+    if (step == 1 && getCachedStat(genome, BASE_COMP_STAT, false, cachedBaseComp)) {
+        // exact counts stored by --materialize
+        istringstream(cachedBaseComp) >> numA >> numC >> numG >> numT;
+    } else {
+        sampleBaseComp(genome, step, numA, numC, numG, numT);
+    }
+
     double total = numA + numC + numG + numT;
     os << (double)numA / total << '\t' << (double)numC / total << '\t' << (double)numG / total << '\t' << (double)numT / total
        << '\n';
@@ -537,86 +614,92 @@ void printChromSizes(ostream &os, AlignmentConstPtr alignment, const string &gen
     }
 }
 
-void printPercentID(ostream &os, AlignmentConstPtr alignment, const string &genomeName) {
-    const Genome *refGenome = alignment->openGenome(genomeName);
-    if (!refGenome) {
-        throw hal_exception("Genome " + genomeName + " does not exist.");
+// Get the genome of the main alignment with the same name as a genome
+// opened from one of the per-thread alignments, so that results from all
+// threads are keyed (and ordered) the same way as in a serial run.
+static const Genome *mainGenome(AlignmentConstPtr alignment, const Genome *genome) {
+    if (genome->getAlignment() == alignment.get()) {
+        return genome;
     }
+    return alignment->openGenome(genome->getName());
+}
+
+// Get the position of the current column of a column iterator in genome
+// coordinates.
+static hal_index_t columnPosition(ColumnIteratorPtr colIt) {
+    return colIt->getReferenceSequencePosition() + colIt->getReferenceSequence()->getStartPosition();
+}
 
-    ColumnIteratorPtr colIt = refGenome->getColumnIterator();
-    // A bit sloppy, but a mapping from genome to (# identical bases, # aligned sites)
-    // The # of aligned sites is necessary since a) not all sites are aligned and
-    // b) we don't consider anything containing N's to be aligned.
-    map<const Genome *, pair<hal_size_t *, hal_size_t *>> genomeStats;
+// Add count to the first depth entries of a coverage histogram.
+static void addCoverage(vector<hal_size_t> &histogram, hal_size_t depth, hal_size_t count) {
+    if (histogram.size() < depth) {
+        histogram.resize(depth, 0);
+    }
+    for (hal_size_t i = 0; i < depth; i++) {
+        histogram[i] += count;
+    }
+}
+
+// Add a histogram computed by one thread to the merged histogram.
+static void mergeHistogram(vector<hal_size_t> &histogram, const vector<hal_size_t> &threadHistogram) {
+    if (histogram.size() < threadHistogram.size()) {
+        histogram.resize(threadHistogram.size(), 0);
+    }
+    for (hal_size_t i = 0; i < threadHistogram.size(); i++) {
+        histogram[i] += threadHistogram[i];
+    }
+}
+
+// mapping from genome to (# identical bases, # aligned sites)
+// The # of aligned sites is necessary since a) not all sites are aligned and
+// b) we don't consider anything containing N's to be aligned.
+typedef map<const Genome *, pair<hal_size_t, hal_size_t>> PercentIDStats;
+
+// Accumulate % ID statistics for the columns of the reference genome
+// in [start, end).
+static void percentIDTile(const Genome *refGenome, hal_index_t start, hal_index_t end, PercentIDStats &genomeStats) {
+    ColumnIteratorPtr colIt = refGenome->getColumnIterator(NULL, 0, start, end - 1);
+    DnaIteratorPtr refDnaIt = refGenome->getDnaIterator(start);
+    PercentIDStats tempGenomeStats;
     while (1) {
         // Get DNA for this site in reference
-        DnaIteratorPtr refDnaIt = refGenome->getDnaIterator(colIt->getReferenceSequencePosition() +
-                                                            colIt->getReferenceSequence()->getStartPosition());
+        refDnaIt->jumpTo(columnPosition(colIt));
         char refDna = fastUpper(refDnaIt->getBase());
-
-        const ColumnIterator::ColumnMap *cmap = colIt->getColumnMap();
-        map<const Genome *, pair<hal_size_t *, hal_size_t *>> tempGenomeStats;
-        for (ColumnIterator::ColumnMap::const_iterator colMapIt = cmap->begin(); colMapIt != cmap->end(); colMapIt++) {
-            if (colMapIt->second->empty()) {
-                // There are empty entries in the column map.
-                continue;
-            }
-            const Genome *genome = colMapIt->first->getGenome();
-            const ColumnIterator::DNASet *dnaSet = colMapIt->second;
-            assert(dnaSet->size() == 1);
-            for (hal_size_t i = 0; i < dnaSet->size(); i++) {
-                DnaIteratorPtr dnaIt = dnaSet->at(i);
-                char otherDna = fastUpper(dnaIt->getBase());
-                if (refDna != 'N' && otherDna != 'N') {
-                    if (!tempGenomeStats.count(genome)) {
-                        // initialize the map for this genome if necessary.
-                        tempGenomeStats[genome] = make_pair(new hal_size_t, new hal_size_t);
-                        *tempGenomeStats[genome].first = 0;
-                        *tempGenomeStats[genome].second = 0;
-                    }
-                    hal_size_t *tempNumID = tempGenomeStats[genome].first;
-                    hal_size_t *tempNumSites = tempGenomeStats[genome].second;
-                    if (refDna == otherDna) {
-                        (*tempNumID)++;
+        if (refDna != 'N') {
+            const ColumnIterator::ColumnMap *cmap = colIt->getColumnMap();
+            tempGenomeStats.clear();
+            for (ColumnIterator::ColumnMap::const_iterator colMapIt = cmap->begin(); colMapIt != cmap->end(); colMapIt++) {
+                // There are empty entries in the column map, which are skipped
+                // by the loop.
+                const Genome *genome = colMapIt->first->getGenome();
+                const ColumnIterator::DNASet *dnaSet = colMapIt->second;
+                for (hal_size_t i = 0; i < dnaSet->size(); i++) {
+                    char otherDna = fastUpper(dnaSet->at(i)->getBase());
+                    if (otherDna != 'N') {
+                        pair<hal_size_t, hal_size_t> &tempStats = tempGenomeStats[genome];
+                        if (refDna == otherDna) {
+                            tempStats.first++;
+                        }
+                        tempStats.second++;
                     }
-                    (*tempNumSites)++;
                 }
             }
-        }
-        if (refDna != 'N' && *tempGenomeStats[refGenome].second == 1) {
-            // If there isn't a duplication in the reference then we count
-            // this column.
-            for (map<const Genome *, pair<hal_size_t *, hal_size_t *>>::iterator it = tempGenomeStats.begin();
-                 it != tempGenomeStats.end(); it++) {
-                const Genome *genome = it->first;
-                if (!genomeStats.count(genome)) {
-                    // initialize the map for this genome if necessary.
-                    genomeStats[genome] = make_pair(new hal_size_t, new hal_size_t);
-                    *genomeStats[genome].first = 0;
-                    *genomeStats[genome].second = 0;
-                }
-                hal_size_t *tempNumID = it->second.first;
-                hal_size_t *tempNumSites = it->second.second;
-                if (*tempNumSites == 1) {
-                    // only count for the ID ratio if there's only 1 site for
-                    // this genome in the column.
-                    hal_size_t *numID = genomeStats[genome].first;
-                    hal_size_t *numSites = genomeStats[genome].second;
-                    assert(*tempNumID == 1 || *tempNumID == 0);
-                    assert(*tempNumSites == 1);
-                    if (*tempNumID == 1) {
-                        (*numID)++;
+            PercentIDStats::const_iterator refIt = tempGenomeStats.find(refGenome);
+            if (refIt != tempGenomeStats.end() && refIt->second.second == 1) {
+                // If there isn't a duplication in the reference then we count
+                // this column.
+                for (PercentIDStats::const_iterator it = tempGenomeStats.begin(); it != tempGenomeStats.end(); it++) {
+                    pair<hal_size_t, hal_size_t> &stats = genomeStats[it->first];
+                    if (it->second.second == 1) {
+                        // only count for the ID ratio if there's only 1 site for
+                        // this genome in the column.
+                        assert(it->second.first == 1 || it->second.first == 0);
+                        stats.first += it->second.first;
+                        stats.second++;
                     }
-                    (*numSites)++;
                 }
             }
         }
-        // clean up temporary counts.
-        for (map<const Genome *, pair<hal_size_t *, hal_size_t *>>::iterator it = tempGenomeStats.begin();
-             it != tempGenomeStats.end(); it++) {
-            delete it->second.first;
-            delete it->second.second;
-        }
         if (colIt->getReferenceSequencePosition() % 1000 == 0) {
             colIt->defragment();
         }
@@ -626,60 +709,77 @@ void printPercentID(ostream &os, AlignmentConstPtr alignment, const string &geno
         }
         colIt->toRight();
     }
-    os << "Genome, % ID, numID, numSites" << endl;
-    for (map<const Genome *, pair<hal_size_t *, hal_size_t *>>::iterator statsIt = genomeStats.begin();
-         statsIt != genomeStats.end(); statsIt++) {
-        string name = statsIt->first->getName();
-        hal_size_t numID = *statsIt->second.first;
-        hal_size_t numSites = *statsIt->second.second;
-        os << name << ", " << ((double)numID) / numSites << ", " << numID << ", " << numSites << endl;
-        delete statsIt->second.first;
-        delete statsIt->second.second;
-    }
 }
 
-void printCoverage(ostream &os, AlignmentConstPtr alignment, const string &genomeName) {
+void printPercentID(ostream &os, const ThreadAlignments &threadAlignments, const string &genomeName, hal_size_t tileSize) {
+    AlignmentConstPtr alignment = threadAlignments.get(0);
     const Genome *refGenome = alignment->openGenome(genomeName);
     if (!refGenome) {
         throw hal_exception("Genome " + genomeName + " does not exist.");
     }
 
-    ColumnIteratorPtr colIt = refGenome->getColumnIterator(NULL, 0, 0, NULL_INDEX, false, false, false, true);
-    map<const Genome *, vector<hal_size_t> *> histograms;
+    // Columns are scanned in tiles of the reference, each thread summing
+    // the columns of its tiles, then the per-thread sums are added up.
+    vector<pair<hal_index_t, hal_index_t>> tiles = makeTiles(refGenome->getSequenceLength(), tileSize);
+    vector<PercentIDStats> threadStats(threadAlignments.size());
+    parallelFor(tiles.size(), threadAlignments.size(), [&](size_t tileIdx, unsigned threadIdx) {
+        const Genome *threadRefGenome = threadAlignments.get(threadIdx)->openGenome(genomeName);
+        percentIDTile(threadRefGenome, tiles[tileIdx].first, tiles[tileIdx].second, threadStats[threadIdx]);
+    });
+
+    PercentIDStats genomeStats;
+    for (size_t threadIdx = 0; threadIdx < threadStats.size(); threadIdx++) {
+        for (PercentIDStats::const_iterator it = threadStats[threadIdx].begin(); it != threadStats[threadIdx].end(); it++) {
+            pair<hal_size_t, hal_size_t> &stats = genomeStats[mainGenome(alignment, it->first)];
+            stats.first += it->second.first;
+            stats.second += it->second.second;
+        }
+    }
+
+    os << "Genome, % ID, numID, numSites" << endl;
+    for (PercentIDStats::const_iterator statsIt = genomeStats.begin(); statsIt != genomeStats.end(); statsIt++) {
+        string name = statsIt->first->getName();
+        hal_size_t numID = statsIt->second.first;
+        hal_size_t numSites = statsIt->second.second;
+        os << name << ", " << ((double)numID) / numSites << ", " << numID << ", " << numSites << endl;
+    }
+}
+
+typedef map<const Genome *, vector<hal_size_t>> CoverageHistograms;
+
+// Accumulate coverage histograms for the columns of the reference genome
+// in [start, end).
+static void coverageTile(const Genome *refGenome, hal_index_t start, hal_index_t end, CoverageHistograms &histograms) {
+    ColumnIteratorPtr colIt = refGenome->getColumnIterator(NULL, 0, start, end - 1);
+    // Temporary collecting of per-genome sites mapped, since it's
+    // organized in the column map by sequence, not genome.
+    map<const Genome *, hal_size_t> numSitesMapped;
     while (1) {
+        hal_index_t refPos = columnPosition(colIt);
         const ColumnIterator::ColumnMap *cmap = colIt->getColumnMap();
-        // Temporary collecting of per-genome sites mapped, since it's
-        // organized in the column map by sequence, not genome.
-        map<const Genome *, hal_size_t> numSitesMapped;
+        numSitesMapped.clear();
+        // A column with several reference sites is only counted at its
+        // leftmost reference site, wherever the tile boundaries fall.
+        bool firstVisit = true;
         for (ColumnIterator::ColumnMap::const_iterator colMapIt = cmap->begin(); colMapIt != cmap->end(); colMapIt++) {
-            if (colMapIt->second->empty()) {
-                // There are empty entries in the column map.
-                continue;
-            }
             const Genome *genome = colMapIt->first->getGenome();
-            if (genome->getNumChildren() == 0 || genome == refGenome) {
+            const ColumnIterator::DNASet *dnaSet = colMapIt->second;
+            if (genome == refGenome) {
+                for (hal_size_t i = 0; i < dnaSet->size(); i++) {
+                    firstVisit = firstVisit && dnaSet->at(i)->getArrayIndex() >= refPos;
+                }
+            }
+            if (!dnaSet->empty() && (genome->getNumChildren() == 0 || genome == refGenome)) {
                 // We only care about coverage from leaf genomes, but if
                 // the reference is an ancestor we need to keep track of its
                 // coverage too.
-                if (!numSitesMapped.count(genome)) {
-                    // Initialize map entry
-                    numSitesMapped[genome] = 0;
-                }
-                const ColumnIterator::DNASet *dnaSet = colMapIt->second;
-                numSitesMapped[genome] = numSitesMapped[genome] + dnaSet->size();
+                numSitesMapped[genome] += dnaSet->size();
             }
         }
-        for (map<const Genome *, hal_size_t>::const_iterator it = numSitesMapped.begin(); it != numSitesMapped.end(); it++) {
-            if (!histograms.count(it->first)) {
-                // Initialize map
-                histograms[it->first] = new vector<hal_size_t>;
-            }
-            vector<hal_size_t> *histogram = histograms[it->first];
-            if (histogram->size() < it->second) {
-                histogram->resize(it->second, 0);
-            }
-            for (hal_size_t i = 0; i < it->second; i++) {
-                (*histogram)[i] = histogram->at(i) + numSitesMapped[refGenome];
+        if (firstVisit) {
+            hal_size_t numRefSites = numSitesMapped[refGenome];
+            for (map<const Genome *, hal_size_t>::const_iterator it = numSitesMapped.begin(); it != numSitesMapped.end(); it++) {
+                addCoverage(histograms[it->first], it->second, numRefSites);
             }
         }
         if (colIt->getReferenceSequencePosition() % 1000 == 0) {
@@ -691,12 +791,32 @@ void printCoverage(ostream &os, AlignmentConstPtr alignment, const string &genom
         }
         colIt->toRight();
     }
+}
+
+// Compute the coverage histograms of a genome, ignoring any stored by
+// --materialize.
+static void computeCoverage(ostream &os, const ThreadAlignments &threadAlignments, const Genome *refGenome,
+                            hal_size_t tileSize) {
+    const string &genomeName = refGenome->getName();
+
+    vector<pair<hal_index_t, hal_index_t>> tiles = makeTiles(refGenome->getSequenceLength(), tileSize);
+    vector<CoverageHistograms> threadHistograms(threadAlignments.size());
+    parallelFor(tiles.size(), threadAlignments.size(), [&](size_t tileIdx, unsigned threadIdx) {
+        const Genome *threadRefGenome = threadAlignments.get(threadIdx)->openGenome(genomeName);
+        coverageTile(threadRefGenome, tiles[tileIdx].first, tiles[tileIdx].second, threadHistograms[threadIdx]);
+    });
+
+    // Rows are sorted by genome name so that the output doesn't depend on
+    // the order the genomes were opened in, and can be stored by
+    // --materialize.
+    map<string, vector<hal_size_t>> histograms;
     hal_size_t maxHistLength = 0;
-    for (map<const Genome *, vector<hal_size_t> *>::iterator histIt = histograms.begin(); histIt != histograms.end();
-         histIt++) {
-        vector<hal_size_t> *histogram = histIt->second;
-        if (histogram->size() > maxHistLength) {
-            maxHistLength = histogram->size();
+    for (size_t threadIdx = 0; threadIdx < threadHistograms.size(); threadIdx++) {
+        for (CoverageHistograms::const_iterator histIt = threadHistograms[threadIdx].begin();
+             histIt != threadHistograms[threadIdx].end(); histIt++) {
+            vector<hal_size_t> &histogram = histograms[histIt->first->getName()];
+            mergeHistogram(histogram, histIt->second);
+            maxHistLength = max(maxHistLength, (hal_size_t)histogram.size());
         }
     }
 
@@ -705,14 +825,13 @@ void printCoverage(ostream &os, AlignmentConstPtr alignment, const string &genom
         os << ", sitesCovered" << i + 1 << "Times";
     }
     os << endl;
-    for (map<const Genome *, vector<hal_size_t> *>::iterator histIt = histograms.begin(); histIt != histograms.end();
+    for (map<string, vector<hal_size_t>>::const_iterator histIt = histograms.begin(); histIt != histograms.end();
          histIt++) {
-        string name = histIt->first->getName();
-        os << name;
-        vector<hal_size_t> *histogram = histIt->second;
+        os << histIt->first;
+        const vector<hal_size_t> &histogram = histIt->second;
         for (hal_size_t i = 0; i < maxHistLength; i++) {
-            if (i < histogram->size()) {
-                os << ", " << histogram->at(i);
+            if (i < histogram.size()) {
+                os << ", " << histogram.at(i);
             } else {
                 os << ", " << 0;
             }
@@ -747,37 +866,56 @@ static void printSegments(ostream &os, AlignmentConstPtr alignment, const string
     }
 }
 
-// Print coverage for all leaves vs. all leaves efficiently.
-static void printAllCoverage(ostream &os, AlignmentConstPtr alignment) {
-    vector<const Genome *> leafGenomes = getLeafGenomes(alignment.get());
-    ColumnIterator::VisitCache visitCache;
-    map<pair<const Genome *, const Genome *>, vector<hal_size_t> *> histograms;
-    for (hal_size_t i = 0; i < leafGenomes.size(); i++) {
-        const Genome *genome = leafGenomes[i];
-        // Follow paralogies, but ignore ancestors.
-        ColumnIteratorPtr colIt = genome->getColumnIterator(NULL, 0, 0, NULL_INDEX, false, true, false, true);
-        colIt->setVisitCache(&visitCache);
-        // So that we don't accidentally visit the first column if it's
-        // already been visited.
-        colIt->toSite(0, genome->getSequenceLength() - 1);
-        while (1) {
-            const ColumnIterator::ColumnMap *cmap = colIt->getColumnMap();
-            // Temporary collecting of per-genome sites mapped, since it's
-            // organized in the column map by sequence, not genome.
-            map<const Genome *, hal_size_t> numSitesMapped;
-            for (ColumnIterator::ColumnMap::const_iterator colMapIt = cmap->begin(); colMapIt != cmap->end(); colMapIt++) {
-                if (colMapIt->second->empty()) {
-                    // There are empty entries in the column map.
-                    continue;
-                }
-                const Genome *genome = colMapIt->first->getGenome();
-                if (!numSitesMapped.count(genome)) {
-                    // Initialize map entry
-                    numSitesMapped[genome] = 0;
+void printCoverage(ostream &os, const ThreadAlignments &threadAlignments, const string &genomeName, hal_size_t tileSize) {
+    const Genome *refGenome = threadAlignments.get(0)->openGenome(genomeName);
+    if (!refGenome) {
+        throw hal_exception("Genome " + genomeName + " does not exist.");
+    }
+    string cachedCoverage;
+    if (getCachedStat(refGenome, COVERAGE_STAT, true, cachedCoverage)) {
+        os << cachedCoverage;
+    } else {
+        computeCoverage(os, threadAlignments, refGenome, tileSize);
+    }
+}
+
+typedef map<pair<const Genome *, const Genome *>, vector<hal_size_t>> PairCoverageHistograms;
+
+// Accumulate the all-vs-all coverage histograms for the columns of leaf
+// genome in [start, end).  Each column is counted once overall: from the
+// first leaf genome (in leafRanks order) that it contains, at that genome's
+// leftmost site in the column.
+static void allCoverageTile(const Genome *genome, const map<const Genome *, size_t> &leafRanks, hal_index_t start,
+                            hal_index_t end, PairCoverageHistograms &histograms) {
+    size_t rank = leafRanks.find(genome)->second;
+    // Follow paralogies, but ignore ancestors.
+    ColumnIteratorPtr colIt = genome->getColumnIterator(NULL, 0, start, end - 1, false, true);
+    // Temporary collecting of per-genome sites mapped, since it's
+    // organized in the column map by sequence, not genome.
+    map<const Genome *, hal_size_t> numSitesMapped;
+    while (1) {
+        hal_index_t refPos = columnPosition(colIt);
+        const ColumnIterator::ColumnMap *cmap = colIt->getColumnMap();
+        numSitesMapped.clear();
+        bool firstVisit = true;
+        for (ColumnIterator::ColumnMap::const_iterator colMapIt = cmap->begin(); colMapIt != cmap->end() && firstVisit;
+             colMapIt++) {
+            const ColumnIterator::DNASet *dnaSet = colMapIt->second;
+            if (dnaSet->empty()) {
+                // There are empty entries in the column map.
+                continue;
+            }
+            const Genome *otherGenome = colMapIt->first->getGenome();
+            if (otherGenome == genome) {
+                for (hal_size_t i = 0; i < dnaSet->size(); i++) {
+                    firstVisit = firstVisit && dnaSet->at(i)->getArrayIndex() >= refPos;
                 }
-                const ColumnIterator::DNASet *dnaSet = colMapIt->second;
-                numSitesMapped[genome] = numSitesMapped[genome] + dnaSet->size();
+            } else {
+                firstVisit = leafRanks.find(otherGenome)->second > rank;
             }
+            numSitesMapped[otherGenome] += dnaSet->size();
+        }
+        if (firstVisit) {
             // O(n^2) in the number of genomes in the column -- doesn't seem
             // like there is a better way, since coverage isn't quite
             // symmetric.
@@ -785,43 +923,66 @@ static void printAllCoverage(ostream &os, AlignmentConstPtr alignment) {
                  it++) {
                 for (map<const Genome *, hal_size_t>::const_iterator it2 = numSitesMapped.begin(); it2 != numSitesMapped.end();
                      it2++) {
-                    pair<const Genome *, const Genome *> key = make_pair(it->first, it2->first);
-                    if (!histograms.count(key)) {
-                        // Initialize map
-                        histograms[key] = new vector<hal_size_t>;
-                    }
-                    vector<hal_size_t> *histogram = histograms[key];
-                    if (histogram->size() < it2->second) {
-                        histogram->resize(it2->second, 0);
-                    }
-                    for (hal_size_t i = 0; i < it2->second; i++) {
-                        (*histogram)[i] = histogram->at(i) + numSitesMapped[it->first];
-                    }
+                    addCoverage(histograms[make_pair(it->first, it2->first)], it2->second, it->second);
                 }
             }
-            if (colIt->getReferenceSequencePosition() % 1000 == 0) {
-                colIt->defragment();
-            }
-            if (colIt->lastColumn()) {
-                // Break here--the column iterator will crash if we try to go further.
-                break;
-            }
-            colIt->toRight();
         }
-        // Copy over the updated visit cache information so we can supply it to the next genome.
-        visitCache.clear();
-        ColumnIterator::VisitCache *newVisitCache = colIt->getVisitCache();
-        for (ColumnIterator::VisitCache::iterator it = newVisitCache->begin(); it != newVisitCache->end(); it++) {
-            visitCache[it->first] = new PositionCache(*it->second);
+        if (colIt->getReferenceSequencePosition() % 1000 == 0) {
+            colIt->defragment();
         }
+        if (colIt->lastColumn()) {
+            // Break here--the column iterator will crash if we try to go further.
+            break;
+        }
+        colIt->toRight();
     }
+}
 
+// Print coverage for all leaves vs. all leaves efficiently.
+static void printAllCoverage(ostream &os, const ThreadAlignments &threadAlignments, hal_size_t tileSize) {
+    AlignmentConstPtr alignment = threadAlignments.get(0);
+    vector<const Genome *> leafGenomes = getLeafGenomes(alignment.get());
+
+    // one task per tile of each leaf genome
+    struct LeafTile {
+        size_t leafIdx;
+        hal_index_t start;
+        hal_index_t end;
+    };
+    vector<LeafTile> leafTiles;
+    for (size_t i = 0; i < leafGenomes.size(); i++) {
+        vector<pair<hal_index_t, hal_index_t>> tiles = makeTiles(leafGenomes[i]->getSequenceLength(), tileSize);
+        for (size_t j = 0; j < tiles.size(); j++) {
+            leafTiles.push_back({i, tiles[j].first, tiles[j].second});
+        }
+    }
+
+    // per-thread leaf genomes and their ranks, looked up on first use
+    vector<vector<const Genome *>> threadLeafGenomes(threadAlignments.size());
+    vector<map<const Genome *, size_t>> threadLeafRanks(threadAlignments.size());
+    vector<PairCoverageHistograms> threadHistograms(threadAlignments.size());
+    parallelFor(leafTiles.size(), threadAlignments.size(), [&](size_t taskIdx, unsigned threadIdx) {
+        if (threadLeafGenomes[threadIdx].empty()) {
+            threadLeafGenomes[threadIdx] = getLeafGenomes(threadAlignments.get(threadIdx).get());
+            for (size_t i = 0; i < threadLeafGenomes[threadIdx].size(); i++) {
+                threadLeafRanks[threadIdx][threadLeafGenomes[threadIdx][i]] = i;
+            }
+        }
+        const LeafTile &leafTile = leafTiles[taskIdx];
+        allCoverageTile(threadLeafGenomes[threadIdx][leafTile.leafIdx], threadLeafRanks[threadIdx], leafTile.start,
+                        leafTile.end, threadHistograms[threadIdx]);
+    });
+
+    PairCoverageHistograms histograms;
     hal_size_t maxHistLength = 0;
-    for (map<pair<const Genome *, const Genome *>, vector<hal_size_t> *>::iterator histIt = histograms.begin();
-         histIt != histograms.end(); histIt++) {
-        vector<hal_size_t> *histogram = histIt->second;
-        if (histogram->size() > maxHistLength) {
-            maxHistLength = histogram->size();
+    for (size_t threadIdx = 0; threadIdx < threadHistograms.size(); threadIdx++) {
+        for (PairCoverageHistograms::const_iterator histIt = threadHistograms[threadIdx].begin();
+             histIt != threadHistograms[threadIdx].end(); histIt++) {
+            pair<const Genome *, const Genome *> key =
+                make_pair(mainGenome(alignment, histIt->first.first), mainGenome(alignment, histIt->first.second));
+            vector<hal_size_t> &histogram = histograms[key];
+            mergeHistogram(histogram, histIt->second);
+            maxHistLength = max(maxHistLength, (hal_size_t)histogram.size());
         }
     }
 
@@ -830,16 +991,15 @@ static void printAllCoverage(ostream &os, AlignmentConstPtr alignment) {
         os << ", sitesCovered" << i + 1 << "Times";
     }
     os << endl;
-    for (map<pair<const Genome *, const Genome *>, vector<hal_size_t> *>::iterator histIt = histograms.begin();
-         histIt != histograms.end(); histIt++) {
+    for (PairCoverageHistograms::const_iterator histIt = histograms.begin(); histIt != histograms.end(); histIt++) {
         string fromName = histIt->first.second->getName();
         string toName = histIt->first.first->getName();
         os << fromName;
         os << ", " << toName;
-        vector<hal_size_t> *histogram = histIt->second;
+        const vector<hal_size_t> &histogram = histIt->second;
         for (hal_size_t i = 0; i < maxHistLength; i++) {
-            if (i < histogram->size()) {
-                os << ", " << histogram->at(i);
+            if (i < histogram.size()) {
+                os << ", " << histogram.at(i);
             } else {
                 os << ", " << 0;
             }
@@ -847,3 +1007,63 @@ static void printAllCoverage(ostream &os, AlignmentConstPtr alignment) {
         os << endl;
     }
 }
+
+// Compute the statistics of every genome that are too slow to compute on
+// demand and store them in the genomes' metadata.  They are computed from
+// read-only handles, which are closed before the file is opened for
+// writing.
+static void materializeStats(const string &path, const CLParser &optionsParser, unsigned numThreads, hal_size_t tileSize) {
+    vector<string> genomeNames;
+    // empty if the stored value is up to date
+    vector<string> baseComps;
+    vector<string> coverages;
+    {
+        AlignmentConstPtr alignment(openHalAlignment(path, &optionsParser));
+        if (alignment->getNumGenomes() == 0) {
+            return;
+        }
+        ThreadAlignments threadAlignments(alignment, path, &optionsParser,
+                                          getReadThreadCount(path, &optionsParser, numThreads));
+        const Genome *root = alignment->openGenome(alignment->getRootName());
+        set<const Genome *> genomes;
+        getGenomesInSubTree(root, genomes);
+        genomes.insert(root);
+        for (set<const Genome *>::const_iterator i = genomes.begin(); i != genomes.end(); ++i) {
+            genomeNames.push_back((*i)->getName());
+        }
+        baseComps.resize(genomeNames.size());
+        coverages.resize(genomeNames.size());
+
+        parallelFor(genomeNames.size(), threadAlignments.size(), [&](size_t genomeIdx, unsigned threadIdx) {
+            const Genome *genome = threadAlignments.get(threadIdx)->openGenome(genomeNames[genomeIdx]);
+            string cached;
+            if (!getCachedStat(genome, BASE_COMP_STAT, false, cached)) {
+                baseComps[genomeIdx] = countBaseComp(genome);
+            }
+        });
+        for (size_t i = 0; i < genomeNames.size(); i++) {
+            const Genome *genome = alignment->openGenome(genomeNames[i]);
+            string cached;
+            if (!getCachedStat(genome, COVERAGE_STAT, true, cached)) {
+                ostringstream coverageStream;
+                computeCoverage(coverageStream, threadAlignments, genome, tileSize);
+                coverages[i] = coverageStream.str();
+            }
+        }
+    }
+
+    // the write options are left out of the help of the other modes, so
+    // the file is reopened for writing with their defaults
+    CLParser writeOptions(WRITE_ACCESS);
+    AlignmentPtr alignment(openHalAlignment(path, &writeOptions, READ_ACCESS | WRITE_ACCESS));
+    for (size_t i = 0; i < genomeNames.size(); i++) {
+        Genome *genome = alignment->openGenome(genomeNames[i]);
+        if (!baseComps[i].empty()) {
+            setCachedStat(genome, BASE_COMP_STAT, baseComps[i], false);
+        }
+        if (!coverages[i].empty()) {
+            setCachedStat(genome, COVERAGE_STAT, coverages[i], true);
+        }
+    }
+    alignment->close();
+}
@@ -5,87 +5,353 @@
  */
 
 #include "hal2psl.h"
+#include "halBlockMapper.h"
+#include "halSegmentMapper.h"
 #include "psl.h"
+#include <algorithm>
+#include <cassert>
+#include <limits>
 
+using namespace std;
 using namespace hal;
 
-void Hal2Psl::storePslResults(std::vector<PslBlock> &pslBlocks) {
-
-    BedList::iterator i = _outBedLines.begin();
-    for (; i != _outBedLines.end(); ++i) {
-        i->_extra.clear();  // not valid in PSLs
-        makeUpPsl(i->_psl, i->_blocks, i->_strand, i->_start, i->_chrName, pslBlocks);
+namespace {
+    void appendNumber(string &buffer, hal_index_t value) {
+        char digits[24];
+        char *end = digits + sizeof(digits);
+        char *p = end;
+        bool negative = value < 0;
+        hal_size_t v = negative ? -(hal_size_t)value : (hal_size_t)value;
+        do {
+            *--p = '0' + (v % 10);
+            v /= 10;
+        } while (v != 0);
+        if (negative) {
+            *--p = '-';
+        }
+        buffer.append(p, end - p);
     }
 }
-std::vector<PslBlock> Hal2Psl::convert2psl(AlignmentConstPtr alignment, const Genome *srcGenome, const Genome *tgtGenome,
-                                           const std::string srcChrom) {
 
-    std::vector<PslBlock> pslBlocks;
-    if (srcGenome->getNumSequences() > 0) {
+Hal2Psl::Hal2Psl() : BlockLiftover() {
+    _coalescenceLimit = NULL;
+    _traverseDupes = true;
+    _outPSL = true;
+}
+
+// The paths used to map segments only depend on the pair of genomes, so
+// they are computed once and reused for all their sequences.
+void Hal2Psl::setGenomes(const Genome *srcGenome, const Genome *tgtGenome) {
+    if (srcGenome != _srcGenome || tgtGenome != _tgtGenome) {
         _srcGenome = srcGenome;
         _tgtGenome = tgtGenome;
         _coalescenceLimit = NULL;
-        _traverseDupes = true;
-        _missedSet.clear();
-        _tgtSet.clear();
-        _tgtSet.insert(tgtGenome);
-        for (SequenceIteratorPtr seqIt = srcGenome->getSequenceIterator(); not seqIt->atEnd(); seqIt->toNext()) {
-            _outBedLines.clear();
-            _srcSequence = seqIt->getSequence();
-            auto chrName = _srcSequence->getName();
-            if (srcChrom != "\"\"" && srcChrom != chrName) {
-                continue;
+        _downwardPath.clear();
+        visitBegin();
+    }
+}
+
+void Hal2Psl::convertSequence(const Genome *srcGenome, const Sequence *srcSequence, const Genome *tgtGenome,
+                              bool countMatches, vector<PslRecord> &records) {
+    setGenomes(srcGenome, tgtGenome);
+    _srcSequence = srcSequence;
+    _blocks.clear();
+    if (srcSequence->getSequenceLength() > 0) {
+        mapSequence(countMatches);
+    }
+    if (!_blocks.empty()) {
+        assignBlocksToRecords(records);
+    }
+}
+
+// Map the segments of the whole source sequence (like
+// BlockLiftover::liftInterval, but making MappedBlocks instead of BedLines)
+void Hal2Psl::mapSequence(bool countMatches) {
+    _mappedSegments.clear();
+    hal_index_t globalStart = _srcSequence->getStartPosition();
+    hal_index_t globalEnd = globalStart + (hal_index_t)_srcSequence->getSequenceLength() - 1;
+
+    _refSeg->toSite(globalStart, false);
+    hal_offset_t startOffset = globalStart - _refSeg->getStartPosition();
+    hal_offset_t endOffset = 0;
+    if (globalEnd <= _refSeg->getEndPosition()) {
+        endOffset = _refSeg->getEndPosition() - globalEnd;
+    }
+    _refSeg->slice(startOffset, endOffset);
+
+    while (_refSeg->getArrayIndex() < _lastIndex && _refSeg->getStartPosition() <= globalEnd) {
+        halMapSegment(_refSeg.get(), _mappedSegments, _tgtGenome, &_downwardPath, _traverseDupes, 0, _coalescenceLimit, _mrca);
+        _refSeg->toRight(globalEnd);
+    }
+
+    MappedSegmentSet emptySet;
+    set<hal_index_t> queryCutSet;
+    set<hal_index_t> targetCutSet;
+    for (MappedSegmentSet::iterator i = _mappedSegments.begin(); i != _mappedSegments.end(); ++i) {
+        BlockMapper::extractSegment(i, emptySet, _fragments, &_mappedSegments, targetCutSet, queryCutSet);
+        if (_fragments.empty()) {
+            continue;
+        }
+        const MappedSegment *front = _fragments.front().get();
+        const MappedSegment *back = _fragments.back().get();
+        hal_index_t tSeqStart = (*i)->getSequence()->getStartPosition();
+        MappedBlock block;
+        block._tSequence = (*i)->getSequence();
+        block._tStart = min(min(front->getStartPosition(), front->getEndPosition()),
+                            min(back->getStartPosition(), back->getEndPosition())) -
+                        tSeqStart;
+        block._tEnd = 1 +
+                      max(max(front->getStartPosition(), front->getEndPosition()),
+                          max(back->getStartPosition(), back->getEndPosition())) -
+                      tSeqStart;
+        block._tStrand = (*i)->getReversed() ? '-' : '+';
+
+        const SlicedSegment *srcFront = front->getSource();
+        const SlicedSegment *srcBack = back->getSource();
+        block._qStart = min(min(srcFront->getStartPosition(), srcFront->getEndPosition()),
+                            min(srcBack->getStartPosition(), srcBack->getEndPosition())) -
+                        _srcSequence->getStartPosition();
+        block._qStrand = srcFront->getReversed() ? '-' : '+';
+        block._matches = 0;
+        block._misMatches = 0;
+        block._repMatches = 0;
+        block._nCount = 0;
+        assert(block._tStart < block._tEnd);
+        if (countMatches) {
+            this->countMatches(block);
+        }
+        _blocks.push_back(block);
+    }
+}
+
+void Hal2Psl::countMatches(MappedBlock &block) {
+    for (size_t i = 0; i < _fragments.size(); ++i) {
+        _fragments[i]->getSource()->getString(_qBuf);
+        _fragments[i]->getString(_tBuf);
+        for (size_t j = 0; j < _qBuf.length(); ++j) {
+            if (_qBuf[j] == _tBuf[j]) {
+                if (!isMasked(_qBuf[j]) && !isMasked(_tBuf[j])) {
+                    ++block._matches;
+                } else {
+                    ++block._repMatches;
+                }
+            } else if (isMissingData(_tBuf[j])) {
+                ++block._nCount;
+            } else {
+                ++block._misMatches;
             }
-            _bedLine._start = 0;
-            _bedLine._end = _srcSequence->getSequenceLength();
-            _mappedBlocks.clear();
-            _outPSL = true;
-            visitBegin();
-            liftInterval(_mappedBlocks);
-            if (_mappedBlocks.size()) {
-                assignBlocksToIntervals();
+        }
+    }
+}
+
+// Group the blocks, sorted by source position, into records the way
+// Liftover::assignBlocksToIntervals does for PSL output: a record is
+// continued by a block that is not a duplication, maps to the same
+// target sequence and strand, and comes after the record's last block on
+// that strand.
+void Hal2Psl::assignBlocksToRecords(vector<PslRecord> &records) {
+    stable_sort(_blocks.begin(), _blocks.end(),
+                [](const MappedBlock &b1, const MappedBlock &b2) { return b1._qStart < b2._qStart; });
+    size_t firstRecord = records.size();
+    hal_index_t prevSrcBlockEnd = NULL_INDEX;
+    for (size_t i = 0; i < _blocks.size(); ++i) {
+        const MappedBlock &block = _blocks[i];
+        hal_index_t length = block._tEnd - block._tStart;
+        hal_index_t srcBlockEnd = block._qStart + length;
+        bool dupe = block._qStart < prevSrcBlockEnd || (i + 1 < _blocks.size() && _blocks[i + 1]._qStart < srcBlockEnd);
+        if (records.size() == firstRecord || dupe || !compatible(records.back(), block)) {
+            records.push_back(PslRecord());
+            PslRecord &record = records.back();
+            record._matches = 0;
+            record._misMatches = 0;
+            record._repMatches = 0;
+            record._nCount = 0;
+            record._qStrand = block._qStrand;
+            record._tStrand = block._tStrand;
+            record._qSequence = _srcSequence;
+            record._tSequence = block._tSequence;
+            record._tStart = block._tStart;
+            record._tEnd = block._tEnd;
+        }
+        prevSrcBlockEnd = srcBlockEnd;
+        PslRecord &record = records.back();
+        record._tStart = min(record._tStart, block._tStart);
+        record._tEnd = max(record._tEnd, block._tEnd);
+        record._blockSizes.push_back(length);
+        record._qStarts.push_back(block._qStart);
+        record._tStarts.push_back(block._tStart);
+        record._matches += block._matches;
+        record._misMatches += block._misMatches;
+        record._repMatches += block._repMatches;
+        record._nCount += block._nCount;
+    }
+
+    for (size_t r = firstRecord; r < records.size(); ++r) {
+        PslRecord &record = records[r];
+        // blocks must be in ascending order on the target strand
+        if (record._blockSizes.size() > 1) {
+            hal_index_t delta = record._tStarts[1] - (record._tStarts[0] + (hal_index_t)record._blockSizes[0]);
+            if ((record._tStrand == '-' && delta >= 0) || (record._tStrand != '-' && delta < 0)) {
+                reverse(record._blockSizes.begin(), record._blockSizes.end());
+                reverse(record._qStarts.begin(), record._qStarts.end());
+                reverse(record._tStarts.begin(), record._tStarts.end());
             }
-            //_outBedLines.sort(BedLineSrcLess());
-            storePslResults(pslBlocks);
-            cleanResults();
+        }
+        computeInserts(record);
+        record._qStart = numeric_limits<hal_index_t>::max();
+        record._qEnd = 0;
+        for (size_t j = 0; j < record._qStarts.size(); ++j) {
+            record._qStart = min(record._qStart, record._qStarts[j]);
+            record._qEnd = max(record._qEnd, record._qStarts[j] + (hal_index_t)record._blockSizes[j]);
         }
     }
-    return pslBlocks;
 }
 
-void Hal2Psl::makeUpPsl(const std::vector<PSLInfo> &vpsl, const std::vector<BedBlock> &blocks, const char strand,
-                        const hal_index_t start, const std::string chrName, std::vector<PslBlock> &pslBlocks) {
-    assert(vpsl.size() == 1);
-    const PSLInfo &psl = vpsl[0];
+bool Hal2Psl::compatible(const PslRecord &record, const MappedBlock &block) {
+    if (record._tStrand != block._tStrand || record._qStarts.front() == block._qStart ||
+        record._tSequence != block._tSequence) {
+        return false;
+    }
+    hal_index_t lastStart = record._tStarts.back();
+    hal_index_t delta;
+    if (record._tStrand == '-') {
+        delta = lastStart - block._tEnd;
+    } else {
+        delta = block._tStart - (lastStart + (hal_index_t)record._blockSizes.back());
+    }
+    return delta >= 0;
+}
 
-    for (size_t i = 0; i < blocks.size(); ++i) {
-        PslBlock b = PslBlock();
-        b.size = blocks[i]._length;
-        b.qName = psl._qSeqName;
-        b.qSize = psl._qSeqSize;
+// Same counts as Liftover::computePSLInserts
+void Hal2Psl::computeInserts(PslRecord &record) {
+    record._qNumInsert = 0;
+    record._qBaseInsert = 0;
+    record._tNumInsert = 0;
+    record._tBaseInsert = 0;
+    bool tReversed = record._tStrand == '-';
+    bool qReversed = record._qStrand == '-';
+    for (size_t cur = 1; cur < record._blockSizes.size(); ++cur) {
+        size_t prev = cur - 1;
+        size_t tNext = tReversed ? prev : cur;
+        size_t tPrev = tReversed ? cur : prev;
+        assert(record._tStarts[tNext] >= record._tStarts[tPrev] + (hal_index_t)record._blockSizes[tPrev]);
+        hal_size_t gap = record._tStarts[tNext] - (record._tStarts[tPrev] + record._blockSizes[tPrev]);
+        if (gap > 0) {
+            ++record._tNumInsert;
+            record._tBaseInsert += gap;
+        }
 
-        b.qStart = psl._qBlockStarts[i] - psl._qChromOffset;
-        b.qEnd = b.qStart + b.size;
-        if (psl._qStrand == '-') {
-            auto posStart = b.qStart;
-            b.qStart = psl._qSeqSize - posStart - b.size;
-            b.qEnd = psl._qSeqSize - posStart;
+        size_t qNext = qReversed ? prev : cur;
+        size_t qPrev = qReversed ? cur : prev;
+        hal_index_t qPrevEnd = record._qStarts[qPrev] + (hal_index_t)record._blockSizes[qPrev];
+        // Duplicated blocks can overlap.
+        gap = record._qStarts[qNext] >= qPrevEnd ? record._qStarts[qNext] - qPrevEnd : 0;
+        if (gap > 0) {
+            ++record._qNumInsert;
+            record._qBaseInsert += gap;
         }
+    }
+}
 
-        b.tStart = blocks[i]._start + start;
-        b.tEnd = b.tStart + b.size;
-        if (strand == '-') {
-            auto posStart = b.tStart;
-            b.tStart = psl._tSeqSize - posStart - b.size;
-            b.tEnd = psl._tSeqSize - posStart;
+vector<PslBlock> Hal2Psl::convert2psl(AlignmentConstPtr alignment, const Genome *srcGenome, const Genome *tgtGenome,
+                                      const string srcChrom) {
+    vector<PslBlock> pslBlocks;
+    vector<PslRecord> records;
+    if (srcChrom != "\"\"") {
+        const Sequence *srcSequence = srcGenome->getSequence(srcChrom);
+        if (srcSequence != NULL) {
+            convertSequence(srcGenome, srcSequence, tgtGenome, false, records);
+        }
+    } else {
+        for (SequenceIteratorPtr seqIt = srcGenome->getSequenceIterator(); not seqIt->atEnd(); seqIt->toNext()) {
+            convertSequence(srcGenome, seqIt->getSequence(), tgtGenome, false, records);
         }
-        std::stringstream ss;
-        ss << psl._qStrand << strand;
-        ss >> b.strand;
-        // b.strand = psl._qStrand+'/'+strand;
-        b.tSize = psl._tSeqSize;
-        b.qSize = psl._qSeqSize;
-        b.tName = chrName;
+    }
+    for (size_t i = 0; i < records.size(); ++i) {
+        makeUpPsl(records[i], pslBlocks);
+    }
+    return pslBlocks;
+}
+
+void Hal2Psl::makeUpPsl(const PslRecord &record, vector<PslBlock> &pslBlocks) {
+    hal_size_t qSize = record._qSequence->getSequenceLength();
+    hal_size_t tSize = record._tSequence->getSequenceLength();
+    string strand;
+    strand += record._qStrand;
+    strand += record._tStrand;
+    for (size_t i = 0; i < record._blockSizes.size(); ++i) {
+        PslBlock b;
+        b.size = record._blockSizes[i];
+        b.qName = record._qSequence->getName();
+        b.qSize = qSize;
+        b.qStart = record._qStarts[i];
+        if (record._qStrand == '-') {
+            b.qStart = qSize - b.qStart - b.size;
+        }
+        b.qEnd = b.qStart + b.size;
+        b.tName = record._tSequence->getName();
+        b.tSize = tSize;
+        b.tStart = record._tStarts[i];
+        if (record._tStrand == '-') {
+            b.tStart = tSize - b.tStart - b.size;
+        }
+        b.tEnd = b.tStart + b.size;
+        b.strand = strand;
         pslBlocks.push_back(b);
     }
 }
+
+void Hal2Psl::writePsl(const PslRecord &record, string &buffer) {
+    hal_size_t qSize = record._qSequence->getSequenceLength();
+    hal_size_t tSize = record._tSequence->getSequenceLength();
+    const hal_size_t counts[] = {record._matches,     record._misMatches,  record._repMatches, record._nCount,
+                                 record._qNumInsert, record._qBaseInsert, record._tNumInsert, record._tBaseInsert};
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        appendNumber(buffer, counts[i]);
+        buffer += '\t';
+    }
+    buffer += record._qStrand;
+    buffer += record._tStrand;
+    buffer += '\t';
+    buffer += record._qSequence->getName();
+    buffer += '\t';
+    appendNumber(buffer, qSize);
+    buffer += '\t';
+    appendNumber(buffer, record._qStart);
+    buffer += '\t';
+    appendNumber(buffer, record._qEnd);
+    buffer += '\t';
+    buffer += record._tSequence->getName();
+    buffer += '\t';
+    appendNumber(buffer, tSize);
+    buffer += '\t';
+    appendNumber(buffer, record._tStart);
+    buffer += '\t';
+    appendNumber(buffer, record._tEnd);
+    buffer += '\t';
+    appendNumber(buffer, record._blockSizes.size());
+    buffer += '\t';
+    for (size_t i = 0; i < record._blockSizes.size(); ++i) {
+        appendNumber(buffer, record._blockSizes[i]);
+        buffer += ',';
+    }
+    buffer += '\t';
+    for (size_t i = 0; i < record._qStarts.size(); ++i) {
+        hal_index_t start = record._qStarts[i];
+        if (record._qStrand == '-') {
+            start = qSize - start - record._blockSizes[i];
+        }
+        appendNumber(buffer, start);
+        buffer += ',';
+    }
+    buffer += '\t';
+    for (size_t i = 0; i < record._tStarts.size(); ++i) {
+        hal_index_t start = record._tStarts[i];
+        if (record._tStrand == '-') {
+            start = tSize - start - record._blockSizes[i];
+        }
+        appendNumber(buffer, start);
+        buffer += ',';
+    }
+    buffer += '\n';
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2012-2019 by UCSC Computational Genomics Lab
+ *
+ * Released under the MIT license, see LICENSE.txt
+ */
+
+#include "hal.h"
+#include "hal2psl.h"
+#include "halCLParser.h"
+#include "halParallel.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+using namespace hal;
+
+static void initParser(CLParser &optionsParser) {
+    optionsParser.addArgument("halFile", "input hal file");
+    optionsParser.addArgument("srcGenome", "source (query) genome");
+    optionsParser.addArgument("tgtGenome", "target genome");
+    optionsParser.addArgument("outPsl", "output psl file (- for stdout)");
+    optionsParser.addOption("srcSequence", "only export this sequence of the source genome", "\"\"");
+    optionsParser.addOptionFlag("noMatches", "do not count matches, mismatches, repeat matches and Ns (they are "
+                                             "written as 0), which avoids reading the DNA",
+                                false);
+    optionsParser.addOption("numThreads", "number of threads exporting source sequences (0 to use all cores).  "
+                                          "Only mmap HAL files can be read by more than one thread",
+                            1);
+    optionsParser.setDescription("Export the alignment of a source genome to a target genome as PSL.  The output is "
+                                 "the same as running halLiftover --outPSL on intervals covering each source sequence.");
+}
+
+static const Genome *openGenomeOrThrow(AlignmentConstPtr alignment, const string &genomeName) {
+    const Genome *genome = alignment->openGenome(genomeName);
+    if (genome == NULL) {
+        throw hal_exception("Genome " + genomeName + " not found in alignment");
+    }
+    return genome;
+}
+
+static void exportPsl(const ThreadAlignments &threadAlignments, const string &srcGenomeName, const string &tgtGenomeName,
+                      const string &srcSequenceName, bool countMatches, ostream &outStream) {
+    vector<const Genome *> srcGenomes, tgtGenomes;
+    for (unsigned threadIdx = 0; threadIdx < threadAlignments.size(); threadIdx++) {
+        srcGenomes.push_back(openGenomeOrThrow(threadAlignments.get(threadIdx), srcGenomeName));
+        tgtGenomes.push_back(openGenomeOrThrow(threadAlignments.get(threadIdx), tgtGenomeName));
+    }
+    vector<string> seqNames;
+    if (srcSequenceName != "\"\"") {
+        if (srcGenomes[0]->getSequence(srcSequenceName) == NULL) {
+            throw hal_exception("Sequence " + srcSequenceName + " not found in genome " + srcGenomeName);
+        }
+        seqNames.push_back(srcSequenceName);
+    } else {
+        for (SequenceIteratorPtr seqIt = srcGenomes[0]->getSequenceIterator(); not seqIt->atEnd(); seqIt->toNext()) {
+            seqNames.push_back(seqIt->getSequence()->getName());
+        }
+    }
+
+    vector<Hal2Psl> converters(threadAlignments.size());
+    OrderedOutput pslOutput(outStream, seqNames.size());
+    parallelFor(seqNames.size(), threadAlignments.size(), [&](size_t seqIdx, unsigned threadIdx) {
+        const Sequence *srcSequence = srcGenomes[threadIdx]->getSequence(seqNames[seqIdx]);
+        vector<PslRecord> records;
+        converters[threadIdx].convertSequence(srcGenomes[threadIdx], srcSequence, tgtGenomes[threadIdx], countMatches,
+                                              records);
+        // ordered by source start, as by halLiftover
+        stable_sort(records.begin(), records.end(),
+                    [](const PslRecord &r1, const PslRecord &r2) { return r1._qStart < r2._qStart; });
+        string buffer;
+        for (size_t i = 0; i < records.size(); ++i) {
+            Hal2Psl::writePsl(records[i], buffer);
+        }
+        pslOutput.commit(seqIdx, buffer);
+    });
+}
+
+int main(int argc, char **argv) {
+    CLParser optionsParser;
+    initParser(optionsParser);
+    string halPath;
+    string srcGenomeName;
+    string tgtGenomeName;
+    string pslPath;
+    string srcSequenceName;
+    bool noMatches;
+    unsigned numThreads;
+    try {
+        optionsParser.parseOptions(argc, argv);
+        halPath = optionsParser.getArgument<string>("halFile");
+        srcGenomeName = optionsParser.getArgument<string>("srcGenome");
+        tgtGenomeName = optionsParser.getArgument<string>("tgtGenome");
+        pslPath = optionsParser.getArgument<string>("outPsl");
+        srcSequenceName = optionsParser.getOption<string>("srcSequence");
+        noMatches = optionsParser.getFlag("noMatches");
+        numThreads = optionsParser.getOption<unsigned>("numThreads");
+    } catch (exception &e) {
+        cerr << e.what() << endl;
+        optionsParser.printUsage(cerr);
+        return 1;
+    }
+    try {
+        AlignmentConstPtr alignment(openHalAlignment(halPath, &optionsParser));
+        numThreads = getReadThreadCount(halPath, &optionsParser, numThreads);
+        ThreadAlignments threadAlignments(alignment, halPath, &optionsParser, numThreads);
+
+        ofstream pslFile;
+        if (pslPath != "-") {
+            pslFile.open(pslPath.c_str());
+            if (!pslFile) {
+                throw hal_exception("Error opening " + pslPath);
+            }
+        }
+        ostream &pslStream = pslPath != "-" ? pslFile : cout;
+        exportPsl(threadAlignments, srcGenomeName, tgtGenomeName, srcSequenceName, !noMatches, pslStream);
+        pslStream.flush();
+        if (!pslStream) {
+            throw hal_exception("Error writing " + pslPath);
+        }
+    } catch (exception &e) {
+        cerr << "hal exception caught: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -6,6 +6,8 @@
 
 #include "hal.h"
 #include "halCLParser.h"
+#include "halParallel.h"
+#include <sstream>
 
 #include "hal2psl.h"
 #include "psl_io.h"
@@ -22,6 +24,9 @@ static void initParser(CLParser &optionsParser) {
     optionsParser.addOption("minBlockSize", "lower bound on synteny block length", 5000);
     optionsParser.addOption("maxAnchorDistance", "upper bound on distance for syntenic psl blocks", 5000);
     optionsParser.addOption("queryChromosome", "chromosome to infer synteny (default is whole genome)", "\"\"");
+    optionsParser.addOption("numThreads", "number of threads inferring synteny of query chromosomes (0 to use all cores).  "
+                                          "Only mmap HAL files can be read by more than one thread",
+                            1);
     optionsParser.setDescription("Convert alignments into synteny blocks");
 }
 
@@ -56,18 +61,19 @@ void validateInputOrThrow(const std::string &queryGenomeName, const std::string
 }
 
 static void makeSyntenyBlocks(std::vector<PslBlock>& blocks, hal_size_t minBlockSize,
-                              hal_size_t maxAnchorDistance, std::ofstream &pslFh) {
-    auto merged_blocks = dag_merge(blocks, minBlockSize, maxAnchorDistance);
+                              hal_size_t maxAnchorDistance, unsigned numThreads, std::ostream &pslFh) {
+    auto merged_blocks = dag_merge(std::move(blocks), minBlockSize, maxAnchorDistance, numThreads);
     psl_io::write_psl(merged_blocks, pslFh);
 }
 
 static void syntenyFromPsl(std::string alignmentFile, hal_size_t minBlockSize,
-                           hal_size_t maxAnchorDistance, std::string outPslPath) {
+                           hal_size_t maxAnchorDistance, unsigned numThreads, std::string outPslPath) {
     auto blocks = psl_io::get_blocks_set(alignmentFile);
     std::ofstream pslFh;
     pslFh.exceptions(std::ofstream::failbit|std::ofstream::badbit);
     pslFh.open(outPslPath, std::ofstream::out);
-    makeSyntenyBlocks(blocks, minBlockSize, maxAnchorDistance, pslFh);
+    makeSyntenyBlocks(blocks, minBlockSize, maxAnchorDistance, numThreads == 0 ? hardwareThreadCount() : numThreads,
+                      pslFh);
     pslFh.close();
 }
 
@@ -81,21 +87,22 @@ static std::vector<std::string> getChromNames(const Genome *genome) {
     return chromNames;
 }
 
-static void syntenyBlockForChrom(AlignmentConstPtr alignment,
+static void syntenyBlockForChrom(AlignmentConstPtr alignment, Hal2Psl &hal2psl,
                                  const Genome *targetGenome, const Genome *queryGenome,
                                  std::string queryChromosome, hal_size_t minBlockSize,
-                                 hal_size_t maxAnchorDistance, std::ofstream &pslFh) {
-    auto hal2psl = hal::Hal2Psl();
+                                 hal_size_t maxAnchorDistance, std::ostream &pslFh) {
     auto blocks = hal2psl.convert2psl(alignment, queryGenome, targetGenome, queryChromosome);
-    makeSyntenyBlocks(blocks, minBlockSize, maxAnchorDistance, pslFh);
+    makeSyntenyBlocks(blocks, minBlockSize, maxAnchorDistance, 1, pslFh);
 }
 
 
-/* do one chromosome at a time to reduce memory */
-static void syntenyFromHal(AlignmentConstPtr alignment, std::string queryGenomeName,
+/* do one chromosome at a time to reduce memory, with chromosomes done in
+ * parallel by threads that each have their own alignment and converter,
+ * and write in chromosome order */
+static void syntenyFromHal(const ThreadAlignments &threadAlignments, std::string queryGenomeName,
                            std::string targetGenomeName, std::string queryChromosome,
                            hal_size_t minBlockSize, hal_size_t maxAnchorDistance, std::string outPslPath) {
-    auto targetGenome = openGenomeOrThrow(alignment, targetGenomeName);
+    AlignmentConstPtr alignment = threadAlignments.get(0);
     auto queryGenome = openGenomeOrThrow(alignment, queryGenomeName);
     std::vector<std::string> chromNames;
     if (queryChromosome != "\"\"") {
@@ -108,10 +115,21 @@ static void syntenyFromHal(AlignmentConstPtr alignment, std::string queryGenomeN
     std::ofstream pslFh;
     pslFh.exceptions(std::ofstream::failbit|std::ofstream::badbit);
     pslFh.open(outPslPath, std::ofstream::out);
-    for (auto chromIt = chromNames.begin(); chromIt != chromNames.end(); chromIt++) {
-        syntenyBlockForChrom(alignment, targetGenome, queryGenome,
-                             *chromIt, minBlockSize, maxAnchorDistance, pslFh);
+    std::vector<const Genome *> threadTargetGenomes, threadQueryGenomes;
+    for (unsigned threadIdx = 0; threadIdx < threadAlignments.size(); threadIdx++) {
+        threadTargetGenomes.push_back(openGenomeOrThrow(threadAlignments.get(threadIdx), targetGenomeName));
+        threadQueryGenomes.push_back(openGenomeOrThrow(threadAlignments.get(threadIdx), queryGenomeName));
     }
+    std::vector<Hal2Psl> threadConverters(threadAlignments.size());
+    OrderedOutput pslOutput(pslFh, chromNames.size());
+    parallelFor(chromNames.size(), threadAlignments.size(), [&](size_t chromIdx, unsigned threadIdx) {
+        std::ostringstream chromPsl;
+        syntenyBlockForChrom(threadAlignments.get(threadIdx), threadConverters[threadIdx], threadTargetGenomes[threadIdx],
+                             threadQueryGenomes[threadIdx], chromNames[chromIdx], minBlockSize, maxAnchorDistance,
+                             chromPsl);
+        std::string buffer = chromPsl.str();
+        pslOutput.commit(chromIdx, buffer);
+    });
     pslFh.close();
 }
 
@@ -126,6 +144,7 @@ int main(int argc, char *argv[]) {
     std::string queryChromosome;
     hal_size_t minBlockSize;
     hal_size_t maxAnchorDistance;
+    unsigned numThreads;
     try {
         optionsParser.parseOptions(argc, argv);
         alignmentFile = optionsParser.getArgument<std::string>("alignment");
@@ -136,6 +155,7 @@ int main(int argc, char *argv[]) {
         minBlockSize = optionsParser.getOption<hal_size_t>("minBlockSize");
         maxAnchorDistance = optionsParser.getOption<hal_size_t>("maxAnchorDistance");
         queryChromosome = optionsParser.getOption<std::string>("queryChromosome");
+        numThreads = optionsParser.getOption<unsigned>("numThreads");
     } catch (std::exception &e) {
         std::cerr << e.what() << std::endl;
         optionsParser.printUsage(std::cerr);
@@ -146,10 +166,12 @@ int main(int argc, char *argv[]) {
     try {
         std::vector<PslBlock> blocks;
         if (alignmentIsPsl) {
-            syntenyFromPsl(alignmentFile, minBlockSize, maxAnchorDistance, outPslPath);
+            syntenyFromPsl(alignmentFile, minBlockSize, maxAnchorDistance, numThreads, outPslPath);
         } else {
             auto alignment = openAlignmentOrThrow(alignmentFile, optionsParser);
-            syntenyFromHal(alignment, queryGenomeName, targetGenomeName, queryChromosome, minBlockSize, maxAnchorDistance, outPslPath);
+            numThreads = getReadThreadCount(alignmentFile, &optionsParser, numThreads);
+            ThreadAlignments threadAlignments(alignment, alignmentFile, &optionsParser, numThreads);
+            syntenyFromHal(threadAlignments, queryGenomeName, targetGenomeName, queryChromosome, minBlockSize, maxAnchorDistance, outPslPath);
             alignment->close();
         }
     } catch (std::exception &e) {
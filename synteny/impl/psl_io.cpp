@@ -76,8 +76,8 @@ namespace psl_io {
         return psl;
     }
 
-    void write_psl(const std::vector<std::vector<PslBlock>> &merged_blocks, std::ofstream &ofs) {
-        for (auto path : merged_blocks) {
+    void write_psl(const std::vector<std::vector<PslBlock>> &merged_blocks, std::ostream &ofs) {
+        for (const auto &path : merged_blocks) {
             auto psl = construct_psl(path);
             ofs << psl << std::endl;
         }
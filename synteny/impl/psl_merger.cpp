@@ -1,4 +1,5 @@
 #include "psl_merger.h"
+#include "halParallel.h"
 
 // Assumes a.start < b.start
 bool are_syntenic(const PslBlock &a, const PslBlock &b) {
@@ -10,14 +11,21 @@ bool is_not_overlapping_ordered_pair(const PslBlock &a, const PslBlock &b, const
            b.tStart - a.tEnd < threshold;
 }
 
+// The group is sorted by query start, so the blocks that can follow the
+// block at pos are in a window starting at its query end, and the scan
+// can stop at maxAnchorDistance instead of going through the whole group.
 std::vector<int> get_next(const int pos, const std::vector<PslBlock> &queryGroup, const hal_size_t maxAnchorDistance) {
+    const PslBlock &block = queryGroup[pos];
+    auto first = std::lower_bound(queryGroup.begin() + pos + 1, queryGroup.end(), block.qEnd,
+                                  [](const PslBlock &b, hal_size_t qStart) { return b.qStart < qStart; });
     std::vector<int> f;
-    for (auto i = pos + 1; i < (int)queryGroup.size(); ++i) {
-        if (is_not_overlapping_ordered_pair(queryGroup[pos], queryGroup[i], maxAnchorDistance)) {
+    for (auto i = int(first - queryGroup.begin());
+         i < (int)queryGroup.size() && queryGroup[i].qStart - block.qEnd < maxAnchorDistance; ++i) {
+        if (is_not_overlapping_ordered_pair(block, queryGroup[i], maxAnchorDistance)) {
             if (f.empty())
                 f.push_back(i);
             else {
-                if (not f.empty() && is_not_overlapping_ordered_pair(queryGroup[f[0]], queryGroup[i], maxAnchorDistance)) {
+                if (is_not_overlapping_ordered_pair(queryGroup[f[0]], queryGroup[i], maxAnchorDistance)) {
                     return f;
                 } else {
                     f.push_back(i);
@@ -29,74 +37,103 @@ std::vector<int> get_next(const int pos, const std::vector<PslBlock> &queryGroup
     return f;
 }
 
-// *dag* is represented as a map:  vertex -> its possible next vertices;
-// *hidden_vertices* is a set of vertices that are already in paths;
-// Weight of an edge equals length of the next psl block;
-// Weight of a vertex equals estimated weight:
-// w_j < w_i + w_e(ij) => w_j must be updated
-// Also keeps track of how we came to this state:
-// (prev_vertex, weight)
-std::map<int, std::pair<int, hal_size_t>> weigh_dag(const std::vector<PslBlock> &group, std::map<int, std::vector<int>> &dag,
-                                                    const std::set<int> &hiddenVertices, const hal_size_t maxAnchorDistance) {
-    std::map<int, std::pair<int, hal_size_t>> weightedDag;
-    for (int i = 0; i < (int)group.size(); ++i) {
-        if (hiddenVertices.count(i))
-            continue;
-        std::vector<int> nexts;
-        if (not dag.count(i)) {
-            nexts = get_next(i, group, maxAnchorDistance);
-            dag[i] = nexts;
-        } else {
-            nexts = dag[i];
-        }
-        // If this vertex was never visited then its weight equals to its size.
-        // Intuition: otherwise we will never count its size
-        if (not weightedDag.count(i))
-            weightedDag[i] = std::make_pair(-1, group[i].size);
-        for (auto j : nexts) {
-            if (hiddenVertices.count(j))
-                continue;
-            auto alternativeWeight = weightedDag[i].second + group[j].size;
-            if (not weightedDag.count(j) or weightedDag[j].second < alternativeWeight)
-                // Remembers previous vertex itself and
-                // its corresponding weight:
-                // previous vertex w_i + weight of the next edge
-                weightedDag[j] = std::make_pair(i, alternativeWeight);
+// The vertices of the dag are the blocks and the edges go from a block to
+// the blocks get_next() gives for it.  Weight of a vertex is the weight of
+// the heaviest path ending with it: its size plus the weight of its
+// heaviest visible predecessor (the first one in case of ties), which is
+// remembered for the traceback.  The heaviest path (the last vertex in
+// case of ties) is taken out and the weights are updated, which only needs
+// to be done downstream of the path's vertices, until all the vertices
+// are in paths.
+std::vector<SyntenyPath> chain_blocks(std::vector<PslBlock> &blocks, const std::vector<hal_size_t> &ranks,
+                                      const hal_size_t minBlockBreath, const hal_size_t maxAnchorDistance) {
+    size_t numBlocks = blocks.size();
+    std::vector<size_t> nextStarts(numBlocks + 1, 0);
+    std::vector<size_t> nexts;
+    for (size_t i = 0; i < numBlocks; ++i) {
+        std::vector<int> f = get_next(i, blocks, maxAnchorDistance);
+        nexts.insert(nexts.end(), f.begin(), f.end());
+        nextStarts[i + 1] = nexts.size();
+    }
+    std::vector<size_t> prevStarts(numBlocks + 1, 0);
+    std::vector<size_t> prevs(nexts.size());
+    for (auto j : nexts) {
+        ++prevStarts[j + 1];
+    }
+    for (size_t i = 0; i < numBlocks; ++i) {
+        prevStarts[i + 1] += prevStarts[i];
+    }
+    std::vector<size_t> prevEnds(prevStarts.begin(), prevStarts.end() - 1);
+    for (size_t i = 0; i < numBlocks; ++i) {
+        for (size_t k = nextStarts[i]; k < nextStarts[i + 1]; ++k) {
+            prevs[prevEnds[nexts[k]]++] = i;
         }
     }
-    return weightedDag;
-}
 
-int get_maxed_vertex(const std::map<int, std::pair<int, hal_size_t>> &weightedDag) {
-    hal_size_t maxWeight = weightedDag.cbegin()->second.second;
-    int maxPos = weightedDag.cbegin()->first;
-    for (auto it = weightedDag.cbegin(); it != weightedDag.cend(); ++it) {
-        if (it->second.second >= maxWeight) {
-            maxWeight = it->second.second;
-            maxPos = it->first;
+    std::vector<hal_size_t> weights(numBlocks);
+    std::vector<int64_t> prevVertices(numBlocks);
+    std::vector<char> hidden(numBlocks, 0);
+    auto weigh = [&](size_t j) {
+        hal_size_t prevWeight = 0;
+        int64_t prevVertex = -1;
+        for (size_t k = prevStarts[j]; k < prevStarts[j + 1]; ++k) {
+            size_t i = prevs[k];
+            if (not hidden[i] and (prevVertex == -1 or weights[i] > prevWeight)) {
+                prevWeight = weights[i];
+                prevVertex = i;
+            }
         }
+        weights[j] = prevWeight + blocks[j].size;
+        prevVertices[j] = prevVertex;
+    };
+    std::set<std::pair<hal_size_t, size_t>> byWeight;
+    for (size_t j = 0; j < numBlocks; ++j) {
+        weigh(j);
+        byWeight.insert(std::make_pair(weights[j], j));
     }
-    return maxPos;
-}
 
-std::vector<PslBlock> traceback(std::map<int, std::pair<int, hal_size_t>> &weightedDag, std::set<int> &hiddenVertices,
-                                const std::vector<PslBlock> &group) {
-    // Chooses the path of the heaviest weight
-    auto startVertex = get_maxed_vertex(weightedDag);
-    std::vector<int> path = {startVertex};
-    auto prevVertex = weightedDag[startVertex].first;
-    while (prevVertex != -1) {
-        path.push_back(prevVertex);
-        prevVertex = weightedDag[prevVertex].first;
+    std::vector<SyntenyPath> paths;
+    std::set<size_t> dirty;
+    while (not byWeight.empty()) {
+        auto heaviest = *byWeight.rbegin();
+        SyntenyPath path;
+        path.weight = heaviest.first;
+        path.rank = ranks[heaviest.second];
+        for (int64_t v = heaviest.second; v != -1; v = prevVertices[v]) {
+            hidden[v] = 1;
+            byWeight.erase(std::make_pair(weights[v], size_t(v)));
+            dirty.insert(nexts.begin() + nextStarts[v], nexts.begin() + nextStarts[v + 1]);
+            path.blocks.push_back(std::move(blocks[v]));
+        }
+        std::reverse(path.blocks.begin(), path.blocks.end());
+        auto qLen = path.blocks.back().qEnd - path.blocks[0].qStart;
+        auto tLen = path.blocks.back().tEnd - path.blocks[0].tStart;
+        if (qLen >= minBlockBreath && tLen >= minBlockBreath) {
+            paths.push_back(std::move(path));
+        }
+
+        // vertices are numbered in topological order, so a vertex is
+        // updated after all its predecessors
+        while (not dirty.empty()) {
+            size_t j = *dirty.begin();
+            dirty.erase(dirty.begin());
+            if (hidden[j]) {
+                continue;
+            }
+            hal_size_t oldWeight = weights[j];
+            weigh(j);
+            if (weights[j] != oldWeight) {
+                byWeight.erase(std::make_pair(oldWeight, j));
+                byWeight.insert(std::make_pair(weights[j], j));
+                dirty.insert(nexts.begin() + nextStarts[j], nexts.begin() + nextStarts[j + 1]);
+            }
+        }
     }
-    hiddenVertices.insert(path.begin(), path.end());
-    std::vector<PslBlock> pslBlockPath;
-    std::transform(path.begin(), path.end(), std::back_inserter(pslBlockPath), [group](int x) -> PslBlock { return group[x]; });
-    std::reverse(pslBlockPath.begin(), pslBlockPath.end());
-    return pslBlockPath;
+    return paths;
 }
+
 struct {
-    bool operator()(PslBlock a, PslBlock b) const {
+    bool operator()(const PslBlock &a, const PslBlock &b) const {
         if (a.qStart < b.qStart)
             return true;
         else if (a.qStart == b.qStart) {
@@ -106,30 +143,69 @@ struct {
     }
 } qStartLess;
 
-std::vector<std::vector<PslBlock>> dag_merge(const std::vector<PslBlock> &blocks, const hal_size_t minBlockBreath,
-                                             const hal_size_t maxAnchorDistance) {
+namespace {
+    // Blocks of a query sequence with the same target sequence and strand,
+    // in query order, along with their ranks in the query sequence's group
+    struct BlockComponent {
+        size_t group;
+        std::vector<PslBlock> blocks;
+        std::vector<hal_size_t> ranks;
+    };
+}
+
+// Blocks can only be chained with blocks of the same target sequence and
+// strand, so each component of a query sequence's dag is chained on its
+// own (in parallel).  The heaviest path of a query sequence is always the
+// heaviest of its components, and the weights of a component only go
+// down, so sorting all the paths by weight and rank gives the order in
+// which they would be taken out of the whole dag.
+std::vector<std::vector<PslBlock>> dag_merge(std::vector<PslBlock> blocks, const hal_size_t minBlockBreath,
+                                             const hal_size_t maxAnchorDistance, unsigned numThreads) {
     std::map<std::string, std::vector<PslBlock>> blocksByQName;
-    for (auto block : blocks)
-        blocksByQName[block.qName].push_back(block);
-    std::vector<std::vector<PslBlock>> paths;
-    for (auto pairs : blocksByQName) {
-        std::vector<PslBlock> group = pairs.second;
-        std::string qName = pairs.first;
-        std::map<int, std::vector<int>> dag;
-        std::set<int> hiddenVertices;
+    for (auto &block : blocks)
+        blocksByQName[block.qName].push_back(std::move(block));
+    blocks = std::vector<PslBlock>();
+
+    std::vector<BlockComponent> components;
+    size_t numGroups = 0;
+    for (auto &pairs : blocksByQName) {
+        std::vector<PslBlock> &group = pairs.second;
         std::sort(group.begin(), group.end(), qStartLess);
-        while (hiddenVertices.size() != group.size()) {
-            auto weightedDag = weigh_dag(group, dag, hiddenVertices, maxAnchorDistance);
-            auto path = traceback(weightedDag, hiddenVertices, group);
-            if (path.empty()) {
-                break;
-            }
-            auto qLen = path.back().qEnd - path[0].qStart;
-            auto tLen = path.back().tEnd - path[0].tStart;
-            if (qLen >= minBlockBreath && tLen >= minBlockBreath) {
-                // if (qLen >= minBlockBreath && tLen >= minBlockBreath){
-                paths.push_back(path);
+        std::map<std::pair<std::string, std::string>, size_t> componentIdx;
+        for (size_t i = 0; i < group.size(); ++i) {
+            auto key = std::make_pair(group[i].tName, group[i].strand);
+            auto found = componentIdx.find(key);
+            if (found == componentIdx.end()) {
+                found = componentIdx.insert(std::make_pair(key, components.size())).first;
+                components.push_back(BlockComponent());
+                components.back().group = numGroups;
             }
+            components[found->second].blocks.push_back(std::move(group[i]));
+            components[found->second].ranks.push_back(i);
+        }
+        group = std::vector<PslBlock>();
+        ++numGroups;
+    }
+
+    std::vector<std::vector<SyntenyPath>> componentPaths(components.size());
+    hal::parallelFor(components.size(), numThreads, [&](size_t c, unsigned) {
+        componentPaths[c] = chain_blocks(components[c].blocks, components[c].ranks, minBlockBreath, maxAnchorDistance);
+        components[c].blocks = std::vector<PslBlock>();
+    });
+
+    std::vector<std::vector<SyntenyPath>> groupPaths(numGroups);
+    for (size_t c = 0; c < components.size(); ++c) {
+        for (auto &path : componentPaths[c]) {
+            groupPaths[components[c].group].push_back(std::move(path));
+        }
+    }
+    std::vector<std::vector<PslBlock>> paths;
+    for (auto &group : groupPaths) {
+        std::sort(group.begin(), group.end(), [](const SyntenyPath &a, const SyntenyPath &b) {
+            return a.weight > b.weight or (a.weight == b.weight and a.rank > b.rank);
+        });
+        for (auto &path : group) {
+            paths.push_back(std::move(path.blocks));
         }
     }
     return paths;
@@ -14,25 +14,94 @@
 #ifndef HAL2PSL_H
 #define HAL2PSL_H
 
-#include "halBedLine.h"
 #include "halBlockLiftover.h"
 #include "psl.h"
+#include <string>
+#include <vector>
 
 namespace hal {
-    class Hal2Psl : public BlockLiftover {
 
-        void storePslResults(std::vector<PslBlock> &pslBlocks);
-        void makeUpPsl(const std::vector<PSLInfo> &vpsl, const std::vector<BedBlock> &blocks, const char strand,
-                       const hal_index_t start, const std::string chrName, std::vector<PslBlock> &pslBlocks);
+    /* One PSL record of the alignment of a source (query) sequence to a
+     * target sequence.  All positions are relative to their sequence and
+     * on its forward strand; they are only converted to the strand of
+     * the record when it is written. */
+    struct PslRecord {
+        hal_size_t _matches;
+        hal_size_t _misMatches;
+        hal_size_t _repMatches;
+        hal_size_t _nCount;
+        hal_size_t _qNumInsert;
+        hal_size_t _qBaseInsert;
+        hal_size_t _tNumInsert;
+        hal_size_t _tBaseInsert;
+        char _qStrand;
+        char _tStrand;
+        const Sequence *_qSequence;
+        const Sequence *_tSequence;
+        hal_index_t _qStart;
+        hal_index_t _qEnd;
+        hal_index_t _tStart;
+        hal_index_t _tEnd;
+        std::vector<hal_size_t> _blockSizes;
+        std::vector<hal_index_t> _qStarts;
+        std::vector<hal_index_t> _tStarts;
+    };
 
+    /* Pairwise export of a source genome to a target genome.  Each source
+     * sequence is mapped with a single sweep over its segments, and the
+     * mapped segments are grouped into PSL records directly, following
+     * the same rules as halLiftover --outPSL on an interval covering the
+     * whole sequence.  An instance keeps its iterators between calls, so
+     * threads need their own instance (and alignment). */
+    class Hal2Psl : public BlockLiftover {
       public:
-        Hal2Psl() {
-        }
+        Hal2Psl();
+
+        /** Append the PSL records of a source sequence, in the order of
+         * their first source block.  Counting matches reads the DNA of
+         * both sequences; when it is off, the match counts are zero. */
+        void convertSequence(const Genome *srcGenome, const Sequence *srcSequence, const Genome *tgtGenome,
+                             bool countMatches, std::vector<PslRecord> &records);
+
+        /** Blocks of the PSL records of a source chromosome (or of all of
+         * them if srcChrom is "\"\""), as used by the synteny merger */
         std::vector<PslBlock> convert2psl(AlignmentConstPtr alignment, const Genome *srcGenome, const Genome *tgtGenome,
                                           const std::string srcChrom);
+
+        /** Append the blocks of a record to a vector of PslBlocks */
+        static void makeUpPsl(const PslRecord &record, std::vector<PslBlock> &pslBlocks);
+
+        /** Append a record as a line of PSL text */
+        static void writePsl(const PslRecord &record, std::string &buffer);
+
+      private:
+        struct MappedBlock {
+            const Sequence *_tSequence;
+            hal_index_t _tStart;
+            hal_index_t _tEnd;
+            hal_index_t _qStart;
+            char _tStrand;
+            char _qStrand;
+            hal_size_t _matches;
+            hal_size_t _misMatches;
+            hal_size_t _repMatches;
+            hal_size_t _nCount;
+        };
+
+        void setGenomes(const Genome *srcGenome, const Genome *tgtGenome);
+        void mapSequence(bool countMatches);
+        void countMatches(MappedBlock &block);
+        void assignBlocksToRecords(std::vector<PslRecord> &records);
+        static bool compatible(const PslRecord &record, const MappedBlock &block);
+        static void computeInserts(PslRecord &record);
+
+        std::vector<MappedBlock> _blocks;
+        std::vector<MappedSegmentPtr> _fragments;
+        std::string _qBuf;
+        std::string _tBuf;
     };
 }
-#endif /* HAL_MERGER_H */
+#endif /* HAL2PSL_H */
 
 // Local Variables:
 // mode: c++
@@ -27,18 +27,26 @@ bool are_syntenic(const PslBlock &a, const PslBlock &b);
 
 bool is_not_overlapping_ordered_pair(const PslBlock &a, const PslBlock &b, const hal_size_t threshold = 5000);
 
+// queryGroup must be sorted by query start
 std::vector<int> get_next(const int pos, const std::vector<PslBlock> &queryGroup, const hal_size_t maxAnchorDistance = 5000);
 
-std::map<int, std::pair<int, hal_size_t>> weigh_dag(const std::vector<PslBlock> &group, std::map<int, std::vector<int>> &dag,
-                                                    const std::set<int> &hiddenVertices, const hal_size_t maxAnchorDistance);
-
-int get_maxed_vertex(const std::map<int, std::pair<int, int>> &weightedDag);
-
-std::vector<PslBlock> traceback(std::map<int, std::pair<int, hal_size_t>> &weightedDag, std::set<int> &hiddenVertices,
-                                const std::vector<PslBlock> &group);
-
-std::vector<std::vector<PslBlock>> dag_merge(const std::vector<PslBlock> &blocks, const hal_size_t minBlockBreath,
-                                             const hal_size_t maxAnchorDistance);
+/* A chain of syntenic blocks taken out of a dag, with the weight of the
+ * dag's heaviest path when it was taken and the rank (in query order) of
+ * its last block */
+struct SyntenyPath {
+    hal_size_t weight;
+    hal_size_t rank;
+    std::vector<PslBlock> blocks;
+};
+
+// Chain blocks of the same query and target sequences and strand, sorted
+// by query start.  The blocks are moved into the paths, and paths shorter
+// than minBlockBreath are dropped.
+std::vector<SyntenyPath> chain_blocks(std::vector<PslBlock> &blocks, const std::vector<hal_size_t> &ranks,
+                                      const hal_size_t minBlockBreath, const hal_size_t maxAnchorDistance);
+
+std::vector<std::vector<PslBlock>> dag_merge(std::vector<PslBlock> blocks, const hal_size_t minBlockBreath,
+                                             const hal_size_t maxAnchorDistance, unsigned numThreads = 1);
 
 #endif /* PSL_MERGER_H */
 